@@ -10,11 +10,25 @@
 #include <QtTest>
 
 #include "../core/document.h"
+#include "../core/observer.h"
 #include "../core/page.h"
 #include "../core/annotations.h"
 #include "../settings_core.h"
 #include "testingutils.h"
 
+// counts the annotation change notifications of every page
+class AnnotationChangesObserver : public Okular::DocumentObserver
+{
+public:
+    void notifyPageChanged( int page, int flags ) override
+    {
+        if ( flags & Okular::DocumentObserver::Annotations )
+            m_changes[ page ]++;
+    }
+
+    QMap< int, int > m_changes;
+};
+
 class AddRemoveAnnotationTest : public QObject
 {
     Q_OBJECT
@@ -26,6 +40,7 @@ private slots:
     void testAddAnnotations();
     void testAddAnnotationUndoWithRotate_Bug318091();
     void testRemoveAnnotations();
+    void testBatchAnnotations();
 
 private:
     Okular::Document *m_document;
@@ -187,5 +202,72 @@ void AddRemoveAnnotationTest::testRemoveAnnotations()
     QVERIFY( TestingUtils::AnnotationDisposeWatcher::disposedAnnotationName() == annot1Name );
 }
 
+void AddRemoveAnnotationTest::testBatchAnnotations()
+{
+    AnnotationChangesObserver observer;
+    m_document->addObserver( &observer );
+
+    Okular::Annotation *annot1 = new Okular::TextAnnotation();
+    annot1->setBoundingRectangle( Okular::NormalizedRect( 0.1, 0.1, 0.15, 0.15 ) );
+    annot1->setContents( QStringLiteral("annot contents") );
+
+    Okular::Annotation *annot2 = new Okular::TextAnnotation();
+    annot2->setBoundingRectangle( Okular::NormalizedRect( 0.2, 0.2, 0.3, 0.4 ) );
+    annot2->setContents( QStringLiteral("annot contents") );
+
+    // Add both annotations in a (nested) batch: one notification, one undo step
+    m_document->beginAnnotationBatch( QStringLiteral("add") );
+    m_document->addPageAnnotation( 0, annot1 );
+    m_document->beginAnnotationBatch( QStringLiteral("inner") );
+    m_document->addPageAnnotation( 0, annot2 );
+    m_document->endAnnotationBatch();
+    QCOMPARE( observer.m_changes.value( 0 ), 0 );
+    m_document->endAnnotationBatch();
+    QCOMPARE( observer.m_changes.value( 0 ), 1 );
+    QCOMPARE( m_document->page( 0 )->annotations().size(), 2 );
+
+    // Undo removes both annotations at once
+    observer.m_changes.clear();
+    m_document->undo();
+    QVERIFY( m_document->page( 0 )->annotations().empty() );
+    QVERIFY( !m_document->canUndo() );
+    QVERIFY( m_document->canRedo() );
+    QCOMPARE( observer.m_changes.value( 0 ), 1 );
+
+    // Redo adds both back
+    observer.m_changes.clear();
+    m_document->redo();
+    QCOMPARE( m_document->page( 0 )->annotations().size(), 2 );
+    QVERIFY( m_document->page( 0 )->annotations().contains( annot1 ) );
+    QVERIFY( m_document->page( 0 )->annotations().contains( annot2 ) );
+    QVERIFY( !m_document->canRedo() );
+    QCOMPARE( observer.m_changes.value( 0 ), 1 );
+
+    // Remove both in a batch
+    observer.m_changes.clear();
+    m_document->beginAnnotationBatch( QStringLiteral("remove") );
+    m_document->removePageAnnotation( 0, annot1 );
+    m_document->removePageAnnotation( 0, annot2 );
+    m_document->endAnnotationBatch();
+    QVERIFY( m_document->page( 0 )->annotations().empty() );
+    QCOMPARE( observer.m_changes.value( 0 ), 1 );
+
+    // Undo brings both back, redo removes them again, each in one step
+    m_document->undo();
+    QCOMPARE( m_document->page( 0 )->annotations().size(), 2 );
+    QVERIFY( m_document->page( 0 )->annotations().contains( annot1 ) );
+    QVERIFY( m_document->page( 0 )->annotations().contains( annot2 ) );
+    m_document->redo();
+    QVERIFY( m_document->page( 0 )->annotations().empty() );
+
+    // Both undo steps are single ones
+    m_document->undo();
+    m_document->undo();
+    QVERIFY( m_document->page( 0 )->annotations().empty() );
+    QVERIFY( !m_document->canUndo() );
+
+    m_document->removeObserver( &observer );
+}
+
 QTEST_MAIN( AddRemoveAnnotationTest )
 #include "addremoveannotationtest.moc"
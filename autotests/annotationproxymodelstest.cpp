@@ -0,0 +1,182 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <QtTest>
+
+#include <QStandardItemModel>
+
+#include "../ui/annotationmodel.h"
+#include "../ui/annotationproxymodels.h"
+
+class AnnotationProxyModelsTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void testInsertPageAbove();
+    void testRemovePageAbove();
+    void testInsertPageFlat();
+    void testDataChanged();
+    void testDataChangedByAuthor();
+
+private:
+    void appendPage( int row, int page, const QStringList &annotations );
+    QModelIndex annotationIndex( int pageRow, int row ) const;
+    QString sourceText( const QModelIndex &groupIndex ) const;
+
+    QStandardItemModel *m_source;
+    PageGroupProxyModel *m_groupProxy;
+    AuthorGroupProxyModel *m_authorProxy;
+};
+
+void AnnotationProxyModelsTest::init()
+{
+    m_source = new QStandardItemModel( this );
+    m_groupProxy = new PageGroupProxyModel( this );
+    m_authorProxy = new AuthorGroupProxyModel( this );
+
+    m_groupProxy->setSourceModel( m_source );
+    m_groupProxy->groupByPage( true );
+    m_authorProxy->setSourceModel( m_groupProxy );
+
+    appendPage( 0, 2, QStringList() << QStringLiteral("a2") << QStringLiteral("b2") );
+    appendPage( 1, 5, QStringList() << QStringLiteral("a5") );
+}
+
+void AnnotationProxyModelsTest::cleanup()
+{
+    delete m_authorProxy;
+    delete m_groupProxy;
+    delete m_source;
+}
+
+void AnnotationProxyModelsTest::appendPage( int row, int page, const QStringList &annotations )
+{
+    QStandardItem *pageItem = new QStandardItem( QString::number( page ) );
+    pageItem->setData( page, AnnotationModel::PageRole );
+    for ( const QString &text : annotations ) {
+        QStandardItem *item = new QStandardItem( text );
+        item->setData( QStringLiteral("author"), AnnotationModel::AuthorRole );
+        item->setData( page, AnnotationModel::PageRole );
+        pageItem->appendRow( item );
+    }
+    m_source->insertRow( row, pageItem );
+}
+
+QModelIndex AnnotationProxyModelsTest::annotationIndex( int pageRow, int row ) const
+{
+    return m_groupProxy->index( row, 0, m_groupProxy->index( pageRow, 0 ) );
+}
+
+QString AnnotationProxyModelsTest::sourceText( const QModelIndex &groupIndex ) const
+{
+    return m_source->data( m_groupProxy->mapToSource( groupIndex ) ).toString();
+}
+
+void AnnotationProxyModelsTest::testInsertPageAbove()
+{
+    const QPersistentModelIndex annotation = annotationIndex( 1, 0 );
+    const QPersistentModelIndex authorAnnotation = m_authorProxy->mapFromSource( annotation );
+    QCOMPARE( sourceText( annotation ), QStringLiteral("a5") );
+    QVERIFY( authorAnnotation.isValid() );
+
+    // a new page above the annotation shifts its page row, not the annotation
+    appendPage( 0, 1, QStringList() << QStringLiteral("a1") );
+
+    QVERIFY( annotation.isValid() );
+    QCOMPARE( annotation.row(), 0 );
+    QCOMPARE( annotation.parent().row(), 2 );
+    QCOMPARE( sourceText( annotation ), QStringLiteral("a5") );
+    QCOMPARE( annotation.data().toString(), QStringLiteral("a5") );
+
+    QVERIFY( authorAnnotation.isValid() );
+    QCOMPARE( sourceText( m_authorProxy->mapToSource( authorAnnotation ) ), QStringLiteral("a5") );
+
+    QCOMPARE( sourceText( annotationIndex( 0, 0 ) ), QStringLiteral("a1") );
+    QCOMPARE( sourceText( annotationIndex( 1, 1 ) ), QStringLiteral("b2") );
+}
+
+void AnnotationProxyModelsTest::testRemovePageAbove()
+{
+    const QPersistentModelIndex removed = annotationIndex( 0, 1 );
+    const QPersistentModelIndex annotation = annotationIndex( 1, 0 );
+    const QPersistentModelIndex authorAnnotation = m_authorProxy->mapFromSource( annotation );
+    QCOMPARE( sourceText( annotation ), QStringLiteral("a5") );
+
+    m_source->removeRow( 0 );
+
+    QVERIFY( !removed.isValid() );
+    QVERIFY( annotation.isValid() );
+    QCOMPARE( annotation.parent().row(), 0 );
+    QCOMPARE( sourceText( annotation ), QStringLiteral("a5") );
+
+    QVERIFY( authorAnnotation.isValid() );
+    QCOMPARE( sourceText( m_authorProxy->mapToSource( authorAnnotation ) ), QStringLiteral("a5") );
+    QCOMPARE( m_groupProxy->rowCount( QModelIndex() ), 1 );
+}
+
+void AnnotationProxyModelsTest::testInsertPageFlat()
+{
+    m_groupProxy->groupByPage( false );
+    QCOMPARE( m_groupProxy->rowCount( QModelIndex() ), 3 );
+
+    const QPersistentModelIndex annotation = m_groupProxy->index( 2, 0 );
+    QCOMPARE( sourceText( annotation ), QStringLiteral("a5") );
+
+    appendPage( 1, 3, QStringList() << QStringLiteral("a3") << QStringLiteral("b3") );
+
+    QCOMPARE( m_groupProxy->rowCount( QModelIndex() ), 5 );
+    QCOMPARE( annotation.row(), 4 );
+    QCOMPARE( sourceText( annotation ), QStringLiteral("a5") );
+    QCOMPARE( sourceText( m_groupProxy->index( 2, 0 ) ), QStringLiteral("a3") );
+}
+
+void AnnotationProxyModelsTest::testDataChanged()
+{
+    QSignalSpy spy( m_authorProxy, &QAbstractItemModel::dataChanged );
+
+    QStandardItem *pageItem = m_source->item( 0 );
+    pageItem->child( 1 )->setText( QStringLiteral("c2") );
+
+    QCOMPARE( spy.count(), 1 );
+    const QModelIndex changed = spy.at( 0 ).at( 0 ).toModelIndex();
+    QCOMPARE( changed, spy.at( 0 ).at( 1 ).toModelIndex() );
+    QCOMPARE( changed.data().toString(), QStringLiteral("c2") );
+    QCOMPARE( changed.row(), 1 );
+    QCOMPARE( changed.parent().row(), 0 );
+}
+
+void AnnotationProxyModelsTest::testDataChangedByAuthor()
+{
+    m_authorProxy->groupByAuthor( true );
+
+    QStandardItem *pageItem = m_source->item( 0 );
+    pageItem->child( 1 )->setData( QStringLiteral("other"), AnnotationModel::AuthorRole );
+    m_authorProxy->groupByAuthor( false );
+    m_authorProxy->groupByAuthor( true );
+
+    // the page has one group per author, each with one annotation
+    const QModelIndex page = m_authorProxy->index( 0, 0 );
+    QCOMPARE( m_authorProxy->rowCount( page ), 2 );
+
+    QSignalSpy spy( m_authorProxy, &QAbstractItemModel::dataChanged );
+    pageItem->child( 1 )->setText( QStringLiteral("c2") );
+
+    QCOMPARE( spy.count(), 1 );
+    const QModelIndex changed = spy.at( 0 ).at( 0 ).toModelIndex();
+    QCOMPARE( changed.data().toString(), QStringLiteral("c2") );
+    QCOMPARE( changed.row(), 0 );
+    QCOMPARE( changed.parent().data().toString(), QStringLiteral("other") );
+    QCOMPARE( changed.parent().parent(), page );
+}
+
+QTEST_MAIN( AnnotationProxyModelsTest )
+#include "annotationproxymodelstest.moc"
@@ -31,6 +31,19 @@ class DocumentTest
     private slots:
         void testCloseDuringRotationJob();
         void testDocdataMigration();
+        void testLazyPageInfoRestore();
+};
+
+class AnnotationChangesObserver : public Okular::DocumentObserver
+{
+    public:
+        void notifyPageChanged( int page, int flags ) override
+        {
+            if ( flags & Okular::DocumentObserver::Annotations )
+                changedPages.insert( page );
+        }
+
+        QSet< int > changedPages;
 };
 
 // Test that we don't crash if the document is closed while a RotationJob
@@ -129,5 +142,66 @@ void DocumentTest::testDocdataMigration()
     delete m_document;
 }
 
+// Test that the annotations saved in the docdata file for several pages are
+// restored page by page on reopening: the page shown right away, a page when
+// its pixmap is requested, and the other ones in the background
+void DocumentTest::testLazyPageInfoRestore()
+{
+    Okular::SettingsCore::instance( QStringLiteral("documenttest") );
+
+    const QUrl testFileUrl = QUrl::fromLocalFile(KDESRCDIR "data/file2.pdf");
+    const QString testFilePath = testFileUrl.toLocalFile();
+    const QString docDataPath = Okular::DocumentPrivate::docDataFileName( testFileUrl, QFileInfo( testFilePath ).size() );
+    QFile::remove( docDataPath );
+
+    Okular::Document *m_document = new Okular::Document( nullptr );
+    QMimeDatabase db;
+    const QMimeType mime = db.mimeTypeForFile( testFilePath );
+    QCOMPARE( m_document->openDocument( testFilePath, testFileUrl, mime ), Okular::Document::OpenSuccess );
+    QCOMPARE( m_document->pages(), 2u );
+
+    for ( int page = 0; page < 2; ++page )
+    {
+        Okular::Annotation *annot = new Okular::TextAnnotation();
+        annot->setBoundingRectangle( Okular::NormalizedRect( 0.1, 0.1, 0.15, 0.15 ) );
+        annot->setContents( QStringLiteral("page %1").arg( page ) );
+        m_document->addPageAnnotation( page, annot );
+    }
+    m_document->closeDocument();
+
+    AnnotationChangesObserver *observer = new AnnotationChangesObserver();
+    m_document->addObserver( observer );
+
+    // the page shown is restored at once, the other one when it is rendered
+    QCOMPARE( m_document->openDocument( testFilePath, testFileUrl, mime ), Okular::Document::OpenSuccess );
+    QCOMPARE( m_document->currentPage(), 0u );
+    QCOMPARE( m_document->page( 0 )->annotations().size(), 1 );
+    QCOMPARE( m_document->page( 0 )->annotations().first()->contents(), QStringLiteral("page 0") );
+    QCOMPARE( m_document->page( 1 )->annotations().size(), 0 );
+
+    Okular::PixmapRequest *pixmapReq = new Okular::PixmapRequest( observer, 1, 100, 100, 1, Okular::PixmapRequest::NoFeature );
+    m_document->requestPixmaps( QLinkedList<Okular::PixmapRequest*>() << pixmapReq );
+    QCOMPARE( m_document->page( 1 )->annotations().size(), 1 );
+    QCOMPARE( m_document->page( 1 )->annotations().first()->contents(), QStringLiteral("page 1") );
+
+    // the observers hear about the restored annotations afterwards
+    QTRY_COMPARE( observer->changedPages, QSet< int >() << 0 << 1 );
+    m_document->closeDocument();
+
+    // without anything asking for it, the page is restored in the background
+    observer->changedPages.clear();
+    QCOMPARE( m_document->openDocument( testFilePath, testFileUrl, mime ), Okular::Document::OpenSuccess );
+    QCOMPARE( m_document->page( 1 )->annotations().size(), 0 );
+    QTRY_COMPARE( m_document->page( 1 )->annotations().size(), 1 );
+    QCOMPARE( m_document->page( 1 )->annotations().first()->contents(), QStringLiteral("page 1") );
+    QTRY_VERIFY( observer->changedPages.contains( 1 ) );
+    m_document->closeDocument();
+
+    m_document->removeObserver( observer );
+    delete observer;
+    delete m_document;
+    QFile::remove( docDataPath );
+}
+
 QTEST_MAIN( DocumentTest )
 #include "documenttest.moc"
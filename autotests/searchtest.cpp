@@ -48,6 +48,7 @@ class SearchTest : public QObject
         void testHyphenAtEndOfPage();
         void testOneColumn();
         void testTwoColumns();
+        void testTwoColumnsReadingOrder();
 };
 
 void SearchTest::initTestCase()
@@ -430,5 +431,49 @@ void SearchTest::testTwoColumns()
   delete page;
 }
 
+void SearchTest::testTwoColumnsReadingOrder()
+{
+  //Tests that a title over two columns is read first, then the left column
+  //and then the right one, line by line, as the layout analysis always did.
+
+  QVector<QString> text;
+  text << QStringLiteral("Reading") << QStringLiteral("order") << QStringLiteral("test")
+       << QStringLiteral("alpha")   << QStringLiteral("beta")  << QStringLiteral("zeta") << QStringLiteral("eta")
+       << QStringLiteral("gamma")   << QStringLiteral("delta") << QStringLiteral("theta") << QStringLiteral("iota")
+       << QStringLiteral("epsilon") << QStringLiteral("kappa");
+
+  //word breaks and line breaks have length 0.05, the columns are 0.15 apart
+  //and the title is 0.12 above them
+  QVector<Okular::NormalizedRect> rect;
+  rect << Okular::NormalizedRect(0.0,  0.0,  0.35, 0.08)
+       << Okular::NormalizedRect(0.4,  0.0,  0.65, 0.08)
+       << Okular::NormalizedRect(0.7,  0.0,  0.9,  0.08)
+       << Okular::NormalizedRect(0.0,  0.2,  0.18, 0.28)
+       << Okular::NormalizedRect(0.23, 0.2,  0.4,  0.28)
+       << Okular::NormalizedRect(0.55, 0.2,  0.75, 0.28)
+       << Okular::NormalizedRect(0.8,  0.2,  1.0,  0.28)
+       << Okular::NormalizedRect(0.0,  0.33, 0.18, 0.41)
+       << Okular::NormalizedRect(0.23, 0.33, 0.4,  0.41)
+       << Okular::NormalizedRect(0.55, 0.33, 0.8,  0.41)
+       << Okular::NormalizedRect(0.85, 0.33, 1.0,  0.41)
+       << Okular::NormalizedRect(0.0,  0.46, 0.25, 0.54)
+       << Okular::NormalizedRect(0.55, 0.46, 0.8,  0.54);
+
+  CREATE_PAGE;
+
+  QStringList order;
+  const Okular::TextEntity::List words = tp->words(nullptr, Okular::TextPage::AnyPixelTextAreaInclusionBehaviour);
+  for (const Okular::TextEntity *word : words) {
+    if (word->text() != QLatin1String(" "))
+      order << word->text();
+  }
+  qDeleteAll(words);
+
+  QCOMPARE(order.join(QLatin1Char('|')),
+           QStringLiteral("Reading|order|test|alpha|beta|gamma|delta|epsilon|zeta|eta|theta|iota|kappa"));
+
+  delete page;
+}
+
 QTEST_MAIN( SearchTest )
 #include "searchtest.moc"
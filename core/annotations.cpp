@@ -172,6 +172,14 @@ AnnotationProxy::~AnnotationProxy()
 {
 }
 
+void AnnotationProxy::beginBatch()
+{
+}
+
+void AnnotationProxy::endBatch()
+{
+}
+
 //BEGIN Annotation implementation
 
 class Annotation::Style::Private
@@ -707,7 +707,8 @@ class OKULARCORE_EXPORT AnnotationProxy
         {
             Addition,       ///< Generator can create native annotations
             Modification,   ///< Generator can edit native annotations
-            Removal         ///< Generator can remove native annotations
+            Removal,        ///< Generator can remove native annotations
+            Batch           ///< Generator wants to know about batches of changes, see beginBatch() (since 1.4)
         };
 
         /**
@@ -743,6 +744,31 @@ class OKULARCORE_EXPORT AnnotationProxy
          * @note Only called if supports(Removal) == true
          */
         virtual void notifyRemoval( Annotation *annotation, int page ) = 0;
+
+        /**
+         * Called before a batch of annotation changes, which ends with a
+         * call to endBatch(). The proxy can keep what it needs to apply the
+         * changes around until the batch ends.
+         *
+         * The default implementation does nothing.
+         *
+         * @note Only called if supports(Batch) == true
+         *
+         * @since 1.4
+         */
+        virtual void beginBatch();
+
+        /**
+         * Called when a batch of annotation changes started with beginBatch()
+         * ends.
+         *
+         * The default implementation does nothing.
+         *
+         * @note Only called if supports(Batch) == true
+         *
+         * @since 1.4
+         */
+        virtual void endBatch();
 };
 
 class OKULARCORE_EXPORT TextAnnotation : public Annotation
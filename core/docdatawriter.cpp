@@ -0,0 +1,223 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "docdatawriter_p.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSaveFile>
+#include <QtCore/QXmlStreamWriter>
+#include <QtXml/QDomElement>
+
+#include <threadweaver/job.h>
+
+#include "debug_p.h"
+
+using namespace Okular;
+
+class Okular::DocdataSaveJob : public ThreadWeaver::Job
+{
+    public:
+        DocdataSaveJob( DocdataWriter *writer, const QString &fileName, const DocdataElement &root )
+            : m_writer( writer ), m_fileName( fileName ), m_root( root )
+        {
+        }
+
+    protected:
+        void run( ThreadWeaver::JobPointer, ThreadWeaver::Thread * ) override
+        {
+            const QByteArray xml = DocdataWriter::serialize( m_root );
+
+            QSaveFile file( m_fileName );
+            if ( !file.open( QIODevice::WriteOnly ) )
+            {
+                qCWarning(OkularCoreDebug) << "Failed to open docdata file" << m_fileName;
+                return;
+            }
+
+            file.write( xml );
+            if ( !file.commit() )
+            {
+                qCWarning(OkularCoreDebug) << "Failed to save docdata file" << m_fileName;
+                return;
+            }
+
+            m_writer->setWritten( m_fileName, m_root );
+        }
+
+    private:
+        DocdataWriter * const m_writer;
+        const QString m_fileName;
+        const DocdataElement m_root;
+};
+
+namespace {
+
+class TextSnapshotSaveJob : public ThreadWeaver::Job
+{
+    public:
+        explicit TextSnapshotSaveJob( const TextSnapshot &snapshot )
+            : m_snapshot( snapshot )
+        {
+        }
+
+    protected:
+        void run( ThreadWeaver::JobPointer, ThreadWeaver::Thread * ) override
+        {
+            m_snapshot.save();
+        }
+
+    private:
+        TextSnapshot m_snapshot;
+};
+
+}
+
+static void writeElement( QXmlStreamWriter &writer, const DocdataElement &element )
+{
+    if ( element.name.isEmpty() )
+    {
+        writer.writeCharacters( element.text );
+        return;
+    }
+
+    writer.writeStartElement( element.name );
+    for ( const QPair< QString, QString > &attribute : element.attributes )
+        writer.writeAttribute( attribute.first, attribute.second );
+    for ( const DocdataElement &child : element.children )
+        writeElement( writer, child );
+    writer.writeEndElement();
+}
+
+DocdataElement::DocdataElement()
+{
+}
+
+DocdataElement::DocdataElement( const QString &name )
+    : name( name )
+{
+}
+
+void DocdataElement::setAttribute( const QString &name, const QString &value )
+{
+    for ( QPair< QString, QString > &attribute : attributes )
+    {
+        if ( attribute.first == name )
+        {
+            attribute.second = value;
+            return;
+        }
+    }
+    attributes.append( qMakePair( name, value ) );
+}
+
+void DocdataElement::appendChild( const DocdataElement &child )
+{
+    children.append( child );
+}
+
+void DocdataElement::appendText( const QString &text )
+{
+    DocdataElement textNode;
+    textNode.text = text;
+    children.append( textNode );
+}
+
+bool DocdataElement::hasChildNodes() const
+{
+    return !children.isEmpty();
+}
+
+bool DocdataElement::operator==( const DocdataElement &other ) const
+{
+    return name == other.name && text == other.text && attributes == other.attributes && children == other.children;
+}
+
+bool DocdataElement::operator!=( const DocdataElement &other ) const
+{
+    return !operator==( other );
+}
+
+DocdataElement DocdataElement::fromDom( const QDomElement &element )
+{
+    DocdataElement result( element.tagName() );
+
+    const QDomNamedNodeMap domAttributes = element.attributes();
+    result.attributes.reserve( domAttributes.count() );
+    for ( int i = 0; i < domAttributes.count(); ++i )
+    {
+        const QDomAttr attribute = domAttributes.item( i ).toAttr();
+        result.attributes.append( qMakePair( attribute.name(), attribute.value() ) );
+    }
+
+    for ( QDomNode node = element.firstChild(); !node.isNull(); node = node.nextSibling() )
+    {
+        if ( node.isElement() )
+            result.appendChild( fromDom( node.toElement() ) );
+        else if ( node.isText() )
+            result.appendText( node.toText().data() );
+    }
+
+    return result;
+}
+
+DocdataWriter::DocdataWriter()
+{
+    // one save at a time, so that they reach the disk in order
+    m_queue.setMaximumNumberOfThreads( 1 );
+}
+
+DocdataWriter::~DocdataWriter()
+{
+    waitForSaves();
+}
+
+void DocdataWriter::save( const QString &fileName, const DocdataElement &root )
+{
+    {
+        QMutexLocker locker( &m_lastMutex );
+        if ( fileName == m_lastFileName && root == m_lastRoot )
+        {
+            qCDebug(OkularCoreDebug) << "Docdata file" << fileName << "is up to date";
+            return;
+        }
+    }
+
+    qCDebug(OkularCoreDebug) << "About to save document info to" << fileName;
+    m_queue.enqueue( ThreadWeaver::JobPointer( new DocdataSaveJob( this, fileName, root ) ) );
+}
+
+void DocdataWriter::save( const TextSnapshot &snapshot )
+{
+    m_queue.enqueue( ThreadWeaver::JobPointer( new TextSnapshotSaveJob( snapshot ) ) );
+}
+
+void DocdataWriter::setWritten( const QString &fileName, const DocdataElement &root )
+{
+    QMutexLocker locker( &m_lastMutex );
+    m_lastFileName = fileName;
+    m_lastRoot = root;
+}
+
+void DocdataWriter::waitForSaves()
+{
+    m_queue.finish();
+}
+
+QByteArray DocdataWriter::serialize( const DocdataElement &root )
+{
+    QByteArray xml;
+    QXmlStreamWriter writer( &xml );
+    writer.setAutoFormatting( true );
+    writer.setAutoFormattingIndent( 1 );
+    writer.writeStartDocument();
+    writer.writeDTD( QStringLiteral("<!DOCTYPE %1>").arg( root.name ) );
+    writeElement( writer, root );
+    writer.writeEndDocument();
+    return xml;
+}
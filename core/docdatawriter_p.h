@@ -0,0 +1,112 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_DOCDATAWRITER_P_H_
+#define _OKULAR_DOCDATAWRITER_P_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include <threadweaver/queue.h>
+
+#include "textsnapshot_p.h"
+
+class QDomElement;
+
+namespace Okular {
+
+class DocdataSaveJob;
+
+/**
+ * A node of a docdata file held in plain values, so that a copy of it can
+ * be serialized by another thread while the document keeps changing.
+ *
+ * A node without a name is a text node.
+ */
+struct DocdataElement
+{
+    DocdataElement();
+    explicit DocdataElement( const QString &name );
+
+    void setAttribute( const QString &name, const QString &value );
+    void appendChild( const DocdataElement &child );
+    void appendText( const QString &text );
+    bool hasChildNodes() const;
+
+    bool operator==( const DocdataElement &other ) const;
+    bool operator!=( const DocdataElement &other ) const;
+
+    /**
+     * Copies @p element, its attributes and all its children.
+     */
+    static DocdataElement fromDom( const QDomElement &element );
+
+    QString name;
+    QString text;
+    QVector< QPair< QString, QString > > attributes;
+    QVector< DocdataElement > children;
+};
+
+/**
+ * Writes the docdata files of a document, and its text snapshot, on a
+ * worker thread.
+ *
+ * Files are replaced atomically, and a save is dropped if it would write
+ * the same content to the same file as the last successful one, so the
+ * periodic saves of a document that did not change do not touch the disk.
+ */
+class DocdataWriter
+{
+    public:
+        DocdataWriter();
+        ~DocdataWriter();
+
+        /**
+         * Queues writing @p root to @p fileName.
+         */
+        void save( const QString &fileName, const DocdataElement &root );
+
+        /**
+         * Queues writing a copy of @p snapshot to its file, after the
+         * docdata saves queued so far.
+         */
+        void save( const TextSnapshot &snapshot );
+
+        /**
+         * Blocks until all the queued saves are written.
+         */
+        void waitForSaves();
+
+        /**
+         * Returns the XML of a docdata file with @p root as root element.
+         */
+        static QByteArray serialize( const DocdataElement &root );
+
+    private:
+        friend class DocdataSaveJob;
+
+        // called by the save jobs once @p root is on disk
+        void setWritten( const QString &fileName, const DocdataElement &root );
+
+        ThreadWeaver::Queue m_queue;
+        QMutex m_lastMutex;
+        QString m_lastFileName;
+        DocdataElement m_lastRoot;
+
+        Q_DISABLE_COPY( DocdataWriter )
+};
+
+}
+
+Q_DECLARE_TYPEINFO( Okular::DocdataElement, Q_MOVABLE_TYPE );
+
+#endif
@@ -16,6 +16,8 @@
 #include "documentcommands_p.h"
 
 #include <limits.h>
+
+#include <algorithm>
 #ifdef Q_OS_WIN
 #define _WIN32_WINNT 0x0500
 #include <windows.h>
@@ -27,13 +29,17 @@
 
 // qt/kde/system includes
 #include <QtCore/QtAlgorithms>
+#include <QtCore/QBitArray>
+#include <QtCore/QCryptographicHash>
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QMap>
 #include <QtCore/qtemporaryfile.h>
 #include <QtCore/QTextStream>
 #include <QtCore/QTimer>
+#include <QtCore/QXmlStreamReader>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QLabel>
 #include <QtPrintSupport/QPrinter>
@@ -83,6 +89,7 @@
 #include "settings_core.h"
 #include "sourcereference.h"
 #include "sourcereference_p.h"
+#include "textdocumentgenerator.h"
 #include "texteditors_p.h"
 #include "tile.h"
 #include "tilesmanager_p.h"
@@ -108,6 +115,14 @@ struct AllocatedPixmap
     AllocatedPixmap( DocumentObserver *o, int p, qulonglong m ) : observer( o ), page( p ), memory( m ) {}
 };
 
+struct AllocatedTextPage
+{
+    int page;
+    qulonglong memory;
+    // public constructor: initialize data
+    AllocatedTextPage( int p, qulonglong m ) : page( p ), memory( m ) {}
+};
+
 struct ArchiveData
 {
     ArchiveData()
@@ -134,6 +149,16 @@ struct RunningSearch
     bool isCurrentlySearching : 1;
     QColor cachedColor;
     int pagesDone;
+
+    // page whose text the search last waited for, -1 if none
+    int textWaitedPage;
+    // pages whose text was last extracted ahead of the search, kept while it runs
+    QVector< int > textLookahead;
+
+    // pages the generator did not rule out, empty if all have to be searched
+    QBitArray candidatePages;
+    // the pages added since the search started may match too
+    bool isCandidate( int page ) const { return page >= candidatePages.size() || candidatePages.testBit( page ); }
 };
 
 #define foreachObserver( cmd ) {\
@@ -544,88 +569,128 @@ bool DocumentPrivate::loadDocumentInfo( QFile &infoFile, LoadDocumentInfoFlags l
     if ( !infoFile.exists() || !infoFile.open( QIODevice::ReadOnly ) )
         return false;
 
-    // Load DOM from XML file
-    QDomDocument doc( QStringLiteral("documentInfo") );
-    if ( !doc.setContent( &infoFile ) )
+    // Stream the XML: the general info is applied as it is read, while the
+    // pages are only indexed and their contents restored when first needed
+    const QString xml = QString::fromUtf8( infoFile.readAll() );
+    infoFile.close();
+
+    QXmlStreamReader reader( xml );
+    if ( !reader.readNextStartElement() || reader.name() != QLatin1String("documentInfo") )
     {
         qCDebug(OkularCoreDebug) << "Can't load XML pair! Check for broken xml.";
-        infoFile.close();
         return false;
     }
-    infoFile.close();
-
-    QDomElement root = doc.documentElement();
 
-    if ( root.tagName() != QLatin1String("documentInfo") )
-        return false;
-
-    QUrl documentUrl( root.attribute( "url" ) );
     bool loadedAnything = false; // set if something gets actually loaded
+    bool indexingPages = false;
 
-    // Parse the DOM tree
-    QDomNode topLevelNode = root.firstChild();
-    while ( topLevelNode.isElement() )
+    while ( reader.readNextStartElement() )
     {
-        QString catName = topLevelNode.toElement().tagName();
-
-        // Restore page attributes (bookmark, annotations, ...) from the DOM
-        if ( catName == QLatin1String("pageList") && ( loadWhat & LoadPageInfo ) )
+        // Index page attributes (bookmark, annotations, ...)
+        if ( reader.name() == QLatin1String("pageList") && ( loadWhat & LoadPageInfo ) )
         {
-            QDomNode pageNode = topLevelNode.firstChild();
-            while ( pageNode.isElement() )
+            while ( !reader.atEnd() )
             {
-                QDomElement pageElement = pageNode.toElement();
-                if ( pageElement.hasAttribute( QStringLiteral("number") ) )
+                reader.readNext();
+                if ( reader.isEndElement() )
+                    break;
+                if ( !reader.isStartElement() )
+                    continue;
+                if ( reader.name() != QLatin1String("page") )
                 {
-                    // get page number (node's attribute)
-                    bool ok;
-                    int pageNumber = pageElement.attribute( QStringLiteral("number") ).toInt( &ok );
+                    reader.skipCurrentElement();
+                    continue;
+                }
+
+                // the offset before the token may be past its '<' as the
+                // reader reads ahead in whitespace, so the slice is anchored
+                // on the tags themselves; no '<' can be inside a tag
+                const int pageStart = xml.lastIndexOf( QLatin1String("<page"), int( reader.characterOffset() ) - 1 );
+
+                // get page number (node's attribute)
+                bool ok = false;
+                const int pageNumber = reader.attributes().value( QStringLiteral("number") ).toInt( &ok );
 
-                    // pass the domElement to the right page, to read config data from
-                    if ( ok && pageNumber >= 0 && pageNumber < (int)m_pagesVector.count() )
+                // only look at which lists the page holds, an empty list restores nothing
+                bool hasContents = false;
+                bool hasForms = false;
+                while ( reader.readNextStartElement() )
+                {
+                    const bool isForms = reader.name() == QLatin1String("forms");
+                    if ( reader.readNextStartElement() )
                     {
-                        if ( m_pagesVector[ pageNumber ]->d->restoreLocalContents( pageElement ) )
-                            loadedAnything = true;
+                        hasContents = true;
+                        hasForms = hasForms || isForms;
+                        reader.skipCurrentElement();
+                        reader.skipCurrentElement();
+                    }
+                }
+
+                if ( !hasContents || !ok || pageNumber < 0 )
+                    continue;
+
+                const int pageEnd = xml.lastIndexOf( QLatin1String("</page>"), int( reader.characterOffset() ) - 7 ) + 7;
+                // the generator may add the page later
+                if ( pageNumber >= m_pagesVector.count() )
+                {
+                    if ( m_generator->hasFeature( Generator::EstimatedPageCount ) )
+                    {
+                        m_laterPageInfo.insert( pageNumber, xml.mid( pageStart, pageEnd - pageStart ) );
+                        loadedAnything = true;
                     }
+                    continue;
+                }
+
+                // the page is listed twice, keep the order in which the contents are restored
+                if ( m_pendingPageInfo.contains( pageNumber ) )
+                    restorePageInfo( pageNumber );
+
+                // only the pages of one file are pending at a time
+                if ( !indexingPages )
+                {
+                    restoreAllPageInfo();
+                    m_pendingPageInfoXml = xml;
+                    indexingPages = true;
                 }
-                pageNode = pageNode.nextSibling();
+                m_pendingPageInfo.insert( pageNumber, qMakePair( pageStart, pageEnd - pageStart ) );
+                loadedAnything = true;
+
+                // form widgets take their values when they are created, so forms are restored now
+                if ( hasForms )
+                    restorePageInfo( pageNumber );
             }
         }
 
-        // Restore 'general info' from the DOM
-        else if ( catName == QLatin1String("generalInfo") && ( loadWhat & LoadGeneralInfo ) )
+        // Restore 'general info'
+        else if ( reader.name() == QLatin1String("generalInfo") && ( loadWhat & LoadGeneralInfo ) )
         {
-            QDomNode infoNode = topLevelNode.firstChild();
-            while ( infoNode.isElement() )
+            while ( reader.readNextStartElement() )
             {
-                QDomElement infoElement = infoNode.toElement();
-
                 // restore viewports history
-                if ( infoElement.tagName() == QLatin1String("history") )
+                if ( reader.name() == QLatin1String("history") )
                 {
                     // clear history
                     m_viewportHistory.clear();
                     // append old viewports
-                    QDomNode historyNode = infoNode.firstChild();
-                    while ( historyNode.isElement() )
+                    while ( reader.readNextStartElement() )
                     {
-                        QDomElement historyElement = historyNode.toElement();
-                        if ( historyElement.hasAttribute( QStringLiteral("viewport") ) )
+                        const QXmlStreamAttributes attributes = reader.attributes();
+                        if ( attributes.hasAttribute( QStringLiteral("viewport") ) )
                         {
-                            QString vpString = historyElement.attribute( QStringLiteral("viewport") );
+                            QString vpString = attributes.value( QStringLiteral("viewport") ).toString();
                             m_viewportIterator = m_viewportHistory.insert( m_viewportHistory.end(),
                                     DocumentViewport( vpString ) );
                             loadedAnything = true;
                         }
-                        historyNode = historyNode.nextSibling();
+                        reader.skipCurrentElement();
                     }
                     // consistancy check
                     if ( m_viewportHistory.isEmpty() )
                         m_viewportIterator = m_viewportHistory.insert( m_viewportHistory.end(), DocumentViewport() );
                 }
-                else if ( infoElement.tagName() == QLatin1String("rotation") )
+                else if ( reader.name() == QLatin1String("rotation") )
                 {
-                    QString str = infoElement.text();
+                    QString str = reader.readElementText( QXmlStreamReader::SkipChildElements );
                     bool ok = true;
                     int newrotation = !str.isEmpty() ? ( str.toInt( &ok ) % 4 ) : 0;
                     if ( ok && newrotation != 0 )
@@ -634,48 +699,91 @@ bool DocumentPrivate::loadDocumentInfo( QFile &infoFile, LoadDocumentInfoFlags l
                         loadedAnything = true;
                     }
                 }
-                else if ( infoElement.tagName() == QLatin1String("views") )
+                else if ( reader.name() == QLatin1String("views") )
                 {
-                    QDomNode viewNode = infoNode.firstChild();
-                    while ( viewNode.isElement() )
+                    while ( reader.readNextStartElement() )
                     {
-                        QDomElement viewElement = viewNode.toElement();
-                        if ( viewElement.tagName() == QLatin1String("view") )
+                        View *matchingView = nullptr;
+                        if ( reader.name() == QLatin1String("view") )
                         {
-                            const QString viewName = viewElement.attribute( QStringLiteral("name") );
+                            const QString viewName = reader.attributes().value( QStringLiteral("name") ).toString();
                             Q_FOREACH ( View * view, m_views )
                             {
                                 if ( view->name() == viewName )
                                 {
-                                    loadViewsInfo( view, viewElement );
-                                    loadedAnything = true;
+                                    matchingView = view;
                                     break;
                                 }
                             }
                         }
-                        viewNode = viewNode.nextSibling();
+
+                        if ( matchingView )
+                        {
+                            loadViewsInfo( matchingView, reader );
+                            loadedAnything = true;
+                        }
+                        else
+                        {
+                            reader.skipCurrentElement();
+                        }
                     }
                 }
-                infoNode = infoNode.nextSibling();
+                // the boxes were found against the paper color, they are computed
+                // again if it changed
+                else if ( reader.name() == QLatin1String("boundingBoxes") &&
+                          reader.attributes().value( QStringLiteral("paperColor") ) == SettingsCore::paperColor().name() )
+                {
+                    while ( reader.readNextStartElement() )
+                    {
+                        const QXmlStreamAttributes attributes = reader.attributes();
+                        reader.skipCurrentElement();
+
+                        bool ok = true;
+                        const int pageNumber = attributes.value( QStringLiteral("number") ).toInt( &ok );
+                        const QVector<QStringRef> values = attributes.value( QStringLiteral("box") ).split( QLatin1Char(';') );
+                        if ( !ok || pageNumber < 0 || pageNumber >= m_pagesVector.count() || values.count() != 4 )
+                            continue;
+
+                        double coordinates[4];
+                        for ( int i = 0; i < 4 && ok; ++i )
+                        {
+                            coordinates[i] = values.at( i ).toDouble( &ok );
+                            ok = ok && coordinates[i] >= 0.0 && coordinates[i] <= 1.0;
+                        }
+                        if ( !ok || coordinates[0] > coordinates[2] || coordinates[1] > coordinates[3] )
+                            continue;
+
+                        m_pagesVector[ pageNumber ]->setBoundingBox( NormalizedRect( coordinates[0], coordinates[1], coordinates[2], coordinates[3] ) );
+                        loadedAnything = true;
+                    }
+                }
+                else
+                {
+                    reader.skipCurrentElement();
+                }
             }
         }
 
-        topLevelNode = topLevelNode.nextSibling();
+        else
+        {
+            reader.skipCurrentElement();
+        }
     } // </documentInfo>
 
+    if ( reader.hasError() )
+        qCDebug(OkularCoreDebug) << "Broken XML in" << infoFile.fileName() << ":" << reader.errorString();
+
     return loadedAnything;
 }
 
-void DocumentPrivate::loadViewsInfo( View *view, const QDomElement &e )
+void DocumentPrivate::loadViewsInfo( View *view, QXmlStreamReader &reader )
 {
-    QDomNode viewNode = e.firstChild();
-    while ( viewNode.isElement() )
+    while ( reader.readNextStartElement() )
     {
-        QDomElement viewElement = viewNode.toElement();
-
-        if ( viewElement.tagName() == QLatin1String("zoom") )
+        if ( reader.name() == QLatin1String("zoom") )
         {
-            const QString valueString = viewElement.attribute( QStringLiteral("value") );
+            const QXmlStreamAttributes attributes = reader.attributes();
+            const QString valueString = attributes.value( QStringLiteral("value") ).toString();
             bool newzoom_ok = true;
             const double newzoom = !valueString.isEmpty() ? valueString.toDouble( &newzoom_ok ) : 1.0;
             if ( newzoom_ok && newzoom != 0
@@ -684,7 +792,7 @@ void DocumentPrivate::loadViewsInfo( View *view, const QDomElement &e )
             {
                 view->setCapability( View::Zoom, newzoom );
             }
-            const QString modeString = viewElement.attribute( QStringLiteral("mode") );
+            const QString modeString = attributes.value( QStringLiteral("mode") ).toString();
             bool newmode_ok = true;
             const int newmode = !modeString.isEmpty() ? modeString.toInt( &newmode_ok ) : 2;
             if ( newmode_ok
@@ -695,19 +803,98 @@ void DocumentPrivate::loadViewsInfo( View *view, const QDomElement &e )
             }
         }
 
-        viewNode = viewNode.nextSibling();
+        reader.skipCurrentElement();
+    }
+}
+
+void DocumentPrivate::restorePageInfo( int page )
+{
+    const QMap< int, QPair< int, int > >::iterator it = m_pendingPageInfo.find( page );
+    if ( it == m_pendingPageInfo.end() )
+        return;
+
+    // forget it first, restoring the contents must not restore them again
+    const QString pageXml = m_pendingPageInfoXml.mid( it.value().first, it.value().second );
+    m_pendingPageInfo.erase( it );
+
+    QDomDocument doc;
+    if ( doc.setContent( pageXml ) )
+    {
+        beginAnnotationChanges();
+        m_pagesVector[ page ]->d->restoreLocalContents( doc.documentElement() );
+        endAnnotationChanges();
+
+        // the observers pick up the annotations later: we may be in the
+        // middle of Document::page() or of a pixmap request here
+        if ( m_pagesVector[ page ]->hasAnnotations() )
+        {
+            m_restoredAnnotationPages.insert( page );
+            if ( m_pendingPageInfoTimer && !m_pendingPageInfoTimer->isActive() )
+                m_pendingPageInfoTimer->start();
+        }
+    }
+    else
+        qCWarning(OkularCoreDebug) << "Can't restore the contents of page" << page;
+}
+
+void DocumentPrivate::restoreAllPageInfo()
+{
+    while ( !m_pendingPageInfo.isEmpty() )
+        restorePageInfo( m_pendingPageInfo.firstKey() );
+    m_pendingPageInfoXml.clear();
+}
+
+void DocumentPrivate::saveLaterPageInfo( QDomNode &pageList, QDomDocument &doc ) const
+{
+    // as they were read, the pages may still be added
+    for ( const QString &pageXml : m_laterPageInfo )
+    {
+        QDomDocument pageDoc;
+        if ( pageDoc.setContent( pageXml ) )
+            pageList.appendChild( doc.importNode( pageDoc.documentElement(), true ) );
+    }
+}
+
+void DocumentPrivate::restorePendingPageInfo()
+{
+    // a few milliseconds at a time, so that the GUI stays responsive while
+    // the annotations of a heavily annotated document are restored
+    QElapsedTimer time;
+    time.start();
+    while ( !m_pendingPageInfo.isEmpty() && time.elapsed() < 10 )
+        restorePageInfo( m_pendingPageInfo.firstKey() );
+
+    // the pages restored in this slice, and the ones restored on demand since the last one
+    if ( !m_restoredAnnotationPages.isEmpty() )
+    {
+        const QSet< int > pages = m_restoredAnnotationPages;
+        m_restoredAnnotationPages.clear();
+        beginAnnotationChanges();
+        for ( int page : pages )
+            notifyAnnotationChanges( page );
+        endAnnotationChanges();
+    }
+
+    if ( !m_pendingPageInfo.isEmpty() )
+    {
+        m_pendingPageInfoTimer->start();
+    }
+    else
+    {
+        // started again by the restoring above, nothing is left to do though
+        m_pendingPageInfoTimer->stop();
+        m_pendingPageInfoXml.clear();
     }
 }
 
-void DocumentPrivate::saveViewsInfo( View *view, QDomElement &e ) const
+void DocumentPrivate::saveViewsInfo( View *view, DocdataElement &e ) const
 {
     if ( view->supportsCapability( View::Zoom )
          && ( view->capabilityFlags( View::Zoom ) & ( View::CapabilityRead | View::CapabilitySerializable ) )
          && view->supportsCapability( View::ZoomModality )
          && ( view->capabilityFlags( View::ZoomModality ) & ( View::CapabilityRead | View::CapabilitySerializable ) ) )
     {
-        QDomElement zoomEl = e.ownerDocument().createElement( QStringLiteral("zoom") );
-        e.appendChild( zoomEl );
+        DocdataElement zoomEl( QStringLiteral("zoom") );
         bool ok = true;
         const double zoom = view->capability( View::Zoom ).toDouble( &ok );
         if ( ok && zoom != 0 )
@@ -717,8 +904,9 @@ void DocumentPrivate::saveViewsInfo( View *view, QDomElement &e ) const
         const int mode = view->capability( View::ZoomModality ).toInt( &ok );
         if ( ok )
         {
-            zoomEl.setAttribute( QStringLiteral("mode"), mode );
+            zoomEl.setAttribute( QStringLiteral("mode"), QString::number(mode) );
         }
+        e.appendChild( zoomEl );
     }
 }
 
@@ -940,6 +1128,7 @@ bool DocumentPrivate::savePageDocumentInfo( QTemporaryFile *infoFile, int what )
         QVector< Page * >::const_iterator pIt = m_pagesVector.constBegin(), pEnd = m_pagesVector.constEnd();
         for ( ; pIt != pEnd; ++pIt )
             (*pIt)->d->saveLocalContents( pageList, doc, PageItems( what ) );
+        saveLaterPageInfo( pageList, doc );
 
         // 3. Save DOM to XML file
         QString xml = doc.toString();
@@ -992,7 +1181,7 @@ void DocumentPrivate::performAddPageAnnotation( int page, Annotation * annotatio
     if ( annotation->flags() & Annotation::ExternallyDrawn )
     {
         // Redraw everything, including ExternallyDrawn annotations
-        refreshPixmaps( page );
+        refreshAnnotationPixmaps( page );
     }
 }
 
@@ -1027,7 +1216,7 @@ void DocumentPrivate::performRemovePageAnnotation( int page, Annotation * annota
         if ( isExternallyDrawn )
         {
             // Redraw everything, including ExternallyDrawn annotations
-            refreshPixmaps( page );
+            refreshAnnotationPixmaps( page );
         }
     }
 }
@@ -1068,7 +1257,7 @@ void DocumentPrivate::performModifyPageAnnotation( int page, Annotation * annota
 
         // Redraw everything, including ExternallyDrawn annotations
         qCDebug(OkularCoreDebug) << "Refreshing Pixmaps";
-        refreshPixmaps( page );
+        refreshAnnotationPixmaps( page );
     }
 }
 
@@ -1137,33 +1326,25 @@ void DocumentPrivate::recalculateForms()
     }
 }
 
-void DocumentPrivate::saveDocumentInfo() const
+void DocumentPrivate::saveDocumentInfo()
 {
     if ( m_xmlFileName.isEmpty() )
         return;
 
-    QFile infoFile( m_xmlFileName );
-    qCDebug(OkularCoreDebug) << "About to save document info to" << m_xmlFileName;
-    if (!infoFile.open( QIODevice::WriteOnly | QIODevice::Truncate))
-    {
-        qCWarning(OkularCoreDebug) << "Failed to open docdata file" << m_xmlFileName;
-        return;
-    }
-    // 1. Create DOM
-    QDomDocument doc( QStringLiteral("documentInfo") );
-    QDomProcessingInstruction xmlPi = doc.createProcessingInstruction(
-            QStringLiteral( "xml" ), QStringLiteral( "version=\"1.0\" encoding=\"utf-8\"" ) );
-    doc.appendChild( xmlPi );
-    QDomElement root = doc.createElement( QStringLiteral("documentInfo") );
+    // 1. Take a snapshot of the document info, it is written by another thread
+    DocdataElement root( QStringLiteral("documentInfo") );
     root.setAttribute( QStringLiteral("url"), m_url.toDisplayString(QUrl::PreferLocalFile) );
-    doc.appendChild( root );
 
-    // 2.1. Save page attributes (bookmark state, annotations, ... ) to DOM
+    // 2.1. Save page attributes (bookmark state, annotations, ... )
     //  -> do this if there are not-yet-migrated annots or forms in docdata/
     if ( m_docdataMigrationNeeded )
     {
+        // the original contents are kept by the pages once restored
+        restoreAllPageInfo();
+
+        QDomDocument doc( QStringLiteral("documentInfo") );
         QDomElement pageList = doc.createElement( "pageList" );
-        root.appendChild( pageList );
+        doc.appendChild( pageList );
         // OriginalAnnotationPageItems and OriginalFormFieldPageItems tell to
         // store the same unmodified annotation list and form contents that we
         // read when we opened the file and ignore any change made by the user.
@@ -1175,17 +1356,18 @@ void DocumentPrivate::saveDocumentInfo() const
         QVector< Page * >::const_iterator pIt = m_pagesVector.constBegin(), pEnd = m_pagesVector.constEnd();
         for ( ; pIt != pEnd; ++pIt )
             (*pIt)->d->saveLocalContents( pageList, doc, saveWhat );
+        saveLaterPageInfo( pageList, doc );
+        root.appendChild( DocdataElement::fromDom( pageList ) );
     }
 
-    // 2.2. Save document info (current viewport, history, ... ) to DOM
-    QDomElement generalInfo = doc.createElement( QStringLiteral("generalInfo") );
-    root.appendChild( generalInfo );
+    // 2.2. Save document info (current viewport, history, ... )
+    DocdataElement generalInfo( QStringLiteral("generalInfo") );
     // create rotation node
     if ( m_rotation != Rotation0 )
     {
-        QDomElement rotationNode = doc.createElement( QStringLiteral("rotation") );
+        DocdataElement rotationNode( QStringLiteral("rotation") );
+        rotationNode.appendText( QString::number( (int)m_rotation ) );
         generalInfo.appendChild( rotationNode );
-        rotationNode.appendChild( doc.createTextNode( QString::number( (int)m_rotation ) ) );
     }
     // <general info><history> ... </history> save history up to OKULAR_HISTORY_SAVEDSTEPS viewports
     QLinkedList< DocumentViewport >::const_iterator backIterator = m_viewportIterator;
@@ -1197,8 +1379,7 @@ void DocumentPrivate::saveDocumentInfo() const
             --backIterator;
 
         // create history root node
-        QDomElement historyNode = doc.createElement( QStringLiteral("history") );
-        generalInfo.appendChild( historyNode );
+        DocdataElement historyNode( QStringLiteral("history") );
 
         // add old[backIterator] and present[viewportIterator] items
         QLinkedList< DocumentViewport >::const_iterator endIt = m_viewportIterator;
@@ -1206,29 +1387,44 @@ void DocumentPrivate::saveDocumentInfo() const
         while ( backIterator != endIt )
         {
             QString name = (backIterator == m_viewportIterator) ? QStringLiteral ("current") : QStringLiteral ("oldPage");
-            QDomElement historyEntry = doc.createElement( name );
+            DocdataElement historyEntry( name );
             historyEntry.setAttribute( QStringLiteral("viewport"), (*backIterator).toString() );
             historyNode.appendChild( historyEntry );
             ++backIterator;
         }
+        generalInfo.appendChild( historyNode );
     }
     // create views root node
-    QDomElement viewsNode = doc.createElement( QStringLiteral("views") );
-    generalInfo.appendChild( viewsNode );
+    DocdataElement viewsNode( QStringLiteral("views") );
     Q_FOREACH ( View * view, m_views )
     {
-        QDomElement viewEntry = doc.createElement( QStringLiteral("view") );
+        DocdataElement viewEntry( QStringLiteral("view") );
         viewEntry.setAttribute( QStringLiteral("name"), view->name() );
-        viewsNode.appendChild( viewEntry );
         saveViewsInfo( view, viewEntry );
+        viewsNode.appendChild( viewEntry );
     }
+    generalInfo.appendChild( viewsNode );
+    // <general info><boundingBoxes> ... </boundingBoxes> save the known page bounding boxes,
+    // so that trimming the margins does not have to wait for the pages to be rendered
+    DocdataElement boundingBoxesNode( QStringLiteral("boundingBoxes") );
+    boundingBoxesNode.setAttribute( QStringLiteral("paperColor"), SettingsCore::paperColor().name() );
+    for ( const Page *page : m_pagesVector )
+    {
+        if ( !page->isBoundingBoxKnown() )
+            continue;
+        const NormalizedRect boundingBox = page->boundingBox();
+        DocdataElement boundingBoxEntry( QStringLiteral("page") );
+        boundingBoxEntry.setAttribute( QStringLiteral("number"), QString::number( page->number() ) );
+        boundingBoxEntry.setAttribute( QStringLiteral("box"), QStringLiteral("%1;%2;%3;%4").arg( boundingBox.left ).arg( boundingBox.top )
+                                                                                        .arg( boundingBox.right ).arg( boundingBox.bottom ) );
+        boundingBoxesNode.appendChild( boundingBoxEntry );
+    }
+    if ( boundingBoxesNode.hasChildNodes() )
+        generalInfo.appendChild( boundingBoxesNode );
+    root.appendChild( generalInfo );
 
-    // 3. Save DOM to XML file
-    QString xml = doc.toString();
-    QTextStream os( &infoFile );
-    os.setCodec( "UTF-8" );
-    os << xml;
-    infoFile.close();
+    // 3. Write the XML file, unless it already holds the same info
+    m_docdataWriter.save( m_xmlFileName, root );
 }
 
 void DocumentPrivate::slotTimedMemoryCheck()
@@ -1423,6 +1619,7 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
         // we can not really know if the generator can do async requests
         m_executingPixmapRequests.push_back( request );
         m_pixmapRequestsMutex.unlock();
+
         m_generator->generatePixmap( request );
     }
     else
@@ -1566,12 +1763,8 @@ void DocumentPrivate::refreshPixmaps( int pageNumber )
 void DocumentPrivate::_o_configChanged()
 {
     // free text pages if needed
-    calculateMaxTextPages();
-    while (m_allocatedTextPagesFifo.count() > m_maxAllocatedTextPages)
-    {
-        int pageToKick = m_allocatedTextPagesFifo.takeFirst();
-        m_pagesVector.at(pageToKick)->setTextPage( nullptr ); // deletes the textpage
-    }
+    calculateMaxTextPagesMemory();
+    cleanupTextPageMemory();
 }
 
 void DocumentPrivate::doContinueDirectionMatchSearch(void *doContinueDirectionMatchSearchStruct)
@@ -1618,12 +1811,18 @@ void DocumentPrivate::doContinueDirectionMatchSearch(void *doContinueDirectionMa
     {
         // get page
         Page * page = m_pagesVector[ searchStruct->currentPage ];
-        // request search page if needed
-        if ( !page->hasTextPage() )
-            m_parent->requestTextPage( page->number() );
+        // don't extract the text of pages that can't match
+        if ( search->isCandidate( page->number() ) )
+        {
+            // wait for the text of the page if needed
+            if ( waitForTextPage( search, page->number(), forward, [this, searchStruct] {
+                    QMetaObject::invokeMethod(m_parent, "doContinueDirectionMatchSearch", Qt::QueuedConnection, Q_ARG(void *, searchStruct));
+                } ) )
+                return;
 
-        // if found a match on the current page, end the loop
-        searchStruct->match = page->findText( searchStruct->searchID, search->cachedString, forward ? FromTop : FromBottom, search->cachedCaseSensitivity );
+            // if found a match on the current page, end the loop
+            searchStruct->match = page->findText( searchStruct->searchID, search->cachedString, forward ? FromTop : FromBottom, search->cachedCaseSensitivity );
+        }
         if ( !searchStruct->match )
         {
             if (forward) searchStruct->currentPage++;
@@ -1645,6 +1844,61 @@ void DocumentPrivate::doContinueDirectionMatchSearch(void *doContinueDirectionMa
     }
 }
 
+bool DocumentPrivate::waitForTextPage( RunningSearch *search, int pageNumber, bool forward, const std::function<void()> &continuation )
+{
+    // how many pages ahead of the searched one have their text extracted with it
+    static const int SearchLookahead = 8;
+
+    Page *page = m_pagesVector.at( pageNumber );
+    if ( page->hasTextPage() )
+    {
+        ++m_textPageHits;
+        touchTextPage( pageNumber );
+        search->textWaitedPage = -1;
+        return false;
+    }
+
+    // a page the generator gave no text for is searched as it is
+    if ( search->textWaitedPage == pageNumber )
+    {
+        search->textWaitedPage = -1;
+        return false;
+    }
+
+    // this reads the snapshot too
+    if ( !m_generator->hasFeature( Generator::Threaded ) )
+    {
+        m_parent->requestTextPage( pageNumber );
+        return false;
+    }
+
+    ++m_textPageMisses;
+    search->textWaitedPage = pageNumber;
+    search->textLookahead.clear();
+    search->textLookahead.append( pageNumber );
+    m_textPageWaiters.insert( pageNumber, continuation );
+
+    GeneratorPrivate *generator = m_generator->d_func();
+    generator->queueTextPage( page, nullptr, GeneratorPrivate::UserTextJob );
+    int next = pageNumber;
+    for ( int queued = 1; queued < SearchLookahead; )
+    {
+        next += forward ? 1 : -1;
+        if ( next < 0 || next >= m_pagesVector.count() )
+            break;
+        // the text thread reads the pages in the snapshot from there
+        if ( search->isCandidate( next ) )
+        {
+            generator->queueTextPage( m_pagesVector.at( next ), nullptr, GeneratorPrivate::UserTextJob );
+            search->textLookahead.append( next );
+            ++queued;
+        }
+    }
+    generator->startTextJobs();
+
+    return true;
+}
+
 void DocumentPrivate::doProcessSearchMatch( RegularAreaRect *match, RunningSearch *search, QSet< int > *pagesToNotify, int currentPage, int searchID, bool moveViewport, const QColor & color )
 {
     // reset cursor to previous shape
@@ -1699,38 +1953,60 @@ void DocumentPrivate::doProcessSearchMatch( RegularAreaRect *match, RunningSearc
     delete pagesToNotify;
 }
 
-void DocumentPrivate::doContinueAllDocumentSearch(void *pagesToNotifySet, void *pageMatchesMap, int currentPage, int searchID)
+void DocumentPrivate::notifySearchHighlights( int pageNumber, QSet< int > *pagesToNotify )
+{
+    if ( !pagesToNotify->remove( pageNumber ) )
+        return;
+
+    foreachObserverD( notifyPageChanged( pageNumber, DocumentObserver::Highlights ) );
+}
+
+void DocumentPrivate::finishAllDocumentSearch( RunningSearch *search, QSet< int > *pagesToNotify, int searchID, Document::SearchStatus status )
+{
+    // reset cursor to previous shape
+    QApplication::restoreOverrideCursor();
+
+    if ( search )
+        search->isCurrentlySearching = false;
+
+    // the pages that had highlights from the previous search and were not
+    // reached, if any
+    foreach(int pageNumber, *pagesToNotify)
+        foreachObserverD( notifyPageChanged( pageNumber, DocumentObserver::Highlights ) );
+    delete pagesToNotify;
+
+    emit m_parent->searchFinished( searchID, status );
+}
+
+void DocumentPrivate::doContinueAllDocumentSearch(void *pagesToNotifySet, int currentPage, int searchID)
 {
-    QMap< Page *, QVector<RegularAreaRect *> > *pageMatches = static_cast< QMap< Page *, QVector<RegularAreaRect *> > * >(pageMatchesMap);
     QSet< int > *pagesToNotify = static_cast< QSet< int > * >( pagesToNotifySet );
     RunningSearch *search = m_searches.value(searchID);
 
     if (m_searchCancelled || !search)
     {
-        typedef QVector<RegularAreaRect *> MatchesVector;
-
-        QApplication::restoreOverrideCursor();
-
-        if (search) search->isCurrentlySearching = false;
-
-        emit m_parent->searchFinished( searchID, Document::SearchCancelled );
-        foreach(const MatchesVector &mv, *pageMatches) qDeleteAll(mv);
-        delete pageMatches;
-        delete pagesToNotify;
+        finishAllDocumentSearch( search, pagesToNotify, searchID, Document::SearchCancelled );
         return;
     }
 
+    // skip the pages that can't match
+    while ( currentPage < m_pagesVector.count() && !search->isCandidate( currentPage ) )
+        notifySearchHighlights( currentPage++, pagesToNotify );
+
     if (currentPage < m_pagesVector.count())
     {
         // get page (from the first to the last)
         Page *page = m_pagesVector.at(currentPage);
         int pageNumber = page->number(); // redundant? is it == currentPage ?
 
-        // request search page if needed
-        if ( !page->hasTextPage() )
-            m_parent->requestTextPage( pageNumber );
+        // wait for the text of the page if needed
+        if ( waitForTextPage( search, pageNumber, true, [this, pagesToNotifySet, currentPage, searchID] {
+                QMetaObject::invokeMethod(m_parent, "doContinueAllDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotifySet), Q_ARG(int, currentPage), Q_ARG(int, searchID));
+            } ) )
+            return;
 
         // loop on a page adding highlights for all found items
+        QVector< RegularAreaRect * > matches;
         RegularAreaRect * lastMatch = nullptr;
         while ( 1 )
         {
@@ -1742,73 +2018,40 @@ void DocumentPrivate::doContinueAllDocumentSearch(void *pagesToNotifySet, void *
             if ( !lastMatch )
                 break;
 
-            // add highligh rect to the matches map
-            (*pageMatches)[page].append(lastMatch);
+            matches.append( lastMatch );
         }
-        delete lastMatch;
 
-        QMetaObject::invokeMethod(m_parent, "doContinueAllDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotifySet), Q_ARG(void *, pageMatches), Q_ARG(int, currentPage + 1), Q_ARG(int, searchID));
-    }
-    else
-    {
-        // reset cursor to previous shape
-        QApplication::restoreOverrideCursor();
-
-        search->isCurrentlySearching = false;
-        bool foundAMatch = pageMatches->count() != 0;
-        QMap< Page *, QVector<RegularAreaRect *> >::const_iterator it, itEnd;
-        it = pageMatches->constBegin();
-        itEnd = pageMatches->constEnd();
-        for ( ; it != itEnd; ++it)
+        // publish the matches of the page right away
+        if ( !matches.isEmpty() )
         {
-            foreach(RegularAreaRect *match, it.value())
+            foreach(RegularAreaRect *match, matches)
             {
-                it.key()->d->setHighlight( searchID, match, search->cachedColor );
+                page->d->setHighlight( searchID, match, search->cachedColor );
                 delete match;
             }
-            search->highlightedPages.insert( it.key()->number() );
-            pagesToNotify->insert( it.key()->number() );
+            search->highlightedPages.insert( pageNumber );
+            pagesToNotify->insert( pageNumber );
         }
+        notifySearchHighlights( pageNumber, pagesToNotify );
 
-        foreach(DocumentObserver *observer, m_observers)
-            observer->notifySetup( m_pagesVector, 0 );
-
-        // notify observers about highlights changes
-        foreach(int pageNumber, *pagesToNotify)
-            foreach(DocumentObserver *observer, m_observers)
-                observer->notifyPageChanged( pageNumber, DocumentObserver::Highlights );
-
-        if (foundAMatch) emit m_parent->searchFinished(searchID, Document::MatchFound );
-        else emit m_parent->searchFinished( searchID, Document::NoMatchFound );
-
-        delete pageMatches;
-        delete pagesToNotify;
+        QMetaObject::invokeMethod(m_parent, "doContinueAllDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotifySet), Q_ARG(int, currentPage + 1), Q_ARG(int, searchID));
+    }
+    else
+    {
+        const bool foundAMatch = !search->highlightedPages.isEmpty();
+        finishAllDocumentSearch( search, pagesToNotify, searchID, foundAMatch ? Document::MatchFound : Document::NoMatchFound );
     }
 }
 
-void DocumentPrivate::doContinueGooglesDocumentSearch(void *pagesToNotifySet, void *pageMatchesMap, int currentPage, int searchID, const QStringList & words)
+void DocumentPrivate::doContinueGooglesDocumentSearch(void *pagesToNotifySet, int currentPage, int searchID, const QStringList & words)
 {
     typedef QPair<RegularAreaRect *, QColor> MatchColor;
-    QMap< Page *, QVector<MatchColor> > *pageMatches = static_cast< QMap< Page *, QVector<MatchColor> > * >(pageMatchesMap);
     QSet< int > *pagesToNotify = static_cast< QSet< int > * >( pagesToNotifySet );
     RunningSearch *search = m_searches.value(searchID);
 
     if (m_searchCancelled || !search)
     {
-        typedef QVector<MatchColor> MatchesVector;
-
-        QApplication::restoreOverrideCursor();
-
-        if (search) search->isCurrentlySearching = false;
-
-        emit m_parent->searchFinished( searchID, Document::SearchCancelled );
-
-        foreach(const MatchesVector &mv, *pageMatches)
-        {
-            foreach(const MatchColor &mc, mv) delete mc.first;
-        }
-        delete pageMatches;
-        delete pagesToNotify;
+        finishAllDocumentSearch( search, pagesToNotify, searchID, Document::SearchCancelled );
         return;
     }
 
@@ -1817,17 +2060,24 @@ void DocumentPrivate::doContinueGooglesDocumentSearch(void *pagesToNotifySet, vo
     int baseHue, baseSat, baseVal;
     search->cachedColor.getHsv( &baseHue, &baseSat, &baseVal );
 
+    // skip the pages that can't match
+    while ( currentPage < m_pagesVector.count() && !search->isCandidate( currentPage ) )
+        notifySearchHighlights( currentPage++, pagesToNotify );
+
     if (currentPage < m_pagesVector.count())
     {
         // get page (from the first to the last)
         Page *page = m_pagesVector.at(currentPage);
         int pageNumber = page->number(); // redundant? is it == currentPage ?
 
-        // request search page if needed
-        if ( !page->hasTextPage() )
-            m_parent->requestTextPage( pageNumber );
+        // wait for the text of the page if needed
+        if ( waitForTextPage( search, pageNumber, true, [this, pagesToNotifySet, currentPage, searchID, words] {
+                QMetaObject::invokeMethod(m_parent, "doContinueGooglesDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotifySet), Q_ARG(int, currentPage), Q_ARG(int, searchID), Q_ARG(QStringList, words));
+            } ) )
+            return;
 
         // loop on a page adding highlights for all found items
+        QVector<MatchColor> matches;
         bool allMatched = wordCount > 0,
              anyMatched = false;
         for ( int w = 0; w < wordCount; w++ )
@@ -1850,8 +2100,7 @@ void DocumentPrivate::doContinueGooglesDocumentSearch(void *pagesToNotifySet, vo
                 if ( !lastMatch )
                     break;
 
-                // add highligh rect to the matches map
-                (*pageMatches)[page].append(MatchColor(lastMatch, wordColor));
+                matches.append(MatchColor(lastMatch, wordColor));
                 wordMatched = true;
             }
             allMatched = allMatched && wordMatched;
@@ -1862,48 +2111,29 @@ void DocumentPrivate::doContinueGooglesDocumentSearch(void *pagesToNotifySet, vo
         const bool matchAll = search->cachedType == Document::GoogleAll;
         if ( !allMatched && matchAll )
         {
-            QVector<MatchColor> &matches = (*pageMatches)[page];
             foreach(const MatchColor &mc, matches) delete mc.first;
-            pageMatches->remove(page);
+            matches.clear();
         }
 
-        QMetaObject::invokeMethod(m_parent, "doContinueGooglesDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotifySet), Q_ARG(void *, pageMatches), Q_ARG(int, currentPage + 1), Q_ARG(int, searchID), Q_ARG(QStringList, words));
-    }
-    else
-    {
-        // reset cursor to previous shape
-        QApplication::restoreOverrideCursor();
-
-        search->isCurrentlySearching = false;
-        bool foundAMatch = pageMatches->count() != 0;
-        QMap< Page *, QVector<MatchColor> >::const_iterator it, itEnd;
-        it = pageMatches->constBegin();
-        itEnd = pageMatches->constEnd();
-        for ( ; it != itEnd; ++it)
+        // publish the matches of the page right away
+        if ( !matches.isEmpty() )
         {
-            foreach(const MatchColor &mc, it.value())
+            foreach(const MatchColor &mc, matches)
             {
-                it.key()->d->setHighlight( searchID, mc.first, mc.second );
+                page->d->setHighlight( searchID, mc.first, mc.second );
                 delete mc.first;
             }
-            search->highlightedPages.insert( it.key()->number() );
-            pagesToNotify->insert( it.key()->number() );
+            search->highlightedPages.insert( pageNumber );
+            pagesToNotify->insert( pageNumber );
         }
+        notifySearchHighlights( pageNumber, pagesToNotify );
 
-        // send page lists to update observers (since some filter on bookmarks)
-        foreach(DocumentObserver *observer, m_observers)
-            observer->notifySetup( m_pagesVector, 0 );
-
-        // notify observers about highlights changes
-        foreach(int pageNumber, *pagesToNotify)
-            foreach(DocumentObserver *observer, m_observers)
-                observer->notifyPageChanged( pageNumber, DocumentObserver::Highlights );
-
-        if (foundAMatch) emit m_parent->searchFinished( searchID, Document::MatchFound );
-        else emit m_parent->searchFinished( searchID, Document::NoMatchFound );
-
-        delete pageMatches;
-        delete pagesToNotify;
+        QMetaObject::invokeMethod(m_parent, "doContinueGooglesDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotifySet), Q_ARG(int, currentPage + 1), Q_ARG(int, searchID), Q_ARG(QStringList, words));
+    }
+    else
+    {
+        const bool foundAMatch = !search->highlightedPages.isEmpty();
+        finishAllDocumentSearch( search, pagesToNotify, searchID, foundAMatch ? Document::MatchFound : Document::NoMatchFound );
     }
 }
 
@@ -2411,7 +2641,9 @@ Document::OpenResult Document::openDocument(const QString & docFile, const QUrl
     d->m_metadataLoadingCompleted = false;
     d->m_docdataMigrationNeeded = false;
 
-    // 2. load Additional Data (bookmarks, local annotations and metadata) about the document
+    // 2. load Additional Data (bookmarks, local annotations and metadata) about the document,
+    // once the files of the last document closed are written
+    d->m_docdataWriter.waitForSaves();
     if ( d->m_archiveData )
     {
         d->loadDocumentInfo( d->m_archiveData->metadataFile, LoadPageInfo );
@@ -2427,6 +2659,28 @@ Document::OpenResult Document::openDocument(const QString & docFile, const QUrl
     d->m_metadataLoadingCompleted = true;
     d->m_bookmarkManager->setUrl( d->m_url );
 
+    // the observers are set up with the contents restored so far, and the
+    // page contents not needed yet are restored in the background
+    d->m_restoredAnnotationPages.clear();
+    if ( !d->m_pendingPageInfo.isEmpty() )
+    {
+        if ( !d->m_pendingPageInfoTimer )
+        {
+            d->m_pendingPageInfoTimer = new QTimer( this );
+            d->m_pendingPageInfoTimer->setSingleShot( true );
+            connect( d->m_pendingPageInfoTimer, SIGNAL(timeout()), this, SLOT(restorePendingPageInfo()) );
+        }
+        d->m_pendingPageInfoTimer->start();
+    }
+
+    // the text of the pages is read from the snapshot only when needed; the
+    // text documents are laid out according to settings (fonts, page size...)
+    // the snapshot knows nothing about, so their text is always extracted
+    if ( !d->m_xmlFileName.isEmpty() && d->m_generator->hasFeature( Generator::TextExtraction ) &&
+         !qobject_cast< TextDocumentGenerator * >( d->m_generator ) )
+        d->m_textSnapshot.open( d->textSnapshotFileName(), d->m_docSize, QFileInfo( d->m_docFileName ).lastModified(), d->m_pagesVector.count(),
+                                d->textSnapshotLayoutKey() );
+
     // 3. setup observers inernal lists and data
     foreachObserver( notifySetup( d->m_pagesVector, DocumentObserver::DocumentChanged | DocumentObserver::UrlChanged ) );
 
@@ -2436,7 +2690,15 @@ Document::OpenResult Document::openDocument(const QString & docFile, const QUrl
     {
         (*d->m_viewportIterator) = DocumentViewport();
         if ( loadedViewport.pageNumber >= (int)d->m_pagesVector.size() )
+        {
+            // go there once the generator adds the page
+            if ( d->m_generator->hasFeature( Generator::EstimatedPageCount ) )
+            {
+                d->m_laterViewport = loadedViewport;
+                d->m_laterViewportFrom = d->m_pagesVector.size() - 1;
+            }
             loadedViewport.pageNumber = d->m_pagesVector.size() - 1;
+        }
     }
     else
         loadedViewport.pageNumber = 0;
@@ -2462,6 +2724,7 @@ Document::OpenResult Document::openDocument(const QString & docFile, const QUrl
     if ( nextViewport.isValid() )
     {
         setViewport( nextViewport );
+        d->m_laterViewport = DocumentViewport();
         d->m_nextDocumentViewport = DocumentViewport();
         d->m_nextDocumentDestination = QString();
     }
@@ -2570,6 +2833,11 @@ void Document::closeDocument()
     if ( d->m_generator && d->m_pagesVector.size() > 0 )
     {
         d->saveDocumentInfo();
+        // the page sizes the text was laid out with, the generator may have
+        // corrected them since the document was opened
+        d->m_textSnapshot.setLayoutKey( d->textSnapshotLayoutKey() );
+        if ( d->m_textSnapshot.isModified() )
+            d->m_docdataWriter.save( d->m_textSnapshot );
         d->m_generator->closeDocument();
     }
 
@@ -2584,6 +2852,16 @@ void Document::closeDocument()
         d->m_memCheckTimer->stop();
     if ( d->m_saveBookmarksTimer )
         d->m_saveBookmarksTimer->stop();
+    if ( d->m_pageSizesChangedTimer )
+        d->m_pageSizesChangedTimer->stop();
+    if ( d->m_pendingPageInfoTimer )
+        d->m_pendingPageInfoTimer->stop();
+    d->m_pendingPageInfo.clear();
+    d->m_pendingPageInfoXml.clear();
+    d->m_restoredAnnotationPages.clear();
+    d->m_laterPageInfo.clear();
+    d->m_laterViewport = DocumentViewport();
+    d->m_laterViewportFrom = -1;
 
     if ( d->m_generator )
     {
@@ -2634,6 +2912,12 @@ void Document::closeDocument()
         delete *rIt;
     d->m_searches.clear();
 
+    // the searches waiting for text find their descriptors gone and finish
+    const QList< std::function<void()> > textPageWaiters = d->m_textPageWaiters.values();
+    d->m_textPageWaiters.clear();
+    for ( const std::function<void()> &waiter : textPageWaiters )
+        waiter();
+
     // clear the visible areas and notify the observers
     QVector< VisiblePageRect * >::const_iterator vIt = d->m_pageRects.constBegin();
     QVector< VisiblePageRect * >::const_iterator vEnd = d->m_pageRects.constEnd();
@@ -2648,7 +2932,14 @@ void Document::closeDocument()
     d->m_viewportHistory.append( DocumentViewport() );
     d->m_viewportIterator = d->m_viewportHistory.begin();
     d->m_allocatedPixmapsTotalMemory = 0;
-    d->m_allocatedTextPagesFifo.clear();
+    qCDebug(OkularCoreDebug) << "Text pages:" << d->m_textPageHits << "hits," << d->m_textPageMisses << "misses";
+    qDeleteAll( d->m_allocatedTextPages );
+    d->m_allocatedTextPages.clear();
+    d->m_allocatedTextPagesIndex.clear();
+    d->m_allocatedTextPagesTotalMemory = 0;
+    d->m_textPageHits = 0;
+    d->m_textPageMisses = 0;
+    d->m_textSnapshot.clear();
     d->m_pageSize = PageSize();
     d->m_pageSizes.clear();
 
@@ -2883,6 +3174,9 @@ void Document::setVisiblePageRects( const QVector< VisiblePageRect * > & visible
     for ( ; vIt != vEnd; ++vIt )
         delete *vIt;
     d->m_pageRects = visiblePageRects;
+    // the text of the pages being looked at is the last to go
+    for ( const VisiblePageRect *rect : visiblePageRects )
+        d->touchTextPage( rect->pageNumber );
     // notify change to all other (different from id) observers
     foreach(DocumentObserver *o, d->m_observers)
         if ( o != excludeObserver )
@@ -2934,6 +3228,11 @@ bool Document::supportsTiles() const
     return d->m_generator ? d->m_generator->hasFeature( Generator::TiledRendering ) : false;
 }
 
+bool Document::supportsPreloading() const
+{
+    return d->m_generator ? d->m_generator->hasFeature( Generator::Threaded ) : false;
+}
+
 PageSize::List Document::pageSizes() const
 {
     if ( d->m_generator )
@@ -2977,6 +3276,9 @@ ExportFormat::List Document::exportFormats() const
 
 bool Document::exportTo( const QString& fileName, const ExportFormat& format ) const
 {
+    // the exported pages carry their annotations
+    d->restoreAllPageInfo();
+
     return d->m_generator ? d->m_generator->exportTo( fileName, format ) : false;
 }
 
@@ -3113,6 +3415,13 @@ void Document::requestPixmaps( const QLinkedList< PixmapRequest * > & requests,
         return;
     }
 
+    // the annotations of a page are restored before it is rendered
+    if ( !d->m_pendingPageInfo.isEmpty() )
+    {
+        for ( const PixmapRequest *request : requests )
+            d->restorePageInfo( request->pageNumber() );
+    }
+
     // 1. [CLEAN STACK] remove previous requests of requesterID
     // FIXME This assumes all requests come from the same observer, that is true atm but not enforced anywhere
     DocumentObserver *requesterObserver = requests.first()->observer();
@@ -3138,6 +3447,10 @@ void Document::requestPixmaps( const QLinkedList< PixmapRequest * > & requests,
             ++sIt;
     }
 
+    // the text of the pages the observer does not want anymore is not needed either
+    if ( removeAllPrevious && d->m_generator )
+        d->m_generator->d_func()->cancelTextPages( requesterObserver, requestedPages );
+
     // 2. [ADD TO STACK] add requests to stack
     QLinkedList< PixmapRequest * >::const_iterator rIt = requests.constBegin(), rEnd = requests.constEnd();
     for ( ; rIt != rEnd; ++rIt )
@@ -3205,6 +3518,30 @@ void Document::requestPixmaps( const QLinkedList< PixmapRequest * > & requests,
         d->sendGeneratorPixmapRequest();
 }
 
+void Document::deletePixmap( DocumentObserver *observer, int pageNumber )
+{
+    Page *kp = d->m_pagesVector.value( pageNumber );
+    if ( !kp || !kp->hasPixmap( observer ) )
+        return;
+
+    kp->deletePixmap( observer );
+
+    // [MEM] free the allocation descriptor too
+    QLinkedList< AllocatedPixmap * >::iterator aIt = d->m_allocatedPixmaps.begin();
+    QLinkedList< AllocatedPixmap * >::iterator aEnd = d->m_allocatedPixmaps.end();
+    for ( ; aIt != aEnd; ++aIt )
+    {
+        AllocatedPixmap * p = *aIt;
+        if ( p->page == pageNumber && p->observer == observer )
+        {
+            d->m_allocatedPixmapsTotalMemory -= p->memory;
+            d->m_allocatedPixmaps.erase( aIt );
+            delete p;
+            break;
+        }
+    }
+}
+
 void Document::requestTextPage( uint page )
 {
     Page * kp = d->m_pagesVector[ page ];
@@ -3212,15 +3549,73 @@ void Document::requestTextPage( uint page )
         return;
 
     // Memory management for TextPages
+    if ( kp->hasTextPage() || d->loadSnapshotTextPage( kp ) )
+    {
+        ++d->m_textPageHits;
+        d->touchTextPage( page );
+        return;
+    }
 
+    ++d->m_textPageMisses;
     d->m_generator->generateTextPage( kp );
 }
 
 void DocumentPrivate::notifyAnnotationChanges( int page )
 {
+    if ( m_annotationChangesDepth > 0 )
+    {
+        m_changedAnnotationPages.insert( page );
+        return;
+    }
+
     foreachObserverD( notifyPageChanged( page, DocumentObserver::Annotations ) );
 }
 
+void DocumentPrivate::beginAnnotationChanges()
+{
+    if ( m_annotationChangesDepth++ > 0 )
+        return;
+
+    Okular::SaveInterface * iface = qobject_cast< Okular::SaveInterface * >( m_generator );
+    AnnotationProxy *proxy = iface ? iface->annotationProxy() : nullptr;
+    // proxies built against older versions do not have the batch methods
+    if ( proxy && proxy->supports( AnnotationProxy::Batch ) )
+        proxy->beginBatch();
+}
+
+void DocumentPrivate::endAnnotationChanges()
+{
+    Q_ASSERT( m_annotationChangesDepth > 0 );
+    if ( --m_annotationChangesDepth > 0 )
+        return;
+
+    Okular::SaveInterface * iface = qobject_cast< Okular::SaveInterface * >( m_generator );
+    AnnotationProxy *proxy = iface ? iface->annotationProxy() : nullptr;
+    if ( proxy && proxy->supports( AnnotationProxy::Batch ) )
+        proxy->endBatch();
+
+    // once per page, in page order
+    QVector< int > pages = m_changedAnnotationPages.toList().toVector();
+    QVector< int > refreshPages = m_annotationPixmapsToRefresh.toList().toVector();
+    m_changedAnnotationPages.clear();
+    m_annotationPixmapsToRefresh.clear();
+    std::sort( pages.begin(), pages.end() );
+    std::sort( refreshPages.begin(), refreshPages.end() );
+
+    for ( int page : qAsConst( pages ) )
+        foreachObserverD( notifyPageChanged( page, DocumentObserver::Annotations ) );
+    for ( int page : qAsConst( refreshPages ) )
+        refreshPixmaps( page );
+}
+
+void DocumentPrivate::refreshAnnotationPixmaps( int page )
+{
+    if ( m_annotationChangesDepth > 0 )
+        m_annotationPixmapsToRefresh.insert( page );
+    else
+        refreshPixmaps( page );
+}
+
 void DocumentPrivate::notifyFormChanges( int /*page*/ )
 {
 }
@@ -3347,12 +3742,31 @@ void Document::removePageAnnotation( int page, Annotation * annotation )
 
 void Document::removePageAnnotations( int page, const QList<Annotation*> &annotations )
 {
-    d->m_undoStack->beginMacro(i18nc("remove a collection of annotations from the page", "remove annotations"));
+    beginAnnotationBatch(i18nc("remove a collection of annotations from the page", "remove annotations"));
     foreach(Annotation* annotation, annotations)
     {
         QUndoCommand *uc = new RemoveAnnotationCommand(this->d, annotation, page);
         d->m_undoStack->push(uc);
     }
+    endAnnotationBatch();
+}
+
+void Document::beginAnnotationBatch( const QString &text )
+{
+    if ( d->m_annotationBatchDepth++ > 0 )
+        return;
+
+    d->m_undoStack->beginMacro( text );
+    d->m_undoStack->push( new AnnotationBatchCommand( d, AnnotationBatchCommand::BatchBegin ) );
+}
+
+void Document::endAnnotationBatch()
+{
+    Q_ASSERT( d->m_annotationBatchDepth > 0 );
+    if ( d->m_annotationBatchDepth == 0 || --d->m_annotationBatchDepth > 0 )
+        return;
+
+    d->m_undoStack->push( new AnnotationBatchCommand( d, AnnotationBatchCommand::BatchEnd ) );
     d->m_undoStack->endMacro();
 }
 
@@ -3455,6 +3869,9 @@ void Document::setViewport( const DocumentViewport & viewport, DocumentObserver
         return;
     }
 
+    // the page shown gets its annotations and forms before it is rendered
+    d->restorePageInfo( viewport.pageNumber );
+
     // if already broadcasted, don't redo it
     DocumentViewport & oldViewport = *d->m_viewportIterator;
     // disabled by enrico on 2005-03-18 (less debug output)
@@ -3569,6 +3986,7 @@ void Document::searchText( int searchID, const QString & text, bool fromStart, Q
     {
         RunningSearch * search = new RunningSearch();
         search->continueOnPage = -1;
+        search->textWaitedPage = -1;
         searchIt = d->m_searches.insert( searchID, search );
     }
     RunningSearch * s = *searchIt;
@@ -3582,6 +4000,19 @@ void Document::searchText( int searchID, const QString & text, bool fromStart, Q
     s->cachedColor = color;
     s->isCurrentlySearching = true;
 
+    // let the generator rule out the pages that can't match
+    s->candidatePages.clear();
+    QVector< int > candidatePages;
+    if ( d->m_generator->hasFeature( Generator::IndexedSearch ) && d->m_generator->searchCandidatePages( text, type, &candidatePages ) )
+    {
+        s->candidatePages.fill( false, d->m_pagesVector.count() );
+        foreach ( int pageNumber, candidatePages )
+        {
+            if ( pageNumber >= 0 && pageNumber < d->m_pagesVector.count() )
+                s->candidatePages.setBit( pageNumber );
+        }
+    }
+
     // global data for search
     QSet< int > *pagesToNotify = new QSet< int >;
 
@@ -3597,10 +4028,8 @@ void Document::searchText( int searchID, const QString & text, bool fromStart, Q
     // 1. ALLDOC - proces all document marking pages
     if ( type == AllDocument )
     {
-        QMap< Page *, QVector<RegularAreaRect *> > *pageMatches = new QMap< Page *, QVector<RegularAreaRect *> >;
-
         // search and highlight 'text' (as a solid phrase) on all pages
-        QMetaObject::invokeMethod(this, "doContinueAllDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotify), Q_ARG(void *, pageMatches), Q_ARG(int, 0), Q_ARG(int, searchID));
+        QMetaObject::invokeMethod(this, "doContinueAllDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotify), Q_ARG(int, 0), Q_ARG(int, searchID));
     }
     // 2. NEXTMATCH - find next matching item (or start from top)
     // 3. PREVMATCH - find previous matching item (or start from bottom)
@@ -3643,11 +4072,10 @@ void Document::searchText( int searchID, const QString & text, bool fromStart, Q
     // 4. GOOGLE* - process all document marking pages
     else if ( type == GoogleAll || type == GoogleAny )
     {
-        QMap< Page *, QVector< QPair<RegularAreaRect *, QColor> > > *pageMatches = new QMap< Page *, QVector<QPair<RegularAreaRect *, QColor> > >;
         const QStringList words = text.split( QLatin1Char ( ' ' ), QString::SkipEmptyParts );
 
         // search and highlight every word in 'text' on all pages
-        QMetaObject::invokeMethod(this, "doContinueGooglesDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotify), Q_ARG(void *, pageMatches), Q_ARG(int, 0), Q_ARG(int, searchID), Q_ARG(QStringList, words));
+        QMetaObject::invokeMethod(this, "doContinueGooglesDocumentSearch", Qt::QueuedConnection, Q_ARG(void *, pagesToNotify), Q_ARG(int, 0), Q_ARG(int, searchID), Q_ARG(QStringList, words));
     }
 }
 
@@ -4181,6 +4609,9 @@ bool Document::supportsPrintToFile() const
 
 bool Document::print( QPrinter &printer )
 {
+    // the printed pages carry their annotations
+    d->restoreAllPageInfo();
+
     return d->m_generator ? d->m_generator->print( printer ) : false;
 }
 
@@ -4345,6 +4776,7 @@ bool Document::swapBackingFile( const QString &newFileName, const QUrl &url )
 
     // Save metadata about the file we're about to close
     d->saveDocumentInfo();
+    d->m_docdataWriter.waitForSaves();
 
     qCDebug(OkularCoreDebug) << "Swapping backing file to" << newFileName;
     QVector< Page * > newPagesVector;
@@ -4519,6 +4951,8 @@ bool Document::saveChanges( const QString &fileName, QString *errorText )
         return false;
     Q_ASSERT( !d->m_generatorName.isEmpty() );
 
+    d->restoreAllPageInfo();
+
     QHash< QString, GeneratorInfo >::iterator genIt = d->m_loadedGenerators.find( d->m_generatorName );
     Q_ASSERT( genIt != d->m_loadedGenerators.end() );
     SaveInterface* saveIface = d->generatorSave( genIt.value() );
@@ -4683,6 +5117,8 @@ bool Document::saveDocumentArchive( const QString &fileName )
     if ( docFileName == QLatin1String( "-" ) )
         return false;
 
+    d->restoreAllPageInfo();
+
     QString docPath = d->m_docFileName;
     const QFileInfo fi( docPath );
     if ( fi.isSymLink() )
@@ -4925,45 +5361,387 @@ void DocumentPrivate::setPageBoundingBox( int page, const NormalizedRect& boundi
 
 }
 
-void DocumentPrivate::calculateMaxTextPages()
+void DocumentPrivate::setPageSize( int page, const QSizeF &size )
+{
+    Page * kp = m_pagesVector.value( page );
+    if ( !m_generator || !kp || size.isEmpty() )
+        return;
+
+    const QSizeF current = kp->rotation() % 2 ? QSizeF( kp->height(), kp->width() ) : QSizeF( kp->width(), kp->height() );
+    if ( current == size )
+        return;
+
+    // the text saved for the old size is laid out differently
+    m_textSnapshot.remove( page );
+
+    // this deletes the pixmaps of the page, so forget their descriptors too
+    kp->d->changeSize( PageSize( size.width(), size.height(), QString() ) );
+    QLinkedList< AllocatedPixmap * >::iterator aIt = m_allocatedPixmaps.begin();
+    while ( aIt != m_allocatedPixmaps.end() )
+    {
+        AllocatedPixmap *p = *aIt;
+        if ( p->page == page )
+        {
+            m_allocatedPixmapsTotalMemory -= p->memory;
+            aIt = m_allocatedPixmaps.erase( aIt );
+            delete p;
+        }
+        else
+            ++aIt;
+    }
+
+    schedulePageSizesChanged();
+}
+
+void DocumentPrivate::setPageCount( int count, const QSizeF &size )
+{
+    const int oldCount = m_pagesVector.count();
+    if ( !m_generator || count <= 0 )
+        return;
+
+    for ( int i = oldCount; i < count; ++i )
+    {
+        Page *page = new Page( i, size.width(), size.height(), Rotation0 );
+        page->d->m_doc = this;
+        if ( m_rotation != Rotation0 )
+            page->d->rotateAt( m_rotation );
+        m_pagesVector.append( page );
+
+        // the contents read while the page was past the estimated count
+        const QString pageXml = m_laterPageInfo.take( i );
+        QDomDocument doc;
+        if ( !pageXml.isEmpty() && doc.setContent( pageXml ) )
+        {
+            beginAnnotationChanges();
+            page->d->restoreLocalContents( doc.documentElement() );
+            endAnnotationChanges();
+        }
+    }
+
+    const bool estimated = m_generator->hasFeature( Generator::EstimatedPageCount );
+    if ( !estimated )
+        m_laterPageInfo.clear();
+
+    if ( count < oldCount )
+    {
+        // the generator removes no page a thread works on, so what is left
+        // are the requests waiting for the pages and what they left behind
+        m_pixmapRequestsMutex.lock();
+        QLinkedList< PixmapRequest * >::iterator sIt = m_pixmapRequestsStack.begin();
+        while ( sIt != m_pixmapRequestsStack.end() )
+        {
+            if ( (*sIt)->pageNumber() >= count )
+            {
+                delete *sIt;
+                sIt = m_pixmapRequestsStack.erase( sIt );
+            }
+            else
+                ++sIt;
+        }
+        m_pixmapRequestsMutex.unlock();
+
+        QLinkedList< AllocatedPixmap * >::iterator aIt = m_allocatedPixmaps.begin();
+        while ( aIt != m_allocatedPixmaps.end() )
+        {
+            AllocatedPixmap *p = *aIt;
+            if ( p->page >= count )
+            {
+                m_allocatedPixmapsTotalMemory -= p->memory;
+                aIt = m_allocatedPixmaps.erase( aIt );
+                delete p;
+            }
+            else
+                ++aIt;
+        }
+
+        QLinkedList< AllocatedTextPage * >::iterator tIt = m_allocatedTextPages.begin();
+        while ( tIt != m_allocatedTextPages.end() )
+        {
+            AllocatedTextPage *textPage = *tIt;
+            if ( textPage->page >= count )
+            {
+                m_allocatedTextPagesIndex.remove( textPage->page );
+                m_allocatedTextPagesTotalMemory -= textPage->memory;
+                tIt = m_allocatedTextPages.erase( tIt );
+                delete textPage;
+            }
+            else
+                ++tIt;
+        }
+        for ( int i = count; i < oldCount; ++i )
+            m_textSnapshot.remove( i );
+
+        bool rectsChanged = false;
+        QVector< VisiblePageRect * >::iterator vIt = m_pageRects.begin();
+        while ( vIt != m_pageRects.end() )
+        {
+            if ( (*vIt)->pageNumber >= count )
+            {
+                delete *vIt;
+                vIt = m_pageRects.erase( vIt );
+                rectsChanged = true;
+            }
+            else
+                ++vIt;
+        }
+
+        for ( RunningSearch *search : qAsConst( m_searches ) )
+        {
+            QSet< int >::iterator hIt = search->highlightedPages.begin();
+            while ( hIt != search->highlightedPages.end() )
+            {
+                if ( *hIt >= count )
+                    hIt = search->highlightedPages.erase( hIt );
+                else
+                    ++hIt;
+            }
+        }
+
+        // the contents not restored yet are kept as they were read
+        QMap< int, QPair< int, int > >::iterator pIt = m_pendingPageInfo.lowerBound( count );
+        while ( pIt != m_pendingPageInfo.end() )
+        {
+            if ( estimated )
+                m_laterPageInfo.insert( pIt.key(), m_pendingPageInfoXml.mid( pIt.value().first, pIt.value().second ) );
+            pIt = m_pendingPageInfo.erase( pIt );
+        }
+        QSet< int >::iterator rIt = m_restoredAnnotationPages.begin();
+        while ( rIt != m_restoredAnnotationPages.end() )
+        {
+            if ( *rIt >= count )
+                rIt = m_restoredAnnotationPages.erase( rIt );
+            else
+                ++rIt;
+        }
+
+        // the commands refer to the pages by number
+        m_undoStack->clear();
+
+        const int oldPage = (*m_viewportIterator).pageNumber;
+        if ( oldPage >= count )
+            (*m_viewportIterator).pageNumber = count - 1;
+
+        for ( int i = count; i < oldCount; ++i )
+            delete m_pagesVector.at( i );
+        m_pagesVector.resize( count );
+
+        if ( m_pageSizesChangedTimer )
+            m_pageSizesChangedTimer->stop();
+        foreachObserverD( notifySetup( m_pagesVector, DocumentObserver::NewLayoutForPages ) );
+        if ( rectsChanged )
+            foreachObserverD( notifyVisibleRectsChanged() );
+        if ( oldPage >= count )
+            foreachObserverD( notifyCurrentPageChanged( -1, count - 1 ) );
+
+        // the searches waiting for the text of the pages find them gone
+        QList< std::function<void()> > waiters;
+        QMultiHash< int, std::function<void()> >::iterator wIt = m_textPageWaiters.begin();
+        while ( wIt != m_textPageWaiters.end() )
+        {
+            if ( wIt.key() >= count )
+            {
+                waiters.append( wIt.value() );
+                wIt = m_textPageWaiters.erase( wIt );
+            }
+            else
+                ++wIt;
+        }
+        for ( const std::function<void()> &waiter : qAsConst( waiters ) )
+            waiter();
+    }
+    else if ( m_laterViewport.isValid() && m_laterViewport.pageNumber < count )
+    {
+        // the observers have to know the page before going there
+        if ( m_pageSizesChangedTimer )
+            m_pageSizesChangedTimer->stop();
+        foreachObserverD( notifySetup( m_pagesVector, DocumentObserver::NewLayoutForPages ) );
+    }
+    else
+    {
+        schedulePageSizesChanged();
+    }
+
+    // where the document was last read, unless it was moved away from meanwhile
+    if ( m_laterViewport.isValid() && ( m_laterViewport.pageNumber < count || !estimated ) )
+    {
+        const DocumentViewport viewport = m_laterViewport;
+        m_laterViewport = DocumentViewport();
+        if ( viewport.pageNumber < count && (*m_viewportIterator).pageNumber == m_laterViewportFrom )
+            m_parent->setViewport( viewport );
+    }
+}
+
+void DocumentPrivate::schedulePageSizesChanged()
 {
-    int multipliers = qMax(1, qRound(getTotalMemory() / 536870912.0)); // 512 MB
+    // generators usually update many pages in a row, relayout once for all of them
+    if ( !m_pageSizesChangedTimer )
+    {
+        m_pageSizesChangedTimer = new QTimer( m_parent );
+        m_pageSizesChangedTimer->setSingleShot( true );
+        m_pageSizesChangedTimer->setInterval( 250 );
+        QObject::connect( m_pageSizesChangedTimer, SIGNAL(timeout()), m_parent, SLOT(notifyPageSizesChanged()) );
+    }
+    if ( !m_pageSizesChangedTimer->isActive() )
+        m_pageSizesChangedTimer->start();
+}
+
+void DocumentPrivate::notifyPageSizesChanged()
+{
+    foreachObserverD( notifySetup( m_pagesVector, DocumentObserver::NewLayoutForPages ) );
+}
+
+void DocumentPrivate::calculateMaxTextPagesMemory()
+{
+    // about 64 KiB per page of text of a dense document, for every 512 MB of RAM
+    const qulonglong unit = 65536 * qMax(1, qRound(getTotalMemory() / 536870912.0)); // 512 MB
     switch (SettingsCore::memoryLevel())
     {
         case SettingsCore::EnumMemoryLevel::Low:
-            m_maxAllocatedTextPages = multipliers * 2;
+            m_maxAllocatedTextPagesMemory = unit * 2;
         break;
 
         case SettingsCore::EnumMemoryLevel::Normal:
-            m_maxAllocatedTextPages = multipliers * 50;
+            m_maxAllocatedTextPagesMemory = unit * 50;
         break;
 
         case SettingsCore::EnumMemoryLevel::Aggressive:
-            m_maxAllocatedTextPages = multipliers * 250;
+            m_maxAllocatedTextPagesMemory = unit * 250;
         break;
 
         case SettingsCore::EnumMemoryLevel::Greedy:
-            m_maxAllocatedTextPages = multipliers * 1250;
+            m_maxAllocatedTextPagesMemory = unit * 1250;
         break;
     }
 }
 
-void DocumentPrivate::textGenerationDone( Page *page )
+void DocumentPrivate::addAllocatedTextPage( int page )
 {
-    if ( !m_pageController ) return;
+    // a page whose text was generated again is accounted only once
+    if ( m_allocatedTextPagesIndex.contains( page ) )
+    {
+        QLinkedList< AllocatedTextPage * >::iterator it = m_allocatedTextPagesIndex.take( page );
+        m_allocatedTextPagesTotalMemory -= (*it)->memory;
+        delete *it;
+        m_allocatedTextPages.erase( it );
+    }
 
-    // 1. If we reached the cache limit, delete the first text page from the fifo
-    if (m_allocatedTextPagesFifo.size() == m_maxAllocatedTextPages)
+    const qulonglong memory = m_pagesVector.at( page )->d->textPageMemory();
+    m_allocatedTextPagesIndex.insert( page, m_allocatedTextPages.insert( m_allocatedTextPages.end(), new AllocatedTextPage( page, memory ) ) );
+    m_allocatedTextPagesTotalMemory += memory;
+}
+
+void DocumentPrivate::touchTextPage( int page )
+{
+    QHash< int, QLinkedList< AllocatedTextPage * >::iterator >::iterator indexIt = m_allocatedTextPagesIndex.find( page );
+    if ( indexIt == m_allocatedTextPagesIndex.end() )
+        return;
+
+    // move it to the most recently used end
+    AllocatedTextPage *textPage = *indexIt.value();
+    m_allocatedTextPages.erase( indexIt.value() );
+    indexIt.value() = m_allocatedTextPages.insert( m_allocatedTextPages.end(), textPage );
+}
+
+void DocumentPrivate::cleanupTextPageMemory( int keepPage )
+{
+    if ( m_allocatedTextPagesTotalMemory <= m_maxAllocatedTextPagesMemory )
+        return;
+
+    // never drop the text of what is on screen or what a running search is about to look at
+    QSet< int > pinnedPages;
+    if ( keepPage != -1 )
+        pinnedPages.insert( keepPage );
+    for ( const VisiblePageRect *rect : qAsConst( m_pageRects ) )
+        pinnedPages.insert( rect->pageNumber );
+    for ( QMultiHash< int, std::function<void()> >::const_iterator it = m_textPageWaiters.constBegin(); it != m_textPageWaiters.constEnd(); ++it )
+        pinnedPages.insert( it.key() );
+    for ( const RunningSearch *search : qAsConst( m_searches ) )
+    {
+        if ( !search->isCurrentlySearching )
+            continue;
+        for ( int page : search->textLookahead )
+            pinnedPages.insert( page );
+    }
+
+    QLinkedList< AllocatedTextPage * >::iterator it = m_allocatedTextPages.begin();
+    while ( it != m_allocatedTextPages.end() && m_allocatedTextPagesTotalMemory > m_maxAllocatedTextPagesMemory )
     {
-        int pageToKick = m_allocatedTextPagesFifo.takeFirst();
-        if (pageToKick != page->number()) // this should never happen but better be safe than sorry
+        AllocatedTextPage *textPage = *it;
+        if ( pinnedPages.contains( textPage->page ) )
         {
-            m_pagesVector.at(pageToKick)->setTextPage( nullptr ); // deletes the textpage
+            ++it;
+            continue;
         }
+
+        it = m_allocatedTextPages.erase( it );
+        m_allocatedTextPagesIndex.remove( textPage->page );
+        m_allocatedTextPagesTotalMemory -= textPage->memory;
+        m_pagesVector.at( textPage->page )->setTextPage( nullptr ); // deletes the textpage
+        delete textPage;
+    }
+
+    qCDebug(OkularCoreDebug) << "Text pages:" << m_allocatedTextPages.count() << "kept," << m_allocatedTextPagesTotalMemory << "bytes," << m_textPageHits << "hits," << m_textPageMisses << "misses";
+}
+
+bool DocumentPrivate::loadSnapshotTextPage( Page *page )
+{
+    if ( !m_textSnapshot.contains( page->number() ) )
+        return false;
+
+    TextPage *textPage = m_textSnapshot.textPage( page->number() );
+    if ( !textPage )
+        return false;
+
+    page->setTextPage( textPage );
+    addAllocatedTextPage( page->number() );
+    cleanupTextPageMemory( page->number() );
+    return true;
+}
+
+QString DocumentPrivate::textSnapshotFileName() const
+{
+    // the docdata file name, with .text instead of .xml
+    if ( m_xmlFileName.isEmpty() )
+        return QString();
+    QString fileName = m_xmlFileName;
+    fileName.chop( 4 );
+    return fileName + QStringLiteral(".text");
+}
+
+QByteArray DocumentPrivate::textSnapshotLayoutKey() const
+{
+    // the generator, and the size of the (unrotated) pages it laid out
+    QCryptographicHash hash( QCryptographicHash::Sha1 );
+    hash.addData( m_generatorName.toUtf8() );
+    for ( const Page *page : m_pagesVector )
+    {
+        const bool rotated = page->rotation() % 2;
+        hash.addData( QByteArray::number( rotated ? page->height() : page->width() ) );
+        hash.addData( QByteArray::number( rotated ? page->width() : page->height() ) );
+    }
+    return hash.result();
+}
+
+void DocumentPrivate::textGenerationDone( Page *page )
+{
+    if ( !m_pageController ) return;
+
+    if ( page->hasTextPage() )
+    {
+        // 1. Account the new text page as the most recently used one, and
+        // keep it for the next time the document is opened
+        addAllocatedTextPage( page->number() );
+        m_textSnapshot.insert( page->number(), page->d->m_text );
+
+        // 2. If we went over the cache limit, delete the least recently used text pages
+        cleanupTextPageMemory( page->number() );
     }
 
-    // 2. Add the page to the fifo of generated text pages
-    m_allocatedTextPagesFifo.append( page->number() );
+    // 3. Let the searches waiting for this page go on
+    const QList< std::function<void()> > waiters = m_textPageWaiters.values( page->number() );
+    m_textPageWaiters.remove( page->number() );
+    for ( const std::function<void()> &waiter : waiters )
+        waiter();
 }
 
 void Document::setRotation( int r )
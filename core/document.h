@@ -350,6 +350,15 @@ class OKULARCORE_EXPORT Document : public QObject
          */
         bool supportsTiles() const;
 
+        /**
+         * Returns whether the pixmap requests with the @ref PixmapRequest::Preload
+         * feature are honoured, they are dropped when the generator does not
+         * render in a thread.
+         *
+         * @since 1.4
+         */
+        bool supportsPreloading() const;
+
         /**
          * Returns the list of supported page sizes or an empty list if this
          * feature is not available.
@@ -487,6 +496,15 @@ class OKULARCORE_EXPORT Document : public QObject
          */
         void requestPixmaps( const QLinkedList<PixmapRequest*> &requests, PixmapRequestFlags reqOptions );
 
+        /**
+         * Deletes the pixmap of the page @p pageNumber generated for the
+         * @p observer, e.g. when the observer keeps a copy of it on its own
+         * and the page is not shown.
+         *
+         * @since 1.4
+         */
+        void deletePixmap( DocumentObserver *observer, int pageNumber );
+
         /**
          * Sends a request for text page generation for the given page @p number.
          */
@@ -576,6 +594,26 @@ class OKULARCORE_EXPORT Document : public QObject
          */
         void removePageAnnotations( int page, const QList<Annotation*> &annotations );
 
+        /**
+         * Starts a batch of annotation changes, which ends with endAnnotationBatch().
+         *
+         * The changes made in between are undone in a single step named @p text,
+         * the observers are told once about every changed page when the batch
+         * ends, and the generator can apply the changes in bulk.
+         *
+         * Batches can be nested, the inner ones are part of the outermost.
+         *
+         * @since 1.4
+         */
+        void beginAnnotationBatch( const QString &text );
+
+        /**
+         * Ends the batch of annotation changes started with beginAnnotationBatch().
+         *
+         * @since 1.4
+         */
+        void endAnnotationBatch();
+
         /**
          * Sets the text selection for the given @p page.
          *
@@ -1206,7 +1244,8 @@ class OKULARCORE_EXPORT Document : public QObject
 
         Q_DISABLE_COPY( Document )
 
-        Q_PRIVATE_SLOT( d, void saveDocumentInfo() const )
+        Q_PRIVATE_SLOT( d, void saveDocumentInfo() )
+        Q_PRIVATE_SLOT( d, void restorePendingPageInfo() )
         Q_PRIVATE_SLOT( d, void slotTimedMemoryCheck() )
         Q_PRIVATE_SLOT( d, void sendGeneratorPixmapRequest() )
         Q_PRIVATE_SLOT( d, void rotationFinished( int page, Okular::Page *okularPage ) )
@@ -1214,12 +1253,13 @@ class OKULARCORE_EXPORT Document : public QObject
         Q_PRIVATE_SLOT( d, void fontReadingGotFont( const Okular::FontInfo& font ) )
         Q_PRIVATE_SLOT( d, void slotGeneratorConfigChanged( const QString& ) )
         Q_PRIVATE_SLOT( d, void refreshPixmaps( int ) )
+        Q_PRIVATE_SLOT( d, void notifyPageSizesChanged() )
         Q_PRIVATE_SLOT( d, void _o_configChanged() )
 
         // search thread simulators
         Q_PRIVATE_SLOT( d, void doContinueDirectionMatchSearch(void *doContinueDirectionMatchSearchStruct) )
-        Q_PRIVATE_SLOT( d, void doContinueAllDocumentSearch(void *pagesToNotifySet, void *pageMatchesMap, int currentPage, int searchID) )
-        Q_PRIVATE_SLOT( d, void doContinueGooglesDocumentSearch(void *pagesToNotifySet, void *pageMatchesMap, int currentPage, int searchID, const QStringList & words) )
+        Q_PRIVATE_SLOT( d, void doContinueAllDocumentSearch(void *pagesToNotifySet, int currentPage, int searchID) )
+        Q_PRIVATE_SLOT( d, void doContinueGooglesDocumentSearch(void *pagesToNotifySet, int currentPage, int searchID, const QStringList & words) )
 };
 
 
@@ -24,18 +24,24 @@
 #include <QUrl>
 #include <KPluginMetaData>
 
+#include <functional>
+
 // local includes
 #include "fontinfo.h"
+#include "docdatawriter_p.h"
 #include "generator.h"
+#include "textsnapshot_p.h"
 
 class QUndoStack;
 class QEventLoop;
 class QFile;
 class QTimer;
 class QTemporaryFile;
+class QXmlStreamReader;
 class KPluginMetaData;
 
 struct AllocatedPixmap;
+struct AllocatedTextPage;
 struct ArchiveData;
 struct RunningSearch;
 
@@ -91,13 +97,18 @@ class DocumentPrivate
             m_tempFile( nullptr ),
             m_docSize( -1 ),
             m_allocatedPixmapsTotalMemory( 0 ),
-            m_maxAllocatedTextPages( 0 ),
+            m_allocatedTextPagesTotalMemory( 0 ),
+            m_maxAllocatedTextPagesMemory( 0 ),
+            m_textPageHits( 0 ),
+            m_textPageMisses( 0 ),
             m_warnedOutOfMemory( false ),
             m_rotation( Rotation0 ),
             m_exportCached( false ),
             m_bookmarkManager( nullptr ),
             m_memCheckTimer( nullptr ),
             m_saveBookmarksTimer( nullptr ),
+            m_pageSizesChangedTimer( nullptr ),
+            m_pendingPageInfoTimer( nullptr ),
             m_generator( nullptr ),
             m_walletGenerator( nullptr ),
             m_generatorsLoaded( false ),
@@ -108,10 +119,13 @@ class DocumentPrivate
             m_fontsCached( false ),
             m_annotationEditingEnabled ( true ),
             m_annotationBeingModified( false ),
+            m_annotationBatchDepth( 0 ),
+            m_annotationChangesDepth( 0 ),
             m_docdataMigrationNeeded( false ),
+            m_laterViewportFrom( -1 ),
             m_synctex_scanner( nullptr )
         {
-            calculateMaxTextPages();
+            calculateMaxTextPagesMemory();
         }
 
         // private methods
@@ -123,13 +137,22 @@ class DocumentPrivate
         void cleanupPixmapMemory();
         void cleanupPixmapMemory( qulonglong memoryToFree );
         AllocatedPixmap * searchLowestPriorityPixmap( bool unloadableOnly = false, bool thenRemoveIt = false, DocumentObserver *observer = nullptr /* any */ );
-        void calculateMaxTextPages();
+        void calculateMaxTextPagesMemory();
+        void addAllocatedTextPage( int page );
+        void touchTextPage( int page );
+        void cleanupTextPageMemory( int keepPage = -1 );
+        bool loadSnapshotTextPage( Page *page );
+        QString textSnapshotFileName() const;
+        QByteArray textSnapshotLayoutKey() const;
         qulonglong getTotalMemory();
         qulonglong getFreeMemory( qulonglong *freeSwap = nullptr );
         bool loadDocumentInfo( LoadDocumentInfoFlags loadWhat );
         bool loadDocumentInfo( QFile &infoFile, LoadDocumentInfoFlags loadWhat );
-        void loadViewsInfo( View *view, const QDomElement &e );
-        void saveViewsInfo( View *view, QDomElement &e ) const;
+        void loadViewsInfo( View *view, QXmlStreamReader &reader );
+        void saveViewsInfo( View *view, DocdataElement &e ) const;
+        void restorePageInfo( int page );
+        void restoreAllPageInfo();
+        void saveLaterPageInfo( QDomNode &pageList, QDomDocument &doc ) const;
         QUrl giveAbsoluteUrl( const QString & fileName ) const;
         bool openRelativeFile( const QString & fileName );
         Generator * loadGeneratorLibrary( const KPluginMetaData& service );
@@ -145,6 +168,9 @@ class DocumentPrivate
         bool savePageDocumentInfo( QTemporaryFile *infoFile, int what ) const;
         DocumentViewport nextDocumentViewport() const;
         void notifyAnnotationChanges( int page );
+        void beginAnnotationChanges();
+        void endAnnotationChanges();
+        void refreshAnnotationPixmaps( int page );
         void notifyFormChanges( int page );
         bool canAddAnnotationsNatively() const;
         bool canModifyExternalAnnotations() const;
@@ -160,7 +186,8 @@ class DocumentPrivate
         void recalculateForms();
 
         // private slots
-        void saveDocumentInfo() const;
+        void saveDocumentInfo();
+        void restorePendingPageInfo();
         void slotTimedMemoryCheck();
         void sendGeneratorPixmapRequest();
         void rotationFinished( int page, Okular::Page *okularPage );
@@ -168,13 +195,34 @@ class DocumentPrivate
         void fontReadingGotFont( const Okular::FontInfo& font );
         void slotGeneratorConfigChanged( const QString& );
         void refreshPixmaps( int );
+        void notifyPageSizesChanged();
         void _o_configChanged();
         void doContinueDirectionMatchSearch(void *doContinueDirectionMatchSearchStruct);
-        void doContinueAllDocumentSearch(void *pagesToNotifySet, void *pageMatchesMap, int currentPage, int searchID);
-        void doContinueGooglesDocumentSearch(void *pagesToNotifySet, void *pageMatchesMap, int currentPage, int searchID, const QStringList & words);
+        void doContinueAllDocumentSearch(void *pagesToNotifySet, int currentPage, int searchID);
+        void doContinueGooglesDocumentSearch(void *pagesToNotifySet, int currentPage, int searchID, const QStringList & words);
 
         void doProcessSearchMatch( RegularAreaRect *match, RunningSearch *search, QSet< int > *pagesToNotify, int currentPage, int searchID, bool moveViewport, const QColor & color );
 
+        /**
+         * Tells the observers about the highlights of @p pageNumber if it is
+         * in @p pagesToNotify, and takes it out of the set.
+         */
+        void notifySearchHighlights( int pageNumber, QSet< int > *pagesToNotify );
+
+        /**
+         * Ends a search of the whole document, telling the observers about the
+         * pages left in @p pagesToNotify, which is deleted.
+         */
+        void finishAllDocumentSearch( RunningSearch *search, QSet< int > *pagesToNotify, int searchID, Document::SearchStatus status );
+
+        /**
+         * Returns true if @p search has to wait for the text of @p pageNumber,
+         * which is then extracted in the text thread together with the next
+         * pages in the search direction, and @p continuation is called once
+         * it is done. Returns false if the page can be searched right away.
+         */
+        bool waitForTextPage( RunningSearch *search, int pageNumber, bool forward, const std::function<void()> &continuation );
+
         // generators stuff
         /**
          * This method is used by the generators to signal the finish of
@@ -187,6 +235,23 @@ class DocumentPrivate
          */
         void setPageBoundingBox( int page, const NormalizedRect& boundingBox );
 
+        /**
+         * Sets the size of the given @p page (in terms of upright orientation, i.e., Rotation0).
+         */
+        void setPageSize( int page, const QSizeF &size );
+
+        /**
+         * Sets the number of pages to @p count, adding pages of @p size (in
+         * terms of upright orientation) or removing the last ones.
+         */
+        void setPageCount( int count, const QSizeF &size );
+
+        /**
+         * Tells the observers about the new layout of the pages once the
+         * generator is done changing them for a while.
+         */
+        void schedulePageSizesChanged();
+
         /**
          * Request a particular metadata of the Document itself (ie, not something
          * depending on the document type/backend).
@@ -233,8 +298,18 @@ class DocumentPrivate
         QMutex m_pixmapRequestsMutex;
         QLinkedList< AllocatedPixmap * > m_allocatedPixmaps;
         qulonglong m_allocatedPixmapsTotalMemory;
-        QList< int > m_allocatedTextPagesFifo;
-        int m_maxAllocatedTextPages;
+        // pages with a text page, least recently used first
+        QLinkedList< AllocatedTextPage * > m_allocatedTextPages;
+        QHash< int, QLinkedList< AllocatedTextPage * >::iterator > m_allocatedTextPagesIndex;
+        qulonglong m_allocatedTextPagesTotalMemory;
+        qulonglong m_maxAllocatedTextPagesMemory;
+        // text page lookups served from the cache and those that needed extraction
+        int m_textPageHits;
+        int m_textPageMisses;
+        // the text extracted the previous times the document was open
+        TextSnapshot m_textSnapshot;
+        // searches waiting for the text of a page, see waitForTextPage()
+        QMultiHash< int, std::function<void()> > m_textPageWaiters;
         bool m_warnedOutOfMemory;
 
         // the rotation applied to the document
@@ -256,6 +331,12 @@ class DocumentPrivate
         // timers (memory checking / info saver)
         QTimer *m_memCheckTimer;
         QTimer *m_saveBookmarksTimer;
+        // writes the docdata files off the GUI thread
+        DocdataWriter m_docdataWriter;
+        // coalesces the relayouts caused by generators updating page sizes
+        QTimer *m_pageSizesChangedTimer;
+        // restores the pending page contents in the background
+        QTimer *m_pendingPageInfoTimer;
 
         QHash<QString, GeneratorInfo> m_loadedGenerators;
         Generator * m_generator;
@@ -286,6 +367,13 @@ class DocumentPrivate
 
         bool m_annotationEditingEnabled;
         bool m_annotationBeingModified; // is an annotation currently being moved or resized?
+        // nesting of Document::beginAnnotationBatch(), and of the batched
+        // annotation changes, that also happen when a batch is undone or redone
+        int m_annotationBatchDepth;
+        int m_annotationChangesDepth;
+        // pages to notify and to render again when the changes end
+        QSet< int > m_changedAnnotationPages;
+        QSet< int > m_annotationPixmapsToRefresh;
         bool m_metadataLoadingCompleted;
 
         QUndoStack *m_undoStack;
@@ -298,6 +386,22 @@ class DocumentPrivate
         // for the current document contains any annotation or form.
         bool m_docdataMigrationNeeded;
 
+        // The page contents (annotations, forms) read from the metadata are
+        // only indexed when the document is opened, and restored when the
+        // page is first needed: the offset and length of the <page> element
+        // of every page not restored yet in m_pendingPageInfoXml
+        QMap< int, QPair< int, int > > m_pendingPageInfo;
+        QString m_pendingPageInfoXml;
+        // pages whose restored annotations the observers were not told about yet
+        QSet< int > m_restoredAnnotationPages;
+
+        // While the page count is an estimate, the contents of the pages past
+        // it and the viewport past it are kept until the pages are added; the
+        // viewport only if the document is still shown at m_laterViewportFrom
+        QMap< int, QString > m_laterPageInfo;
+        DocumentViewport m_laterViewport;
+        int m_laterViewportFrom;
+
         synctex_scanner_p m_synctex_scanner;
 
         // generator selection
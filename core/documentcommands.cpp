@@ -28,6 +28,10 @@ void moveViewportIfBoundingRectNotFullyVisible( Okular::NormalizedRect boundingR
                                                 DocumentPrivate *docPriv,
                                                 int pageNumber )
 {
+    // a batch of changes does not move the view around
+    if ( docPriv->m_annotationChangesDepth > 0 )
+        return;
+
     const Rotation pageRotation = docPriv->m_parent->page( pageNumber )->rotation();
     const QTransform rotationMatrix = Okular::buildRotationMatrix( pageRotation );
     boundingRect.transform( rotationMatrix );
@@ -749,5 +753,32 @@ void EditFormButtonsCommand::clearFormButtonStates()
     }
 }
 
+AnnotationBatchCommand::AnnotationBatchCommand( Okular::DocumentPrivate* docPriv, Boundary boundary )
+ : m_docPriv( docPriv ),
+   m_boundary( boundary )
+{
+}
+
+void AnnotationBatchCommand::undo()
+{
+    // the macro is undone backwards
+    if ( m_boundary == BatchEnd )
+        m_docPriv->beginAnnotationChanges();
+    else
+        m_docPriv->endAnnotationChanges();
+}
+
+void AnnotationBatchCommand::redo()
+{
+    if ( m_boundary == BatchBegin )
+        m_docPriv->beginAnnotationChanges();
+    else
+        m_docPriv->endAnnotationChanges();
+}
+
+bool AnnotationBatchCommand::refreshInternalPageReferences( const QVector< Okular::Page * > & )
+{
+    return true;
 }
 
+}
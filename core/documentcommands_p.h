@@ -310,6 +310,29 @@ class EditFormButtonsCommand : public OkularUndoCommand
         QList< bool > m_prevButtonStates;
 };
 
+/* Pushed at both ends of the undo macro of an annotation batch, so that
+ * the annotation changes are also batched when the macro is undone or redone */
+class AnnotationBatchCommand : public OkularUndoCommand
+{
+    public:
+        enum Boundary
+        {
+            BatchBegin,
+            BatchEnd
+        };
+
+        AnnotationBatchCommand( Okular::DocumentPrivate* docPriv, Boundary boundary );
+
+        void undo() override;
+        void redo() override;
+
+        bool refreshInternalPageReferences( const QVector< Okular::Page * > &newPagesVector ) override;
+
+    private:
+        Okular::DocumentPrivate* m_docPriv;
+        Boundary m_boundary;
+};
+
 }
 #endif
 
@@ -37,7 +37,7 @@ using namespace Okular;
 GeneratorPrivate::GeneratorPrivate()
     : m_document( nullptr ),
       mPixmapGenerationThread( nullptr ), mTextPageGenerationThread( nullptr ),
-      m_mutex( nullptr ), m_threadsMutex( nullptr ), mPixmapReady( true ), mTextPageReady( true ),
+      m_mutex( nullptr ), m_threadsMutex( nullptr ), mPendingPageCount( -1 ), mPixmapReady( true ), mTextPageReady( true ),
       m_closing( false ), m_closingLoop( nullptr ),
       m_dpi(72.0, 72.0)
 {
@@ -113,12 +113,17 @@ void GeneratorPrivate::pixmapGenerationFinished()
     if ( mPixmapGenerationThread->calcBoundingBox() )
         q->updatePageBoundingBox( pageNumber, mPixmapGenerationThread->boundingBox() );
     q->signalPixmapRequestDone( request );
+
+    locker.unlock();
+    applyPageCount();
+    startTextJobs();
 }
 
 void GeneratorPrivate::textpageGenerationFinished()
 {
     Q_Q( Generator );
-    Page *page = mTextPageGenerationThread->page();
+    const QVector<Page *> pages = mTextPageGenerationThread->pages();
+    const QVector<TextPage *> textPages = mTextPageGenerationThread->textPages();
     mTextPageGenerationThread->endGeneration();
 
     QMutexLocker locker( threadsLock() );
@@ -126,7 +131,7 @@ void GeneratorPrivate::textpageGenerationFinished()
 
     if ( m_closing )
     {
-        delete mTextPageGenerationThread->textPage();
+        qDeleteAll( textPages );
         if ( mPixmapReady )
         {
             locker.unlock();
@@ -134,13 +139,122 @@ void GeneratorPrivate::textpageGenerationFinished()
         }
         return;
     }
+    locker.unlock();
 
-    if ( mTextPageGenerationThread->textPage() )
+    for ( int i = 0; i < textPages.count(); ++i )
     {
-        TextPage *tp = mTextPageGenerationThread->textPage();
-        page->setTextPage( tp );
+        Page *page = pages.at( i );
+        TextPage *tp = textPages.at( i );
+        // the text may have been extracted synchronously in the meantime
+        if ( page->hasTextPage() )
+        {
+            delete tp;
+            continue;
+        }
+
+        if ( tp )
+            page->setTextPage( tp );
+        // also without text, so whoever waits for it can go on
         q->signalTextGenerationDone( page, tp );
     }
+
+    applyPageCount();
+    startTextJobs();
+}
+
+void GeneratorPrivate::queueTextPage( Page *page, DocumentObserver *observer, int priority )
+{
+    if ( page->hasTextPage() || m_closing )
+        return;
+
+    for ( int i = 0; i < mTextJobs.count(); ++i )
+    {
+        if ( mTextJobs.at( i ).page != page )
+            continue;
+        if ( mTextJobs.at( i ).priority <= priority )
+            return;
+        mTextJobs.removeAt( i );
+        break;
+    }
+
+    const TextJob job = { page, observer, priority };
+    int pos = mTextJobs.count();
+    while ( pos > 0 && mTextJobs.at( pos - 1 ).priority > priority )
+        --pos;
+    mTextJobs.insert( pos, job );
+}
+
+void GeneratorPrivate::cancelTextPages( DocumentObserver *observer, const QSet<int> &keep )
+{
+    QList<TextJob>::iterator it = mTextJobs.begin();
+    while ( it != mTextJobs.end() )
+    {
+        if ( it->priority != UserTextJob && it->observer == observer && !keep.contains( it->page->number() ) )
+            it = mTextJobs.erase( it );
+        else
+            ++it;
+    }
+}
+
+void GeneratorPrivate::startTextJobs()
+{
+    // the pages of a batch are extracted in one run of the thread
+    static const int TextJobBatchSize = 8;
+
+    if ( !mTextPageReady || m_closing || mTextJobs.isEmpty() )
+        return;
+
+    // only the text the user waits for is extracted next to a pixmap
+    // generation, the rest waits so it never delays the pixmaps
+    const int priority = mTextJobs.first().priority;
+    if ( priority != UserTextJob && !mPixmapReady )
+        return;
+
+    QVector<Page *> pages;
+    pages.append( mTextJobs.takeFirst().page );
+    bool found = true;
+    while ( found && pages.count() < TextJobBatchSize )
+    {
+        found = false;
+        const int next = pages.last()->number() + 1;
+        for ( int i = 0; i < mTextJobs.count() && mTextJobs.at( i ).priority == priority; ++i )
+        {
+            if ( mTextJobs.at( i ).page->number() == next )
+            {
+                pages.append( mTextJobs.takeAt( i ).page );
+                found = true;
+                break;
+            }
+        }
+    }
+
+    mTextPageReady = false;
+    textPageGenerationThread()->startGeneration( pages, priority == UserTextJob ? QThread::InheritPriority : QThread::LowPriority,
+                                                 m_document ? &m_document->m_textSnapshot : nullptr );
+}
+
+void GeneratorPrivate::applyPageCount()
+{
+    if ( mPendingPageCount < 0 || !m_document )
+        return;
+
+    // the threads hold on to the pages they work on
+    if ( mPendingPageCount < m_document->m_pagesVector.count() && !( mPixmapReady && mTextPageReady ) )
+        return;
+
+    const int count = mPendingPageCount;
+    mPendingPageCount = -1;
+
+    QList<TextJob>::iterator it = mTextJobs.begin();
+    while ( it != mTextJobs.end() )
+    {
+        if ( it->page->number() >= count )
+            it = mTextJobs.erase( it );
+        else
+            ++it;
+    }
+
+    m_document->setPageCount( count, mPendingPageSize );
 }
 
 QMutex* GeneratorPrivate::threadsLock()
@@ -213,6 +327,10 @@ bool Generator::closeDocument()
     Q_D( Generator );
 
     d->m_closing = true;
+    d->mTextJobs.clear();
+    d->mPendingPageCount = -1;
+    if ( d->mTextPageGenerationThread )
+        d->mTextPageGenerationThread->abortGeneration();
 
     d->threadsLock()->lock();
     if ( !( d->mPixmapReady && d->mTextPageReady ) )
@@ -258,11 +376,12 @@ void Generator::generatePixmap( PixmapRequest *request )
         /**
          * We create the text page for every page that is visible to the
          * user, so he can use the text extraction tools without a delay.
+         * The job waits for the pixmap generation to finish.
          */
-        if ( hasFeature( TextExtraction ) && !request->page()->hasTextPage() && canGenerateTextPage() && !d->m_closing ) {
-            d->mTextPageReady = false;
-            // Queue the text generation request so that pixmap generation gets a chance to start before the text generation
-            QMetaObject::invokeMethod(d->textPageGenerationThread(), "startGeneration", Qt::QueuedConnection, Q_ARG(Okular::Page*, request->page()));
+        if ( hasFeature( TextExtraction ) )
+        {
+            d->queueTextPage( request->page(), request->observer(), request->preload() ? GeneratorPrivate::PrefetchTextJob : GeneratorPrivate::VisibleTextJob );
+            d->startTextJobs();
         }
 
         return;
@@ -303,6 +422,11 @@ TextPage* Generator::textPage( Page* )
     return nullptr;
 }
 
+bool Generator::searchCandidatePages( const QString&, Document::SearchType, QVector<int>* )
+{
+    return false;
+}
+
 DocumentInfo Generator::generateDocumentInfo(const QSet<DocumentInfo::Key> &keys) const
 {
     Q_UNUSED(keys);
@@ -482,6 +606,24 @@ void Generator::updatePageBoundingBox( int page, const NormalizedRect & bounding
         d->m_document->setPageBoundingBox( page, boundingBox );
 }
 
+void Generator::updatePageSize( int page, const QSizeF & size )
+{
+    Q_D( Generator );
+    if ( d->m_document ) // still connected to document?
+        d->m_document->setPageSize( page, size );
+}
+
+void Generator::updatePageCount( int count, const QSizeF & size )
+{
+    Q_D( Generator );
+    if ( !d->m_document || count <= 0 ) // still connected to document?
+        return;
+
+    d->mPendingPageCount = count;
+    d->mPendingPageSize = size;
+    d->applyPageCount();
+}
+
 void Generator::requestFontData(const Okular::FontInfo & /*font*/, QByteArray * /*data*/)
 {
 
@@ -559,6 +701,11 @@ bool PixmapRequest::preload() const
     return d->mFeatures & Preload;
 }
 
+bool PixmapRequest::thumbnail() const
+{
+    return d->mFeatures & Thumbnail;
+}
+
 Page* PixmapRequest::page() const
 {
     return d->mPage;
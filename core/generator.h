@@ -212,7 +212,9 @@ class OKULARCORE_EXPORT Generator : public QObject
             PrintPostscript,   ///< Whether the Generator supports postscript-based file printing.
             PrintToFile,       ///< Whether the Generator supports export to PDF & PS through the Print Dialog
             TiledRendering,    ///< Whether the Generator can render tiles @since 0.16 (KDE 4.10)
-            SwapBackingFile    ///< Whether the Generator can hot-swap the file it's reading from @since 1.3
+            SwapBackingFile,   ///< Whether the Generator can hot-swap the file it's reading from @since 1.3
+            IndexedSearch,     ///< Whether the Generator can tell which pages may match a search, see searchCandidatePages() @since 1.4
+            EstimatedPageCount ///< Whether the page count is an estimate the Generator still corrects with updatePageCount() @since 1.4
         };
 
         /**
@@ -533,6 +535,19 @@ class OKULARCORE_EXPORT Generator : public QObject
          */
         virtual TextPage* textPage( Page *page );
 
+        /**
+         * This method is called before searching the document for @p text with
+         * the search @p type, if the generator has the @ref IndexedSearch feature.
+         *
+         * Return true and fill @p pages with the numbers of the pages that may
+         * contain a match to have the text of every other page left alone, or
+         * false to search all the pages. The result may contain pages without
+         * a match, but must never leave out a page with one.
+         *
+         * @since 1.4
+         */
+        virtual bool searchCandidatePages( const QString &text, Document::SearchType type, QVector<int> *pages );
+
         /**
          * Returns a pointer to the document.
          */
@@ -581,6 +596,28 @@ class OKULARCORE_EXPORT Generator : public QObject
          */
         void updatePageBoundingBox( int page, const NormalizedRect & boundingBox );
 
+        /**
+         * Set the size of a page after the page has already been handed
+         * to the Document, for example when the document was opened with
+         * estimated page sizes that are measured later. The observers are
+         * notified of the new layout once a burst of updates is over.
+         *
+         * @since 1.4
+         */
+        void updatePageSize( int page, const QSizeF & size );
+
+        /**
+         * Set the number of pages after the document has already been handed
+         * to the Document, for example when the document was opened with an
+         * estimated page count that is known exactly once it is laid out.
+         * Pages of @p size are added at the end, or the last pages are
+         * removed once the Generator is not rendering anything. The observers
+         * are notified of a new layout even if the count did not change.
+         *
+         * @since 1.4
+         */
+        void updatePageCount( int count, const QSizeF & size );
+
         /**
          * Returns DPI, previously set via setDPI()
          * @since 0.19 (KDE 4.13)
@@ -638,7 +675,8 @@ class OKULARCORE_EXPORT PixmapRequest
         {
             NoFeature = 0,
             Asynchronous = 1,
-            Preload = 2
+            Preload = 2,
+            Thumbnail = 4   ///< The pixmap is a thumbnail, see thumbnail() @since 1.4
         };
         Q_DECLARE_FLAGS( PixmapRequestFeatures, PixmapRequestFeature )
 
@@ -700,6 +738,14 @@ class OKULARCORE_EXPORT PixmapRequest
          */
         bool preload() const;
 
+        /**
+         * Returns whether the pixmap is a thumbnail of the page, that the
+         * generator can render faster at a lower quality.
+         *
+         * @since 1.4
+         */
+        bool thumbnail() const;
+
         /**
          * Returns a pointer to the page where the pixmap shall be generated for.
          */
@@ -13,6 +13,9 @@
 
 #include "fontinfo.h"
 #include "generator.h"
+#include "textpage.h"
+#include "textpage_p.h"
+#include "textsnapshot_p.h"
 #include "utils.h"
 
 using namespace Okular;
@@ -69,38 +72,78 @@ void PixmapGenerationThread::run()
 
 
 TextPageGenerationThread::TextPageGenerationThread( Generator *generator )
-    : mGenerator( generator ), mPage( nullptr )
+    : mGenerator( generator ), mSnapshot( nullptr )
 {
 }
 
-void TextPageGenerationThread::startGeneration( Page *page )
+void TextPageGenerationThread::startGeneration( const QVector<Page *> &pages, QThread::Priority priority, const TextSnapshot *snapshot )
 {
-    mPage = page;
+    mPages = pages;
+    mSnapshot = snapshot;
+    mPageNumbers.clear();
+    mPageSizes.clear();
+    mBoundingBoxes.clear();
+    for ( const Page *page : pages )
+    {
+        mPageNumbers.append( page->number() );
+        mPageSizes.append( QSizeF( page->width(), page->height() ) );
+        mBoundingBoxes.append( page->boundingBox() );
+    }
+    mAbort.store( 0 );
 
-    start( QThread::InheritPriority );
+    start( priority );
 }
 
 void TextPageGenerationThread::endGeneration()
 {
-    mPage = nullptr;
+    mPages.clear();
+    mSnapshot = nullptr;
+    mPageNumbers.clear();
+    mPageSizes.clear();
+    mBoundingBoxes.clear();
+    mTextPages.clear();
 }
 
-Page *TextPageGenerationThread::page() const
+void TextPageGenerationThread::abortGeneration()
 {
-    return mPage;
+    mAbort.store( 1 );
 }
 
-TextPage* TextPageGenerationThread::textPage() const
+QVector<Page *> TextPageGenerationThread::pages() const
 {
-    return mTextPage;
+    return mPages;
+}
+
+QVector<TextPage *> TextPageGenerationThread::textPages() const
+{
+    return mTextPages;
 }
 
 void TextPageGenerationThread::run()
 {
-    mTextPage = nullptr;
+    mTextPages.clear();
 
-    if ( mPage )
-        mTextPage = mGenerator->textPage( mPage );
+    for ( int i = 0; i < mPages.count(); ++i )
+    {
+        if ( mAbort.load() )
+            break;
+        // the text saved the last time is in reading order already
+        TextPage *textPage = mSnapshot ? mSnapshot->textPage( mPageNumbers.at( i ) ) : nullptr;
+        if ( textPage )
+        {
+            mTextPages.append( textPage );
+            continue;
+        }
+
+        textPage = mGenerator->textPage( mPages.at( i ) );
+        // the layout analysis runs here rather than when the GUI thread sets the text
+        if ( textPage )
+        {
+            const QSizeF &size = mPageSizes.at( i );
+            TextPagePrivate::get( textPage )->correctTextOrder( size.width(), size.height(), mBoundingBoxes.at( i ) );
+        }
+        mTextPages.append( textPage );
+    }
 }
 
 
@@ -15,8 +15,12 @@
 
 #include "area.h"
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QList>
 #include <QtCore/QSet>
+#include <QtCore/QSizeF>
 #include <QtCore/QThread>
+#include <QtCore/QVector>
 #include <QtGui/QImage>
 
 class QEventLoop;
@@ -35,6 +39,7 @@ class PixmapGenerationThread;
 class PixmapRequest;
 class TextPage;
 class TextPageGenerationThread;
+class TextSnapshot;
 class TilesManager;
 
 class GeneratorPrivate
@@ -53,6 +58,47 @@ class GeneratorPrivate
         void pixmapGenerationFinished();
         void textpageGenerationFinished();
 
+        /**
+         * The priorities of the text extraction jobs, a lower value runs first.
+         */
+        enum TextJobPriority
+        {
+            UserTextJob,      ///< Searches and other things the user waits on
+            VisibleTextJob,   ///< Pages visible in an observer
+            PrefetchTextJob   ///< Pages preloaded around the visible ones
+        };
+
+        struct TextJob
+        {
+            Page *page;
+            DocumentObserver *observer;
+            int priority;
+        };
+
+        /**
+         * Queues the extraction of the text of @p page in the text thread,
+         * or raises the priority of the job already queued for it.
+         * startTextJobs() has to be called once all the jobs are queued.
+         */
+        void queueTextPage( Page *page, DocumentObserver *observer, int priority );
+
+        /**
+         * Drops the visible and prefetch jobs queued for @p observer,
+         * except the ones for the pages in @p keep.
+         */
+        void cancelTextPages( DocumentObserver *observer, const QSet<int> &keep );
+
+        /**
+         * Starts the most important queued jobs if the text thread is idle.
+         */
+        void startTextJobs();
+
+        /**
+         * Sets the page count asked for with Generator::updatePageCount(),
+         * pages are only removed once no thread works on them.
+         */
+        void applyPageCount();
+
         QMutex* threadsLock();
 
         virtual QVariant metaData( const QString &key, const QVariant &option ) const;
@@ -66,6 +112,11 @@ class GeneratorPrivate
         TextPageGenerationThread *mTextPageGenerationThread;
         mutable QMutex *m_mutex;
         QMutex *m_threadsMutex;
+        // sorted by priority, in queuing order for the same priority
+        QList<TextJob> mTextJobs;
+        // the page count to set, -1 if none
+        int mPendingPageCount;
+        QSizeF mPendingPageSize;
         bool mPixmapReady : 1;
         bool mTextPageReady : 1;
         bool m_closing : 1;
@@ -130,22 +181,42 @@ class TextPageGenerationThread : public QThread
     public:
         TextPageGenerationThread( Generator *generator );
 
+        /**
+         * Extracts the text of @p pages, one after the other. The geometry
+         * of the pages is taken now, the thread does not read the pages.
+         * The text of the pages in @p snapshot, if any, is read from there.
+         */
+        void startGeneration( const QVector<Page *> &pages, QThread::Priority priority, const TextSnapshot *snapshot );
+
         void endGeneration();
 
-        Page *page() const;
+        /**
+         * Makes the running generation stop after the current page.
+         */
+        void abortGeneration();
 
-        TextPage* textPage() const;
+        QVector<Page *> pages() const;
 
-    public slots:
-        void startGeneration( Okular::Page *page );
+        /**
+         * The text pages of pages(), in the same order. Shorter than
+         * pages() if the generation was aborted.
+         */
+        QVector<TextPage *> textPages() const;
 
     protected:
         void run() override;
 
     private:
         Generator *mGenerator;
-        Page *mPage;
-        TextPage *mTextPage;
+        QVector<Page *> mPages;
+        const TextSnapshot *mSnapshot;
+        // the number, size and bounding box of mPages, for the snapshot and
+        // the layout analysis
+        QVector<int> mPageNumbers;
+        QVector<QSizeF> mPageSizes;
+        QVector<NormalizedRect> mBoundingBoxes;
+        QVector<TextPage *> mTextPages;
+        QAtomicInt mAbort;
 };
 
 class FontExtractionThread : public QThread
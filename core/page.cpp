@@ -574,9 +574,11 @@ void Page::setTextPage( TextPage * textPage )
     {
         d->m_text->d->m_page = this;
         /**
-         * Correct text order for before text selection
+         * Correct text order for before text selection, unless the
+         * text thread already did it
          */
-        d->m_text->d->correctTextOrder();
+        if ( !d->m_text->d->m_textOrderCorrected )
+            d->m_text->d->correctTextOrder();
     }
 }
 
@@ -598,6 +600,22 @@ void Page::setObjectRects( const QLinkedList< ObjectRect * > & rects )
     m_rects << rects;
 }
 
+void PagePrivate::addObjectRects( const QLinkedList< ObjectRect * > & rects )
+{
+    const QTransform matrix = rotationMatrix();
+
+    QLinkedList< ObjectRect * >::const_iterator objectIt = rects.begin(), end = rects.end();
+    for ( ; objectIt != end; ++objectIt )
+        (*objectIt)->transform( matrix );
+
+    m_page->m_rects << rects;
+}
+
+qulonglong PagePrivate::textPageMemory() const
+{
+    return m_text ? m_text->d->memoryUsage() : 0;
+}
+
 void PagePrivate::setHighlight( int s_id, RegularAreaRect *rect, const QColor & color )
 {
     HighlightAreaRect * hr = new HighlightAreaRect(rect);
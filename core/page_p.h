@@ -92,6 +92,18 @@ class PagePrivate
          */
         void changeSize( const PageSize &size );
 
+        /**
+         * Adds the object @p rects to the ones the page already has, unlike
+         * Page::setObjectRects() that replaces them.
+         */
+        void addObjectRects( const QLinkedList< ObjectRect * > & rects );
+
+        /**
+         * Returns an estimate of the memory used by the text page, in bytes,
+         * 0 if the page has no text page.
+         */
+        qulonglong textPageMemory() const;
+
         /**
          * Sets the @p color and @p areas of text selections.
          */
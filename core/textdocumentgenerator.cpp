@@ -10,6 +10,8 @@
 #include "textdocumentgenerator.h"
 #include "textdocumentgenerator_p.h"
 
+#include <limits.h>
+
 #include <QtCore/QFile>
 #include <QtCore/QMutex>
 #include <QtCore/QStack>
@@ -24,9 +26,11 @@
 #include "action.h"
 #include "annotations.h"
 #include "page.h"
+#include "page_p.h"
 #include "textpage.h"
 
 #include "document.h"
+#include "document_p.h"
 
 using namespace Okular;
 
@@ -60,6 +64,15 @@ QTextDocument *TextDocumentConverter::document()
     return d_ptr->mDocument;
 }
 
+void TextDocumentConverter::convertNextPart()
+{
+}
+
+int TextDocumentConverter::pendingPagesEstimate() const
+{
+    return 0;
+}
+
 void TextDocumentConverter::setDocument( QTextDocument *document )
 {
     d_ptr->mDocument = document;
@@ -75,22 +88,51 @@ TextDocumentGenerator* TextDocumentConverter::generator() const
     return d_ptr->mParent ? d_ptr->mParent->q_func() : nullptr;
 }
 
+/**
+ * Background Conversion Implementation
+ */
+TextDocumentConversionThread::TextDocumentConversionThread( TextDocumentGeneratorPrivate *generator, QMutex *mutex )
+    : mGenerator( generator ), mMutex( mutex ), mOwnerThread( QThread::currentThread() )
+{
+}
+
+void TextDocumentConversionThread::stopConversion()
+{
+    mStop.store( 1 );
+}
+
+void TextDocumentConversionThread::run()
+{
+    // a part at a time, so the pages to show can be converted in between
+    while ( !mStop.load() )
+    {
+        QMutexLocker locker( mMutex );
+        if ( mGenerator->mConversionComplete )
+            break;
+        mGenerator->convertNextPart();
+        mGenerator->mPartConverted.wakeAll();
+    }
+
+    // the rest, if any, is converted where it is needed
+    QMutexLocker locker( mMutex );
+    mGenerator->mDocument->moveToThread( mOwnerThread );
+    mGenerator->mConversionRunning = false;
+    mGenerator->mPartConverted.wakeAll();
+}
+
 /**
  * Generic Generator Implementation
  */
-Okular::TextPage* TextDocumentGeneratorPrivate::createTextPage( int pageNumber ) const
+Okular::TextPage* TextDocumentGeneratorPrivate::createTextPage( int pageNumber )
 {
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    Q_Q( const TextDocumentGenerator );
-#endif
+    Q_Q( TextDocumentGenerator );
 
     Okular::TextPage *textPage = new Okular::TextPage;
 
     int start, end;
 
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    q->userMutex()->lock();
-#endif
+    QMutexLocker locker( q->userMutex() );
+    convertUntilPage( pageNumber );
     TextDocumentUtils::calculatePositions( mDocument, pageNumber, start, end );
 
     {
@@ -110,9 +152,6 @@ Okular::TextPage* TextDocumentGeneratorPrivate::createTextPage( int pageNumber )
         }
     }
     }
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    q->userMutex()->unlock();
-#endif
 
     return textPage;
 }
@@ -179,6 +218,8 @@ void TextDocumentGeneratorPrivate::generateLinkInfos()
         if ( info.page >= 0 )
             mLinkInfos.append( info );
     }
+    // the parts converted later only add new positions
+    mLinkPositions.clear();
 }
 
 void TextDocumentGeneratorPrivate::generateAnnotationInfos()
@@ -195,6 +236,7 @@ void TextDocumentGeneratorPrivate::generateAnnotationInfos()
         if ( info.page >= 0 )
             mAnnotationInfos.append( info );
     }
+    mAnnotationPositions.clear();
 }
 
 void TextDocumentGeneratorPrivate::generateTitleInfos()
@@ -231,6 +273,132 @@ void TextDocumentGeneratorPrivate::generateTitleInfos()
         parentNode.appendChild( item );
         parentNodeStack.push( qMakePair( headingLevel, QDomNode(item) ) );
     }
+    mTitlePositions.clear();
+}
+
+QSet<int> TextDocumentGeneratorPrivate::attachInfos( const QVector<Okular::Page*> &pages, int finalPages )
+{
+    const int count = qMin( finalPages, pages.count() );
+
+    QVector< QLinkedList<Okular::ObjectRect*> > objects( count );
+    QList<LinkInfo>::iterator linkIt = mLinkInfos.begin();
+    while ( linkIt != mLinkInfos.end() ) {
+        // in case that the converter report bogus link info data, do not assert here
+        if ( linkIt->page >= count ) {
+            ++linkIt;
+            continue;
+        }
+
+        const QRectF rect = linkIt->boundingRect;
+        objects[ linkIt->page ].append( new Okular::ObjectRect( rect.left(), rect.top(), rect.right(), rect.bottom(), false,
+                                                                Okular::ObjectRect::Action, linkIt->link ) );
+        linkIt = mLinkInfos.erase( linkIt );
+    }
+
+    for ( int i = 0; i < count; ++i ) {
+        if ( !objects.at( i ).isEmpty() )
+            PagePrivate::get( pages.at( i ) )->addObjectRects( objects.at( i ) );
+    }
+
+    QSet<int> annotatedPages;
+    QList<AnnotationInfo>::iterator annIt = mAnnotationInfos.begin();
+    while ( annIt != mAnnotationInfos.end() ) {
+        if ( annIt->page >= count ) {
+            ++annIt;
+            continue;
+        }
+
+        pages.at( annIt->page )->addAnnotation( annIt->annotation );
+        annotatedPages.insert( annIt->page );
+        annIt = mAnnotationInfos.erase( annIt );
+    }
+
+    return annotatedPages;
+}
+
+int TextDocumentGeneratorPrivate::finalPageCount() const
+{
+    // the last page is where the next part starts
+    return mConversionComplete ? mDocument->pageCount() : qMax( 0, mDocument->pageCount() - 1 );
+}
+
+void TextDocumentGeneratorPrivate::convertNextPart()
+{
+    Q_Q( TextDocumentGenerator );
+
+    mConverter->convertNextPart();
+    mConversionComplete = mConverter->pendingPagesEstimate() == 0;
+
+    if ( mPartsConvertedQueued.testAndSetOrdered( 0, 1 ) )
+        QMetaObject::invokeMethod( q, "partsConverted", Qt::QueuedConnection );
+}
+
+void TextDocumentGeneratorPrivate::convertUntilPage( int page )
+{
+    Q_Q( TextDocumentGenerator );
+
+    while ( !mConversionComplete && page >= finalPageCount() ) {
+        if ( mConversionRunning )
+            mPartConverted.wait( q->userMutex() );
+        else
+            convertNextPart();
+    }
+}
+
+void TextDocumentGeneratorPrivate::partsConverted()
+{
+    Q_Q( TextDocumentGenerator );
+    mPartsConvertedQueued.store( 0 );
+
+    // the document may have been closed meanwhile
+    if ( !mDocument || !m_document )
+        return;
+
+    QMutexLocker locker( q->userMutex() );
+    // without a thread the parts are converted here, one per event loop round
+    if ( !mConversionThread && !mConversionComplete )
+        convertNextPart();
+    generateLinkInfos();
+    generateAnnotationInfos();
+    const bool complete = mConversionComplete;
+    if ( complete )
+        generateTitleInfos();
+    const int finalPages = finalPageCount();
+    const int pendingPages = complete ? 0 : mConverter->pendingPagesEstimate();
+    const QSize size = mDocument->pageSize().toSize();
+    locker.unlock();
+
+    const int oldCount = mPageCount;
+    if ( complete && q->hasFeature( Generator::EstimatedPageCount ) ) {
+        // also tells the observers about the synopsis
+        q->setFeature( Generator::EstimatedPageCount, false );
+        mPageCount = finalPages;
+        q->updatePageCount( mPageCount, size );
+    } else if ( !complete && finalPages >= mPageCount ) {
+        // the estimate was too short, the page being laid out is shown too
+        mPageCount = finalPages + pendingPages;
+        q->updatePageCount( mPageCount, size );
+    }
+
+    const QSet<int> annotatedPages = attachInfos( m_document->m_pagesVector, finalPages );
+    // the observers set up the pages with annotations when laying them out
+    Q_FOREACH ( int page, annotatedPages ) {
+        if ( page < oldCount ) {
+            q->updatePageCount( mPageCount, size );
+            break;
+        }
+    }
+}
+
+void TextDocumentGeneratorPrivate::stopConversion()
+{
+    if ( !mConversionThread )
+        return;
+
+    mConversionThread->stopConversion();
+    mConversionThread->wait();
+    delete mConversionThread;
+    mConversionThread = nullptr;
 }
 
 void TextDocumentGeneratorPrivate::initializeGenerator()
@@ -246,17 +414,18 @@ void TextDocumentGeneratorPrivate::initializeGenerator()
     q->setFeature( Generator::TextExtraction );
     q->setFeature( Generator::PrintNative );
     q->setFeature( Generator::PrintToFile );
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
+    // After loading the document is only touched while holding userMutex(),
+    // see image(), createTextPage(), print(), exportTo() and the conversion
+    // of the parts left, whose positions are gathered in the converting thread
     if ( QFontDatabase::supportsThreadedFontRendering() )
         q->setFeature( Generator::Threaded );
-#endif
 
     QObject::connect( mConverter, SIGNAL(addAction(Action*,int,int)),
-                      q, SLOT(addAction(Action*,int,int)) );
+                      q, SLOT(addAction(Action*,int,int)), Qt::DirectConnection );
     QObject::connect( mConverter, SIGNAL(addAnnotation(Annotation*,int,int)),
-                      q, SLOT(addAnnotation(Annotation*,int,int)) );
+                      q, SLOT(addAnnotation(Annotation*,int,int)), Qt::DirectConnection );
     QObject::connect( mConverter, SIGNAL(addTitle(int,QString,QTextBlock)),
-                      q, SLOT(addTitle(int,QString,QTextBlock)) );
+                      q, SLOT(addTitle(int,QString,QTextBlock)), Qt::DirectConnection );
     QObject::connect( mConverter, SIGNAL(addMetaData(QString,QString,QString)),
                       q, SLOT(addMetaData(QString,QString,QString)) );
     QObject::connect( mConverter, SIGNAL(addMetaData(DocumentInfo::Key,QString)),
@@ -309,43 +478,35 @@ Document::OpenResult TextDocumentGenerator::loadDocumentWithPassword( const QStr
     }
     d->mDocument = d->mConverter->document();
 
-    d->generateTitleInfos();
+    // the converter may leave parts of the document to convert while it is shown
+    d->mConversionComplete = d->mConverter->pendingPagesEstimate() == 0;
+
     d->generateLinkInfos();
     d->generateAnnotationInfos();
+    if ( d->mConversionComplete )
+        d->generateTitleInfos();
 
-    pagesVector.resize( d->mDocument->pageCount() );
+    const int finalPages = d->finalPageCount();
+    d->mPageCount = d->mConversionComplete ? finalPages : finalPages + d->mConverter->pendingPagesEstimate();
+    pagesVector.resize( d->mPageCount );
 
     const QSize size = d->mDocument->pageSize().toSize();
-
-    QVector< QLinkedList<Okular::ObjectRect*> > objects( d->mDocument->pageCount() );
-    for ( int i = 0; i < d->mLinkInfos.count(); ++i ) {
-        const TextDocumentGeneratorPrivate::LinkInfo &info = d->mLinkInfos.at( i );
-
-        // in case that the converter report bogus link info data, do not assert here
-        if ( info.page >= objects.count() )
-          continue;
-
-        const QRectF rect = info.boundingRect;
-        objects[ info.page ].append( new Okular::ObjectRect( rect.left(), rect.top(), rect.right(), rect.bottom(), false,
-                                                             Okular::ObjectRect::Action, info.link ) );
-    }
-
-    QVector< QLinkedList<Okular::Annotation*> > annots( d->mDocument->pageCount() );
-    for ( int i = 0; i < d->mAnnotationInfos.count(); ++i ) {
-        const TextDocumentGeneratorPrivate::AnnotationInfo &info = d->mAnnotationInfos[ i ];
-        annots[ info.page ].append( info.annotation );
+    for ( int i = 0; i < d->mPageCount; ++i ) {
+        pagesVector[ i ] = new Okular::Page( i, size.width(), size.height(), Okular::Rotation0 );
     }
-
-    for ( int i = 0; i < d->mDocument->pageCount(); ++i ) {
-        Okular::Page * page = new Okular::Page( i, size.width(), size.height(), Okular::Rotation0 );
-        pagesVector[ i ] = page;
-
-        if ( !objects.at( i ).isEmpty() ) {
-            page->setObjectRects( objects.at( i ) );
-        }
-        QLinkedList<Okular::Annotation*>::ConstIterator annIt = annots.at( i ).begin(), annEnd = annots.at( i ).end();
-        for ( ; annIt != annEnd; ++annIt ) {
-            page->addAnnotation( *annIt );
+    d->attachInfos( pagesVector, finalPages );
+
+    if ( !d->mConversionComplete ) {
+        // the page count is corrected as the rest is converted, in a thread
+        // if the fonts can be used outside of the GUI thread
+        setFeature( EstimatedPageCount );
+        if ( hasFeature( Threaded ) ) {
+            d->mConversionThread = new TextDocumentConversionThread( d, userMutex() );
+            d->mConversionRunning = true;
+            d->mDocument->moveToThread( d->mConversionThread );
+            d->mConversionThread->start( QThread::LowPriority );
+        } else {
+            QMetaObject::invokeMethod( this, "partsConverted", Qt::QueuedConnection );
         }
     }
 
@@ -355,6 +516,12 @@ Document::OpenResult TextDocumentGenerator::loadDocumentWithPassword( const QStr
 bool TextDocumentGenerator::doCloseDocument()
 {
     Q_D( TextDocumentGenerator );
+    d->stopConversion();
+    d->mConversionComplete = true;
+    d->mPartsConvertedQueued.store( 0 );
+    d->mPageCount = 0;
+    setFeature( EstimatedPageCount, false );
+
     delete d->mDocument;
     d->mDocument = nullptr;
 
@@ -385,9 +552,7 @@ QImage TextDocumentGeneratorPrivate::image( PixmapRequest * request )
     if ( !mDocument )
         return QImage();
 
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
     Q_Q( TextDocumentGenerator );
-#endif
 
     QImage image( request->width(), request->height(), QImage::Format_ARGB32 );
     image.fill( Qt::white );
@@ -406,9 +571,8 @@ QImage TextDocumentGeneratorPrivate::image( PixmapRequest * request )
     rect = QRect( 0, request->pageNumber() * size.height(), size.width(), size.height() );
     p.translate( QPoint( 0, request->pageNumber() * size.height() * -1 ) );
     p.setClipRect( rect );
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    q->userMutex()->lock();
-#endif
+    QMutexLocker locker( q->userMutex() );
+    convertUntilPage( request->pageNumber() );
     QAbstractTextDocumentLayout::PaintContext context;
     context.palette.setColor( QPalette::Text, Qt::black );
 //  FIXME Fix Qt, this doesn't work, we have horrible hacks
@@ -416,11 +580,13 @@ QImage TextDocumentGeneratorPrivate::image( PixmapRequest * request )
 //        if Qt ever gets fixed
 //     context.palette.setColor( QPalette::Link, Qt::blue );
     context.clip = rect;
-    mDocument->setDefaultFont( mFont );
+    // setting the default font invalidates the layout of the whole document,
+    // only do it when the font setting actually changed
+    if ( mDocument->defaultFont() != mFont )
+        mDocument->setDefaultFont( mFont );
+    // the layout starts drawing from the clip top, so only the blocks of this page are visited
     mDocument->documentLayout()->draw( &p, context );
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    q->userMutex()->unlock();
-#endif
+    locker.unlock();
     p.end();
 
     return image;
@@ -438,6 +604,8 @@ bool TextDocumentGenerator::print( QPrinter& printer )
     if ( !d->mDocument )
         return false;
 
+    QMutexLocker locker( userMutex() );
+    d->convertUntilPage( INT_MAX );
     d->mDocument->print( &printer );
 
     return true;
@@ -491,6 +659,8 @@ bool TextDocumentGenerator::exportTo( const QString &fileName, const Okular::Exp
     if ( !d->mDocument )
         return false;
 
+    QMutexLocker locker( userMutex() );
+    d->convertUntilPage( INT_MAX );
     if ( format.mimeType().name() == QLatin1String( "application/pdf" ) ) {
         QFile file( fileName );
         if ( !file.open( QIODevice::WriteOnly ) )
@@ -529,6 +699,7 @@ bool TextDocumentGenerator::reparseConfig()
     const QFont newFont = d->mGeneralSettings->font();
 
     if ( newFont != d->mFont ) {
+        QMutexLocker locker( userMutex() );
         d->mFont = newFont;
         return true;
     }
@@ -61,6 +61,29 @@ class OKULARCORE_EXPORT TextDocumentConverter : public QObject
          */
         QTextDocument *document();
 
+        /**
+         * Converts the next part of the document, for converters that only
+         * convert its beginning in convert() and the rest while the document
+         * is shown. Every part has to start on a new page.
+         *
+         * It is called with TextDocumentGenerator::userMutex() locked, from
+         * any thread, as long as pendingPagesEstimate() is not 0. The signals
+         * emitted meanwhile are delivered in the calling thread, which the
+         * document belongs to.
+         *
+         * @since 1.4
+         */
+        virtual void convertNextPart();
+
+        /**
+         * Returns the number of pages the parts not converted yet are expected
+         * to take, at least 1 while there is any. The default implementation
+         * returns 0, as convert() converts the whole document.
+         *
+         * @since 1.4
+         */
+        virtual int pendingPagesEstimate() const;
+
     Q_SIGNALS:
         /**
          * Adds a new link object which is located between cursorBegin and
@@ -219,6 +242,7 @@ class OKULARCORE_EXPORT TextDocumentGenerator : public Generator, public Okular:
         Q_PRIVATE_SLOT( d_func(), void addTitle( int, const QString&, const QTextBlock& ) )
         Q_PRIVATE_SLOT( d_func(), void addMetaData( const QString&, const QString&, const QString& ) )
         Q_PRIVATE_SLOT( d_func(), void addMetaData( DocumentInfo::Key, const QString& ) )
+        Q_PRIVATE_SLOT( d_func(), void partsConverted() )
 };
 
 }
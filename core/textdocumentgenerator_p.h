@@ -10,6 +10,9 @@
 #ifndef _OKULAR_TEXTDOCUMENTGENERATOR_P_H_
 #define _OKULAR_TEXTDOCUMENTGENERATOR_P_H_
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
 #include <QtGui/QAbstractTextDocumentLayout>
 #include <QtGui/QTextBlock>
 #include <QtGui/QTextDocument>
@@ -110,18 +113,44 @@ class TextDocumentConverterPrivate
         QTextDocument *mDocument;
 };
 
+class TextDocumentGeneratorPrivate;
+
+/**
+ * Converts the parts of the document left after opening it, ahead of the reader.
+ * The document belongs to this thread while it runs, as the converted parts
+ * create objects that are children of it.
+ */
+class TextDocumentConversionThread : public QThread
+{
+    public:
+        TextDocumentConversionThread( TextDocumentGeneratorPrivate *generator, QMutex *mutex );
+
+        void stopConversion();
+
+    protected:
+        void run() override;
+
+    private:
+        TextDocumentGeneratorPrivate *mGenerator;
+        QMutex *mMutex;
+        QThread *mOwnerThread;
+        QAtomicInt mStop;
+};
+
 class TextDocumentGeneratorPrivate : public GeneratorPrivate
 {
     friend class TextDocumentConverter;
 
     public:
         TextDocumentGeneratorPrivate( TextDocumentConverter *converter )
-            : mConverter( converter ), mDocument( nullptr ), mGeneralSettings( nullptr )
+            : mConverter( converter ), mDocument( nullptr ), mConversionThread( nullptr ), mConversionRunning( false ),
+              mConversionComplete( true ), mPageCount( 0 ), mGeneralSettings( nullptr )
         {
         }
 
         virtual ~TextDocumentGeneratorPrivate()
         {
+            stopConversion();
             delete mConverter;
             delete mDocument;
         }
@@ -135,7 +164,7 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
 
         void calculateBoundingRect( int startPosition, int endPosition, QRectF &rect, int &page ) const;
         void calculatePositions( int page, int &start, int &end ) const;
-        Okular::TextPage* createTextPage( int ) const;
+        Okular::TextPage* createTextPage( int );
 
         void addAction( Action *action, int cursorBegin, int cursorEnd );
         void addAnnotation( Annotation *annotation, int cursorBegin, int cursorEnd );
@@ -147,6 +176,38 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
         void generateAnnotationInfos();
         void generateTitleInfos();
 
+        /**
+         * Gives the links and annotations of the first @p finalPages pages
+         * to the pages they are on, returns the numbers of the pages that
+         * got annotations.
+         */
+        QSet<int> attachInfos( const QVector<Okular::Page*> &pages, int finalPages );
+
+        // the following ones need userMutex() to be locked
+
+        /**
+         * Returns the number of pages whose layout does not change any more.
+         */
+        int finalPageCount() const;
+
+        /**
+         * Converts the next part of the document, and tells partsConverted() about it.
+         */
+        void convertNextPart();
+
+        /**
+         * Converts the parts of the document up to the one @p page ends in,
+         * or waits for the conversion thread to convert them.
+         */
+        void convertUntilPage( int page );
+
+        /**
+         * Updates the pages with what the last parts converted, in the GUI thread.
+         */
+        void partsConverted();
+
+        void stopConversion();
+
         TextDocumentConverter *mConverter;
 
         QTextDocument *mDocument;
@@ -175,6 +236,7 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
           QRectF boundingRect;
           Action *link;
         };
+        // the ones not given to their pages yet
         QList<LinkInfo> mLinkInfos;
 
         struct AnnotationPosition
@@ -191,8 +253,21 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
           QRectF boundingRect;
           Annotation *annotation;
         };
+        // the ones not given to their pages yet
         QList<AnnotationInfo> mAnnotationInfos;
 
+        TextDocumentConversionThread *mConversionThread;
+        // whether the thread converts the parts, under userMutex()
+        bool mConversionRunning;
+        // woken after every part the thread converts
+        QWaitCondition mPartConverted;
+        // whether no part is left to convert, under userMutex()
+        bool mConversionComplete;
+        // whether a call of partsConverted() is queued
+        QAtomicInt mPartsConvertedQueued;
+        // the page count given to the document
+        int mPageCount;
+
         TextDocumentSettings *mGeneralSettings;
 
         QFont mFont;
@@ -18,10 +18,10 @@
 #include "page.h"
 #include "page_p.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include <QtAlgorithms>
-#include <QVarLengthArray>
 
 using namespace Okular;
 
@@ -171,6 +171,11 @@ class TinyTextEntity
             return transformed_area;
         }
 
+        inline qulonglong memoryUsage() const
+        {
+            return sizeof( TinyTextEntity ) + ( length > MaxStaticChars ? length * sizeof( QChar ) : 0 );
+        }
+
         NormalizedRect area;
 
     private:
@@ -214,7 +219,7 @@ NormalizedRect TextEntity::transformedArea(const QTransform &matrix) const
 
 
 TextPagePrivate::TextPagePrivate()
-    : m_page( nullptr )
+    : m_page( nullptr ), m_textOrderCorrected( false )
 {
 }
 
@@ -225,6 +230,22 @@ TextPagePrivate::~TextPagePrivate()
 }
 
 
+TextPagePrivate *TextPagePrivate::get( TextPage *textPage )
+{
+    return textPage ? textPage->d : nullptr;
+}
+
+qulonglong TextPagePrivate::memoryUsage() const
+{
+    // one pointer per list entry on top of the entities themselves
+    qulonglong memory = sizeof( TextPagePrivate ) + m_words.count() * sizeof( void * );
+    for ( const TinyTextEntity *word : m_words )
+        memory += word->memoryUsage();
+    memory += m_searchPoints.count() * ( sizeof( SearchPoint ) + 4 * sizeof( void * ) );
+    return memory;
+}
+
+
 TextPage::TextPage()
     : d( new TextPagePrivate() )
 {
@@ -255,27 +276,29 @@ void TextPage::append( const QString &text, NormalizedRect *area )
     delete area;
 }
 
+/**
+ * A word made by the layout analysis out of consecutive characters. The
+ * geometries the analysis looks at are computed once, and the characters
+ * are a range of the character array of the page.
+ */
 struct WordWithCharacters
 {
-    WordWithCharacters(TinyTextEntity *w, const TextList &c)
-     : word(w), characters(c)
-    {
-    }
-    
-    inline QString text() const
-    {
-        return word->text();
-    }
-    
-    inline const NormalizedRect &area() const
-    {
-      return word->area;
-    }
-    
-    TinyTextEntity *word;
-    TextList characters;
+    NormalizedRect area;
+    // the area at the page size of the analysis, rounded and not
+    QRect roundedRect;
+    QRect rect;
+    // top and left of the area rounded on a 1000x1000 grid, used for sorting
+    int sortTop;
+    int sortLeft;
+    int firstCharacter;
+    int characterCount;
 };
-typedef QList<WordWithCharacters> WordsWithCharacters;
+typedef QVector<WordWithCharacters> WordsWithCharacters;
+
+/**
+ * Indexes of some of the WordsWithCharacters of a page.
+ */
+typedef QVector<int> WordIndexes;
 
 /**
  * We will divide the whole page in some regions depending on the horizontal and
@@ -290,22 +313,14 @@ public:
     {
     };
 
-    RegionText(const WordsWithCharacters &wordsWithCharacters, const QRect &area)
-        : m_region_wordWithCharacters(wordsWithCharacters), m_area(area)
-    {
-    }
-    
-    inline QString string() const
+    RegionText(const WordIndexes &words, const QRect &area)
+        : m_region_words(words), m_area(area)
     {
-        QString res;
-        foreach(const WordWithCharacters &word, m_region_wordWithCharacters)
-            res += word.text();
-        return res;
     }
 
-    inline WordsWithCharacters text() const
+    inline const WordIndexes &text() const
     {
-        return m_region_wordWithCharacters;
+        return m_region_words;
     }
 
     inline QRect area() const
@@ -318,16 +333,21 @@ public:
         m_area = area;
     }
 
-    inline void setText(const WordsWithCharacters &wordsWithCharacters)
-    {
-        m_region_wordWithCharacters = wordsWithCharacters;
-    }
-
 private:
-    WordsWithCharacters m_region_wordWithCharacters;
+    WordIndexes m_region_words;
     QRect m_area;
 };
 
+/**
+ * A line of words with the area they cover.
+ */
+struct TextLine
+{
+    WordIndexes words;
+    QRect area;
+};
+typedef QVector<TextLine> TextLines;
+
 RegularAreaRect * TextPage::textArea ( TextSelection * sel) const
 {
     if ( d->m_words.isEmpty() )
@@ -1108,122 +1128,81 @@ QString TextPage::text(const RegularAreaRect *area, TextAreaInclusionBehaviour b
     return ret;
 }
 
-static bool compareTinyTextEntityX(const WordWithCharacters &first, const WordWithCharacters &second)
-{
-    QRect firstArea = first.area().roundedGeometry(1000,1000);
-    QRect secondArea = second.area().roundedGeometry(1000,1000);
-
-    return firstArea.left() < secondArea.left();
-}
-
-static bool compareTinyTextEntityY(const WordWithCharacters &first, const WordWithCharacters &second)
+static WordWithCharacters makeWord(const NormalizedRect &area, int firstCharacter, int characterCount, int pageWidth, int pageHeight)
 {
-    const QRect firstArea = first.area().roundedGeometry(1000,1000);
-    const QRect secondArea = second.area().roundedGeometry(1000,1000);
-
-    return firstArea.top() < secondArea.top();
+    WordWithCharacters word;
+    word.area = area;
+    word.roundedRect = area.roundedGeometry(pageWidth, pageHeight);
+    word.rect = area.geometry(pageWidth, pageHeight);
+    const QRect sortRect = area.roundedGeometry(1000, 1000);
+    word.sortTop = sortRect.top();
+    word.sortLeft = sortRect.left();
+    word.firstCharacter = firstCharacter;
+    word.characterCount = characterCount;
+    return word;
 }
 
 /**
- * Sets a new world list. Deleting the contents of the old one
+ * Moves the character at @p index to the @p area grid and normalizes its text.
+ * The entity is kept when its text is already normalized, otherwise it is
+ * replaced and added to @p obsolete.
  */
-void TextPagePrivate::setWordList(const TextList &list)
+static void normalizeCharacter(QVector<TinyTextEntity*> &characters, int index, const QRect &area, TextList *obsolete, int pageWidth, int pageHeight)
 {
-    qDeleteAll(m_words);
-    m_words = list;
-}
-
-/**
- * Remove all the spaces in between texts. It will make all the generators
- * same, whether they save spaces(like pdf) or not(like djvu).
- */
-static void removeSpace(TextList *words)
-{
-    TextList::Iterator it = words->begin();
-    const QString str(QLatin1Char(' '));
-
-    while ( it != words->end() )
+    TinyTextEntity *character = characters.at(index);
+    const NormalizedRect newRect(area, pageWidth, pageHeight);
+    const QString text = character->text();
+    const QString normalized = text.normalized(QString::NormalizationForm_KC);
+    if (normalized == text)
     {
-        if((*it)->text() == str)
-        {
-            it = words->erase(it);
-        }
-        else
-        {
-            ++it;
-        }
+        character->area = newRect;
+        return;
     }
+
+    obsolete->append(character);
+    characters[index] = new TinyTextEntity(normalized, newRect);
 }
 
 /**
  * We will read the TinyTextEntity from characters and try to create words from there.
  * Note: characters might be already characters for some generators, but we will keep
- * the nomenclature characters for the generator produced data. The resulting
- * WordsWithCharacters memory has to be managed by the caller, both the 
- * WordWithCharacters::word and WordWithCharacters::characters contents
+ * the nomenclature characters for the generator produced data. The characters are
+ * modified in place, the entities replaced in @p characters are added to @p obsolete
  */
-static WordsWithCharacters makeWordFromCharacters(const TextList &characters, int pageWidth, int pageHeight)
+static WordsWithCharacters makeWordFromCharacters(QVector<TinyTextEntity*> &characters, TextList *obsolete, int pageWidth, int pageHeight)
 {
     /**
      * We will traverse characters and try to create words from the TinyTextEntities in it.
      * We will search TinyTextEntity blocks and merge them until we get a
      * space between two consecutive TinyTextEntities. When we get a space
-     * we can take it as a end of word. Then we store the word as a TinyTextEntity
-     * and keep it in newList.
-
-     * We create a RegionText named regionWord that contains the word and the characters associated with it and
-     * a rectangle area of the element in newList. 
-
+     * we can take it as a end of word. The word keeps the range of its
+     * characters and the rectangle area they cover.
      */
     WordsWithCharacters wordsWithCharacters;
+    wordsWithCharacters.reserve(characters.count());
 
-    TextList::ConstIterator it = characters.begin(), itEnd = characters.end(), tmpIt;
-    int newLeft,newRight,newTop,newBottom;
-    int index = 0;
-
-    for( ; it != itEnd ; it++)
+    const int count = characters.count();
+    int it = 0;
+    while (it < count)
     {
-        QString textString = (*it)->text();
-        QString newString;
-        QRect lineArea = (*it)->area.roundedGeometry(pageWidth,pageHeight),elementArea;
-        TextList wordCharacters;
-        tmpIt = it;
-        int space = 0;
-
-        while (!space)
-        {
-            if (textString.length())
-            {
-                newString.append(textString);
+        const int firstCharacter = it;
+        QRect lineArea = characters.at(it)->area.roundedGeometry(pageWidth,pageHeight);
+        QRect elementArea = lineArea;
 
-                // when textString is the start of the word
-                if (tmpIt == it)
-                {
-                    NormalizedRect newRect(lineArea,pageWidth,pageHeight);
-                    wordCharacters.append(new TinyTextEntity(textString.normalized
-                                                   (QString::NormalizationForm_KC), newRect));
-                }
-                else
-                {
-                    NormalizedRect newRect(elementArea,pageWidth,pageHeight);
-                    wordCharacters.append(new TinyTextEntity(textString.normalized
-                                                   (QString::NormalizationForm_KC), newRect));
-                }
-            }
+        for (;;)
+        {
+            normalizeCharacter(characters, it, elementArea, obsolete, pageWidth, pageHeight);
 
             ++it;
+            if (it == count) break;
 
-            /*
-             we must have to put this line before the if condition of it==itEnd
-             otherwise the last character can be missed
-             */
-            if (it == itEnd) break;
-            elementArea = (*it)->area.roundedGeometry(pageWidth,pageHeight);
+            elementArea = characters.at(it)->area.roundedGeometry(pageWidth,pageHeight);
             if (!doesConsumeY(elementArea, lineArea, 60))
-            {
-                --it;
                 break;
-            }
+
+            const int space = elementArea.left() - lineArea.right();
+            if (space != 0)
+                break;
 
             const int text_y1 = elementArea.top() ,
                       text_x1 = elementArea.left(),
@@ -1233,47 +1212,28 @@ static WordsWithCharacters makeWordFromCharacters(const TextList &characters, in
                       line_y2 = lineArea.y() + lineArea.height(),
                       line_x2 = lineArea.x() + lineArea.width();
 
-            space = elementArea.left() - lineArea.right();
-
-            if (space != 0)
-            {
-                it--;
-                break;
-            }
-
-            newLeft = text_x1 < line_x1 ? text_x1 : line_x1;
-            newRight = line_x2 > text_x2 ? line_x2 : text_x2;
-            newTop = text_y1 > line_y1 ? line_y1 : text_y1;
-            newBottom = text_y2 > line_y2 ? text_y2 : line_y2;
+            const int newLeft = text_x1 < line_x1 ? text_x1 : line_x1;
+            const int newRight = line_x2 > text_x2 ? line_x2 : text_x2;
+            const int newTop = text_y1 > line_y1 ? line_y1 : text_y1;
+            const int newBottom = text_y2 > line_y2 ? text_y2 : line_y2;
 
             lineArea.setLeft (newLeft);
             lineArea.setTop (newTop);
             lineArea.setWidth( newRight - newLeft );
             lineArea.setHeight( newBottom - newTop );
-
-            textString = (*it)->text();
-        }
-
-        // if newString is not empty, save it
-        if (!newString.isEmpty())
-        {
-            const NormalizedRect newRect(lineArea, pageWidth, pageHeight);
-            TinyTextEntity *word = new TinyTextEntity(newString.normalized(QString::NormalizationForm_KC), newRect);
-            wordsWithCharacters.append(WordWithCharacters(word, wordCharacters));
-
-            index++;
         }
 
-        if(it == itEnd) break;
+        const NormalizedRect newRect(lineArea, pageWidth, pageHeight);
+        wordsWithCharacters.append(makeWord(newRect, firstCharacter, it - firstCharacter, pageWidth, pageHeight));
     }
-    
+
     return wordsWithCharacters;
 }
 
 /**
  * Create Lines from the words and sort them
  */
-QList< QPair<WordsWithCharacters, QRect> > makeAndSortLines(const WordsWithCharacters &wordsTmp, int pageWidth, int pageHeight)
+static TextLines makeAndSortLines(const WordsWithCharacters &words, const WordIndexes &indexes)
 {
     /**
      * We cannot assume that the generator will give us texts in the right order.
@@ -1285,89 +1245,100 @@ QList< QPair<WordsWithCharacters, QRect> > makeAndSortLines(const WordsWithChara
      * 2. Create textline where there is y overlap between TinyTextEntity 's
      * 3. Within each line sort the TinyTextEntity 's by x0(left)
      */
-    
-    QList< QPair<WordsWithCharacters, QRect> > lines;
 
-    /*
-     Make a new copy of the TextList in the words, so that the wordsTmp and lines do
-     not contain same pointers for all the TinyTextEntity.
-     */
-    QList<WordWithCharacters> words = wordsTmp;
+    TextLines lines;
 
     // Step 1
-    qSort(words.begin(),words.end(),compareTinyTextEntityY);
+    WordIndexes sorted = indexes;
+    std::stable_sort(sorted.begin(), sorted.end(), [&words](int first, int second) {
+        return words.at(first).sortTop < words.at(second).sortTop;
+    });
 
     // Step 2
-    QList<WordWithCharacters>::Iterator it = words.begin(), itEnd = words.end();
-
-    //for every non-space texts(characters/words) in the textList
-    for( ; it != itEnd ; it++)
+    /*
+       Texts come by increasing top, so a line that ends above a text can not
+       take it nor any of the following ones. Only the lines that are still
+       open are looked at, in the order they were made.
+     */
+    QVector<int> openLines;
+    for (int index : qAsConst(sorted))
     {
-        const QRect elementArea = (*it).area().roundedGeometry(pageWidth,pageHeight);
+        const QRect elementArea = words.at(index).roundedRect;
         bool found = false;
+        int kept = 0;
 
-        for( int i = 0 ; i < lines.length() ; i++)
+        for (int i = 0 ; i < openLines.count() ; i++)
         {
-            /* the line area which will be expanded
-               line_rects is only necessary to preserve the topmin and bottommax of all
-               the texts in the line, left and right is not necessary at all
-            */
-            QRect &lineArea = lines[i].second;
-            const int text_y1 = elementArea.top() ,
-                      text_y2 = elementArea.top() + elementArea.height() ,
-                      text_x1 = elementArea.left(),
-                      text_x2 = elementArea.left() + elementArea.width();
-            const int line_y1 = lineArea.top() ,
-                      line_y2 = lineArea.top() + lineArea.height(),
-                      line_x1 = lineArea.left(),
-                      line_x2 = lineArea.left() + lineArea.width();
-
-            /*
-               if the new text and the line has y overlapping parts of more than 70%,
-               the text will be added to this line
-             */
-            if(doesConsumeY(elementArea,lineArea,70))
+            const int lineIndex = openLines.at(i);
+            if (!found)
             {
-                WordsWithCharacters &line = lines[i].first;
-                line.append(*it);
-
-                const int newLeft = line_x1 < text_x1 ? line_x1 : text_x1;
-                const int newRight = line_x2 > text_x2 ? line_x2 : text_x2;
-                const int newTop = line_y1 < text_y1 ? line_y1 : text_y1;
-                const int newBottom = text_y2 > line_y2 ? text_y2 : line_y2;
+                /* the line area which will be expanded
+                   line_rects is only necessary to preserve the topmin and bottommax of all
+                   the texts in the line, left and right is not necessary at all
+                */
+                QRect &lineArea = lines[lineIndex].area;
+                if (lineArea.height() >= 0 && lineArea.bottom() < elementArea.top() - 1)
+                    continue;
 
-                lineArea = QRect( newLeft,newTop, newRight - newLeft, newBottom - newTop );
-                found = true;
+                /*
+                   if the new text and the line has y overlapping parts of more than 70%,
+                   the text will be added to this line
+                 */
+                if (doesConsumeY(elementArea,lineArea,70))
+                {
+                    const int text_y1 = elementArea.top() ,
+                              text_y2 = elementArea.top() + elementArea.height() ,
+                              text_x1 = elementArea.left(),
+                              text_x2 = elementArea.left() + elementArea.width();
+                    const int line_y1 = lineArea.top() ,
+                              line_y2 = lineArea.top() + lineArea.height(),
+                              line_x1 = lineArea.left(),
+                              line_x2 = lineArea.left() + lineArea.width();
+
+                    lines[lineIndex].words.append(index);
+
+                    const int newLeft = line_x1 < text_x1 ? line_x1 : text_x1;
+                    const int newRight = line_x2 > text_x2 ? line_x2 : text_x2;
+                    const int newTop = line_y1 < text_y1 ? line_y1 : text_y1;
+                    const int newBottom = text_y2 > line_y2 ? text_y2 : line_y2;
+
+                    lineArea = QRect( newLeft,newTop, newRight - newLeft, newBottom - newTop );
+                    found = true;
+                }
             }
-
-            if(found) break;
+            openLines[kept++] = lineIndex;
         }
+        openLines.resize(kept);
 
-        /* when we have found a new line create a new TextList containing
+        /* when we have found a new line create a new line containing
            only one element and append it to the lines
          */
         if(!found)
         {
-            WordsWithCharacters tmp;
-            tmp.append((*it));
-            lines.append(QPair<WordsWithCharacters, QRect>(tmp, elementArea));
+            TextLine line;
+            line.words.append(index);
+            line.area = elementArea;
+            openLines.append(lines.count());
+            lines.append(line);
         }
     }
 
     // Step 3
-    for(int i = 0 ; i < lines.length() ; i++)
+    for(int i = 0 ; i < lines.count() ; i++)
     {
-        WordsWithCharacters &list = lines[i].first;
-        qSort(list.begin(), list.end(), compareTinyTextEntityX);
+        WordIndexes &list = lines[i].words;
+        std::stable_sort(list.begin(), list.end(), [&words](int first, int second) {
+            return words.at(first).sortLeft < words.at(second).sortLeft;
+        });
     }
-    
+
     return lines;
 }
 
 /**
  * Calculate Statistical information from the lines we made previously
  */
-static void calculateStatisticalInformation(const QList<WordWithCharacters> &words, int pageWidth, int pageHeight, int *word_spacing, int *line_spacing, int *col_spacing)
+static void calculateStatisticalInformation(const WordsWithCharacters &words, const WordIndexes &indexes, int pageWidth, int *word_spacing, int *line_spacing, int *col_spacing)
 {
     /**
      * For the region, defined by line_rects and lines
@@ -1375,181 +1346,134 @@ static void calculateStatisticalInformation(const QList<WordWithCharacters> &wor
      * 2. Make character statistical analysis to differentiate between
      *   word spacing and column spacing.
      */
-    
+
     /**
      * Step 0
      */
-    const QList< QPair<WordsWithCharacters, QRect> > sortedLines = makeAndSortLines(words, pageWidth, pageHeight);
+    const TextLines sortedLines = makeAndSortLines(words, indexes);
 
     /**
      * Step 1
      */
-    QMap<int,int> line_space_stat;
-    for(int i = 0 ; i < sortedLines.length(); i++)
+    int line_space_sum = 0, line_space_count = 0;
+    for(int i = 0 ; i + 1 < sortedLines.count(); i++)
     {
-        const QRect rectUpper = sortedLines.at(i).second;
-
-        if(i+1 == sortedLines.length()) break;
-        const QRect rectLower = sortedLines.at(i+1).second;
+        const QRect rectUpper = sortedLines.at(i).area;
+        const QRect rectLower = sortedLines.at(i+1).area;
 
         int linespace = rectLower.top() - (rectUpper.top() + rectUpper.height());
         if(linespace < 0) linespace =-linespace;
 
-        if(line_space_stat.contains(linespace))
-            line_space_stat[linespace]++;
-        else line_space_stat[linespace] = 1;
+        line_space_sum += linespace;
+        line_space_count++;
     }
 
     *line_spacing = 0;
-    int weighted_count = 0;
-    QMapIterator<int, int> iterate_linespace(line_space_stat);
-
-    while(iterate_linespace.hasNext())
-    {
-        iterate_linespace.next();
-        *line_spacing += iterate_linespace.value() * iterate_linespace.key();
-        weighted_count += iterate_linespace.value();
-    }
-    if (*line_spacing != 0)
-        *line_spacing = (int) ( (double)*line_spacing / (double) weighted_count + 0.5);
+    if (line_space_sum != 0)
+        *line_spacing = (int) ( (double)line_space_sum / (double) line_space_count + 0.5);
 
     /**
      * Step 2
      */
-    // We would like to use QMap instead of QHash as it will keep the keys sorted
-    QMap<int,int> hor_space_stat;
-    QMap<int,int> col_space_stat;
-    QList< QList<QRect> > space_rects;
-    QList<QRect> max_hor_space_rects;
-
-    // Space in every line
-    for(int i = 0 ; i < sortedLines.length() ; i++)
-    {
-        const WordsWithCharacters list = sortedLines.at(i).first;
-        QList<QRect> line_space_rects;
-        int maxSpace = 0, minSpace = pageWidth;
+    // the word spacing is the average of the positive spaces but the widest of
+    // each line, the column spacing the most frequent widest space of a line
+    int hor_space_sum = 0, hor_space_count = 0;
+    QVector<int> max_spaces;
+    max_spaces.reserve(sortedLines.count());
 
-        // for every TinyTextEntity element in the line
-        WordsWithCharacters::ConstIterator it = list.begin(), itEnd = list.end();
-        QRect max_area1,max_area2;
-        QString before_max, after_max;
+    for(int i = 0 ; i < sortedLines.count() ; i++)
+    {
+        const WordIndexes &list = sortedLines.at(i).words;
+        int maxSpace = 0;
 
-        // for every line
-        for( ; it != itEnd ; it++ )
+        for(int k = 0 ; k + 1 < list.count() ; k++ )
         {
-            const QRect area1 = (*it).area().roundedGeometry(pageWidth,pageHeight);
-            if( it+1 == itEnd ) break;
-
-            const QRect area2 = (*(it+1)).area().roundedGeometry(pageWidth,pageHeight);
-            int space = area2.left() - area1.right();
+            const QRect &area1 = words.at(list.at(k)).roundedRect;
+            const QRect &area2 = words.at(list.at(k+1)).roundedRect;
+            const int space = area2.left() - area1.right();
 
             if(space > maxSpace)
-            {
-                max_area1 = area1;
-                max_area2 = area2;
                 maxSpace = space;
-                before_max = (*it).text();
-                after_max = (*(it+1)).text();
-            }
-
-            if(space < minSpace && space != 0) minSpace = space;
 
             //if we found a real space, whose length is not zero and also less than the pageWidth
-            if(space != 0 && space != pageWidth)
+            if(space > 0 && space != pageWidth)
             {
-                // increase the count of the space amount
-                if(hor_space_stat.contains(space)) hor_space_stat[space]++;
-                else hor_space_stat[space] = 1;
-
-                int left,right,top,bottom;
-
-                left = area1.right();
-                right = area2.left();
-
-                top = area2.top() < area1.top() ? area2.top() : area1.top();
-                bottom = area2.bottom() > area1.bottom() ? area2.bottom() : area1.bottom();
-
-                QRect rect(left,top,right-left,bottom-top);
-                line_space_rects.append(rect);
+                hor_space_sum += space;
+                hor_space_count++;
             }
         }
 
-        space_rects.append(line_space_rects);
-
-        if(hor_space_stat.contains(maxSpace))
-        {
-            if(hor_space_stat[maxSpace] != 1)
-                hor_space_stat[maxSpace]--;
-            else hor_space_stat.remove(maxSpace);
-        }
-
         if(maxSpace != 0)
         {
-            if (col_space_stat.contains(maxSpace))
-                col_space_stat[maxSpace]++;
-            else col_space_stat[maxSpace] = 1;
-
-            //store the max rect of each line
-            const int left = max_area1.right();
-                const int right = max_area2.left();
-            const int top = (max_area1.top() > max_area2.top()) ? max_area2.top() :
-                                                                  max_area1.top();
-            const int bottom = (max_area1.bottom() < max_area2.bottom()) ? max_area2.bottom() :
-                                                                           max_area1.bottom();
-
-            const QRect rect(left,top,right-left,bottom-top);
-            max_hor_space_rects.append(rect);
+            if(maxSpace != pageWidth)
+            {
+                hor_space_sum -= maxSpace;
+                hor_space_count--;
+            }
+            max_spaces.append(maxSpace);
         }
-        else max_hor_space_rects.append(QRect(0,0,0,0));
     }
 
-    // All the between word space counts are in hor_space_stat
     *word_spacing = 0;
-    weighted_count = 0;
-    QMapIterator<int, int> iterate(hor_space_stat);
+    if(hor_space_count)
+        *word_spacing = (int) ((double)hor_space_sum / (double)hor_space_count + 0.5);
 
-    while (iterate.hasNext())
+    // the smallest of the most frequent ones
+    std::sort(max_spaces.begin(), max_spaces.end());
+    *col_spacing = 0;
+    int col_space_count = 0;
+    for(int i = 0 ; i < max_spaces.count() ; )
     {
-        iterate.next();
-
-        if(iterate.key() > 0)
+        int j = i + 1;
+        while(j < max_spaces.count() && max_spaces.at(j) == max_spaces.at(i))
+            j++;
+        if(j - i > col_space_count)
         {
-            *word_spacing += iterate.value() * iterate.key();
-            weighted_count += iterate.value();
+            col_space_count = j - i;
+            *col_spacing = max_spaces.at(i);
         }
+        i = j;
     }
-    if(weighted_count)
-        *word_spacing = (int) ((double)*word_spacing / (double)weighted_count + 0.5);
-
-    *col_spacing = 0;
-    QMapIterator<int, int> iterate_col(col_space_stat);
-
-    while (iterate_col.hasNext())
-    {
-        iterate_col.next();
-        if(iterate_col.value() > *col_spacing) *col_spacing = iterate_col.value();
-    }
-    *col_spacing = col_space_stat.key(*col_spacing);
 
     // if there is just one line in a region, there is no point in dividing it
-    if(sortedLines.length() == 1)
+    if(sortedLines.count() == 1)
         *word_spacing = *col_spacing;
 }
 
+/**
+ * Adds @p weight to @p profile over [@p from, @p to] clipped to its first @p size
+ * entries. The profile holds differences until it is accumulated.
+ */
+static inline void addToProjection(QVector<int> &profile, int size, int from, int to, int weight)
+{
+    from = qMax(from, 0);
+    to = qMin(to, size - 1);
+    if (from > to)
+        return;
+    profile[from] += weight;
+    profile[to + 1] -= weight;
+}
+
 /**
  * Implements the XY Cut algorithm for textpage segmentation
- * The resulting RegionTextList will contain RegionText whose WordsWithCharacters::word and
- * WordsWithCharacters::characters are reused from wordsWithCharacters (i.e. no new nor delete happens in this function)
+ * The resulting RegionTextList will contain RegionText whose indexes refer to @p wordsWithCharacters
  */
-static RegionTextList XYCutForBoundingBoxes(const QList<WordWithCharacters> &wordsWithCharacters, const NormalizedRect &boundingBox, int pageWidth, int pageHeight)
+static RegionTextList XYCutForBoundingBoxes(const WordsWithCharacters &wordsWithCharacters, const NormalizedRect &boundingBox, int pageWidth, int pageHeight)
 {
     RegionTextList tree;
     QRect contentRect(boundingBox.geometry(pageWidth,pageHeight));
-    const RegionText root(wordsWithCharacters, contentRect);
+    WordIndexes allWords(wordsWithCharacters.count());
+    for (int j = 0 ; j < allWords.count() ; ++j)
+        allWords[j] = j;
+    const RegionText root(allWords, contentRect);
 
     // start the tree with the root, it is our only region at the start
     tree.push_back(root);
 
+    // the projection profiles, reused for all the regions
+    QVector<int> proj_on_xaxis;
+    QVector<int> proj_on_yaxis;
+
     int i = 0;
 
     // while traversing the tree has not been ended
@@ -1561,21 +1485,18 @@ static RegionTextList XYCutForBoundingBoxes(const QList<WordWithCharacters> &wor
         /**
          * 1. calculation of projection profiles
          */
-        // allocate the size of proj profiles and initialize with 0
-        int size_proj_y = node.area().height();
-        int size_proj_x = node.area().width();
-        //dynamic memory allocation
-        QVarLengthArray<int> proj_on_xaxis(size_proj_x);
-        QVarLengthArray<int> proj_on_yaxis(size_proj_y);
-
-        for( int j = 0 ; j < size_proj_y ; ++j ) proj_on_yaxis[j] = 0;
-        for( int j = 0 ; j < size_proj_x ; ++j ) proj_on_xaxis[j] = 0;
+        // allocate the size of proj profiles and initialize with 0,
+        // one more entry for the end of the difference ranges
+        const int size_proj_y = qMax(0, node.area().height());
+        const int size_proj_x = qMax(0, node.area().width());
+        proj_on_xaxis.fill(0, size_proj_x + 1);
+        proj_on_yaxis.fill(0, size_proj_y + 1);
 
-        const QList<WordWithCharacters> list = node.text();
+        const WordIndexes &list = node.text();
 
         // Calculate tcx and tcy locally for each new region
         int word_spacing, line_spacing, column_spacing;
-        calculateStatisticalInformation(list, pageWidth, pageHeight, &word_spacing, &line_spacing, &column_spacing);
+        calculateStatisticalInformation(wordsWithCharacters, list, pageWidth, &word_spacing, &line_spacing, &column_spacing);
 
         const int tcx = word_spacing * 2;
         const int tcy = line_spacing * 2;
@@ -1585,26 +1506,24 @@ static RegionTextList XYCutForBoundingBoxes(const QList<WordWithCharacters> &wor
         int count;
 
         // for every text in the region
-        for(int j = 0 ; j < list.length() ; ++j )
+        for(int j = 0 ; j < list.count() ; ++j )
         {
-            TinyTextEntity *ent = list.at(j).word;
-            const QRect entRect = ent->area.geometry(pageWidth, pageHeight);
+            const QRect &entRect = wordsWithCharacters.at(list.at(j)).rect;
 
             // calculate vertical projection profile proj_on_xaxis1
-            for(int k = entRect.left() ; k <= entRect.left() + entRect.width() ; ++k)
-            {
-                if( ( k-regionRect.left() ) < size_proj_x && ( k-regionRect.left() ) >= 0 )
-                    proj_on_xaxis[k - regionRect.left()] += entRect.height();
-            }
+            addToProjection(proj_on_xaxis, size_proj_x, entRect.left() - regionRect.left(),
+                            entRect.left() + entRect.width() - regionRect.left(), entRect.height());
 
             // calculate horizontal projection profile in the same way
-            for(int k = entRect.top() ; k <= entRect.top() + entRect.height() ; ++k)
-            {
-                if( ( k-regionRect.top() ) < size_proj_y && ( k-regionRect.top() ) >= 0 )
-                    proj_on_yaxis[k - regionRect.top()] += entRect.width();
-            }
+            addToProjection(proj_on_yaxis, size_proj_y, entRect.top() - regionRect.top(),
+                            entRect.top() + entRect.height() - regionRect.top(), entRect.width());
         }
 
+        for( int j = 1 ; j < size_proj_x ; ++j )
+            proj_on_xaxis[j] += proj_on_xaxis[j-1];
+        for( int j = 1 ; j < size_proj_y ; ++j )
+            proj_on_yaxis[j] += proj_on_yaxis[j-1];
+
         for( int j = 0 ; j < size_proj_y ; ++j )
         {
             if (proj_on_yaxis[j] > maxY)
@@ -1623,7 +1542,6 @@ static RegionTextList XYCutForBoundingBoxes(const QList<WordWithCharacters> &wor
         }
         if(count) avgX /= count;
 
-
         /**
          * 2. Cleanup Boundary White Spaces and removal of noise
          */
@@ -1753,15 +1671,15 @@ static RegionTextList XYCutForBoundingBoxes(const QList<WordWithCharacters> &wor
             continue;
         }
 
-        WordsWithCharacters list1,list2;
+        WordIndexes list1,list2;
 
         // horizontal cut, topRect and bottomRect
         if(cut_hor)
         {
-            for( int j = 0 ; j < list.length() ; ++j )
+            for( int j = 0 ; j < list.count() ; ++j )
             {
-                const WordWithCharacters word = list.at(j);
-                const QRect wordRect = word.area().geometry(pageWidth,pageHeight);
+                const int word = list.at(j);
+                const QRect &wordRect = wordsWithCharacters.at(word).rect;
 
                 if(topRect.intersects(wordRect))
                     list1.append(word);
@@ -1779,10 +1697,10 @@ static RegionTextList XYCutForBoundingBoxes(const QList<WordWithCharacters> &wor
         //vertical cut, leftRect and rightRect
         else if(cut_ver)
         {
-            for( int j = 0 ; j < list.length() ; ++j )
+            for( int j = 0 ; j < list.count() ; ++j )
             {
-                const WordWithCharacters word = list.at(j);
-                const QRect wordRect = word.area().geometry(pageWidth,pageHeight);
+                const int word = list.at(j);
+                const QRect &wordRect = wordsWithCharacters.at(word).rect;
 
                 if(leftRect.intersects(wordRect))
                     list1.append(word);
@@ -1802,34 +1720,39 @@ static RegionTextList XYCutForBoundingBoxes(const QList<WordWithCharacters> &wor
 }
 
 /**
- * Add spaces in between words in a line. It reuses the pointers passed in tree and might add new ones. You will need to take care of deleting them if needed
+ * Add spaces in between words in a line and returns the characters of the page
+ * in reading order. The characters are reused, the spaces are new entities.
  */
-WordsWithCharacters addNecessarySpace(RegionTextList tree, int pageWidth, int pageHeight)
+static TextList addNecessarySpace(const RegionTextList &tree, const WordsWithCharacters &words, const QVector<TinyTextEntity*> &characters, int pageWidth, int pageHeight)
 {
     /**
      * 1. Call makeAndSortLines before adding spaces in between words in a line
      * 2. Now add spaces between every two words in a line
      * 3. Finally, extract all the space separated texts from each region and return it
      */
+    TextList result;
+    result.reserve(characters.count() + words.count());
+    const QString spaceStr(QStringLiteral(" "));
 
-    // Only change the texts under RegionTexts, not the area
     for(int j = 0 ; j < tree.length() ; j++)
     {
-        RegionText &tmpRegion = tree[j];
-
         // Step 01
-        QList< QPair<WordsWithCharacters, QRect> > sortedLines = makeAndSortLines(tmpRegion.text(), pageWidth, pageHeight);
+        const TextLines sortedLines = makeAndSortLines(words, tree.at(j).text());
 
-        // Step 02
-        for(int i = 0 ; i < sortedLines.length() ; i++)
+        // Step 02 and 03
+        for(int i = 0 ; i < sortedLines.count() ; i++)
         {
-            WordsWithCharacters &list = sortedLines[i].first;
-            for(int k = 0 ; k < list.length() ; k++ )
+            const WordIndexes &list = sortedLines.at(i).words;
+            for(int k = 0 ; k < list.count() ; k++ )
             {
-                const QRect area1 = list.at(k).area().roundedGeometry(pageWidth,pageHeight);
-                if( k+1 >= list.length() ) break;
+                const WordWithCharacters &word = words.at(list.at(k));
+                for(int c = 0 ; c < word.characterCount ; c++)
+                    result.append(characters.at(word.firstCharacter + c));
 
-                const QRect area2 = list.at(k+1).area().roundedGeometry(pageWidth,pageHeight);
+                if( k+1 >= list.count() ) break;
+
+                const QRect &area1 = word.roundedRect;
+                const QRect &area2 = words.at(list.at(k+1)).roundedRect;
                 const int space = area2.left() - area1.right();
 
                 if(space != 0)
@@ -1840,36 +1763,15 @@ WordsWithCharacters addNecessarySpace(RegionTextList tree, int pageWidth, int pa
                     const int top = area2.top() < area1.top() ? area2.top() : area1.top();
                     const int bottom = area2.bottom() > area1.bottom() ? area2.bottom() : area1.bottom();
 
-                    const QString spaceStr(QStringLiteral(" "));
                     const QRect rect(QPoint(left,top),QPoint(right,bottom));
                     const NormalizedRect entRect(rect,pageWidth,pageHeight);
-                    TinyTextEntity *ent1 = new TinyTextEntity(spaceStr, entRect);
-                    TinyTextEntity *ent2 = new TinyTextEntity(spaceStr, entRect);
-                    WordWithCharacters word(ent1, QList<TinyTextEntity*>() << ent2);
-
-                    list.insert(k+1, word);
-
-                    // Skip the space
-                    k++;
+                    result.append(new TinyTextEntity(spaceStr, entRect));
                 }
             }
         }
-
-        WordsWithCharacters tmpList;
-        for(int i = 0 ; i < sortedLines.length() ; i++)
-        {
-            tmpList += sortedLines.at(i).first;
-        }
-        tmpRegion.setText(tmpList);
     }
 
-    // Step 03
-    WordsWithCharacters tmp;
-    for(int i = 0 ; i < tree.length() ; i++)
-    {
-        tmp += tree.at(i).text();
-    }
-    return tmp;
+    return result;
 }
 
 /**
@@ -1877,46 +1779,51 @@ WordsWithCharacters addNecessarySpace(RegionTextList tree, int pageWidth, int pa
  */
 void TextPagePrivate::correctTextOrder()
 {
-    //m_page->m_page->width() and m_page->m_page->height() are in pixels at
+    correctTextOrder(m_page->width(), m_page->height(), m_page->boundingBox());
+}
+
+void TextPagePrivate::correctTextOrder(double width, double height, const NormalizedRect &boundingBox)
+{
+    //width and height are the ones of the page in pixels at
     //100% zoom level, and thus depend on display DPI. We scale pageWidth and
     //pageHeight to remove the dependence. Otherwise bugs would be more difficult
     //to reproduce and Okular could fail in extreme cases like a large TV with low DPI.
-    const double scalingFactor = 2000.0 / (m_page->width() + m_page->height());
-    const int pageWidth  = (int) (scalingFactor * m_page->width() );
-    const int pageHeight = (int) (scalingFactor * m_page->height());
-
-    TextList characters = m_words;
+    const double scalingFactor = 2000.0 / (width + height);
+    const int pageWidth  = (int) (scalingFactor * width );
+    const int pageHeight = (int) (scalingFactor * height);
 
     /**
-     * Remove spaces from the text
+     * Remove all the spaces in between texts. It will make all the generators
+     * same, whether they save spaces(like pdf) or not(like djvu).
      */
-    removeSpace(&characters);
+    QVector<TinyTextEntity*> characters;
+    characters.reserve(m_words.count());
+    TextList obsolete;
+    const QString space(QLatin1Char(' '));
+    for (TinyTextEntity *character : qAsConst(m_words))
+    {
+        if (character->text() == space)
+            obsolete.append(character);
+        else
+            characters.append(character);
+    }
 
     /**
      * Construct words from characters
      */
-    const QList<WordWithCharacters> wordsWithCharacters = makeWordFromCharacters(characters, pageWidth, pageHeight);
+    const WordsWithCharacters wordsWithCharacters = makeWordFromCharacters(characters, &obsolete, pageWidth, pageHeight);
 
     /**
      * Make a XY Cut tree for segmentation of the texts
      */
-    const RegionTextList tree = XYCutForBoundingBoxes(wordsWithCharacters, m_page->boundingBox(), pageWidth, pageHeight);
+    const RegionTextList tree = XYCutForBoundingBoxes(wordsWithCharacters, boundingBox, pageWidth, pageHeight);
 
     /**
-     * Add spaces to the word
+     * Add spaces to the words and break them into characters
      */
-    const WordsWithCharacters listWithWordsAndSpaces = addNecessarySpace(tree, pageWidth, pageHeight);
-
-    /**
-     * Break the words into characters
-     */
-    TextList listOfCharacters;
-    foreach(const WordWithCharacters &word, listWithWordsAndSpaces)
-    {
-        delete word.word;
-        listOfCharacters.append(word.characters);
-    }
-    setWordList(listOfCharacters);
+    m_words = addNecessarySpace(tree, wordsWithCharacters, characters, pageWidth, pageHeight);
+    qDeleteAll(obsolete);
+    m_textOrderCorrected = true;
 }
 
 TextEntity::List TextPage::words(const RegularAreaRect *area, TextAreaInclusionBehaviour b) const
@@ -43,6 +43,8 @@ class TextPagePrivate
         TextPagePrivate();
         ~TextPagePrivate();
 
+        static TextPagePrivate *get( TextPage *textPage );
+
         RegularAreaRect * findTextInternalForward( int searchID, const QString &query,
                                                    TextComparisonFunction comparer,
                                                    const TextList::ConstIterator &start,
@@ -55,20 +57,30 @@ class TextPagePrivate
                                                     const TextList::ConstIterator &end );
 
         /**
-         * Copy a TextList to m_words, the pointers of list are adopted
+         * Make necessary modifications in the TextList to make the text order correct, so
+         * that textselection works fine
+         *
+         * The page is described by its size and @p boundingBox instead of
+         * being read, so this can run in the thread that extracted the text.
          */
-        void setWordList(const TextList &list);
+        void correctTextOrder( double pageWidth, double pageHeight, const NormalizedRect &boundingBox );
 
         /**
-         * Make necessary modifications in the TextList to make the text order correct, so
-         * that textselection works fine
+         * The same, with the size and bounding box of m_page.
          */
         void correctTextOrder();
 
+        /**
+         * Returns an estimate of the memory used by the words and search points, in bytes
+         */
+        qulonglong memoryUsage() const;
+
         // variables those can be accessed directly from TextPage
         TextList m_words;
         QMap< int, SearchPoint* > m_searchPoints;
         Page *m_page;
+        // whether correctTextOrder() already ran on m_words
+        bool m_textOrderCorrected;
 
     private:
         RegularAreaRect * searchPointToArea(const SearchPoint* sp);
@@ -0,0 +1,314 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "textsnapshot_p.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSaveFile>
+
+#include "area.h"
+#include "debug_p.h"
+#include "textpage.h"
+#include "textpage_p.h"
+
+using namespace Okular;
+
+static const quint32 SnapshotMagic = 0x4f4b5458; // "OKTX"
+static const quint32 SnapshotVersion = 2;
+// magic, version, document size and time, page count, index entry count;
+// the layout key follows the page count
+static const qint64 SnapshotHeaderSize = 4 + 4 + 8 + 8 + 4 + 4;
+// page number, offset, length
+static const qint64 SnapshotIndexEntrySize = 4 + 8 + 4;
+static const double CoordinateScale = 65535.0;
+// how many bytes of compressed pages are kept until the next save, a few
+// thousand pages of dense text
+static const qint64 MaxAddedSize = 16 * 1024 * 1024;
+
+static quint16 quantize( double coordinate )
+{
+    return qRound( qBound( 0.0, coordinate, 1.0 ) * CoordinateScale );
+}
+
+static QByteArray serializeTextPage( const TextPage *textPage )
+{
+    QByteArray data;
+    QDataStream stream( &data, QIODevice::WriteOnly );
+    stream.setVersion( QDataStream::Qt_5_0 );
+
+    const TextEntity::List words = textPage->words( nullptr, TextPage::AnyPixelTextAreaInclusionBehaviour );
+    stream << qint32( words.count() );
+    for ( const TextEntity *word : words )
+    {
+        const NormalizedRect *area = word->area();
+        stream << word->text() << quantize( area->left ) << quantize( area->top ) << quantize( area->right ) << quantize( area->bottom );
+    }
+    qDeleteAll( words );
+
+    return qCompress( data );
+}
+
+static TextPage *deserializeTextPage( const QByteArray &compressed )
+{
+    const QByteArray data = qUncompress( compressed );
+    if ( data.isEmpty() )
+        return nullptr;
+
+    QDataStream stream( data );
+    stream.setVersion( QDataStream::Qt_5_0 );
+
+    qint32 count = 0;
+    stream >> count;
+    TextEntity::List words;
+    words.reserve( qMax( 0, count ) );
+    for ( qint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i )
+    {
+        QString text;
+        quint16 left, top, right, bottom;
+        stream >> text >> left >> top >> right >> bottom;
+        words.append( new TextEntity( text, new NormalizedRect( left / CoordinateScale, top / CoordinateScale,
+                                                                right / CoordinateScale, bottom / CoordinateScale ) ) );
+    }
+
+    if ( stream.status() != QDataStream::Ok )
+    {
+        qDeleteAll( words );
+        return nullptr;
+    }
+
+    // takes ownership of the words, that were saved in reading order already
+    TextPage *textPage = new TextPage( words );
+    TextPagePrivate::get( textPage )->m_textOrderCorrected = true;
+    return textPage;
+}
+
+TextSnapshot::TextSnapshot()
+    : m_documentSize( -1 ), m_pageCount( 0 ), m_modified( false ), m_addedSize( 0 )
+{
+}
+
+TextSnapshot::TextSnapshot( const TextSnapshot &other )
+{
+    QMutexLocker locker( &other.m_mutex );
+    m_fileName = other.m_fileName;
+    m_documentSize = other.m_documentSize;
+    m_documentModified = other.m_documentModified;
+    m_pageCount = other.m_pageCount;
+    m_layoutKey = other.m_layoutKey;
+    m_modified = other.m_modified;
+    m_index = other.m_index;
+    m_addedPages = other.m_addedPages;
+    m_addedSize = other.m_addedSize;
+}
+
+bool TextSnapshot::open( const QString &fileName, qint64 documentSize, const QDateTime &documentModified, int pageCount, const QByteArray &layoutKey )
+{
+    clear();
+    m_fileName = fileName;
+    m_documentSize = documentSize;
+    m_documentModified = documentModified;
+    m_pageCount = pageCount;
+    m_layoutKey = layoutKey;
+
+    QFile file( m_fileName );
+    if ( !file.open( QIODevice::ReadOnly ) )
+        return false;
+
+    QDataStream stream( &file );
+    stream.setVersion( QDataStream::Qt_5_0 );
+    quint32 magic = 0, version = 0;
+    qint64 size = 0, modified = 0;
+    qint32 pages = 0, entries = 0;
+    QByteArray key;
+    stream >> magic >> version;
+    if ( stream.status() != QDataStream::Ok || magic != SnapshotMagic || version != SnapshotVersion )
+        return false;
+
+    stream >> size >> modified >> pages >> key >> entries;
+    if ( stream.status() != QDataStream::Ok )
+        return false;
+
+    if ( size != m_documentSize || modified != m_documentModified.toMSecsSinceEpoch() || pages != m_pageCount || key != m_layoutKey )
+    {
+        qCDebug(OkularCoreDebug) << "Text snapshot" << m_fileName << "is out of date";
+        return false;
+    }
+
+    QHash< int, QPair< qint64, qint32 > > index;
+    for ( qint32 i = 0; i < entries && stream.status() == QDataStream::Ok; ++i )
+    {
+        qint32 page = 0, length = 0;
+        qint64 offset = 0;
+        stream >> page >> offset >> length;
+        if ( page >= 0 && page < m_pageCount && offset + length <= file.size() )
+            index.insert( page, qMakePair( offset, length ) );
+    }
+
+    if ( stream.status() != QDataStream::Ok )
+        return false;
+
+    qCDebug(OkularCoreDebug) << "Text snapshot" << m_fileName << "has the text of" << index.count() << "pages";
+    QMutexLocker locker( &m_mutex );
+    m_index = index;
+    return true;
+}
+
+void TextSnapshot::clear()
+{
+    m_fileName.clear();
+    m_documentSize = -1;
+    m_documentModified = QDateTime();
+    m_pageCount = 0;
+    m_layoutKey.clear();
+    m_modified = false;
+
+    QMutexLocker locker( &m_mutex );
+    m_index.clear();
+    m_addedPages.clear();
+    m_addedSize = 0;
+}
+
+bool TextSnapshot::contains( int page ) const
+{
+    QMutexLocker locker( &m_mutex );
+    return m_index.contains( page ) || m_addedPages.contains( page );
+}
+
+QByteArray TextSnapshot::readPage( int page ) const
+{
+    QPair< qint64, qint32 > entry;
+    {
+        QMutexLocker locker( &m_mutex );
+        const QHash< int, QByteArray >::const_iterator added = m_addedPages.constFind( page );
+        if ( added != m_addedPages.constEnd() )
+            return added.value();
+
+        if ( !m_index.contains( page ) )
+            return QByteArray();
+        entry = m_index.value( page );
+    }
+
+    QFile file( m_fileName );
+    if ( !file.open( QIODevice::ReadOnly ) || !file.seek( entry.first ) )
+        return QByteArray();
+
+    return file.read( entry.second );
+}
+
+TextPage * TextSnapshot::textPage( int page ) const
+{
+    const QByteArray data = readPage( page );
+    if ( data.isEmpty() )
+        return nullptr;
+
+    return deserializeTextPage( data );
+}
+
+void TextSnapshot::insert( int page, const TextPage *textPage )
+{
+    if ( m_fileName.isEmpty() || page < 0 || page >= m_pageCount || contains( page ) )
+        return;
+
+    // the pages not kept now are extracted again the next time
+    if ( m_addedSize >= MaxAddedSize )
+        return;
+
+    const QByteArray data = serializeTextPage( textPage );
+    QMutexLocker locker( &m_mutex );
+    m_addedPages.insert( page, data );
+    m_addedSize += data.size();
+    m_modified = true;
+}
+
+void TextSnapshot::remove( int page )
+{
+    QMutexLocker locker( &m_mutex );
+    const QHash< int, QByteArray >::iterator added = m_addedPages.find( page );
+    if ( added != m_addedPages.end() )
+    {
+        m_addedSize -= added.value().size();
+        m_addedPages.erase( added );
+        m_modified = true;
+    }
+    if ( m_index.remove( page ) )
+        m_modified = true;
+}
+
+void TextSnapshot::setLayoutKey( const QByteArray &layoutKey )
+{
+    if ( m_fileName.isEmpty() || m_layoutKey == layoutKey )
+        return;
+
+    m_layoutKey = layoutKey;
+    m_modified = true;
+}
+
+bool TextSnapshot::isModified() const
+{
+    return m_modified;
+}
+
+bool TextSnapshot::save()
+{
+    if ( m_fileName.isEmpty() )
+        return false;
+
+    // the pages already in the file are read back before it is replaced
+    QHash< int, QByteArray > pages;
+    QList< int > indexedPages;
+    {
+        QMutexLocker locker( &m_mutex );
+        pages = m_addedPages;
+        indexedPages = m_index.keys();
+    }
+    for ( int page : qAsConst( indexedPages ) )
+    {
+        const QByteArray data = readPage( page );
+        if ( !data.isEmpty() )
+            pages.insert( page, data );
+    }
+
+    QSaveFile file( m_fileName );
+    if ( !file.open( QIODevice::WriteOnly ) )
+    {
+        qCWarning(OkularCoreDebug) << "Failed to open text snapshot" << m_fileName;
+        return false;
+    }
+
+    QDataStream stream( &file );
+    stream.setVersion( QDataStream::Qt_5_0 );
+    stream << SnapshotMagic << SnapshotVersion << m_documentSize << qint64( m_documentModified.toMSecsSinceEpoch() )
+           << qint32( m_pageCount ) << m_layoutKey << qint32( pages.count() );
+
+    QHash< int, QPair< qint64, qint32 > > index;
+    qint64 offset = SnapshotHeaderSize + 4 + m_layoutKey.size() + pages.count() * SnapshotIndexEntrySize;
+    for ( QHash< int, QByteArray >::const_iterator it = pages.constBegin(); it != pages.constEnd(); ++it )
+    {
+        stream << qint32( it.key() ) << offset << qint32( it.value().size() );
+        index.insert( it.key(), qMakePair( offset, qint32( it.value().size() ) ) );
+        offset += it.value().size();
+    }
+    for ( QHash< int, QByteArray >::const_iterator it = pages.constBegin(); it != pages.constEnd(); ++it )
+        stream.writeRawData( it.value().constData(), it.value().size() );
+
+    if ( stream.status() != QDataStream::Ok || !file.commit() )
+    {
+        qCWarning(OkularCoreDebug) << "Failed to save text snapshot" << m_fileName;
+        return false;
+    }
+
+    QMutexLocker locker( &m_mutex );
+    m_index = index;
+    m_addedPages.clear();
+    m_addedSize = 0;
+    m_modified = false;
+    return true;
+}
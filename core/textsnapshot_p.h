@@ -0,0 +1,122 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_TEXTSNAPSHOT_P_H_
+#define _OKULAR_TEXTSNAPSHOT_P_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+
+namespace Okular {
+
+class TextPage;
+
+/**
+ * The text extracted from the pages of a document, saved next to its
+ * docdata so that it does not have to be extracted again when the
+ * document is opened another time.
+ *
+ * Every page is compressed on its own and the file starts with an index,
+ * so opening a snapshot only reads the index and a page is only read and
+ * decompressed when its text is needed. Word boxes are quantized to 16 bits
+ * per coordinate.
+ *
+ * A snapshot is only used for the document with the size and modification
+ * time it was saved for, laid out by the same generator in the same way.
+ *
+ * The pages are read by the text thread while the GUI thread adds new ones,
+ * and a copy of the snapshot is saved by the docdata writer thread.
+ */
+class TextSnapshot
+{
+    public:
+        TextSnapshot();
+        TextSnapshot( const TextSnapshot &other );
+
+        /**
+         * Opens the snapshot in @p fileName for a document of the given size,
+         * modification time and number of pages. @p layoutKey identifies the
+         * generator and the layout of the pages the text is extracted from.
+         *
+         * Returns false if there is no snapshot for this very document, in
+         * which case the snapshot starts empty.
+         */
+        bool open( const QString &fileName, qint64 documentSize, const QDateTime &documentModified, int pageCount, const QByteArray &layoutKey );
+
+        /**
+         * Forgets the snapshot, nothing is saved.
+         */
+        void clear();
+
+        /**
+         * Returns whether the text of page @p page is in the snapshot.
+         */
+        bool contains( int page ) const;
+
+        /**
+         * Returns the text of page @p page, or 0 if it is not in the snapshot
+         * or can not be read. The caller takes ownership of the text page.
+         */
+        TextPage * textPage( int page ) const;
+
+        /**
+         * Adds the text of page @p page to the snapshot, if not there already
+         * and if the pages added since the snapshot was opened do not take
+         * too much memory already.
+         */
+        void insert( int page, const TextPage *textPage );
+
+        /**
+         * Forgets the text of page @p page, e.g. because it was laid out again.
+         */
+        void remove( int page );
+
+        /**
+         * Sets the layout the snapshot is saved for, as the generator may
+         * have corrected the page sizes since the snapshot was opened.
+         */
+        void setLayoutKey( const QByteArray &layoutKey );
+
+        /**
+         * Returns whether the snapshot changed since it was opened.
+         */
+        bool isModified() const;
+
+        /**
+         * Writes the snapshot back to the file it was opened from.
+         */
+        bool save();
+
+    private:
+        TextSnapshot &operator=( const TextSnapshot & ) = delete;
+
+        QByteArray readPage( int page ) const;
+
+        QString m_fileName;
+        qint64 m_documentSize;
+        QDateTime m_documentModified;
+        int m_pageCount;
+        QByteArray m_layoutKey;
+        bool m_modified;
+        // guards the pages, used from the text thread
+        mutable QMutex m_mutex;
+        // offset and length of the pages in the file
+        QHash< int, QPair< qint64, qint32 > > m_index;
+        // compressed pages added since the snapshot was opened, and their size
+        QHash< int, QByteArray > m_addedPages;
+        qint64 m_addedSize;
+};
+
+}
+
+#endif
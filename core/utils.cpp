@@ -164,6 +164,52 @@ inline static bool isPaperColor( QRgb argb, QRgb paperColor ) {
     return ( argb & 0xFFFFFF ) == ( paperColor & 0xFFFFFF); // ignore alpha
 }
 
+// how many pixels are compared before looking whether one was not paper,
+// the comparison loop has no branch so that it can be vectorized
+static const int PaperRunLength = 64;
+
+inline static bool isPaperRun( const QRgb *pixels, int count, QRgb paperColor )
+{
+    QRgb difference = 0;
+    for ( int i = 0; i < count; ++i )
+        difference |= pixels[ i ] ^ paperColor;
+    return ( difference & 0xFFFFFF ) == 0; // ignore alpha
+}
+
+// returns the first pixel in [from, to) of the line that is not paper, to if none
+static int firstInk( const QRgb *line, int from, int to, QRgb paperColor )
+{
+    int x = from;
+    while ( x < to )
+    {
+        const int count = qMin( PaperRunLength, to - x );
+        if ( !isPaperRun( line + x, count, paperColor ) )
+            break;
+        x += count;
+    }
+    for ( ; x < to; ++x )
+        if ( !isPaperColor( line[ x ], paperColor ) )
+            return x;
+    return to;
+}
+
+// returns the last pixel in [from, to) of the line that is not paper, from - 1 if none
+static int lastInk( const QRgb *line, int from, int to, QRgb paperColor )
+{
+    int x = to;
+    while ( x > from )
+    {
+        const int count = qMin( PaperRunLength, x - from );
+        if ( !isPaperRun( line + x - count, count, paperColor ) )
+            break;
+        x -= count;
+    }
+    for ( --x; x >= from; --x )
+        if ( !isPaperColor( line[ x ], paperColor ) )
+            return x;
+    return from - 1;
+}
+
 NormalizedRect Utils::imageBoundingBox( const QImage * image )
 {
     if ( !image )
@@ -179,36 +225,50 @@ NormalizedRect Utils::imageBoundingBox( const QImage * image )
     time.start();
 #endif
 
-    // Scan pixels for top non-white
+    // the scan reads the 32-bit scanlines directly, as QImage::pixel() does for
+    // these formats; other formats (grayscale, mono) are converted first
+    QImage converted;
+    if ( image->format() != QImage::Format_RGB32 && image->format() != QImage::Format_ARGB32
+         && image->format() != QImage::Format_ARGB32_Premultiplied )
+    {
+        converted = image->convertToFormat( QImage::Format_ARGB32 );
+        image = &converted;
+    }
+
+    // Scan rows for top non-white
     for ( top = 0; top < height; ++top )
-        for ( x = 0; x < width; ++x )
-            if ( !isPaperColor( image->pixel( x, top ), paperColor ) )
-                goto got_top;
-    return NormalizedRect( 0, 0, 0, 0 ); // the image is blank
-got_top:
+    {
+        x = firstInk( reinterpret_cast<const QRgb *>( image->constScanLine( top ) ), 0, width, paperColor );
+        if ( x < width )
+            break;
+    }
+    if ( top == height )
+        return NormalizedRect( 0, 0, 0, 0 ); // the image is blank
     left = right = x;
 
-    // Scan pixels for bottom non-white
-    for ( bottom = height-1; bottom >= top; --bottom )
-        for ( x = width-1; x >= 0; --x )
-            if ( !isPaperColor( image->pixel( x, bottom ), paperColor ) )
-                goto got_bottom;
-    Q_ASSERT( 0 ); // image changed?!
-got_bottom:
-    if ( x < left )
-        left = x;
-    if ( x > right )
-        right = x;
+    // Scan rows for bottom non-white
+    for ( bottom = height-1; bottom > top; --bottom )
+    {
+        x = lastInk( reinterpret_cast<const QRgb *>( image->constScanLine( bottom ) ), 0, width, paperColor );
+        if ( x >= 0 )
+            break;
+    }
+    if ( bottom > top )
+    {
+        if ( x < left )
+            left = x;
+        if ( x > right )
+            right = x;
+    }
 
     // Scan for leftmost and rightmost (we already found some bounds on these):
     for ( y = top; y <= bottom && ( left > 0 || right < width-1 ); ++y )
     {
-        for ( x = 0; x < left; ++x )
-            if ( !isPaperColor( image->pixel( x, y ), paperColor ) )
-                left = x;
-        for ( x = width-1; x > right+1; --x )
-            if ( !isPaperColor( image->pixel( x, y ), paperColor ) )
-                right = x;
+        const QRgb *line = reinterpret_cast<const QRgb *>( image->constScanLine( y ) );
+        left = firstInk( line, 0, left, paperColor );
+        x = lastInk( line, right + 1, width, paperColor );
+        if ( x > right )
+            right = x;
     }
 
     NormalizedRect bbox( QRect( left, top, ( right - left + 1), ( bottom - top + 1 ) ),
@@ -10,9 +10,18 @@
 
 #include "generator_chm.h"
 
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
 #include <QEventLoop>
+#include <QFileInfo>
 #include <QMutex>
 #include <QPainter>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTimer>
 #include <QDomElement>
 
 #include <KAboutData>
@@ -29,8 +38,73 @@
 #include <core/textpage.h>
 #include <core/utils.h>
 
+#include "lib/ebook_search.h"
+
 OKULAR_EXPORT_PLUGIN(CHMGenerator, "libokularGenerator_chmlib.json")
 
+// identifies the page sizes cache format, change when the layout changes
+static const quint32 PageSizesCacheMagic = 0x4f6b6331;
+// identifies the search index cache format, change when the tokenizer changes
+static const quint32 IndexCacheMagic = 0x4f6b6931;
+
+// the caches are only trusted if they were written for this very file
+static bool readCacheHeader(QDataStream &stream, quint32 expectedMagic, const QString &fileName)
+{
+    const QFileInfo info(fileName);
+    quint32 magic;
+    qint64 size;
+    QDateTime modified;
+    stream >> magic >> size >> modified;
+    return stream.status() == QDataStream::Ok && magic == expectedMagic && size == info.size()
+           && modified == info.lastModified();
+}
+
+static void writeCacheHeader(QDataStream &stream, quint32 magic, const QString &fileName)
+{
+    const QFileInfo info(fileName);
+    stream << magic << info.size() << info.lastModified();
+}
+
+static QString withoutReference(const QString &url)
+{
+    const int pos = url.indexOf(QLatin1Char('#'));
+    return pos == -1 ? url : url.left(pos);
+}
+
+class CHMIndexThread : public QThread
+{
+    public:
+        explicit CHMIndexThread(const QString &fileName)
+            : m_fileName(fileName)
+        {
+        }
+
+        QByteArray index() const
+        {
+            return m_index;
+        }
+
+    protected:
+        void run() override
+        {
+            // use a handle of our own, the generator keeps reading from its one
+            EBook *ebook = EBook::loadFile(m_fileName);
+            if (!ebook)
+                return;
+
+            QByteArray index;
+            QDataStream stream(&index, QIODevice::WriteOnly);
+            EBookSearch search;
+            if (search.generateIndex(ebook, stream))
+                m_index = index;
+            delete ebook;
+        }
+
+    private:
+        QString m_fileName;
+        QByteArray m_index;
+};
+
 static QString absolutePath( const QString &baseUrl, const QString &path )
 {
     QString absPath;
@@ -52,15 +126,23 @@ CHMGenerator::CHMGenerator( QObject *parent, const QVariantList &args )
     : Okular::Generator( parent, args )
 {
     setFeature( TextExtraction );
+    setFeature( IndexedSearch );
 
     m_syncGen=0;
     m_file=0;
     m_request = 0;
+    m_measureGen = 0;
+    m_measuringPage = -1;
+    m_pageSizesDirty = false;
+    m_search = 0;
+    m_indexThread = 0;
 }
 
 CHMGenerator::~CHMGenerator()
 {
+    stopIndexing();
     delete m_syncGen;
+    delete m_measureGen;
 }
 
 bool CHMGenerator::loadDocument( const QString & fileName, QVector< Okular::Page * > & pagesVector )
@@ -114,9 +196,8 @@ bool CHMGenerator::loadDocument( const QString & fileName, QVector< Okular::Page
         if (!urlLower.endsWith(QLatin1String(".html")) && !urlLower.endsWith(QLatin1String(".htm")))
             continue;
 
-        int pos = url.indexOf (QLatin1Char(('#')));
         // insert the url into the maps, but insert always the variant without the #ref part
-        QString tmpUrl = pos == -1 ? url : url.left(pos);
+        QString tmpUrl = withoutReference(url);
 
         // url already there, abort insertion
         if (m_urlPage.contains(tmpUrl)) continue;
@@ -143,21 +224,292 @@ bool CHMGenerator::loadDocument( const QString & fileName, QVector< Okular::Page
     }
     disconnect( m_syncGen, 0, this, 0 );
 
+    // laying out every page just to know its size takes minutes for big
+    // files, so use the sizes measured the last time this file was opened
+    // and estimate the missing ones from the first page
+    loadPageSizes();
+    if (!m_pageUrl.isEmpty() && !m_pageSizes.at(0).isValid())
+    {
+        preparePageForSyncOperation(m_pageUrl.at(0));
+        m_pageSizes[0] = QSize(m_syncGen->view()->contentsWidth(), m_syncGen->view()->contentsHeight());
+        m_pageSizesDirty = true;
+    }
+
+    m_measureQueue.clear();
     for (int i = 0; i < m_pageUrl.count(); ++i)
     {
-        preparePageForSyncOperation(m_pageUrl.at(i));
-        pagesVector[ i ] = new Okular::Page (i, m_syncGen->view()->contentsWidth(),
-            m_syncGen->view()->contentsHeight(), Okular::Rotation0 );
+        QSize size = m_pageSizes.at(i);
+        if (!size.isValid())
+        {
+            size = m_pageSizes.at(0);
+            m_measureQueue.append(i);
+        }
+        pagesVector[ i ] = new Okular::Page (i, size.width(), size.height(), Okular::Rotation0 );
     }
 
     connect( m_syncGen, SIGNAL(completed()), this, SLOT(slotCompleted()) );
     connect( m_syncGen, &KParts::ReadOnlyPart::canceled, this, &CHMGenerator::slotCompleted );
 
+    if (!m_measureQueue.isEmpty())
+        QTimer::singleShot(0, this, &CHMGenerator::measureNextPage);
+
     return true;
 }
 
+QString CHMGenerator::pageAddress(const QString &url) const
+{
+    return QStringLiteral("ms-its:") + m_fileName + QStringLiteral("::") + m_file->urlToPath(QUrl(url));
+}
+
+QString CHMGenerator::cacheFileName(const QString &extension) const
+{
+    const QByteArray key = QCryptographicHash::hash(QFileInfo(m_fileName).absoluteFilePath().toUtf8(), QCryptographicHash::Md5).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+           + QStringLiteral("/okular/chm/") + QString::fromLatin1(key) + extension;
+}
+
+void CHMGenerator::loadPageSizes()
+{
+    m_pageSizes.fill(QSize(), m_pageUrl.count());
+    m_pageSizesDirty = false;
+
+    QFile file(cacheFileName(QStringLiteral(".pagesizes")));
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    if (!readCacheHeader(stream, PageSizesCacheMagic, m_fileName))
+        return;
+
+    QVector<QSize> sizes;
+    stream >> sizes;
+    if (stream.status() == QDataStream::Ok && sizes.count() == m_pageUrl.count())
+        m_pageSizes = sizes;
+}
+
+void CHMGenerator::savePageSizes()
+{
+    if (!m_pageSizesDirty || m_fileName.isEmpty())
+        return;
+
+    const QString fileName = cacheFileName(QStringLiteral(".pagesizes"));
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    writeCacheHeader(stream, PageSizesCacheMagic, m_fileName);
+    stream << m_pageSizes;
+    if (file.commit())
+        m_pageSizesDirty = false;
+}
+
+void CHMGenerator::loadIndex()
+{
+    if (m_search || m_indexThread)
+        return;
+
+    QFile file(cacheFileName(QStringLiteral(".index")));
+    if (file.open(QIODevice::ReadOnly))
+    {
+        QDataStream stream(&file);
+        if (readCacheHeader(stream, IndexCacheMagic, m_fileName))
+        {
+            EBookSearch *search = new EBookSearch();
+            if (search->loadIndex(stream) && stream.status() == QDataStream::Ok)
+            {
+                setIndex(search);
+                return;
+            }
+            delete search;
+        }
+    }
+
+    // reading every html file takes a while, search the slow way meanwhile
+    m_indexThread = new CHMIndexThread(m_fileName);
+    connect( m_indexThread, &QThread::finished, this, &CHMGenerator::slotIndexGenerated );
+    m_indexThread->start(QThread::LowPriority);
+}
+
+void CHMGenerator::slotIndexGenerated()
+{
+    if (m_search || !m_indexThread || sender() != m_indexThread || !m_indexThread->isFinished())
+        return;
+
+    // the finished thread is kept until the document is closed, so a file
+    // that can't be indexed is not tried again
+    const QByteArray index = m_indexThread->index();
+    if (index.isEmpty())
+        return;
+
+    const QString fileName = cacheFileName(QStringLiteral(".index"));
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile file(fileName);
+    if (file.open(QIODevice::WriteOnly))
+    {
+        QDataStream stream(&file);
+        writeCacheHeader(stream, IndexCacheMagic, m_fileName);
+        stream.writeRawData(index.constData(), index.size());
+        file.commit();
+    }
+
+    QDataStream stream(index);
+    EBookSearch *search = new EBookSearch();
+    if (search->loadIndex(stream))
+        setIndex(search);
+    else
+        delete search;
+}
+
+void CHMGenerator::setIndex(EBookSearch *search)
+{
+    m_search = search;
+
+    // document numbers are 16 bit in the index, it can't be trusted for
+    // files with more documents than that
+    const QList<QUrl> documents = search->documents();
+    if (documents.count() > 32767)
+        return;
+
+    m_indexedPages.fill(false, m_pageUrl.count());
+    foreach (const QUrl &url, documents)
+    {
+        const int page = m_urlPage.value(withoutReference(url.toString()), -1);
+        if (page != -1)
+            m_indexedPages.setBit(page);
+    }
+}
+
+void CHMGenerator::stopIndexing()
+{
+    if (m_indexThread)
+    {
+        m_indexThread->requestInterruption();
+        m_indexThread->wait();
+        delete m_indexThread;
+        m_indexThread = 0;
+    }
+    delete m_search;
+    m_search = 0;
+    m_indexedPages.clear();
+}
+
+bool CHMGenerator::searchCandidatePages(const QString &text, Okular::Document::SearchType type, QVector<int> *pages)
+{
+    loadIndex();
+    if (!m_search || m_indexedPages.isEmpty())
+        return false;
+
+    // the index has the lowercase words of the html source; only ascii letters
+    // and digits are sure to be there as they are rendered, entities and the
+    // characters splitting words make the search go through every page
+    const QString query = text.toLower();
+    foreach (const QChar &c, query)
+    {
+        if (c != QLatin1Char(' ') && (c.unicode() > 127 || !c.isLetterOrNumber()))
+            return false;
+    }
+
+    const QStringList words = query.split(QLatin1Char(' '), QString::SkipEmptyParts);
+    if (words.isEmpty())
+        return false;
+
+    // a phrase is only on the pages having all of its words, like the google
+    // style search for all words; any of them is enough for the other one
+    const bool anyWord = type == Okular::Document::GoogleAny;
+    QBitArray matching;
+    foreach (const QString &word, words)
+    {
+        QList<QUrl> documents;
+        m_search->documentsContaining(word, &documents);
+
+        QBitArray wordPages(m_pageUrl.count());
+        foreach (const QUrl &url, documents)
+        {
+            const int page = m_urlPage.value(withoutReference(url.toString()), -1);
+            if (page != -1)
+                wordPages.setBit(page);
+        }
+
+        if (matching.isEmpty())
+            matching = wordPages;
+        else if (anyWord)
+            matching |= wordPages;
+        else
+            matching &= wordPages;
+    }
+
+    // the pages missing from the index are always searched
+    matching |= ~m_indexedPages;
+
+    pages->clear();
+    for (int i = 0; i < matching.size(); ++i)
+    {
+        if (matching.testBit(i))
+            pages->append(i);
+    }
+    return true;
+}
+
+void CHMGenerator::measureNextPage()
+{
+    if (!m_file || m_measuringPage != -1)
+        return;
+
+    if (m_measureQueue.isEmpty())
+    {
+        savePageSizes();
+        return;
+    }
+
+    if (!m_measureGen)
+    {
+        m_measureGen = new KHTMLPart();
+        connect( m_measureGen, SIGNAL(completed()), this, SLOT(slotMeasureCompleted()) );
+        connect( m_measureGen, &KParts::ReadOnlyPart::canceled, this, &CHMGenerator::slotMeasureCompleted );
+    }
+
+    m_measuringPage = m_measureQueue.takeFirst();
+    m_measureGen->openUrl(QUrl(pageAddress(m_pageUrl.at(m_measuringPage))));
+}
+
+void CHMGenerator::slotMeasureCompleted()
+{
+    if (m_measuringPage == -1)
+        return;
+
+    const int page = m_measuringPage;
+    m_measuringPage = -1;
+
+    m_measureGen->view()->layout();
+    const QSize size(m_measureGen->view()->contentsWidth(), m_measureGen->view()->contentsHeight());
+    m_measureGen->closeUrl();
+
+    if (!size.isEmpty())
+    {
+        m_pageSizes[page] = size;
+        m_pageSizesDirty = true;
+        updatePageSize(page, size);
+    }
+
+    // let the event loop breathe between pages
+    QTimer::singleShot(0, this, &CHMGenerator::measureNextPage);
+}
+
 bool CHMGenerator::doCloseDocument()
 {
+    // keep what was measured so far for the next time
+    m_measureQueue.clear();
+    m_measuringPage = -1;
+    if (m_measureGen)
+    {
+        m_measureGen->closeUrl();
+    }
+    savePageSizes();
+    m_pageSizes.clear();
+    stopIndexing();
+
     // delete the document information of the old document
     delete m_file;
     m_file=0;
@@ -176,7 +528,7 @@ bool CHMGenerator::doCloseDocument()
 
 void CHMGenerator::preparePageForSyncOperation(const QString & url)
 {
-    QString pAddress = QStringLiteral("ms-its:") + m_fileName + QStringLiteral("::") + m_file->urlToPath(QUrl(url));
+    QString pAddress = pageAddress(url);
     m_chmUrl = url;
 
     m_syncGen->openUrl(QUrl(pAddress));
@@ -259,7 +611,11 @@ void CHMGenerator::generatePixmap( Okular::PixmapRequest * request )
     userMutex()->lock();
     QString url= m_pageUrl[request->pageNumber()];
 
-    QString pAddress= QStringLiteral("ms-its:") + m_fileName + QStringLiteral("::") + m_file->urlToPath(QUrl(url));
+    // visible pages are measured first
+    if (m_measureQueue.removeOne(request->pageNumber()))
+        m_measureQueue.prepend(request->pageNumber());
+
+    QString pAddress= pageAddress(url);
     m_chmUrl = url;
     m_syncGen->view()->resizeContents(requestWidth,requestHeight);
     m_request=request;
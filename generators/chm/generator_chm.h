@@ -18,6 +18,8 @@
 
 #include <qbitarray.h>
 
+class CHMIndexThread;
+class EBookSearch;
 class KHTMLPart;
 
 namespace Okular {
@@ -45,9 +47,16 @@ class CHMGenerator : public Okular::Generator
 
         QVariant metaData( const QString & key, const QVariant & option ) const override;
 
+        bool searchCandidatePages( const QString &text, Okular::Document::SearchType type, QVector<int> *pages ) override;
+
     public Q_SLOTS:
         void slotCompleted();
 
+    private Q_SLOTS:
+        void measureNextPage();
+        void slotMeasureCompleted();
+        void slotIndexGenerated();
+
     protected:
         bool doCloseDocument() override;
         Okular::TextPage* textPage( Okular::Page *page ) override;
@@ -56,6 +65,13 @@ class CHMGenerator : public Okular::Generator
         void additionalRequestData();
         void recursiveExploreNodes( DOM::Node node, Okular::TextPage *tp );
         void preparePageForSyncOperation( const QString &url );
+        QString pageAddress( const QString &url ) const;
+        QString cacheFileName( const QString &extension ) const;
+        void loadPageSizes();
+        void savePageSizes();
+        void loadIndex();
+        void setIndex( EBookSearch *search );
+        void stopIndexing();
         QMap<QString, int> m_urlPage;
         QVector<QString> m_pageUrl;
         Okular::DocumentSynopsis m_docSyn;
@@ -66,6 +82,20 @@ class CHMGenerator : public Okular::Generator
         Okular::PixmapRequest* m_request;
         QBitArray m_textpageAddedList;
         QBitArray m_rectsGenerated;
+
+        // pages are opened with an estimated size and measured in the
+        // background by m_measureGen, the results are cached on disk
+        KHTMLPart *m_measureGen;
+        QVector<QSize> m_pageSizes;
+        QList<int> m_measureQueue;
+        int m_measuringPage;
+        bool m_pageSizesDirty;
+
+        // word index of the html files, used to skip the pages that can't
+        // match a search; generated once in a thread and cached on disk
+        EBookSearch *m_search;
+        CHMIndexThread *m_indexThread;
+        QBitArray m_indexedPages;
 };
 
 #endif
@@ -223,3 +223,17 @@ bool EBookSearch::hasIndex() const
 {
 	return m_Index != 0;
 }
+
+bool EBookSearch::documentsContaining( const QString& fragment, QList< QUrl > * results ) const
+{
+	if ( !m_Index )
+		return false;
+	
+	*results += m_Index->documentsContaining( fragment );
+	return true;
+}
+
+QList< QUrl > EBookSearch::documents() const
+{
+	return m_Index ? m_Index->documents() : QList< QUrl >();
+}
@@ -65,6 +65,16 @@ class EBookSearch : public QObject
 		//! Returns true if a valid search index is present, and therefore search could be executed
 		bool	hasIndex() const;
 		
+		//! Adds to \param results every document having a word which contains \param fragment,
+		//! which must be lowercase and consist of letters and numbers only. Unlike searchQuery()
+		//! this does not need the word boundaries, so it never misses a document where
+		//! \param fragment appears as a part of a word.
+		//! Returns false if the index is not generated.
+		bool	documentsContaining( const QString& fragment, QList< QUrl > * results ) const;
+		
+		//! Returns the list of documents the index was generated from.
+		QList< QUrl >	documents() const;
+		
 	signals:
 		void	progressStep( int value, const QString& stepName );
 		
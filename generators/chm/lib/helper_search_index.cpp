@@ -17,7 +17,9 @@
  */
 
 #include <QApplication>
+#include <QSet>
 #include <QTextCodec>
+#include <QThread>
 
 #include "ebook.h"
 #include "ebook_search.h"
@@ -94,7 +96,7 @@ bool Index::makeIndex(const QList< QUrl >& docs, EBook *chmFile )
 	
 	for ( int i = 0; it != docList.constEnd(); ++it, ++i )
 	{
-		if ( lastWindowClosed )
+		if ( lastWindowClosed || QThread::currentThread()->isInterruptionRequested() )
 			return false;
 
 		QUrl filename = *it;
@@ -249,11 +251,12 @@ bool Index::parseDocumentToStringlist(EBook *chmFile, const QUrl& filename, QStr
 		// Now process STATE_OUTSIDE_TAGS
 		//
 		
-		// Check for start of HTML tag, and switch to STATE_IN_HTML_TAG if it is
+		// Check for start of HTML tag, and switch to STATE_IN_HTML_TAG if it is.
+		// The word is not ended there, inline markup like <b>W</b>ord must not split it.
 		if ( ch == '<' )
 		{
 			state = STATE_IN_HTML_TAG;
-			goto tokenize_buf;
+			continue;
 		}
 		
 		// Check for start of HTML entity
@@ -287,7 +290,6 @@ bool Index::parseDocumentToStringlist(EBook *chmFile, const QUrl& filename, QStr
 			continue;
 		}
 		
-tokenize_buf:		
 		// Just add the word; it is most likely a space or terminated by tokenizer.
 		if ( !parsedbuf.isEmpty() )
 		{
@@ -357,6 +359,30 @@ bool Index::readDict( QDataStream& stream )
 }
 
 
+QList< QUrl > Index::documentsContaining( const QString& fragment ) const
+{
+	QSet< int > docNumbers;
+	
+	for ( QHash<QString, Entry *>::ConstIterator it = dict.constBegin(); it != dict.constEnd(); ++it )
+	{
+		if ( !it.key().contains( fragment ) )
+			continue;
+		
+		for ( QVector<Document>::ConstIterator doc_it = it.value()->documents.constBegin(); doc_it != it.value()->documents.constEnd(); ++doc_it )
+			docNumbers.insert( (*doc_it).docNumber );
+	}
+	
+	QList< QUrl > results;
+	for ( QSet< int >::ConstIterator it = docNumbers.constBegin(); it != docNumbers.constEnd(); ++it )
+	{
+		if ( *it >= 0 && *it < docList.size() )
+			results << docList.at( *it );
+	}
+	
+	return results;
+}
+
+
 QList< QUrl > Index::query(const QStringList &terms, const QStringList &termSeq, const QStringList &seqWords, EBook *chmFile )
 {
 	QList<Term> termList;
@@ -76,6 +76,8 @@ class Index : public QObject
 		bool 		readDict( QDataStream& stream );
 		bool 		makeIndex(const QList<QUrl> &docs, EBook * chmFile );
 		QList<QUrl>	query( const QStringList&, const QStringList&, const QStringList&, EBook * chmFile );
+		QList<QUrl>	documentsContaining( const QString& fragment ) const;
+		const QList<QUrl>& documents() const { return docList; }
 		QString 	getCharsSplit() const { return m_charssplit; }
 		QString 	getCharsPartOfWord() const { return m_charsword; }
 
@@ -14,7 +14,6 @@
 #include <QtGui/QTextFrame>
 #include <QTextDocumentFragment>
 #include <QFileInfo>
-#include <QApplication> // Because of the HACK
 
 #include <QtCore/QDebug>
 #include <KLocalizedString>
@@ -28,12 +27,19 @@
 
 using namespace Epub;
 
-Converter::Converter() : mTextDocument(NULL)
+// the length of the HTML converted at a time, a few chapters at most
+static const int partLength = 64 * 1024;
+
+static const QSize videoSize(320, 240);
+
+Converter::Converter() : mTextDocument(NULL), mCursor(NULL), mNextChapter(0),
+  mPendingLength(0), mConvertedLength(0), mFirstPage(true), mDone(true)
 {
 }
 
 Converter::~Converter()
 {
+  delete mCursor;
 }
 
 // join the char * array into one QString
@@ -174,10 +180,22 @@ QTextDocument* Converter::convert( const QString &fileName )
   }
   mTextDocument = newDocument;
 
-  QTextCursor *_cursor = new QTextCursor( mTextDocument );
+  // Get the links without CSS to be blue, the link color of the palette
+  // can't be changed while the rest of the book is converted in a thread
+  mTextDocument->setDefaultStyleSheet(QStringLiteral("a { color: blue; }"));
+
+  delete mCursor;
+  mCursor = new QTextCursor( mTextDocument );
 
   mLocalLinks.clear();
   mSectionMap.clear();
+  mChapterLinks.clear();
+  mChapterContents.clear();
+  mNextChapter = 0;
+  mPendingLength = 0;
+  mConvertedLength = 0;
+  mFirstPage = true;
+  mDone = false;
 
   // Emit the document meta data
   _emitData(Okular::DocumentInfo::Title, EPUB_TITLE);
@@ -194,172 +212,219 @@ QTextDocument* Converter::convert( const QString &fileName )
 
   struct eiterator *it;
 
-  // iterate over the book
+  // read the chapters of the book, their size gives the page count estimate
   it = epub_get_iterator(mTextDocument->getEpub(), EITERATOR_SPINE, 0);
+  if (it) {
+    do {
+      if (epub_it_get_curr(it)) {
+        mChapterLinks.append(QString::fromUtf8(epub_it_get_curr_url(it)));
+        mChapterContents.append(QString::fromUtf8(epub_it_get_curr(it)));
+        mPendingLength += mChapterContents.last().length();
+      }
+    } while (epub_it_get_next(it));
 
-  // if the background color of the document is non-white it will be handled by QTextDocument::setHtml()
-  bool firstPage = true;
-  QVector<Okular::MovieAnnotation *> movieAnnots;
-  QVector<Okular::SoundAction *> soundActions;
-  const QSize videoSize(320, 240);
-  do{
-    movieAnnots.clear();
-    soundActions.clear();
-
-    if(epub_it_get_curr(it)) {
-      const QString link = QString::fromUtf8(epub_it_get_curr_url(it));
-      mTextDocument->setCurrentSubDocument(link);
-      QString htmlContent = QString::fromUtf8(epub_it_get_curr(it));
-
-      // as QTextCharFormat::anchorNames() ignores sections, replace it with <p>
-      htmlContent.replace(QRegExp(QStringLiteral("< *section")),QStringLiteral("<p"));
-      htmlContent.replace(QRegExp(QStringLiteral("< */ *section")),QStringLiteral("</p"));
-
-      // convert svg tags to img
-      const int maxHeight = mTextDocument->maxContentHeight();
-      const int maxWidth = mTextDocument->maxContentWidth();
-      QDomDocument dom;
-      if(dom.setContent(htmlContent)) {
-        QDomNodeList svgs = dom.elementsByTagName(QStringLiteral("svg"));
-        if(!svgs.isEmpty()) {
-          QList< QDomNode > imgNodes;
-          for (int i = 0; i < svgs.length(); ++i) {
-            QDomNodeList images = svgs.at(i).toElement().elementsByTagName(QStringLiteral("image"));
-            for (int j = 0; j < images.length(); ++j) {
-              QString lnk = images.at(i).toElement().attribute(QStringLiteral("xlink:href"));
-              int ht = images.at(i).toElement().attribute(QStringLiteral("height")).toInt();
-              int wd = images.at(i).toElement().attribute(QStringLiteral("width")).toInt();
-              QImage img = mTextDocument->loadResource(QTextDocument::ImageResource,QUrl(lnk)).value<QImage>();
-              if(ht == 0) ht = img.height();
-              if(wd == 0) wd = img.width();
-              if(ht > maxHeight) ht = maxHeight;
-              if(wd > maxWidth) wd = maxWidth;
-              mTextDocument->addResource(QTextDocument::ImageResource,QUrl(lnk),img);
-              QDomDocument newDoc;
-              newDoc.setContent(QStringLiteral("<img src=\"%1\" height=\"%2\" width=\"%3\" />").arg(lnk).arg(ht).arg(wd));
-              imgNodes.append(newDoc.documentElement());
-            }
-            foreach (const QDomNode& nd, imgNodes) {
-              svgs.at(i).parentNode().replaceChild(nd,svgs.at(i));
-            }
-          }
-        }
+    epub_free_iterator(it);
+  }
+
+  // only the beginning is laid out now, the rest while the book is shown
+  convertNextPart();
+
+  return mTextDocument;
+}
 
-        // handle embedded videos
-        QDomNodeList videoTags = dom.elementsByTagName(QStringLiteral("video"));
-        while(!videoTags.isEmpty()) {
-          QDomNodeList sourceTags = videoTags.at(0).toElement().elementsByTagName(QStringLiteral("source"));
-          if(!sourceTags.isEmpty()) {
-            QString lnk = sourceTags.at(0).toElement().attribute(QStringLiteral("src"));
+void Converter::convertNextPart()
+{
+  int length = 0;
+  while (mNextChapter < mChapterLinks.size() && length < partLength) {
+    const QString htmlContent = mChapterContents.at(mNextChapter);
+    mChapterContents[mNextChapter].clear();
+    length += htmlContent.length();
+    _convertChapter(mChapterLinks.at(mNextChapter), htmlContent);
+    ++mNextChapter;
+  }
+  mPendingLength -= length;
+  mConvertedLength += length;
 
-            Okular::Movie *movie = new Okular::Movie(mTextDocument->loadResource(EpubDocument::MovieResource,QUrl(lnk)).toString());
-            movie->setSize(videoSize);
-            movie->setShowControls(true);
+  if (mNextChapter == mChapterLinks.size()) {
+    _handle_toc();
+    mDone = true;
+  }
 
-            Okular::MovieAnnotation *annot = new Okular::MovieAnnotation;
-            annot->setMovie(movie);
+  _emit_local_links(mDone);
 
-            movieAnnots.push_back(annot);
-            QDomDocument tempDoc;
-            tempDoc.setContent(QStringLiteral("<pre>&lt;video&gt;&lt;/video&gt;</pre>"));
-            videoTags.at(0).parentNode().replaceChild(tempDoc.documentElement(),videoTags.at(0));
-          }
-        }
+  if (mDone) {
+    delete mCursor;
+    mCursor = NULL;
+  }
+}
 
-        //handle embedded audio
-        QDomNodeList audioTags = dom.elementsByTagName(QStringLiteral("audio"));
-        while(!audioTags.isEmpty()) {
-          QDomElement element = audioTags.at(0).toElement();
-          bool repeat = element.hasAttribute(QStringLiteral("loop"));
-          QString lnk = element.attribute(QStringLiteral("src"));
+int Converter::pendingPagesEstimate() const
+{
+  if (mDone)
+    return 0;
+
+  // the chapters left take as many pages per character as the converted
+  // ones, the last page is empty as it is where the next chapter starts
+  int pages = 0;
+  if (mConvertedLength > 0)
+    pages = qRound(qreal(mPendingLength) * qMax(mTextDocument->pageCount() - 1, 1) / mConvertedLength);
 
-          Okular::Sound *sound = new Okular::Sound(mTextDocument->loadResource(
-                  EpubDocument::AudioResource, QUrl(lnk)).toByteArray());
+  // every chapter starts on a new page
+  return qMax(pages, mChapterLinks.size() - mNextChapter);
+}
 
-          Okular::SoundAction *soundAction = new Okular::SoundAction(1.0,true,repeat,false,sound);
-          soundActions.push_back(soundAction);
+void Converter::_convertChapter(const QString &link, QString htmlContent)
+{
+  // if the background color of the document is non-white it will be handled by QTextDocument::setHtml()
+  QVector<Okular::MovieAnnotation *> movieAnnots;
+  QVector<Okular::SoundAction *> soundActions;
 
-          QDomDocument tempDoc;
-          tempDoc.setContent(QStringLiteral("<pre>&lt;audio&gt;&lt;/audio&gt;</pre>"));
-          audioTags.at(0).parentNode().replaceChild(tempDoc.documentElement(),audioTags.at(0));
+  mTextDocument->setCurrentSubDocument(link);
+
+  // as QTextCharFormat::anchorNames() ignores sections, replace it with <p>
+  htmlContent.replace(QRegExp(QStringLiteral("< *section")),QStringLiteral("<p"));
+  htmlContent.replace(QRegExp(QStringLiteral("< */ *section")),QStringLiteral("</p"));
+
+  // convert svg tags to img
+  const int maxHeight = mTextDocument->maxContentHeight();
+  const int maxWidth = mTextDocument->maxContentWidth();
+  // only pay for the DOM round trip when there is something to rewrite
+  const bool needsDom = htmlContent.contains(QLatin1String("<svg"), Qt::CaseInsensitive) ||
+                        htmlContent.contains(QLatin1String("<video"), Qt::CaseInsensitive) ||
+                        htmlContent.contains(QLatin1String("<audio"), Qt::CaseInsensitive);
+  QDomDocument dom;
+  if(needsDom && dom.setContent(htmlContent)) {
+    QDomNodeList svgs = dom.elementsByTagName(QStringLiteral("svg"));
+    if(!svgs.isEmpty()) {
+      QList< QDomNode > imgNodes;
+      for (int i = 0; i < svgs.length(); ++i) {
+        QDomNodeList images = svgs.at(i).toElement().elementsByTagName(QStringLiteral("image"));
+        for (int j = 0; j < images.length(); ++j) {
+          QString lnk = images.at(i).toElement().attribute(QStringLiteral("xlink:href"));
+          int ht = images.at(i).toElement().attribute(QStringLiteral("height")).toInt();
+          int wd = images.at(i).toElement().attribute(QStringLiteral("width")).toInt();
+          QImage img = mTextDocument->loadResource(QTextDocument::ImageResource,QUrl(lnk)).value<QImage>();
+          if(ht == 0) ht = img.height();
+          if(wd == 0) wd = img.width();
+          if(ht > maxHeight) ht = maxHeight;
+          if(wd > maxWidth) wd = maxWidth;
+          mTextDocument->addResource(QTextDocument::ImageResource,QUrl(lnk),img);
+          QDomDocument newDoc;
+          newDoc.setContent(QStringLiteral("<img src=\"%1\" height=\"%2\" width=\"%3\" />").arg(lnk).arg(ht).arg(wd));
+          imgNodes.append(newDoc.documentElement());
+        }
+        foreach (const QDomNode& nd, imgNodes) {
+          svgs.at(i).parentNode().replaceChild(nd,svgs.at(i));
         }
-        htmlContent = dom.toString();
       }
+    }
 
-      // HACK BEGIN Get the links without CSS to be blue
-      //            Remove if Qt ever gets fixed and the code in textdocumentgenerator.cpp works
-      const QPalette orig = qApp->palette();
-      QPalette p = orig;
-      p.setColor(QPalette::Link, Qt::blue);
-      qApp->setPalette(p);
-      // HACK END
-
-      QTextBlock before;
-      if(firstPage) {
-        // preHtml & postHtml make it possible to have a margin around the content of the page
-        const QString preHtml = QString::fromLatin1("<html><head></head><body>"
-                                        "<table style=\"-qt-table-type: root; margin-top:%1px; margin-bottom:%1px; margin-left:%1px; margin-right:%1px;\">"
-                                        "<tr>"
-                                        "<td style=\"border: none;\">").arg(mTextDocument->padding);
-        const QString postHtml = QStringLiteral("</tr></table></body></html>");
-        mTextDocument->setHtml(preHtml + htmlContent + postHtml);
-        firstPage = false;
-        before = mTextDocument->begin();
-      } else {
-        before = _cursor->block();
-        _cursor->insertHtml(htmlContent);
-      }
-      // HACK BEGIN
-      qApp->setPalette(orig);
-      // HACK END
-
-      QTextCursor csr(mTextDocument);   // a temporary cursor
-      csr.movePosition(QTextCursor::Start);
-      int index = 0;
-      while( !(csr = mTextDocument->find(QStringLiteral("<video></video>"),csr)).isNull() ) {
-        const int posStart = csr.position();
-        const QPoint startPoint = calculateXYPosition(mTextDocument, posStart);
-        QImage img(QStandardPaths::locate(QStandardPaths::GenericDataLocation, QStringLiteral("okular/pics/okular-epub-movie.png")));
-        img = img.scaled(videoSize);
-        csr.insertImage(img);
-        const int posEnd = csr.position();
-        const QRect videoRect(startPoint,videoSize);
-        movieAnnots[index]->setBoundingRectangle(Okular::NormalizedRect(videoRect,mTextDocument->pageSize().width(), mTextDocument->pageSize().height()));
-        emit addAnnotation(movieAnnots[index++],posStart,posEnd);
-        csr.movePosition(QTextCursor::NextWord);
-      }
+    // handle embedded videos
+    QDomNodeList videoTags = dom.elementsByTagName(QStringLiteral("video"));
+    while(!videoTags.isEmpty()) {
+      QDomNodeList sourceTags = videoTags.at(0).toElement().elementsByTagName(QStringLiteral("source"));
+      if(!sourceTags.isEmpty()) {
+        QString lnk = sourceTags.at(0).toElement().attribute(QStringLiteral("src"));
+
+        Okular::Movie *movie = new Okular::Movie(mTextDocument->loadResource(EpubDocument::MovieResource,QUrl(lnk)).toString());
+        movie->setSize(videoSize);
+        movie->setShowControls(true);
 
-      csr.movePosition(QTextCursor::Start);
-      index = 0;
-      const QString keyToSearch(QStringLiteral("<audio></audio>"));
-      while( !(csr = mTextDocument->find(keyToSearch, csr)).isNull() ) {
-        const int posStart = csr.position() - keyToSearch.size();
-        const QImage img(QStandardPaths::locate(QStandardPaths::GenericDataLocation, QStringLiteral("okular/pics/okular-epub-sound-icon.png")));
-        csr.insertImage(img);
-        const int posEnd = csr.position();
-        qDebug() << posStart << posEnd;;
-        emit addAction(soundActions[index++],posStart,posEnd);
-        csr.movePosition(QTextCursor::NextWord);
+        Okular::MovieAnnotation *annot = new Okular::MovieAnnotation;
+        annot->setMovie(movie);
+
+        movieAnnots.push_back(annot);
+        QDomDocument tempDoc;
+        tempDoc.setContent(QStringLiteral("<pre>&lt;video&gt;&lt;/video&gt;</pre>"));
+        videoTags.at(0).parentNode().replaceChild(tempDoc.documentElement(),videoTags.at(0));
       }
+    }
 
-      mSectionMap.insert(link, before);
+    //handle embedded audio
+    QDomNodeList audioTags = dom.elementsByTagName(QStringLiteral("audio"));
+    while(!audioTags.isEmpty()) {
+      QDomElement element = audioTags.at(0).toElement();
+      bool repeat = element.hasAttribute(QStringLiteral("loop"));
+      QString lnk = element.attribute(QStringLiteral("src"));
 
-      _handle_anchors(before, link);
+      Okular::Sound *sound = new Okular::Sound(mTextDocument->loadResource(
+              EpubDocument::AudioResource, QUrl(lnk)).toByteArray());
 
-      const int page = mTextDocument->pageCount();
+      Okular::SoundAction *soundAction = new Okular::SoundAction(1.0,true,repeat,false,sound);
+      soundActions.push_back(soundAction);
 
-      // it will clear the previous format
-      // useful when the last line had a bullet
-      _cursor->insertBlock(QTextBlockFormat());
+      QDomDocument tempDoc;
+      tempDoc.setContent(QStringLiteral("<pre>&lt;audio&gt;&lt;/audio&gt;</pre>"));
+      audioTags.at(0).parentNode().replaceChild(tempDoc.documentElement(),audioTags.at(0));
+    }
+    htmlContent = dom.toString();
+  }
 
-      while(mTextDocument->pageCount() == page)
-        _cursor->insertText(QStringLiteral("\n"));
+  QTextBlock before;
+  if(mFirstPage) {
+    // preHtml & postHtml make it possible to have a margin around the content of the page
+    const QString preHtml = QString::fromLatin1("<html><head></head><body>"
+                                    "<table style=\"-qt-table-type: root; margin-top:%1px; margin-bottom:%1px; margin-left:%1px; margin-right:%1px;\">"
+                                    "<tr>"
+                                    "<td style=\"border: none;\">").arg(mTextDocument->padding);
+    const QString postHtml = QStringLiteral("</tr></table></body></html>");
+    mTextDocument->setHtml(preHtml + htmlContent + postHtml);
+    mFirstPage = false;
+    before = mTextDocument->begin();
+  } else {
+    before = mCursor->block();
+    mCursor->insertHtml(htmlContent);
+  }
+  // only look for the placeholders in the chapter that was just inserted,
+  // searching from the start of the document makes opening quadratic
+  QTextCursor csr(mTextDocument);   // a temporary cursor
+  csr.setPosition(before.position());
+  int index = 0;
+  while( index < movieAnnots.size() && !(csr = mTextDocument->find(QStringLiteral("<video></video>"),csr)).isNull() ) {
+    const int posStart = csr.position();
+    const QPoint startPoint = calculateXYPosition(mTextDocument, posStart);
+    if (mMovieImage.isNull()) {
+      mMovieImage = QImage(QStandardPaths::locate(QStandardPaths::GenericDataLocation, QStringLiteral("okular/pics/okular-epub-movie.png")));
+      mMovieImage = mMovieImage.scaled(videoSize);
     }
-  } while (epub_it_get_next(it));
+    csr.insertImage(mMovieImage);
+    const int posEnd = csr.position();
+    const QRect videoRect(startPoint,videoSize);
+    movieAnnots[index]->setBoundingRectangle(Okular::NormalizedRect(videoRect,mTextDocument->pageSize().width(), mTextDocument->pageSize().height()));
+    emit addAnnotation(movieAnnots[index++],posStart,posEnd);
+    csr.movePosition(QTextCursor::NextWord);
+  }
+
+  csr.setPosition(before.position());
+  index = 0;
+  const QString keyToSearch(QStringLiteral("<audio></audio>"));
+  while( index < soundActions.size() && !(csr = mTextDocument->find(keyToSearch, csr)).isNull() ) {
+    const int posStart = csr.position() - keyToSearch.size();
+    if (mSoundImage.isNull())
+      mSoundImage = QImage(QStandardPaths::locate(QStandardPaths::GenericDataLocation, QStringLiteral("okular/pics/okular-epub-sound-icon.png")));
+    csr.insertImage(mSoundImage);
+    const int posEnd = csr.position();
+    qDebug() << posStart << posEnd;;
+    emit addAction(soundActions[index++],posStart,posEnd);
+    csr.movePosition(QTextCursor::NextWord);
+  }
+
+  mSectionMap.insert(link, before);
+
+  _handle_anchors(before, link);
+
+  const int page = mTextDocument->pageCount();
 
-  epub_free_iterator(it);
+  // it will clear the previous format
+  // useful when the last line had a bullet
+  mCursor->insertBlock(QTextBlockFormat());
 
-  // handle toc
+  while(mTextDocument->pageCount() == page)
+    mCursor->insertText(QStringLiteral("\n"));
+}
+
+void Converter::_handle_toc()
+{
   struct titerator *tit;
 
   // FIXME: support other method beside NAVMAP and GUIDE
@@ -381,18 +446,18 @@ QTextDocument* Converter::convert( const QString &fileName )
           char *data = 0;
           int size = epub_get_data(mTextDocument->getEpub(), clink, &data);
           if (data) {
-            _cursor->insertBlock();
+            mCursor->insertBlock();
 
             // try to load as image and if not load as html
-            block = _cursor->block();
+            block = mCursor->block();
             QImage image;
             mSectionMap.insert(link, block);
             if (image.loadFromData((unsigned char *)data, size)) {
               mTextDocument->addResource(QTextDocument::ImageResource,
                                          QUrl(link), image);
-              _cursor->insertImage(link);
+              mCursor->insertImage(link);
             } else {
-              _cursor->insertHtml(QString::fromUtf8(data));
+              mCursor->insertHtml(QString::fromUtf8(data));
               // Add anchors to hashes
               _handle_anchors(block, link);
             }
@@ -400,7 +465,7 @@ QTextDocument* Converter::convert( const QString &fileName )
             // Start new file in a new page
             int page = mTextDocument->pageCount();
             while(mTextDocument->pageCount() == page)
-              _cursor->insertText(QStringLiteral("\n"));
+              mCursor->insertText(QStringLiteral("\n"));
           }
 
           free(data);
@@ -425,29 +490,33 @@ QTextDocument* Converter::convert( const QString &fileName )
   } else {
     qDebug() << "no toc found";
   }
+}
 
-  // adding link actions
-  QHashIterator<QString, QVector< QPair<int, int> > > hit(mLocalLinks);
+// adding link actions for the links whose target is converted, the others
+// wait for the next parts
+void Converter::_emit_local_links(bool last)
+{
+  QMutableHashIterator<QString, QVector< QPair<int, int> > > hit(mLocalLinks);
   while (hit.hasNext()) {
     hit.next();
 
     const QTextBlock block = mSectionMap.value(hit.key());
 
-    for (int i = 0; i < hit.value().size(); ++i) {
-      if (block.isValid()) { // be sure we actually got a block
-        Okular::DocumentViewport viewport =
-          calculateViewport(mTextDocument, block);
-
-        Okular::GotoAction *action = new Okular::GotoAction(QString(), viewport);
-
-        emit addAction(action, hit.value()[i].first, hit.value()[i].second);
-      } else {
+    if (!block.isValid()) { // be sure we actually got a block
+      if (last)
         qDebug() << "Error: no block found for "<< hit.key();
-      }
+      continue;
     }
-  }
 
-  delete _cursor;
+    const Okular::DocumentViewport viewport =
+      calculateViewport(mTextDocument, block);
 
-  return mTextDocument;
+    for (int i = 0; i < hit.value().size(); ++i) {
+      Okular::GotoAction *action = new Okular::GotoAction(QString(), viewport);
+
+      emit addAction(action, hit.value()[i].first, hit.value()[i].second);
+    }
+
+    hit.remove();
+  }
 }
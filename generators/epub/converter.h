@@ -13,6 +13,9 @@
 #include <core/textdocumentgenerator.h>
 #include <core/document.h>
 
+#include <QImage>
+#include <QStringList>
+
 #include "epubdocument.h"
 
 class QTextCursor;
@@ -27,16 +30,34 @@ namespace Epub {
       ~Converter();
 
       QTextDocument *convert( const QString &fileName ) override;
+      void convertNextPart() override;
+      int pendingPagesEstimate() const override;
 
     private:
 
       void _emitData(Okular::DocumentInfo::Key key, enum epub_metadata type); 
       void _handle_anchors(const QTextBlock &start, const QString &name);
       void _insert_local_links(const QString &key, const QPair<int, int> &value);
+      void _convertChapters();
+      void _convertChapter(const QString &link, QString htmlContent);
+      void _handle_toc();
+      void _emit_local_links(bool last);
       EpubDocument *mTextDocument;
+      QTextCursor *mCursor;
 
       QHash<QString, QTextBlock> mSectionMap;
       QHash<QString, QVector< QPair<int, int> > > mLocalLinks;
+
+      // the spine, the chapters from mNextChapter on are not converted yet
+      QStringList mChapterLinks;
+      QStringList mChapterContents;
+      int mNextChapter;
+      int mPendingLength;
+      int mConvertedLength;
+      bool mFirstPage;
+      bool mDone;
+      QImage mMovieImage;
+      QImage mSoundImage;
     };
 }
 
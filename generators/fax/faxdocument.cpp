@@ -10,6 +10,7 @@
 #include <stdlib.h>
 
 #include <QtCore/QFile>
+#include <QtCore/QVector>
 
 #include "faxexpand.h"
 #include "faxdocument.h"
@@ -55,18 +56,6 @@ static void normalize( pagenode *pn, int revbits, int swapbytes, size_t length )
     }
 }
 
-static bool new_image( pagenode *pn, int width, int height )
-{
-    pn->image = QImage( width, height, QImage::Format_MonoLSB );
-    pn->image.setColor( 0, qRgb( 255, 255, 255 ) );
-    pn->image.setColor( 1, qRgb( 0, 0, 0 ) );
-    pn->bytes_per_line = pn->image.bytesPerLine();
-    pn->dpi = FAX_DPI_FINE;
-    pn->imageData = new uchar[ width * height ];
-
-    return !pn->image.isNull();
-}
-
 /* get compressed data into memory */
 static unsigned char* getstrip( pagenode *pn, int strip )
 {
@@ -141,96 +130,70 @@ static unsigned char* getstrip( pagenode *pn, int strip )
     return data;
 }
 
-static void draw_line( pixnum *run, int lineNum, pagenode *pn )
+/* set the pixels [from, to) of a Format_MonoLSB line */
+static inline void fill_bits( uchar *line, int from, int to )
 {
-    t32bits *p, *p1;  /* p - current line, p1 - low-res duplicate */
-    pixnum *r;        /* pointer to run-lengths */
-    t32bits pix;      /* current pixel value */
-    t32bits acc;      /* pixel accumulator */
-    int nacc;         /* number of valid bits in acc */
-    int tot;          /* total pixels in line */
-    int n;
+    while ( from < to && ( from & 7 ) )
+    {
+        line[ from >> 3 ] |= 1 << ( from & 7 );
+        ++from;
+    }
+    while ( to - from >= 8 )
+    {
+        line[ from >> 3 ] = 0xff;
+        from += 8;
+    }
+    while ( from < to )
+    {
+        line[ from >> 3 ] |= 1 << ( from & 7 );
+        ++from;
+    }
+}
 
+static void draw_line( pixnum *run, int lineNum, pagenode *pn )
+{
     lineNum += pn->stripnum * pn->rowsperstrip;
     if ( lineNum >= pn->size.height() )
         return;
 
-    p = (t32bits *)(pn->imageData + lineNum*(2-pn->vres)*pn->bytes_per_line);
-    p1 =(t32bits *)(pn->vres ? nullptr : p + pn->bytes_per_line/sizeof(*p));
-
-    r = run;
-    acc = 0;
-    nacc = 0;
-    pix = pn->inverse ? ~0 : 0;
-    tot = 0;
+    uchar *line = pn->image.scanLine( lineNum );
+    int pix = pn->inverse;
+    int tot = 0;
     while ( tot < pn->size.width() )
     {
-        n = *r++;
+        const int n = *run++;
         tot += n;
         /* Watch out for buffer overruns, e.g. when n == 65535.  */
         if ( tot > pn->size.width() )
             break;
         if ( pix )
-            acc |= (~(t32bits)0 >> nacc);
-        else if ( nacc )
-            acc &= (~(t32bits)0 << (32 - nacc));
-        else
-            acc = 0;
-        if ( nacc + n < 32 )
-        {
-            nacc += n;
-            pix = ~pix;
-            continue;
-        }
-        *p++ = acc;
-        if ( p1 )
-            *p1++ = acc;
-        n -= 32 - nacc;
-        while ( n >= 32 )
-        {
-            n -= 32;
-            *p++ = pix;
-            if ( p1 )
-                *p1++ = pix;
-        }
-        acc = pix;
-        nacc = n;
-        pix = ~pix;
-    }
-    if ( nacc )
-    {
-        *p++ = acc;
-        if ( p1 )
-            *p1++ = acc;
+            fill_bits( line, tot - n, tot );
+        pix = !pix;
     }
 }
 
-static bool get_image( pagenode *pn )
-{
-    unsigned char *data = getstrip( pn, 0 );
-    if ( !data )
-        return false;
-
-    if ( !new_image( pn, pn->size.width(), (pn->vres ? 1 : 2) * pn->size.height() ) )
-        return false;
-
-    (*pn->expander)( pn, draw_line );
-
-    return true;
-}
-
 class FaxDocument::Private
 {
     public:
         Private( FaxDocument *parent )
-            : mParent( parent )
+            : mParent( parent ), mData( nullptr )
         {
             mPageNode.size = QSize( 1728, 0 );
         }
 
+        // runs the expander over the compressed data kept by load()
+        void expand( drawfunc df )
+        {
+            mPageNode.data = mData;
+            mPageNode.stripnum = 0;
+            (*mPageNode.expander)( &mPageNode, df );
+        }
+
         FaxDocument *mParent;
         pagenode mPageNode;
         FaxDocument::DocumentType mType;
+        t16bits *mData;
+        QImage mImage;
 };
 
 FaxDocument::FaxDocument( const QString &fileName, DocumentType type )
@@ -244,7 +207,8 @@ FaxDocument::FaxDocument( const QString &fileName, DocumentType type )
     d->mPageNode.inverse = 0;
     d->mPageNode.data = nullptr;
     d->mPageNode.dataOrig = nullptr;
-    d->mPageNode.imageData = nullptr;
+    d->mPageNode.dpi = FAX_DPI_FINE;
+    d->mPageNode.reduced = nullptr;
     d->mType = type;
 
     if ( d->mType == G3 )
@@ -256,7 +220,6 @@ FaxDocument::FaxDocument( const QString &fileName, DocumentType type )
 FaxDocument::~FaxDocument()
 {
     delete [] d->mPageNode.dataOrig;
-    delete [] d->mPageNode.imageData;
     delete d;
 }
 
@@ -264,46 +227,71 @@ bool FaxDocument::load()
 {
     fax_init_tables();
 
-    bool ok = get_image( &(d->mPageNode) );
-    if ( !ok )
+    // only read the compressed data and count the lines, the page
+    // is expanded when an image of it is asked for
+    if ( !getstrip( &(d->mPageNode), 0 ) )
         return false;
 
-    // byte-swapping the image
-    int height = d->mPageNode.size.height();
-    int bytes_per_line = d->mPageNode.size.width()/8;
+    d->mData = d->mPageNode.data;
+    return true;
+}
 
-    QByteArray bytes( height * bytes_per_line, 0 );
-    for ( int y= height - 1; y >= 0; --y )
+QSize FaxDocument::size() const
+{
+    // fax lines are not square, the page is stretched vertically; normal
+    // resolution faxes have half as many lines as fine ones
+    const double scale = d->mPageNode.vres ? 1.5 : 3.0;
+    return QSize( d->mPageNode.size.width(), d->mPageNode.size.height() * scale );
+}
+
+QImage FaxDocument::image() const
+{
+    if ( d->mImage.isNull() )
     {
-        quint32 offset  = y * bytes_per_line;
-        quint32 *source = (quint32 *) (d->mPageNode.imageData + offset);
-        quint32 *dest   = (quint32 *) (bytes.data() + offset);
-        for ( int x= (bytes_per_line/4) - 1; x >= 0; --x )
-        {
-            quint32 dv = 0, sv = *source;
-            for ( int bit = 32; bit > 0; --bit )
-            {
-                dv <<= 1;
-                dv |= sv&1;
-                sv >>= 1;
-            }
-            *dest = dv;
-            ++dest;
-            ++source;
-        }
+        pagenode *pn = &( d->mPageNode );
+        pn->image = QImage( pn->size, QImage::Format_MonoLSB );
+        if ( pn->image.isNull() )
+            return QImage();
+        pn->image.setColor( 0, qRgb( 255, 255, 255 ) );
+        pn->image.setColor( 1, qRgb( 0, 0, 0 ) );
+        pn->image.fill( 0 );
+
+        d->expand( draw_line );
+
+        // a fast scale keeps the image at 1 bit per pixel
+        d->mImage = pn->image.scaled( size() );
+        pn->image = QImage();
     }
 
-    // convert it into a QImage
-    QImage img( (uchar*)bytes.data(), d->mPageNode.size.width(), d->mPageNode.size.height(), QImage::Format_MonoLSB );
-    img.setColor( 0, qRgb( 255, 255, 255 ) );
-    img.setColor( 1, qRgb( 0, 0, 0 ) );
-
-    d->mPageNode.image = img.copy().scaled( img.width(), img.height() * 1.5 );
-
-    return true;
+    return d->mImage;
 }
 
-QImage FaxDocument::image() const
+QImage FaxDocument::image( const QSize &size ) const
 {
-    return d->mPageNode.image;
+    const QSize fullSize = this->size();
+    if ( size.width() >= fullSize.width() || size.height() >= fullSize.height() )
+        return image().scaled( size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+
+    // box filter the runs straight into the wanted width, there is
+    // never a row with no fax line in it
+    pagenode *pn = &( d->mPageNode );
+    reduction reduced;
+    reduced.image = QImage( size.width(), qMin( size.height(), pn->size.height() ), QImage::Format_Grayscale8 );
+    if ( reduced.image.isNull() )
+        return QImage();
+    reduced.image.fill( Qt::white );
+    reduced.row = -1;
+    reduced.lines = 0;
+    QVector<quint32> coverage( size.width(), 0 );
+    reduced.coverage = coverage.data();
+
+    pn->reduced = &reduced;
+    d->expand( draw_reduced_line );
+    reduce_finish( pn );
+    pn->reduced = nullptr;
+
+    if ( reduced.image.size() != size )
+        return reduced.image.scaled( size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+
+    return reduced.image;
 }
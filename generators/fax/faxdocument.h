@@ -43,15 +43,33 @@ class FaxDocument
     /**
      * Loads the document.
      *
+     * Only the compressed data is read, the page is expanded
+     * when one of the image() methods is called.
+     *
      * @return @c true if the document can be loaded successfully, @c false otherwise.
      */
     bool load();
 
     /**
-     * Returns the document as an image.
+     * Returns the size of the page in pixels.
+     */
+    QSize size() const;
+
+    /**
+     * Returns the document as an image of size(), at 1 bit per pixel.
+     *
+     * The image is expanded on the first call and kept afterwards.
      */
     QImage image() const;
 
+    /**
+     * Returns the document scaled to @p size.
+     *
+     * Sizes smaller than size() are expanded directly at the reduced
+     * resolution as a gray image, without going through image().
+     */
+    QImage image( const QSize &size ) const;
+
   private:
     class Private;
     Private* const d;
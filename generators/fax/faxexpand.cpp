@@ -662,6 +662,85 @@ g4expand(pagenode *pn, drawfunc df)
     (void)EOLcnt; // make gcc happy
 }
 
+/* left edge of the reduced cell `cell', in fax pixels */
+static inline int
+cell_start(int cell, int cells, int width)
+{
+    return (int)(((qint64)cell * width + cells - 1) / cells);
+}
+
+/* write the accumulated row of the reduced grid as gray levels */
+static void
+emit_reduced_row(pagenode *pn)
+{
+    struct reduction *rd = pn->reduced;
+    if (rd->row < 0 || rd->lines == 0)
+	return;
+
+    const int cells = rd->image.width();
+    uchar *out = rd->image.scanLine(rd->row);
+    int start = 0;
+    for (int c = 0; c < cells; c++) {
+	const int end = cell_start(c + 1, cells, pn->size.width());
+	const quint32 area = (end - start) * rd->lines;
+	out[c] = area ? 255 - (255 * rd->coverage[c] + area / 2) / area : 255;
+	rd->coverage[c] = 0;
+	start = end;
+    }
+    rd->lines = 0;
+}
+
+void
+draw_reduced_line(pixnum *run, int lineNum, pagenode *pn)
+{
+    struct reduction *rd = pn->reduced;
+    const int lastx = pn->size.width();
+    const int cells = rd->image.width();
+    int row, x, n;
+    int pix;
+
+    lineNum += pn->stripnum * pn->rowsperstrip;
+    if (lineNum >= pn->size.height())
+	return;
+
+    row = (int)((qint64)lineNum * rd->image.height() / pn->size.height());
+    if (row != rd->row) {
+	emit_reduced_row(pn);
+	rd->row = row;
+    }
+    rd->lines++;
+
+    /* add the length of every black run to the cells it crosses */
+    pix = pn->inverse;
+    x = 0;
+    while (x < lastx) {
+	n = *run++;
+	x += n;
+	/* Watch out for buffer overruns, e.g. when n == 65535.  */
+	if (x > lastx)
+	    break;
+	if (pix && n) {
+	    int from = x - n;
+	    int cell = (int)((qint64)from * cells / lastx);
+	    const int last = (int)((qint64)(x - 1) * cells / lastx);
+	    for (; cell < last; cell++) {
+		const int end = cell_start(cell + 1, cells, lastx);
+		rd->coverage[cell] += end - from;
+		from = end;
+	    }
+	    rd->coverage[last] += x - from;
+	}
+	pix = !pix;
+    }
+}
+
+void
+reduce_finish(pagenode *pn)
+{
+    emit_reduced_row(pn);
+    pn->reduced->row = -1;
+}
+
 static const unsigned char zerotab[256] = {
 	0x88, 0x07, 0x16, 0x06, 0x25, 0x05, 0x15, 0x05,
 	0x34, 0x04, 0x14, 0x04, 0x24, 0x04, 0x14, 0x04,
@@ -48,6 +48,14 @@ struct strip {			/* tiff strip descriptor */
 };
 
 
+/* state of an expansion into a reduced grid, see draw_reduced_line() */
+struct reduction {
+    QImage image;		/* 8 bit gray output, one byte per cell */
+    int row;			/* output row being accumulated, -1 before the first */
+    int lines;			/* fax lines accumulated into that row */
+    quint32 *coverage;		/* black pixels seen in each cell of the row */
+};
+
 /* defines for the pagenode member: type */
 #define FAX_TIFF   1
 #define FAX_RAW    2
@@ -70,10 +78,9 @@ class pagenode {		/* compressed page descriptor */
     int vres;			/* vertical resolution: 1 = fine  */
     QPoint dpi;			/* DPI horz/vert */
     void (*expander)(class pagenode *, drawfunc);
-    unsigned int bytes_per_line;
     QString filename;         /* The name of the file to be opened */
-    QImage image;             /* The final image */
-    uchar *imageData;         /* The temporary raw image data */
+    QImage image;             /* The expanded 1 bit image, one row per line */
+    struct reduction *reduced;	/* target of draw_reduced_line() */
 };
 
 /* page orientation flags */
@@ -119,4 +126,10 @@ extern void fax_init_tables(void);
 /* count lines in image */
 extern int G3count(class pagenode *pn, int twoD);
 
+/* drawfunc that box filters the lines into pn->reduced instead of
+   expanding them at full resolution, reduce_finish() must be called
+   once the expander is done to emit the last row */
+extern void draw_reduced_line(pixnum *run, int linenum, class pagenode *pn);
+extern void reduce_finish(class pagenode *pn);
+
 #endif
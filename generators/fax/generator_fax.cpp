@@ -9,6 +9,7 @@
 
 #include "generator_fax.h"
 
+#include <QtCore/QMutexLocker>
 #include <QtGui/QPainter>
 #include <QtPrintSupport/QPrinter>
 
@@ -21,7 +22,7 @@
 OKULAR_EXPORT_PLUGIN(FaxGenerator, "libokularGenerator_fax.json")
 
 FaxGenerator::FaxGenerator( QObject *parent, const QVariantList &args )
-    : Generator( parent, args )
+    : Generator( parent, args ), m_document( nullptr )
 {
     setFeature( Threaded );
     setFeature( PrintNative );
@@ -39,19 +40,20 @@ bool FaxGenerator::loadDocument( const QString & fileName, QVector<Okular::Page*
     else
         m_type = FaxDocument::G4;
 
-    FaxDocument faxDocument( fileName, m_type );
+    m_document = new FaxDocument( fileName, m_type );
 
-    if ( !faxDocument.load() )
+    if ( !m_document->load() )
     {
+        delete m_document;
+        m_document = nullptr;
         emit error( i18n( "Unable to load document" ), -1 );
         return false;
     }
 
-    m_img = faxDocument.image();
-
     pagesVector.resize( 1 );
 
-    Okular::Page * page = new Okular::Page( 0, m_img.width(), m_img.height(), Okular::Rotation0 );
+    const QSize size = m_document->size();
+    Okular::Page * page = new Okular::Page( 0, size.width(), size.height(), Okular::Rotation0 );
     pagesVector[0] = page;
 
     return true;
@@ -59,20 +61,22 @@ bool FaxGenerator::loadDocument( const QString & fileName, QVector<Okular::Page*
 
 bool FaxGenerator::doCloseDocument()
 {
-    m_img = QImage();
+    delete m_document;
+    m_document = nullptr;
 
     return true;
 }
 
 QImage FaxGenerator::image( Okular::PixmapRequest * request )
 {
-    // perform a smooth scaled generation
     int width = request->width();
     int height = request->height();
     if ( request->page()->rotation() % 2 == 1 )
         qSwap( width, height );
 
-    return m_img.scaled( width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+    // smaller sizes are expanded directly at the wanted resolution
+    QMutexLocker locker( userMutex() );
+    return m_document->image( QSize( width, height ) );
 }
 
 Okular::DocumentInfo FaxGenerator::generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const
@@ -92,7 +96,9 @@ bool FaxGenerator::print( QPrinter& printer )
 {
     QPainter p( &printer );
 
-    QImage image( m_img );
+    userMutex()->lock();
+    QImage image = m_document->image();
+    userMutex()->unlock();
 
     if ( ( image.width() > printer.width() ) || ( image.height() > printer.height() ) )
 
@@ -12,8 +12,6 @@
 
 #include <core/generator.h>
 
-#include <QtGui/QImage>
-
 #include "faxdocument.h"
 
 class FaxGenerator : public Okular::Generator
@@ -36,7 +34,7 @@ class FaxGenerator : public Okular::Generator
         QImage image( Okular::PixmapRequest * request ) override;
 
     private:
-        QImage m_img;
+        FaxDocument *m_document;
         FaxDocument::DocumentType m_type;
 };
 
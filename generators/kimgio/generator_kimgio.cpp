@@ -56,76 +56,151 @@ bool KIMGIOGenerator::loadDocument( const QString & fileName, QVector<Okular::Pa
         emit error( i18n( "Unable to load document: %1", f.errorString() ), -1 );
         return false;
     }
-    return loadDocumentInternal( f.readAll(), fileName, pagesVector );
-}
 
-bool KIMGIOGenerator::loadDocumentFromData( const QByteArray & fileData, QVector<Okular::Page*> & pagesVector )
-{
-    return loadDocumentInternal( fileData, QString(), pagesVector );
+    // the image is read straight from the file, so a huge one is never
+    // held in memory both encoded and decoded
+    KExiv2Iface::KExiv2 exifMetadata;
+    exifMetadata.load( fileName );
+    m_fileName = fileName;
+    return loadDocumentInternal( &f, fileName, exifMetadata, pagesVector );
 }
 
-bool KIMGIOGenerator::loadDocumentInternal(const QByteArray & fileData, const QString & fileName, QVector<Okular::Page*> & pagesVector )
+bool KIMGIOGenerator::loadDocumentFromData( const QByteArray & fileData, QVector<Okular::Page*> & pagesVector )
 {
     QBuffer buffer;
     buffer.setData( fileData );
     buffer.open( QIODevice::ReadOnly );
 
-    QImageReader reader( &buffer, QImageReader::imageFormat( &buffer ) );
-    reader.setAutoDetectImageFormat( true );
-    if ( !reader.read( &m_img ) ) {
-        if (!m_img.isNull()) {
-            emit warning( i18n( "This document appears malformed. Here is a best approximation of the document's intended appearance." ), -1 );
-        } else {
-            emit error( i18n( "Unable to load document: %1", reader.errorString() ), -1 );
-            return false;
-        }
-    }
+    KExiv2Iface::KExiv2 exifMetadata;
+    exifMetadata.loadFromData( fileData );
+    m_data = fileData;
+    return loadDocumentInternal( &buffer, QString(), exifMetadata, pagesVector );
+}
+
+bool KIMGIOGenerator::loadDocumentInternal(QIODevice * device, const QString & fileName,
+                                           const KExiv2Iface::KExiv2 & exifMetadata, QVector<Okular::Page*> & pagesVector )
+{
     QMimeDatabase db;
-    auto mime = db.mimeTypeForFileNameAndData( fileName, fileData );
+    auto mime = db.mimeTypeForFileNameAndData( fileName, device );
     docInfo.set( Okular::DocumentInfo::MimeType, mime.name() );
 
-    // Apply transformations dictated by Exif metadata
-    KExiv2Iface::KExiv2 exifMetadata;
-    if ( exifMetadata.loadFromData( fileData ) ) {
-        exifMetadata.rotateExifQImage(m_img, exifMetadata.getImageOrientation());
+    QImageReader reader( device, QImageReader::imageFormat( device ) );
+    reader.setAutoDetectImageFormat( true );
+
+    // Images with more pixels than this are not decoded as a whole if their
+    // format can decode just a part of them at a reduced size
+    const qint64 regionDecodingThreshold = 4096 * 4096;
+    const KExiv2Iface::KExiv2::ImageOrientation orientation = exifMetadata.getImageOrientation();
+    const QSize size = reader.size();
+    if ( ( orientation == KExiv2Iface::KExiv2::ORIENTATION_UNSPECIFIED || orientation == KExiv2Iface::KExiv2::ORIENTATION_NORMAL )
+         && size.isValid() && qint64( size.width() ) * size.height() > regionDecodingThreshold
+         && reader.supportsOption( QImageIOHandler::ClipRect ) && reader.supportsOption( QImageIOHandler::ScaledSize ) )
+    {
+        m_imageSize = size;
+    }
+    else
+    {
+        if ( !reader.read( &m_img ) ) {
+            if (!m_img.isNull()) {
+                emit warning( i18n( "This document appears malformed. Here is a best approximation of the document's intended appearance." ), -1 );
+            } else {
+                emit error( i18n( "Unable to load document: %1", reader.errorString() ), -1 );
+                return false;
+            }
+        }
+
+        // Apply transformations dictated by Exif metadata
+        exifMetadata.rotateExifQImage( m_img, orientation );
+        m_imageSize = m_img.size();
+
+        // everything needed is decoded now
+        m_fileName.clear();
+        m_data.clear();
     }
 
     pagesVector.resize( 1 );
 
-    Okular::Page * page = new Okular::Page( 0, m_img.width(), m_img.height(), Okular::Rotation0 );
+    Okular::Page * page = new Okular::Page( 0, m_imageSize.width(), m_imageSize.height(), Okular::Rotation0 );
     pagesVector[0] = page;
 
     return true;
 }
 
-KIMGIOGenerator::SwapBackingFileResult KIMGIOGenerator::swapBackingFile( QString const &/*newFileName*/, QVector<Okular::Page*> & /*newPagesVector*/ )
+KIMGIOGenerator::SwapBackingFileResult KIMGIOGenerator::swapBackingFile( QString const &newFileName, QVector<Okular::Page*> & /*newPagesVector*/ )
 {
     // NOP: We don't actually need to do anything because all data has already
-    // been loaded in RAM
+    // been loaded in RAM, or the image is read from the file on demand
+    if ( !m_fileName.isEmpty() )
+        m_fileName = newFileName;
     return SwapBackingFileNoOp;
 }
 
 bool KIMGIOGenerator::doCloseDocument()
 {
     m_img = QImage();
+    m_pyramid.clear();
+    m_imageSize = QSize();
+    m_fileName.clear();
+    m_data.clear();
 
     return true;
 }
 
+QImage KIMGIOGenerator::readImage( const QRect & clipRect, const QSize & scaledSize ) const
+{
+    QFile file( m_fileName );
+    QBuffer buffer;
+    QIODevice *device = &file;
+    if ( m_fileName.isEmpty() ) {
+        buffer.setData( m_data );
+        device = &buffer;
+    }
+    if ( !device->open( QIODevice::ReadOnly ) )
+        return QImage();
+
+    QImageReader reader( device );
+    reader.setClipRect( clipRect );
+    reader.setScaledSize( scaledSize );
+    return reader.read();
+}
+
+QImage KIMGIOGenerator::sourceImage( int width, int height )
+{
+    // scaling cost depends on the source size, so use the smallest copy that
+    // still has enough pixels, creating the missing ones along the way
+    QImage source = m_img;
+    for ( int level = 0; source.width() / 2 >= width && source.height() / 2 >= height; ++level )
+    {
+        if ( level == m_pyramid.count() )
+            m_pyramid.append( source.scaled( source.width() / 2, source.height() / 2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ) );
+        source = m_pyramid.at( level );
+    }
+    return source;
+}
+
 QImage KIMGIOGenerator::image( Okular::PixmapRequest * request )
 {
     // perform a smooth scaled generation
     if ( request->isTile() )
     {
-        const QRect srcRect = request->normalizedRect().geometry( m_img.width(), m_img.height() );
         const QRect destRect = request->normalizedRect().geometry( request->width(), request->height() );
 
         QImage destImg( destRect.size(), QImage::Format_RGB32 );
         destImg.fill( Qt::white );
 
         QPainter p( &destImg );
-        p.setRenderHint( QPainter::SmoothPixmapTransform );
-        p.drawImage( destImg.rect(), m_img, srcRect );
+        if ( m_img.isNull() )
+        {
+            const QRect srcRect = request->normalizedRect().geometry( m_imageSize.width(), m_imageSize.height() );
+            p.drawImage( 0, 0, readImage( srcRect, destRect.size() ) );
+        }
+        else
+        {
+            const QImage source = sourceImage( request->width(), request->height() );
+            const QRect srcRect = request->normalizedRect().geometry( source.width(), source.height() );
+            p.setRenderHint( QPainter::SmoothPixmapTransform );
+            p.drawImage( destImg.rect(), source, srcRect );
+        }
 
         return destImg;
     }
@@ -136,7 +211,10 @@ QImage KIMGIOGenerator::image( Okular::PixmapRequest * request )
         if ( request->page()->rotation() % 2 == 1 )
             qSwap( width, height );
 
-        return m_img.scaled( width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+        if ( m_img.isNull() )
+            return readImage( QRect( QPoint( 0, 0 ), m_imageSize ), QSize( width, height ) );
+
+        return sourceImage( width, height ).scaled( width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
     }
 }
 
@@ -146,10 +224,19 @@ bool KIMGIOGenerator::print( QPrinter& printer )
 
     QImage image( m_img );
 
-    if ( ( image.width() > printer.width() ) || ( image.height() > printer.height() ) )
-
+    if ( image.isNull() )
+    {
+        // decode the image right at the size it is printed
+        QSize size = m_imageSize;
+        if ( ( size.width() > printer.width() ) || ( size.height() > printer.height() ) )
+            size.scale( printer.width(), printer.height(), Qt::KeepAspectRatio );
+        image = readImage( QRect( QPoint( 0, 0 ), m_imageSize ), size );
+    }
+    else if ( ( image.width() > printer.width() ) || ( image.height() > printer.height() ) )
+    {
         image = image.scaled( printer.width(), printer.height(),
                               Qt::KeepAspectRatio, Qt::SmoothTransformation );
+    }
 
     p.drawImage( 0, 0, image );
 
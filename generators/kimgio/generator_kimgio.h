@@ -16,8 +16,15 @@
 #include <core/generator.h>
 #include <core/document.h>
 
+#include <QtCore/QVector>
 #include <QtGui/QImage>
 
+class QIODevice;
+
+namespace KExiv2Iface {
+class KExiv2;
+}
+
 class KIMGIOGenerator : public Okular::Generator
 {
     Q_OBJECT
@@ -43,10 +50,19 @@ class KIMGIOGenerator : public Okular::Generator
         QImage image( Okular::PixmapRequest * request ) override;
 
     private:
-        bool loadDocumentInternal(const QByteArray & fileData, const QString & fileName,
-                                  QVector<Okular::Page*> & pagesVector );
+        bool loadDocumentInternal(QIODevice * device, const QString & fileName,
+                                  const KExiv2Iface::KExiv2 & exifMetadata, QVector<Okular::Page*> & pagesVector );
+        QImage readImage( const QRect & clipRect, const QSize & scaledSize ) const;
+        QImage sourceImage( int width, int height );
     private:
+        // null if the image is too big to be kept decoded, in that case
+        // every request decodes only its part from m_fileName or m_data
         QImage m_img;
+        // smaller copies of m_img, each half the size of the previous one
+        QVector<QImage> m_pyramid;
+        QSize m_imageSize;
+        QString m_fileName;
+        QByteArray m_data;
         Okular::DocumentInfo docInfo;
 };
 
@@ -32,6 +32,7 @@ class KIMGIOTest
 		void initTestCase();
 		void testExifOrientation_data();
 		void testExifOrientation();
+		void testRegionDecoding();
 };
 
 void KIMGIOTest::initTestCase()
@@ -116,5 +117,51 @@ void KIMGIOTest::testExifOrientation()
 	delete m_document;
 }
 
+// A JPEG this big is not decoded as a whole, the page is rendered by
+// decoding it at the requested size
+void KIMGIOTest::testRegionDecoding()
+{
+	QTemporaryFile file( QDir::tempPath() + QStringLiteral( "/okular_kimgiotest_XXXXXX.jpg" ) );
+	QVERIFY( file.open() );
+	{
+		// left half black, right half white
+		QImage bigImage( 4200, 4100, QImage::Format_RGB32 );
+		bigImage.fill( Qt::white );
+		QPainter p( &bigImage );
+		p.fillRect( 0, 0, 2100, 4100, Qt::black );
+		p.end();
+		QVERIFY( bigImage.save( &file, "JPG" ) );
+		file.close();
+	}
+
+	QMimeDatabase db;
+	Okular::SettingsCore::instance( QStringLiteral("kimgiotest") );
+	Okular::Document *m_document = new Okular::Document( nullptr );
+	const QMimeType mime = db.mimeTypeForFile( file.fileName() );
+
+	Okular::DocumentObserver *dummyDocumentObserver = new Okular::DocumentObserver();
+	m_document->addObserver( dummyDocumentObserver );
+
+	QCOMPARE((int)m_document->openDocument( file.fileName(), QUrl(), mime ), (int)Okular::Document::OpenSuccess);
+	QCOMPARE( m_document->page(0)->width(), double(4200) );
+	QCOMPARE( m_document->page(0)->height(), double(4100) );
+
+	Okular::PixmapRequest *req = new Okular::PixmapRequest( dummyDocumentObserver, 0, 84, 82,
+		1, Okular::PixmapRequest::NoFeature );
+	m_document->requestPixmaps( QLinkedList<Okular::PixmapRequest*>() << req );
+	QVERIFY( m_document->page(0)->hasPixmap( dummyDocumentObserver, 84, 82 ) );
+
+	QImage img( 84, 82, QImage::Format_ARGB32_Premultiplied );
+	QPainter p( &img );
+	PagePainter::paintPageOnPainter( &p, m_document->page(0), dummyDocumentObserver, 0, 84, 82, QRect(0, 0, 84, 82) );
+
+	QVERIFY( qGray( img.pixel(10, 41) ) < 32 );
+	QVERIFY( qGray( img.pixel(73, 41) ) > 223 );
+
+	m_document->removeObserver( dummyDocumentObserver );
+	delete dummyDocumentObserver;
+	delete m_document;
+}
+
 QTEST_MAIN(KIMGIOTest)
 #include "kimgiotest.moc"
@@ -66,12 +66,13 @@ static int maskExportedFlags(int flags)
 
 //BEGIN PopplerAnnotationProxy implementation
 PopplerAnnotationProxy::PopplerAnnotationProxy( Poppler::Document *doc, QMutex *userMutex, QHash<Okular::Annotation*, Poppler::Annotation*> *annotsOnOpenHash )
-    : ppl_doc ( doc ), mutex ( userMutex ), annotationsOnOpenHash( annotsOnOpenHash )
+    : ppl_doc ( doc ), mutex ( userMutex ), annotationsOnOpenHash( annotsOnOpenHash ), inBatch( false )
 {
 }
 
 PopplerAnnotationProxy::~PopplerAnnotationProxy()
 {
+    qDeleteAll( batchPages );
 }
 
 bool PopplerAnnotationProxy::supports( Capability cap ) const
@@ -81,6 +82,7 @@ bool PopplerAnnotationProxy::supports( Capability cap ) const
         case Addition:
         case Modification:
         case Removal:
+        case Batch:
             return true;
         default:
             return false;
@@ -124,9 +126,9 @@ void PopplerAnnotationProxy::notifyAddition( Okular::Annotation *okl_ann, int pa
     }
 
     // Bind poppler object to page
-    Poppler::Page *ppl_page = ppl_doc->page( page );
+    Poppler::Page *ppl_page = popplerPage( page );
     ppl_page->addAnnotation( ppl_ann );
-    delete ppl_page;
+    releasePopplerPage( ppl_page );
 
     // Set pointer to poppler annotation as native Id
     okl_ann->setNativeId( qVariantFromValue( ppl_ann ) );
@@ -256,15 +258,48 @@ void PopplerAnnotationProxy::notifyRemoval( Okular::Annotation *okl_ann, int pag
 
     QMutexLocker ml(mutex);
 
-    Poppler::Page *ppl_page = ppl_doc->page( page );
+    Poppler::Page *ppl_page = popplerPage( page );
     annotationsOnOpenHash->remove( okl_ann );
     ppl_page->removeAnnotation( ppl_ann ); // Also destroys ppl_ann
-    delete ppl_page;
+    releasePopplerPage( ppl_page );
 
     okl_ann->setNativeId( qVariantFromValue(0) ); // So that we don't double-free in disposeAnnotation
 
     qCDebug(OkularPdfDebug) << okl_ann->uniqueName();
 }
+
+void PopplerAnnotationProxy::beginBatch()
+{
+    inBatch = true;
+}
+
+void PopplerAnnotationProxy::endBatch()
+{
+    QMutexLocker ml(mutex);
+
+    inBatch = false;
+    qDeleteAll( batchPages );
+    batchPages.clear();
+}
+
+// The mutex must be locked. Within a batch the page is loaded once and
+// reused for all the annotations added to or removed from it
+Poppler::Page *PopplerAnnotationProxy::popplerPage( int page )
+{
+    if ( !inBatch )
+        return ppl_doc->page( page );
+
+    Poppler::Page *&ppl_page = batchPages[ page ];
+    if ( !ppl_page )
+        ppl_page = ppl_doc->page( page );
+    return ppl_page;
+}
+
+void PopplerAnnotationProxy::releasePopplerPage( Poppler::Page *ppl_page )
+{
+    if ( !inBatch )
+        delete ppl_page;
+}
 //END PopplerAnnotationProxy implementation
 
 Okular::Annotation* createAnnotationFromPopplerAnnotation( Poppler::Annotation *ann, bool *doDelete )
@@ -33,10 +33,18 @@ class PopplerAnnotationProxy : public Okular::AnnotationProxy
         void notifyAddition( Okular::Annotation *annotation, int page ) override;
         void notifyModification( const Okular::Annotation *annotation, int page, bool appearanceChanged ) override;
         void notifyRemoval( Okular::Annotation *annotation, int page ) override;
+        void beginBatch() override;
+        void endBatch() override;
     private:
+        Poppler::Page *popplerPage( int page );
+        void releasePopplerPage( Poppler::Page *ppl_page );
+
         Poppler::Document *ppl_doc;
         QMutex *mutex;
         QHash<Okular::Annotation*, Poppler::Annotation*> *annotationsOnOpenHash;
+        // the pages touched by the current batch, kept until it ends
+        bool inBatch;
+        QHash<int, Poppler::Page*> batchPages;
 };
 
 #endif
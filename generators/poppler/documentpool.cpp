@@ -0,0 +1,125 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "documentpool.h"
+
+#include <qthread.h>
+
+#include "debug_pdf.h"
+
+// opening documents is not free, keep the pool small
+static const int MaximumPoolSize = 4;
+
+PopplerDocumentPool::PopplerDocumentPool()
+    : m_count( 0 ), m_generation( 0 )
+{
+}
+
+PopplerDocumentPool::~PopplerDocumentPool()
+{
+    clear();
+}
+
+void PopplerDocumentPool::setFile( const QString &fileName, const QByteArray &password )
+{
+    clear();
+    QMutexLocker locker( &m_mutex );
+    m_fileName = fileName;
+    m_password = password;
+}
+
+void PopplerDocumentPool::setData( const QByteArray &fileData, const QByteArray &password )
+{
+    clear();
+    QMutexLocker locker( &m_mutex );
+    m_fileData = fileData;
+    m_password = password;
+}
+
+void PopplerDocumentPool::clear()
+{
+    QMutexLocker locker( &m_mutex );
+    qDeleteAll( m_free );
+    m_free.clear();
+    // the busy ones are deleted when they are released
+    m_count = m_busy.count();
+    ++m_generation;
+    m_fileName.clear();
+    m_fileData.clear();
+    m_password.clear();
+}
+
+Poppler::Document *PopplerDocumentPool::acquire()
+{
+    QMutexLocker locker( &m_mutex );
+    if ( !m_free.isEmpty() )
+    {
+        Poppler::Document *document = m_free.takeLast();
+        m_busy.insert( document, m_generation );
+        return document;
+    }
+
+    if ( m_count >= maximumSize() || ( m_fileName.isEmpty() && m_fileData.isEmpty() ) )
+        return nullptr;
+
+    // open it without the lock, it can take a while on big files
+    const QString fileName = m_fileName;
+    const QByteArray fileData = m_fileData;
+    const QByteArray password = m_password;
+    const int generation = m_generation;
+    ++m_count;
+    locker.unlock();
+
+    Poppler::Document *document = fileData.isEmpty() ? Poppler::Document::load( fileName, password, password )
+                                                     : Poppler::Document::loadFromData( fileData, password, password );
+    if ( document && document->isLocked() )
+    {
+        delete document;
+        document = nullptr;
+    }
+
+    locker.relock();
+    if ( !document || generation != m_generation )
+    {
+        if ( document )
+            qCDebug(OkularPdfDebug) << "Document changed while opening a pool document";
+        else
+            qCWarning(OkularPdfDebug) << "Could not open a pool document";
+        delete document;
+        if ( generation == m_generation )
+            --m_count;
+        return nullptr;
+    }
+
+    m_busy.insert( document, generation );
+    return document;
+}
+
+void PopplerDocumentPool::release( Poppler::Document *document )
+{
+    if ( !document )
+        return;
+
+    QMutexLocker locker( &m_mutex );
+    const int generation = m_busy.take( document );
+    if ( generation == m_generation )
+    {
+        m_free.append( document );
+    }
+    else
+    {
+        --m_count;
+        delete document;
+    }
+}
+
+int PopplerDocumentPool::maximumSize()
+{
+    return qBound( 1, QThread::idealThreadCount() - 1, MaximumPoolSize );
+}
@@ -0,0 +1,83 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_GENERATOR_PDF_DOCUMENTPOOL_H_
+#define _OKULAR_GENERATOR_PDF_DOCUMENTPOOL_H_
+
+#include <poppler-qt5.h>
+
+#include <qbytearray.h>
+#include <qhash.h>
+#include <qlist.h>
+#include <qmutex.h>
+#include <qstring.h>
+
+/**
+ * Extra Poppler documents opened on the same file (or data) as the one
+ * the generator renders with.
+ *
+ * Poppler documents can not be used by two threads at once, so text
+ * extraction and font scanning take a document of their own from the pool
+ * instead of waiting for the renders to release the main one. The pool
+ * documents never see the in memory changes (annotations, forms, layers,
+ * render hints) of the main document, so only work that does not depend
+ * on them must be routed here.
+ */
+class PopplerDocumentPool
+{
+    public:
+        PopplerDocumentPool();
+        ~PopplerDocumentPool();
+
+        /**
+         * Sets the source of the pool documents and closes the current ones.
+         */
+        void setFile( const QString &fileName, const QByteArray &password );
+        void setData( const QByteArray &fileData, const QByteArray &password );
+
+        /**
+         * Closes all the documents and forgets the source.
+         */
+        void clear();
+
+        /**
+         * Returns a document for the exclusive use of the caller, opening
+         * a new one if all of them are busy and the pool is not full.
+         * Returns null if no document is available, the caller should
+         * then fall back to the main document.
+         */
+        Poppler::Document *acquire();
+
+        /**
+         * Gives back a document returned by acquire().
+         */
+        void release( Poppler::Document *document );
+
+        /**
+         * How many documents the pool opens at most, one less than
+         * the cores so renders keep one for themselves.
+         */
+        static int maximumSize();
+
+    private:
+        QMutex m_mutex;
+        QString m_fileName;
+        QByteArray m_fileData;
+        QByteArray m_password;
+        QList<Poppler::Document *> m_free;
+        int m_count;
+        // bumped by every source change, so documents acquired before
+        // it are deleted on release instead of going back to the pool
+        int m_generation;
+        QHash<Poppler::Document *, int> m_busy;
+
+        Q_DISABLE_COPY( PopplerDocumentPool )
+};
+
+#endif
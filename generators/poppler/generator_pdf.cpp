@@ -540,7 +540,10 @@ Okular::Document::OpenResult PDFGenerator::loadDocumentWithPassword( const QStri
 #endif
     // create PDFDoc for the given file
     pdfdoc = Poppler::Document::load( filePath, 0, 0 );
-    return init(pagesVector, password);
+    const Okular::Document::OpenResult result = init(pagesVector, password);
+    if ( result == Okular::Document::OpenSuccess )
+        docPool.setFile( filePath, password.toLatin1() );
+    return result;
 }
 
 Okular::Document::OpenResult PDFGenerator::loadDocumentFromDataWithPassword( const QByteArray & fileData, QVector<Okular::Page*> & pagesVector, const QString &password )
@@ -554,7 +557,10 @@ Okular::Document::OpenResult PDFGenerator::loadDocumentFromDataWithPassword( con
 #endif
     // create PDFDoc for the given file
     pdfdoc = Poppler::Document::loadFromData( fileData, 0, 0 );
-    return init(pagesVector, password);
+    const Okular::Document::OpenResult result = init(pagesVector, password);
+    if ( result == Okular::Document::OpenSuccess )
+        docPool.setData( fileData, password.toLatin1() );
+    return result;
 }
 
 Okular::Document::OpenResult PDFGenerator::init(QVector<Okular::Page*> & pagesVector, const QString &password)
@@ -610,6 +616,7 @@ PDFGenerator::SwapBackingFileResult PDFGenerator::swapBackingFile( QString const
 bool PDFGenerator::doCloseDocument()
 {
     // remove internal objects
+    docPool.clear();
     userMutex()->lock();
     delete annotProxy;
     annotProxy = 0;
@@ -822,13 +829,21 @@ Okular::FontInfo::List PDFGenerator::fontsForPage( int page )
         return list;
 
     QList<Poppler::FontInfo> fonts;
-    userMutex()->lock();
+    // fonts come from the file, scan them on a pool document if there
+    // is one so the renders do not have to wait
+    Poppler::Document *poolDoc = docPool.acquire();
+    if ( !poolDoc )
+        userMutex()->lock();
 
-    Poppler::FontIterator* it = pdfdoc->newFontIterator(page);
+    Poppler::FontIterator* it = ( poolDoc ? poolDoc : pdfdoc )->newFontIterator(page);
     if (it->hasNext()) {
         fonts = it->next();
     }
-    userMutex()->unlock();
+    delete it;
+
+    if ( !poolDoc )
+        userMutex()->unlock();
+    docPool.release( poolDoc );
 
     foreach (const Poppler::FontInfo &font, fonts)
     {
@@ -974,6 +989,15 @@ QImage PDFGenerator::image( Okular::PixmapRequest * request )
     // note: thread safety is set on 'false' for the GUI (this) thread
     Poppler::Page *p = pdfdoc->page(page->number());
 
+    // thumbnails are rendered faster without antialiasing
+    const Poppler::Document::RenderHints hints = pdfdoc->renderHints();
+    const bool fastRendering = request->thumbnail() && !request->isTile();
+    if ( fastRendering )
+    {
+        pdfdoc->setRenderHint( Poppler::Document::Antialiasing, false );
+        pdfdoc->setRenderHint( Poppler::Document::TextAntialiasing, false );
+    }
+
     // 2. Take data from outputdev and attach it to the Page
     QImage img;
     if (p)
@@ -1016,6 +1040,12 @@ QImage PDFGenerator::image( Okular::PixmapRequest * request )
         img.fill( Qt::white );
     }
 
+    if ( fastRendering )
+    {
+        pdfdoc->setRenderHint( Poppler::Document::Antialiasing, hints.testFlag( Poppler::Document::Antialiasing ) );
+        pdfdoc->setRenderHint( Poppler::Document::TextAntialiasing, hints.testFlag( Poppler::Document::TextAntialiasing ) );
+    }
+
     if ( p && genObjectRects )
     {
         // TODO previously we extracted Image type rects too, but that needed porting to poppler
@@ -1108,12 +1138,18 @@ Okular::TextPage* PDFGenerator::textPage( Okular::Page *page )
     // build a TextList...
     QList<Poppler::TextBox*> textList;
     double pageWidth, pageHeight;
-    Poppler::Page *pp = pdfdoc->page( page->number() );
+    // extract the text from a pool document if there is one, so searches
+    // and the text thread do not wait for the renders of pdfdoc. Like the
+    // text pages generated before an edit, the text is the one of the file
+    Poppler::Document *poolDoc = docPool.acquire();
+    Poppler::Page *pp = ( poolDoc ? poolDoc : pdfdoc )->page( page->number() );
     if (pp)
     {
-        userMutex()->lock();
+        if ( !poolDoc )
+            userMutex()->lock();
         textList = pp->textList();
-        userMutex()->unlock();
+        if ( !poolDoc )
+            userMutex()->unlock();
 
         QSizeF s = pp->pageSizeF();
         pageWidth = s.width();
@@ -1126,6 +1162,7 @@ Okular::TextPage* PDFGenerator::textPage( Okular::Page *page )
         pageWidth = defaultPageWidth;
         pageHeight = defaultPageHeight;
     }
+    docPool.release( poolDoc );
 
     Okular::TextPage *tp = abstractTextPage(textList, pageHeight, pageWidth, (Poppler::Page::Rotation)page->orientation());
     qDeleteAll(textList);
@@ -28,6 +28,8 @@
 #include <interfaces/printinterface.h>
 #include <interfaces/saveinterface.h>
 
+#include "documentpool.h"
+
 namespace Okular {
 class ObjectRect;
 class SourceReference;
@@ -131,6 +133,8 @@ class PDFGenerator : public Okular::Generator, public Okular::ConfigInterface, p
 
         // poppler dependant stuff
         Poppler::Document *pdfdoc;
+        // documents for the text extraction and font scanning threads
+        PopplerDocumentPool docPool;
 
 
         // misc variables for document info and synopsis caching
@@ -39,21 +39,31 @@
 
 OKULAR_EXPORT_PLUGIN(GSGenerator, "libokularGenerator_ghostview.json")
 
+// one renderer for the main view and one for the previews
+static const int MaxRenderersPerDocument = 2;
+
 GSGenerator::GSGenerator( QObject *parent, const QVariantList &args ) :
     Okular::Generator( parent, args ),
-    m_internalDocument(0),
-    m_request(0)
+    m_internalDocument(0)
 {
     setFeature( PrintPostscript );
     setFeature( PrintToFile );
+    setFeature( TiledRendering );
 
-    GSRendererThread *renderer = GSRendererThread::getCreateRenderer();
-    if (!renderer->isRunning()) renderer->start();
-    connect(renderer, &GSRendererThread::imageDone, this, &GSGenerator::slotImageGenerated, Qt::QueuedConnection);
+    for (int i = 0; i < MaxRenderersPerDocument; ++i)
+    {
+        GSRendererThread *renderer = GSRendererThread::acquireRenderer();
+        m_renderers.append(renderer);
+        m_requests.append(nullptr);
+        connect(renderer, &GSRendererThread::imageDone, this, &GSGenerator::slotImageGenerated,
+                static_cast<Qt::ConnectionType>(Qt::QueuedConnection | Qt::UniqueConnection));
+    }
 }
 
 GSGenerator::~GSGenerator()
 {
+    for (GSRendererThread *renderer : qAsConst(m_renderers))
+        GSRendererThread::releaseRenderer(renderer);
 }
 
 bool GSGenerator::reparseConfig()
@@ -171,17 +181,18 @@ bool GSGenerator::doCloseDocument()
 
 void GSGenerator::slotImageGenerated(QImage *img, Okular::PixmapRequest *request)
 {
-    // This can happen as GSInterpreterCMD is a singleton and on creation signals all the slots
-    // of all the generators attached to it
-    if (request != m_request) return;
+    // This can happen as the renderers are shared by the documents open in
+    // the process and signal all the slots of the generators attached to them
+    const int slot = m_requests.indexOf(request);
+    if (slot == -1) return;
 
-    if ( !request->page()->isBoundingBoxKnown() )
+    if ( !request->isTile() && !request->page()->isBoundingBoxKnown() )
         updatePageBoundingBox( request->page()->number(), Okular::Utils::imageBoundingBox( img ) );
 
-    m_request = 0;
+    m_requests[slot] = nullptr;
     QPixmap *pix = new QPixmap(QPixmap::fromImage(*img));
     delete img;
-    request->page()->setPixmap( request->observer(), pix );
+    request->page()->setPixmap( request->observer(), pix, request->isTile() ? request->normalizedRect() : Okular::NormalizedRect() );
     signalPixmapRequestDone( request );
 }
 
@@ -210,10 +221,9 @@ void GSGenerator::generatePixmap( Okular::PixmapRequest * req )
 {
     qCDebug(OkularSpectreDebug) << "receiving" << *req;
 
+    const int slot = m_requests.indexOf(nullptr);
     SpectrePage *page = spectre_document_get_page(m_internalDocument, req->pageNumber());
 
-    GSRendererThread *renderer = GSRendererThread::getCreateRenderer();
-
     GSRendererThreadRequest gsreq(this);
     gsreq.spectrePage = page;
     gsreq.platformFonts = GSSettings::platformFonts();
@@ -236,14 +246,16 @@ void GSGenerator::generatePixmap( Okular::PixmapRequest * req )
         gsreq.magnify = qMax( (double)req->width() / req->page()->width(),
                               (double)req->height() / req->page()->height() );
     }
+    if (req->isTile())
+        gsreq.slice = req->normalizedRect().geometry(req->width(), req->height());
     gsreq.request = req;
-    m_request = req;
-    renderer->addRequest(gsreq);
+    m_requests[slot] = req;
+    m_renderers.at(slot)->addRequest(gsreq);
 }
 
 bool GSGenerator::canGeneratePixmap() const
 {
-    return !m_request;
+    return m_requests.contains(nullptr);
 }
 
 Okular::DocumentInfo GSGenerator::generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const
@@ -15,6 +15,8 @@
 
 #include <libspectre/spectre.h>
 
+class GSRendererThread;
+
 class GSGenerator : public Okular::Generator, public Okular::ConfigInterface
 {
     Q_OBJECT
@@ -61,7 +63,10 @@ class GSGenerator : public Okular::Generator, public Okular::ConfigInterface
         // backendish stuff
         SpectreDocument *m_internalDocument;
 
-        Okular::PixmapRequest *m_request;
+        // renderers of the pool this document uses and the request each
+        // one is busy with, so previews and the main view render in parallel
+        QVector<GSRendererThread *> m_renderers;
+        QVector<Okular::PixmapRequest *> m_requests;
 
         bool cache_AAtext;
         bool cache_AAgfx;
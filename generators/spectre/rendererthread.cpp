@@ -9,6 +9,7 @@
 
 #include "rendererthread.h"
 
+#include <qatomic.h>
 #include <qimage.h>
 
 #include "spectre_debug.h"
@@ -17,15 +18,42 @@
 #include "core/page.h"
 #include "core/utils.h"
 
-GSRendererThread *GSRendererThread::theRenderer = 0;
+QList<GSRendererThread *> GSRendererThread::thePool;
+QMutex GSRendererThread::thePoolMutex;
 
-GSRendererThread *GSRendererThread::getCreateRenderer()
+// Ghostscript builds that only allow a single instance per process make
+// concurrent renders fail, once that is seen renders go one at a time
+static QMutex gsMutex;
+static QAtomicInt activeRenders;
+static QAtomicInt serializeRenders;
+
+GSRendererThread *GSRendererThread::acquireRenderer()
 {
-    if (!theRenderer) theRenderer = new GSRendererThread();
-    return theRenderer;
+    QMutexLocker locker(&thePoolMutex);
+    GSRendererThread *renderer = 0;
+    for (GSRendererThread *candidate : qAsConst(thePool))
+    {
+        if (!renderer || candidate->m_users < renderer->m_users)
+            renderer = candidate;
+    }
+    if (!renderer || (renderer->m_users > 0 && thePool.count() < qMax(1, QThread::idealThreadCount())))
+    {
+        renderer = new GSRendererThread();
+        thePool.append(renderer);
+        renderer->start();
+    }
+    ++renderer->m_users;
+    return renderer;
+}
+
+void GSRendererThread::releaseRenderer(GSRendererThread *renderer)
+{
+    QMutexLocker locker(&thePoolMutex);
+    --renderer->m_users;
 }
 
 GSRendererThread::GSRendererThread()
+    : m_users(0)
 {
     m_renderContext = spectre_render_context_new();
 }
@@ -43,6 +71,139 @@ void GSRendererThread::addRequest(const GSRendererThreadRequest &req)
     m_semaphore.release();
 }
 
+static bool renderPage(SpectrePage *page, SpectreRenderContext *renderContext, const QRect &slice, unsigned char **data, int *row_length)
+{
+    if (slice.isEmpty())
+        spectre_page_render(page, renderContext, data, row_length);
+    else
+        spectre_page_render_slice(page, renderContext, slice.x(), slice.y(), slice.width(), slice.height(), data, row_length);
+    return spectre_page_status(page) == SPECTRE_STATUS_SUCCESS;
+}
+
+QImage GSRendererThread::render(const GSRendererThreadRequest &req)
+{
+    spectre_render_context_set_scale(m_renderContext, req.magnify, req.magnify);
+    spectre_render_context_set_use_platform_fonts(m_renderContext, req.platformFonts);
+    spectre_render_context_set_antialias_bits(m_renderContext, req.graphicsAAbits, req.textAAbits);
+    // Do not use spectre_render_context_set_rotation makes some files not render correctly, e.g. bug210499.ps
+    // so we basically do the rendering without any rotation and then rotate to the orientation as needed
+    // spectre_render_context_set_rotation(m_renderContext, req.orientation);
+
+    unsigned char *data = NULL;
+    int row_length = 0;
+    int pageWidth = req.request->width();
+    int pageHeight = req.request->height();
+
+    if ( req.orientation % 2 )
+        qSwap( pageWidth, pageHeight );
+
+    // the slice is given on the oriented page, map it back to the unrotated one
+    QRect slice;
+    if (!req.slice.isEmpty())
+    {
+        const QRect &s = req.slice;
+        switch (req.orientation)
+        {
+            case Okular::Rotation90:
+                slice = QRect(s.y(), pageHeight - s.x() - s.width(), s.height(), s.width());
+                break;
+            case Okular::Rotation180:
+                slice = QRect(pageWidth - s.x() - s.width(), pageHeight - s.y() - s.height(), s.width(), s.height());
+                break;
+            case Okular::Rotation270:
+                slice = QRect(pageWidth - s.y() - s.height(), s.x(), s.height(), s.width());
+                break;
+            default:
+                slice = s;
+        }
+    }
+    const int wantedWidth = slice.isEmpty() ? pageWidth : slice.width();
+    const int wantedHeight = slice.isEmpty() ? pageHeight : slice.height();
+
+    const bool serialized = serializeRenders.loadAcquire();
+    if (serialized)
+        gsMutex.lock();
+    bool concurrent = activeRenders.fetchAndAddOrdered(1) > 0;
+    bool ok = renderPage(req.spectrePage, m_renderContext, slice, &data, &row_length);
+    if (activeRenders.deref())
+        concurrent = true;
+    if (serialized)
+        gsMutex.unlock();
+
+    if (!ok && !serialized && concurrent)
+    {
+        qCWarning(OkularSpectreDebug) << "Rendering failed while another page was being rendered, rendering one page at a time from now on";
+        serializeRenders.storeRelease(1);
+        free(data);
+        data = NULL;
+        row_length = 0;
+
+        QMutexLocker locker(&gsMutex);
+        // wait for the renders that started before the switch
+        while (activeRenders.loadAcquire() > 0)
+            QThread::msleep(1);
+        renderPage(req.spectrePage, m_renderContext, slice, &data, &row_length);
+    }
+
+    // Qt needs the missing alpha of QImage::Format_RGB32 to be 0xff
+    if (data && data[3] != 0xff)
+    {
+        for (int i = 3; i < row_length * wantedHeight; i += 4)
+            data[i] = 0xff;
+    }
+
+    QImage img;
+    if (row_length == wantedWidth * 4)
+    {
+        img = QImage(data, wantedWidth, wantedHeight, QImage::Format_RGB32);
+    }
+    else
+    {
+        // In case this ends up beign very slow we can try with some memmove
+        QImage aux(data, row_length / 4, wantedHeight, QImage::Format_RGB32);
+        img = QImage(aux.copy(0, 0, wantedWidth, wantedHeight));
+    }
+
+    switch (req.orientation)
+    {
+        case Okular::Rotation90:
+        {
+            QTransform m;
+            m.rotate(90);
+            img = img.transformed( m );
+            break;
+        }
+
+        case Okular::Rotation180:
+        {
+            QTransform m;
+            m.rotate(180);
+            img = img.transformed( m );
+            break;
+        }
+        case Okular::Rotation270:
+        {
+            QTransform m;
+            m.rotate(270);
+            img = img.transformed( m );
+        }
+    }
+
+    // detach from data before freeing it
+    img = img.copy();
+    free(data);
+
+    const QSize wantedSize = req.slice.isEmpty() ? QSize(req.request->width(), req.request->height()) : req.slice.size();
+    if (img.size() != wantedSize)
+    {
+        qCWarning(OkularSpectreDebug).nospace() << "Generated image does not match wanted size: "
+            << "[" << img.width() << "x" << img.height() << "] vs requested "
+            << "[" << wantedSize.width() << "x" << wantedSize.height() << "]";
+        img = img.scaled(wantedSize);
+    }
+    return img;
+}
+
 void GSRendererThread::run()
 {
     while(1)
@@ -53,79 +214,7 @@ void GSRendererThread::run()
             GSRendererThreadRequest req = m_queue.dequeue();
             m_queueMutex.unlock();
 
-            spectre_render_context_set_scale(m_renderContext, req.magnify, req.magnify);
-            spectre_render_context_set_use_platform_fonts(m_renderContext, req.platformFonts);
-            spectre_render_context_set_antialias_bits(m_renderContext, req.graphicsAAbits, req.textAAbits);
-            // Do not use spectre_render_context_set_rotation makes some files not render correctly, e.g. bug210499.ps
-            // so we basically do the rendering without any rotation and then rotate to the orientation as needed
-            // spectre_render_context_set_rotation(m_renderContext, req.orientation);
-
-            unsigned char *data = NULL;
-            int row_length = 0;
-            int wantedWidth = req.request->width();
-            int wantedHeight = req.request->height();
-
-            if ( req.orientation % 2 )
-                qSwap( wantedWidth, wantedHeight );
-
-            spectre_page_render(req.spectrePage, m_renderContext, &data, &row_length);
-
-            // Qt needs the missing alpha of QImage::Format_RGB32 to be 0xff
-            if (data && data[3] != 0xff)
-            {
-                for (int i = 3; i < row_length * wantedHeight; i += 4)
-                    data[i] = 0xff;
-            }
-
-            QImage img;
-            if (row_length == wantedWidth * 4)
-            {
-                img = QImage(data, wantedWidth, wantedHeight, QImage::Format_RGB32);
-            }
-            else
-            {
-                // In case this ends up beign very slow we can try with some memmove
-                QImage aux(data, row_length / 4, wantedHeight, QImage::Format_RGB32);
-                img = QImage(aux.copy(0, 0, wantedWidth, wantedHeight));
-            }
-
-            switch (req.orientation)
-            {
-                case Okular::Rotation90:
-                {
-                    QTransform m;
-                    m.rotate(90);
-                    img = img.transformed( m );
-                    break;
-                }
-
-                case Okular::Rotation180:
-                {
-                    QTransform m;
-                    m.rotate(180);
-                    img = img.transformed( m );
-                    break;
-                }
-                case Okular::Rotation270:
-                {
-                    QTransform m;
-                    m.rotate(270);
-                    img = img.transformed( m );
-                }
-            }
-
-            QImage *image = new QImage(img.copy());
-            free(data);
-
-            if (image->width() != req.request->width() || image->height() != req.request->height())
-            {
-                qCWarning(OkularSpectreDebug).nospace() << "Generated image does not match wanted size: "
-                    << "[" << image->width() << "x" << image->height() << "] vs requested "
-                    << "[" << req.request->width() << "x" << req.request->height() << "]";
-                QImage aux = image->scaled(wantedWidth, wantedHeight);
-                delete image;
-                image = new QImage(aux);
-            }
+            QImage *image = new QImage(render(req));
             emit imageDone(image, req.request);
 
             spectre_page_free(req.spectrePage);
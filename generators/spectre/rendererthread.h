@@ -10,8 +10,10 @@
 #ifndef _OKULAR_GSRENDERERTHREAD_H_
 #define _OKULAR_GSRENDERERTHREAD_H_
 
+#include <qlist.h>
 #include <qmutex.h>
 #include <qqueue.h>
+#include <qrect.h>
 #include <qsemaphore.h>
 #include <qstring.h>
 #include <qthread.h>
@@ -47,6 +49,8 @@ struct GSRendererThreadRequest
     double magnify;
     int orientation;
     bool platformFonts;
+    // area of the oriented page to render, in pixels, empty for the whole page
+    QRect slice;
 };
 Q_DECLARE_TYPEINFO(GSRendererThreadRequest, Q_MOVABLE_TYPE);
 
@@ -54,7 +58,13 @@ class GSRendererThread : public QThread
 {
 Q_OBJECT
     public:
-        static GSRendererThread *getCreateRenderer();
+        /**
+         * Returns the running renderer of the pool with the fewest documents
+         * attached, a new one is started while the pool has less renderers
+         * than cores. Every call must be paired with releaseRenderer().
+         */
+        static GSRendererThread *acquireRenderer();
+        static void releaseRenderer(GSRendererThread *renderer);
 
         ~GSRendererThread();
 
@@ -66,9 +76,13 @@ Q_OBJECT
     private:
         GSRendererThread();
 
+        QImage render(const GSRendererThreadRequest &req);
+
         QSemaphore m_semaphore;
 
-        static GSRendererThread *theRenderer;
+        static QList<GSRendererThread *> thePool;
+        static QMutex thePoolMutex;
+        int m_users;
 
         void run() override;
 
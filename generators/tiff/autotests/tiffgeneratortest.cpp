@@ -0,0 +1,240 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <QtTest>
+
+#include <QImage>
+#include <QPainter>
+#include <QTemporaryFile>
+#include <KPluginLoader>
+
+#include <tiffio.h>
+
+#include "core/document.h"
+#include "core/observer.h"
+#include "core/page.h"
+#include "settings_core.h"
+#include "ui/pagepainter.h"
+
+class TiffGeneratorTest
+: public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void initTestCase();
+        void testReducedResolution();
+        void testRegionDecoding_data();
+        void testRegionDecoding();
+};
+
+// left part black, right part white
+static QImage splitImage( int width, int height, int split )
+{
+    QImage image( width, height, QImage::Format_RGB32 );
+    image.fill( Qt::white );
+    QPainter p( &image );
+    p.fillRect( 0, 0, split, height, Qt::black );
+    return image;
+}
+
+/*
+ * Appends @p image as a new uncompressed RGB directory, stored in strips
+ * of 16 rows, or in tiles of @p tileSize pixels if it is not 0.
+ */
+static bool writeDirectory( TIFF *tiff, const QImage &image, bool reduced, int tileSize )
+{
+    TIFFSetField( tiff, TIFFTAG_IMAGEWIDTH, (uint32)image.width() );
+    TIFFSetField( tiff, TIFFTAG_IMAGELENGTH, (uint32)image.height() );
+    TIFFSetField( tiff, TIFFTAG_BITSPERSAMPLE, 8 );
+    TIFFSetField( tiff, TIFFTAG_SAMPLESPERPIXEL, 3 );
+    TIFFSetField( tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB );
+    TIFFSetField( tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG );
+    TIFFSetField( tiff, TIFFTAG_COMPRESSION, COMPRESSION_NONE );
+    TIFFSetField( tiff, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT );
+    if ( reduced )
+        TIFFSetField( tiff, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE );
+
+    if ( tileSize > 0 )
+    {
+        TIFFSetField( tiff, TIFFTAG_TILEWIDTH, (uint32)tileSize );
+        TIFFSetField( tiff, TIFFTAG_TILELENGTH, (uint32)tileSize );
+        QByteArray tile( tileSize * tileSize * 3, 0 );
+        for ( int ty = 0; ty < image.height(); ty += tileSize )
+        {
+            for ( int tx = 0; tx < image.width(); tx += tileSize )
+            {
+                tile.fill( 0 );
+                for ( int y = ty; y < qMin( ty + tileSize, image.height() ); ++y )
+                {
+                    for ( int x = tx; x < qMin( tx + tileSize, image.width() ); ++x )
+                    {
+                        char *sample = tile.data() + ( ( y - ty ) * tileSize + ( x - tx ) ) * 3;
+                        const QRgb pixel = image.pixel( x, y );
+                        sample[0] = qRed( pixel );
+                        sample[1] = qGreen( pixel );
+                        sample[2] = qBlue( pixel );
+                    }
+                }
+                if ( TIFFWriteTile( tiff, tile.data(), tx, ty, 0, 0 ) < 0 )
+                    return false;
+            }
+        }
+    }
+    else
+    {
+        TIFFSetField( tiff, TIFFTAG_ROWSPERSTRIP, 16 );
+        QByteArray row( image.width() * 3, 0 );
+        for ( int y = 0; y < image.height(); ++y )
+        {
+            for ( int x = 0; x < image.width(); ++x )
+            {
+                const QRgb pixel = image.pixel( x, y );
+                row[ x * 3 ] = qRed( pixel );
+                row[ x * 3 + 1 ] = qGreen( pixel );
+                row[ x * 3 + 2 ] = qBlue( pixel );
+            }
+            if ( TIFFWriteScanline( tiff, row.data(), y, 0 ) < 0 )
+                return false;
+        }
+    }
+
+    return TIFFWriteDirectory( tiff );
+}
+
+// renders page @p page of @p document at width x height
+static QImage renderPage( Okular::Document *document, Okular::DocumentObserver *observer, int page, int width, int height )
+{
+    Okular::PixmapRequest *req = new Okular::PixmapRequest( observer, page, width, height,
+        1, Okular::PixmapRequest::NoFeature );
+    document->requestPixmaps( QLinkedList<Okular::PixmapRequest*>() << req );
+    if ( !document->page( page )->hasPixmap( observer, width, height ) )
+        return QImage();
+
+    QImage img( width, height, QImage::Format_ARGB32_Premultiplied );
+    QPainter p( &img );
+    PagePainter::paintPageOnPainter( &p, document->page( page ), observer, 0, width, height, QRect( 0, 0, width, height ) );
+    return img;
+}
+
+void TiffGeneratorTest::initTestCase()
+{
+    // Make sure we find the okularGenerator_tiff that we build just now and not the system one
+    QFileInfo lib( QStringLiteral(GENERATOR_PATH) );
+    QVERIFY2( lib.exists(), GENERATOR_PATH );
+    QStringList libPaths = QCoreApplication::libraryPaths();
+    libPaths.prepend( lib.absolutePath() );
+    QCoreApplication::setLibraryPaths( libPaths );
+    QVERIFY( !KPluginLoader::findPlugin( QStringLiteral("okularGenerator_tiff") ).isEmpty() );
+
+    Okular::SettingsCore::instance( QStringLiteral("tiffgeneratortest") );
+}
+
+// A reduced resolution directory is an overview of the page before it, not
+// a page, and small renderings of the page are read from it
+void TiffGeneratorTest::testReducedResolution()
+{
+    QTemporaryFile file( QDir::tempPath() + QStringLiteral( "/okular_tiffgeneratortest_XXXXXX.tif" ) );
+    QVERIFY( file.open() );
+    file.close();
+    {
+        TIFF *tiff = TIFFOpen( QFile::encodeName( file.fileName() ).constData(), "w" );
+        QVERIFY( tiff );
+        // the overview is red on purpose, to tell which level was read
+        QImage overview( 100, 75, QImage::Format_RGB32 );
+        overview.fill( Qt::red );
+        QVERIFY( writeDirectory( tiff, splitImage( 400, 300, 200 ), false, 0 ) );
+        QVERIFY( writeDirectory( tiff, overview, true, 0 ) );
+        QVERIFY( writeDirectory( tiff, splitImage( 200, 100, 100 ), false, 0 ) );
+        TIFFClose( tiff );
+    }
+
+    QMimeDatabase db;
+    Okular::Document *m_document = new Okular::Document( nullptr );
+    const QMimeType mime = db.mimeTypeForFile( file.fileName() );
+
+    Okular::DocumentObserver *dummyDocumentObserver = new Okular::DocumentObserver();
+    m_document->addObserver( dummyDocumentObserver );
+
+    QCOMPARE( (int)m_document->openDocument( file.fileName(), QUrl(), mime ), (int)Okular::Document::OpenSuccess );
+    m_document->setRotation( 0 );
+    QCOMPARE( m_document->pages(), 2u );
+    QCOMPARE( m_document->page(0)->width(), double(400) );
+    QCOMPARE( m_document->page(0)->height(), double(300) );
+    QCOMPARE( m_document->page(1)->width(), double(200) );
+    QCOMPARE( m_document->page(1)->height(), double(100) );
+
+    QImage img = renderPage( m_document, dummyDocumentObserver, 0, 50, 37 );
+    QVERIFY( !img.isNull() );
+    QCOMPARE( img.pixel(25, 18), qRgb(255, 0, 0) );
+
+    img = renderPage( m_document, dummyDocumentObserver, 0, 400, 300 );
+    QVERIFY( !img.isNull() );
+    QCOMPARE( img.pixel(10, 150), qRgb(0, 0, 0) );
+    QCOMPARE( img.pixel(390, 150), qRgb(255, 255, 255) );
+
+    img = renderPage( m_document, dummyDocumentObserver, 1, 200, 100 );
+    QVERIFY( !img.isNull() );
+    QCOMPARE( img.pixel(10, 50), qRgb(0, 0, 0) );
+    QCOMPARE( img.pixel(190, 50), qRgb(255, 255, 255) );
+
+    m_document->removeObserver( dummyDocumentObserver );
+    delete dummyDocumentObserver;
+    delete m_document;
+}
+
+void TiffGeneratorTest::testRegionDecoding_data()
+{
+    QTest::addColumn<int>( "tileSize" );
+
+    QTest::newRow( "strips" ) << 0;
+    QTest::newRow( "tiles" ) << 64;
+}
+
+// Pages rendered smaller than their size are reduced while their strips or
+// tiles are read, the split is not aligned to them
+void TiffGeneratorTest::testRegionDecoding()
+{
+    QFETCH( int, tileSize );
+
+    QTemporaryFile file( QDir::tempPath() + QStringLiteral( "/okular_tiffgeneratortest_XXXXXX.tif" ) );
+    QVERIFY( file.open() );
+    file.close();
+    {
+        TIFF *tiff = TIFFOpen( QFile::encodeName( file.fileName() ).constData(), "w" );
+        QVERIFY( tiff );
+        QVERIFY( writeDirectory( tiff, splitImage( 300, 200, 130 ), false, tileSize ) );
+        TIFFClose( tiff );
+    }
+
+    QMimeDatabase db;
+    Okular::Document *m_document = new Okular::Document( nullptr );
+    const QMimeType mime = db.mimeTypeForFile( file.fileName() );
+
+    Okular::DocumentObserver *dummyDocumentObserver = new Okular::DocumentObserver();
+    m_document->addObserver( dummyDocumentObserver );
+
+    QCOMPARE( (int)m_document->openDocument( file.fileName(), QUrl(), mime ), (int)Okular::Document::OpenSuccess );
+    m_document->setRotation( 0 );
+    QCOMPARE( m_document->pages(), 1u );
+
+    const QImage img = renderPage( m_document, dummyDocumentObserver, 0, 150, 100 );
+    QVERIFY( !img.isNull() );
+    QCOMPARE( img.pixel(10, 10), qRgb(0, 0, 0) );
+    QCOMPARE( img.pixel(60, 90), qRgb(0, 0, 0) );
+    QCOMPARE( img.pixel(70, 10), qRgb(255, 255, 255) );
+    QCOMPARE( img.pixel(140, 90), qRgb(255, 255, 255) );
+
+    m_document->removeObserver( dummyDocumentObserver );
+    delete dummyDocumentObserver;
+    delete m_document;
+}
+
+QTEST_MAIN(TiffGeneratorTest)
+#include "tiffgeneratortest.moc"
@@ -15,6 +15,7 @@
 #include <qfileinfo.h>
 #include <qimage.h>
 #include <qlist.h>
+#include <qmutex.h>
 #include <qpainter.h>
 #include <QtPrintSupport/QPrinter>
 
@@ -22,6 +23,7 @@
 #include <QtCore/QDebug>
 #include <KLocalizedString>
 
+#include <core/area.h>
 #include <core/document.h>
 #include <core/page.h>
 #include <core/fileprinter.h>
@@ -30,6 +32,9 @@
 #include <tiff.h>
 #include <tiffio.h>
 
+#include <algorithm>
+#include <string.h>
+
 #define TiffDebug 4714
 
 tsize_t okular_tiffReadProc( thandle_t handle, tdata_t buf, tsize_t size )
@@ -85,17 +90,263 @@ void okular_tiffUnmapProc( thandle_t, tdata_t, toff_t )
 }
 
 
+static TIFF* openTiff( QIODevice *device, const char *name )
+{
+    return TIFFClientOpen( name, "r", device,
+                           okular_tiffReadProc, okular_tiffWriteProc, okular_tiffSeekProc,
+                           okular_tiffCloseProc, okular_tiffSizeProc,
+                           okular_tiffMapProc, okular_tiffUnmapProc );
+}
+
 class TIFFGenerator::Private
 {
     public:
         Private()
           : tiff( nullptr ), dev( nullptr ) {}
 
+        // a reduced resolution copy of a page
+        struct Level
+        {
+            Level( toff_t o = 0, uint32 w = 0, uint32 h = 0 )
+              : offset( o ), width( w ), height( h ) {}
+
+            toff_t offset;
+            uint32 width;
+            uint32 height;
+        };
+
+        TIFF* acquireHandle();
+        void releaseHandle( TIFF *handle );
+        void closeHandles();
+
         TIFF* tiff;
         QByteArray data;
         QIODevice* dev;
+        QString fileName;
+
+        // the levels of each page, the biggest first
+        QHash< int, QVector< Level > > levels;
+
+        // the rendering threads read through handles of their own, so that
+        // they never share the current directory with each other or with tiff
+        QMutex handlesMutex;
+        QList< TIFF * > freeHandles;
+        QHash< TIFF *, QIODevice * > handleDevices;
+};
+
+TIFF* TIFFGenerator::Private::acquireHandle()
+{
+    QMutexLocker locker( &handlesMutex );
+    if ( !freeHandles.isEmpty() )
+        return freeHandles.takeLast();
+
+    QIODevice *device = nullptr;
+    if ( fileName.isEmpty() )
+    {
+        QBuffer *buffer = new QBuffer;
+        buffer->setData( data );
+        device = buffer;
+    }
+    else
+    {
+        device = new QFile( fileName );
+    }
+
+    TIFF *handle = device->open( QIODevice::ReadOnly ) ? openTiff( device, "<okular>" ) : nullptr;
+    if ( !handle )
+    {
+        delete device;
+        return nullptr;
+    }
+
+    handleDevices.insert( handle, device );
+    return handle;
+}
+
+void TIFFGenerator::Private::releaseHandle( TIFF *handle )
+{
+    QMutexLocker locker( &handlesMutex );
+    if ( handleDevices.contains( handle ) )
+        freeHandles.append( handle );
+}
+
+void TIFFGenerator::Private::closeHandles()
+{
+    QMutexLocker locker( &handlesMutex );
+    QHash< TIFF *, QIODevice * >::const_iterator it = handleDevices.constBegin(), itEnd = handleDevices.constEnd();
+    for ( ; it != itEnd; ++it )
+    {
+        TIFFClose( it.key() );
+        delete it.value();
+    }
+    handleDevices.clear();
+    freeHandles.clear();
+}
+
+/*
+ * Averages the rows of a TIFFReadRGBA* raster down by an integer factor
+ * while they are read, so a small rendering of a big page never needs
+ * the whole page decoded in memory.
+ */
+class RowReducer
+{
+    public:
+        RowReducer( int width, int height, int factor )
+          : m_width( width ), m_height( height ), m_factor( factor ), m_row( 0 ),
+            m_image( ( width + factor - 1 ) / factor, ( height + factor - 1 ) / factor, QImage::Format_RGB32 ),
+            m_sums( m_image.width() * 3, 0 )
+        {
+        }
+
+        // adds the next row, @p row points to its first pixel in ABGR order
+        void addRow( const uint32 *row )
+        {
+            if ( m_image.isNull() || m_row >= m_height )
+                return;
+
+            quint32 *sums = m_sums.data();
+            for ( int x = 0; x < m_width; ++x )
+            {
+                quint32 *sum = sums + ( x / m_factor ) * 3;
+                sum[0] += TIFFGetR( row[x] );
+                sum[1] += TIFFGetG( row[x] );
+                sum[2] += TIFFGetB( row[x] );
+            }
+
+            ++m_row;
+            if ( m_row % m_factor == 0 || m_row == m_height )
+                flush();
+        }
+
+        QImage image() const
+        {
+            return m_image;
+        }
+
+    private:
+        void flush()
+        {
+            const int rows = ( m_row - 1 ) % m_factor + 1;
+            QRgb *line = reinterpret_cast< QRgb * >( m_image.scanLine( ( m_row - 1 ) / m_factor ) );
+            quint32 *sum = m_sums.data();
+            for ( int x = 0; x < m_image.width(); ++x, sum += 3 )
+            {
+                const quint32 count = rows * qMin( m_factor, m_width - x * m_factor );
+                line[x] = qRgb( sum[0] / count, sum[1] / count, sum[2] / count );
+                sum[0] = sum[1] = sum[2] = 0;
+            }
+        }
+
+        int m_width;
+        int m_height;
+        int m_factor;
+        int m_row;
+        QImage m_image;
+        QVector< quint32 > m_sums;
 };
 
+// the biggest strip or band of tiles held in memory at once, in pixels
+static const qint64 MaxBufferPixels = 64 * 1024 * 1024;
+
+/*
+ * Reads @p region of the current directory, which must be top-left oriented,
+ * decoding only the strips or tiles it intersects. The result is reduced by
+ * the biggest integer factor that keeps it at least as big as @p size.
+ */
+static QImage readRGBARegion( TIFF *tiff, const QRect &region, const QSize &size )
+{
+    uint32 width = 0;
+    uint32 height = 0;
+    TIFFGetField( tiff, TIFFTAG_IMAGEWIDTH, &width );
+    TIFFGetField( tiff, TIFFTAG_IMAGELENGTH, &height );
+    if ( region.isEmpty() || region.right() >= (int)width || region.bottom() >= (int)height )
+        return QImage();
+
+    // 2048 keeps the sums of a block within 32 bits
+    const int factor = qBound( 1, qMin( region.width() / qMax( 1, size.width() ), region.height() / qMax( 1, size.height() ) ), 2048 );
+    RowReducer reducer( region.width(), region.height(), factor );
+
+    if ( TIFFIsTiled( tiff ) )
+    {
+        uint32 tileWidth = 0;
+        uint32 tileHeight = 0;
+        TIFFGetField( tiff, TIFFTAG_TILEWIDTH, &tileWidth );
+        TIFFGetField( tiff, TIFFTAG_TILELENGTH, &tileHeight );
+        if ( tileWidth == 0 || tileHeight == 0 || (qint64)region.width() * tileHeight > MaxBufferPixels )
+            return QImage();
+
+        QVector< uint32 > tile( tileWidth * tileHeight );
+        QVector< uint32 > band( region.width() * tileHeight );
+        for ( uint32 ty = region.top() / tileHeight * tileHeight; ty <= (uint32)region.bottom(); ty += tileHeight )
+        {
+            const int bandRows = qMin( tileHeight, height - ty );
+            for ( uint32 tx = region.left() / tileWidth * tileWidth; tx <= (uint32)region.right(); tx += tileWidth )
+            {
+                if ( !TIFFReadRGBATile( tiff, tx, ty, tile.data() ) )
+                    return QImage();
+
+                // the tile is stored bottom-up, copy its columns inside the region
+                const int left = qMax( (int)tx, region.left() );
+                const int right = qMin( (int)( tx + tileWidth ), region.right() + 1 );
+                for ( int row = 0; row < bandRows; ++row )
+                {
+                    const uint32 *src = tile.constData() + ( tileHeight - 1 - row ) * tileWidth + ( left - tx );
+                    memcpy( band.data() + row * region.width() + ( left - region.left() ), src, ( right - left ) * sizeof( uint32 ) );
+                }
+            }
+
+            for ( int row = 0; row < bandRows; ++row )
+            {
+                const int y = ty + row;
+                if ( y >= region.top() && y <= region.bottom() )
+                    reducer.addRow( band.constData() + row * region.width() );
+            }
+        }
+    }
+    else
+    {
+        uint32 rowsPerStrip = 0;
+        TIFFGetFieldDefaulted( tiff, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip );
+        rowsPerStrip = qBound( (uint32)1, rowsPerStrip, height );
+        if ( (qint64)width * rowsPerStrip > MaxBufferPixels )
+            return QImage();
+
+        QVector< uint32 > strip( width * rowsPerStrip );
+        for ( uint32 sy = region.top() / rowsPerStrip * rowsPerStrip; sy <= (uint32)region.bottom(); sy += rowsPerStrip )
+        {
+            if ( !TIFFReadRGBAStrip( tiff, sy, strip.data() ) )
+                return QImage();
+
+            // the strip is stored bottom-up
+            const int stripRows = qMin( rowsPerStrip, height - sy );
+            for ( int row = 0; row < stripRows; ++row )
+            {
+                const int y = sy + row;
+                if ( y >= region.top() && y <= region.bottom() )
+                    reducer.addRow( strip.constData() + ( stripRows - 1 - row ) * width + region.left() );
+            }
+        }
+    }
+
+    return reducer.image();
+}
+
+static bool isTopLeftOriented( TIFF *tiff )
+{
+    uint32 orientation = 0;
+    return !TIFFGetField( tiff, TIFFTAG_ORIENTATION, &orientation ) || orientation == ORIENTATION_TOPLEFT;
+}
+
+// maps @p rect of a width x height image to one of levelWidth x levelHeight
+static QRect scaledRect( const QRect &rect, const QSize &size, uint32 levelWidth, uint32 levelHeight )
+{
+    const int left = (qint64)rect.left() * levelWidth / size.width();
+    const int top = (qint64)rect.top() * levelHeight / size.height();
+    const int right = ( (qint64)( rect.right() + 1 ) * levelWidth + size.width() - 1 ) / size.width();
+    const int bottom = ( (qint64)( rect.bottom() + 1 ) * levelHeight + size.height() - 1 ) / size.height();
+    return QRect( QPoint( left, top ), QPoint( qMin( right, (int)levelWidth ) - 1, qMin( bottom, (int)levelHeight ) - 1 ) );
+}
+
 static QDateTime convertTIFFDateTime( const char* tiffdate )
 {
     if ( !tiffdate )
@@ -164,6 +415,7 @@ TIFFGenerator::TIFFGenerator( QObject *parent, const QVariantList &args )
       d( new Private )
 {
     setFeature( Threaded );
+    setFeature( TiledRendering );
     setFeature( PrintNative );
     setFeature( PrintToFile );
     setFeature( ReadRawData );
@@ -171,6 +423,7 @@ TIFFGenerator::TIFFGenerator( QObject *parent, const QVariantList &args )
 
 TIFFGenerator::~TIFFGenerator()
 {
+    d->closeHandles();
     if ( d->tiff )
     {
         TIFFClose( d->tiff );
@@ -185,8 +438,8 @@ bool TIFFGenerator::loadDocument( const QString & fileName, QVector<Okular::Page
     QFile* qfile = new QFile( fileName );
     qfile->open( QIODevice::ReadOnly );
     d->dev = qfile;
-    d->data = QFile::encodeName( QFileInfo( *qfile ).fileName() );
-    return loadTiff( pagesVector, d->data.constData() );
+    d->fileName = fileName;
+    return loadTiff( pagesVector, QFile::encodeName( QFileInfo( *qfile ).fileName() ).constData() );
 }
 
 bool TIFFGenerator::loadDocumentFromData( const QByteArray & fileData, QVector< Okular::Page * > & pagesVector )
@@ -200,15 +453,13 @@ bool TIFFGenerator::loadDocumentFromData( const QByteArray & fileData, QVector<
 
 bool TIFFGenerator::loadTiff( QVector< Okular::Page * > & pagesVector, const char *name )
 {
-    d->tiff = TIFFClientOpen( name, "r", d->dev,
-                  okular_tiffReadProc, okular_tiffWriteProc, okular_tiffSeekProc,
-                  okular_tiffCloseProc, okular_tiffSizeProc,
-                  okular_tiffMapProc, okular_tiffUnmapProc );
+    d->tiff = openTiff( d->dev, name );
     if ( !d->tiff )
     {
         delete d->dev;
         d->dev = nullptr;
         d->data.clear();
+        d->fileName.clear();
         return false;
     }
 
@@ -220,6 +471,7 @@ bool TIFFGenerator::loadTiff( QVector< Okular::Page * > & pagesVector, const cha
 bool TIFFGenerator::doCloseDocument()
 {
     // closing the old document
+    d->closeHandles();
     if ( d->tiff )
     {
         TIFFClose( d->tiff );
@@ -227,6 +479,8 @@ bool TIFFGenerator::doCloseDocument()
         delete d->dev;
         d->dev = nullptr;
         d->data.clear();
+        d->fileName.clear();
+        d->levels.clear();
         m_pageMapping.clear();
     }
 
@@ -235,53 +489,114 @@ bool TIFFGenerator::doCloseDocument()
 
 QImage TIFFGenerator::image( Okular::PixmapRequest * request )
 {
-    bool generated = false;
+    int reqwidth = request->width();
+    int reqheight = request->height();
+    Okular::NormalizedRect rect( 0, 0, 1, 1 );
+    QSize size;
+    if ( request->isTile() )
+    {
+        rect = request->normalizedRect();
+        size = rect.geometry( reqwidth, reqheight ).size();
+    }
+    else
+    {
+        if ( request->page()->rotation() % 2 == 1 )
+            qSwap( reqwidth, reqheight );
+        size = QSize( reqwidth, reqheight );
+    }
+
     QImage img;
+    TIFF *tiff = d->acquireHandle();
+    if ( tiff )
+    {
+        img = readPage( tiff, request->page()->number(), rect, size, true );
+        d->releaseHandle( tiff );
+    }
 
-    if ( TIFFSetDirectory( d->tiff, mapPage( request->page()->number() ) ) )
+    if ( img.isNull() )
     {
-        int rotation = request->page()->rotation();
-        uint32 width = 1;
-        uint32 height = 1;
-        uint32 orientation = 0;
-        TIFFGetField( d->tiff, TIFFTAG_IMAGEWIDTH, &width );
-        TIFFGetField( d->tiff, TIFFTAG_IMAGELENGTH, &height );
+        img = QImage( size, QImage::Format_RGB32 );
+        img.fill( qRgb( 255, 255, 255 ) );
+    }
 
-        if ( !TIFFGetField( d->tiff, TIFFTAG_ORIENTATION, &orientation ) )
-            orientation = ORIENTATION_TOPLEFT;
+    return img;
+}
 
-        QImage image( width, height, QImage::Format_RGB32 );
-        uint32 * data = (uint32 *)image.bits();
+QImage TIFFGenerator::readPage( TIFF *tiff, int page, const Okular::NormalizedRect &rect, const QSize &size, bool keepOrientation ) const
+{
+    if ( size.isEmpty() || !TIFFSetDirectory( tiff, mapPage( page ) ) )
+        return QImage();
 
-        // read data
-        if ( TIFFReadRGBAImageOriented( d->tiff, width, height, data, orientation ) != 0 )
-        {
-            // an image read by ReadRGBAImage is ABGR, we need ARGB, so swap red and blue
-            uint32 size = width * height;
-            for ( uint32 i = 0; i < size; ++i )
-            {
-                uint32 red = ( data[i] & 0x00FF0000 ) >> 16;
-                uint32 blue = ( data[i] & 0x000000FF ) << 16;
-                data[i] = ( data[i] & 0xFF00FF00 ) + red + blue;
-            }
+    uint32 width = 1;
+    uint32 height = 1;
+    uint32 orientation = 0;
+    TIFFGetField( tiff, TIFFTAG_IMAGEWIDTH, &width );
+    TIFFGetField( tiff, TIFFTAG_IMAGELENGTH, &height );
+
+    if ( !TIFFGetField( tiff, TIFFTAG_ORIENTATION, &orientation ) )
+        orientation = ORIENTATION_TOPLEFT;
+
+    const QRect region = rect.geometry( width, height ) & QRect( 0, 0, width, height );
+    if ( region.isEmpty() )
+        return QImage();
+
+    // strips and tiles are read top-left oriented, any other orientation
+    // is left to TIFFReadRGBAImageOriented on the whole page
+    QImage img;
+    if ( orientation == ORIENTATION_TOPLEFT )
+        img = readRegion( tiff, page, QSize( width, height ), region, size );
+
+    if ( img.isNull() )
+    {
+        if ( !TIFFSetDirectory( tiff, mapPage( page ) ) )
+            return QImage();
 
-            int reqwidth = request->width();
-            int reqheight = request->height();
-            if ( rotation % 2 == 1 )
-                qSwap( reqwidth, reqheight );
-            img = image.scaled( reqwidth, reqheight, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+        img = QImage( width, height, QImage::Format_RGB32 );
+        uint32 * data = (uint32 *)img.bits();
+
+        // read data
+        if ( !data || TIFFReadRGBAImageOriented( tiff, width, height, data, keepOrientation ? orientation : ORIENTATION_TOPLEFT ) == 0 )
+            return QImage();
 
-            generated = true;
+        // an image read by ReadRGBAImage is ABGR, we need ARGB, so swap red and blue
+        uint32 pixels = width * height;
+        for ( uint32 i = 0; i < pixels; ++i )
+        {
+            uint32 red = ( data[i] & 0x00FF0000 ) >> 16;
+            uint32 blue = ( data[i] & 0x000000FF ) << 16;
+            data[i] = ( data[i] & 0xFF00FF00 ) + red + blue;
         }
+
+        if ( region != img.rect() )
+            img = img.copy( region );
     }
 
-    if ( !generated )
+    if ( img.size() != size )
+        img = img.scaled( size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+
+    return img;
+}
+
+QImage TIFFGenerator::readRegion( TIFF *tiff, int page, const QSize &pageSize, const QRect &region, const QSize &size ) const
+{
+    // read from the smallest reduced resolution copy that has enough pixels
+    QRect levelRegion = region;
+    const QVector< Private::Level > levels = d->levels.value( page );
+    for ( int i = levels.count() - 1; i >= 0; --i )
     {
-        img = QImage( request->width(), request->height(), QImage::Format_RGB32 );
-        img.fill( qRgb( 255, 255, 255 ) );
+        const Private::Level &level = levels.at( i );
+        const QRect scaled = scaledRect( region, pageSize, level.width, level.height );
+        if ( scaled.width() < size.width() || scaled.height() < size.height() )
+            continue;
+
+        if ( TIFFSetSubDirectory( tiff, level.offset ) && isTopLeftOriented( tiff ) )
+            levelRegion = scaled;
+        else if ( !TIFFSetDirectory( tiff, mapPage( page ) ) )
+            return QImage();
+        break;
     }
 
-    return img;
+    return readRGBARegion( tiff, levelRegion, size );
 }
 
 Okular::DocumentInfo TIFFGenerator::generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const
@@ -354,6 +669,38 @@ void TIFFGenerator::loadPages( QVector<Okular::Page*> & pagesVector )
              TIFFGetField( d->tiff, TIFFTAG_IMAGELENGTH, &height ) != 1 )
             continue;
 
+        // reduced resolution copies of a page are not pages themselves
+        uint32 subfileType = 0;
+        TIFFGetFieldDefaulted( d->tiff, TIFFTAG_SUBFILETYPE, &subfileType );
+        if ( subfileType & FILETYPE_REDUCEDIMAGE )
+        {
+            if ( realdirs > 0 )
+                d->levels[ realdirs - 1 ].append( Private::Level( TIFFCurrentDirOffset( d->tiff ), width, height ) );
+            continue;
+        }
+
+        // they can also be stored in sub directories of the page
+        uint16 subIfdCount = 0;
+        toff_t *subIfdOffsets = nullptr;
+        if ( TIFFGetField( d->tiff, TIFFTAG_SUBIFD, &subIfdCount, &subIfdOffsets ) && subIfdCount > 0 )
+        {
+            QVector< toff_t > offsets( subIfdCount );
+            std::copy( subIfdOffsets, subIfdOffsets + subIfdCount, offsets.begin() );
+            foreach ( toff_t offset, offsets )
+            {
+                uint32 levelWidth = 0;
+                uint32 levelHeight = 0;
+                if ( TIFFSetSubDirectory( d->tiff, offset )
+                     && TIFFGetFieldDefaulted( d->tiff, TIFFTAG_SUBFILETYPE, &subfileType ) && ( subfileType & FILETYPE_REDUCEDIMAGE )
+                     && TIFFGetField( d->tiff, TIFFTAG_IMAGEWIDTH, &levelWidth ) && TIFFGetField( d->tiff, TIFFTAG_IMAGELENGTH, &levelHeight ) )
+                {
+                    d->levels[ realdirs ].append( Private::Level( offset, levelWidth, levelHeight ) );
+                }
+            }
+            if ( !TIFFSetDirectory( d->tiff, i ) )
+                continue;
+        }
+
         adaptSizeToResolution( d->tiff, TIFFTAG_XRESOLUTION, dpi.width(), &width );
         adaptSizeToResolution( d->tiff, TIFFTAG_YRESOLUTION, dpi.height(), &height );
 
@@ -366,6 +713,28 @@ void TIFFGenerator::loadPages( QVector<Okular::Page*> & pagesVector )
     }
 
     pagesVector.resize( realdirs );
+
+    // only keep the levels smaller than their page, the biggest first
+    QHash< int, QVector< Private::Level > >::iterator it = d->levels.begin();
+    while ( it != d->levels.end() )
+    {
+        QVector< Private::Level > &levels = it.value();
+        if ( !TIFFSetDirectory( d->tiff, mapPage( it.key() ) ) ||
+             TIFFGetField( d->tiff, TIFFTAG_IMAGEWIDTH, &width ) != 1 ||
+             TIFFGetField( d->tiff, TIFFTAG_IMAGELENGTH, &height ) != 1 )
+        {
+            it = d->levels.erase( it );
+            continue;
+        }
+
+        for ( int l = levels.count() - 1; l >= 0; --l )
+        {
+            if ( levels.at( l ).width == 0 || levels.at( l ).height == 0 || levels.at( l ).width >= width || levels.at( l ).height >= height )
+                levels.remove( l );
+        }
+        std::sort( levels.begin(), levels.end(), []( const Private::Level &a, const Private::Level &b ) { return a.width > b.width; } );
+        ++it;
+    }
 }
 
 bool TIFFGenerator::print( QPrinter& printer )
@@ -388,35 +757,16 @@ bool TIFFGenerator::print( QPrinter& printer )
              TIFFGetField( d->tiff, TIFFTAG_IMAGELENGTH, &height ) != 1 )
             continue;
 
-        QImage image( width, height, QImage::Format_RGB32 );
-        uint32 * data = (uint32 *)image.bits();
-
-        // read data
-        if ( TIFFReadRGBAImageOriented( d->tiff, width, height, data, ORIENTATION_TOPLEFT ) != 0 )
-        {
-            // an image read by ReadRGBAImage is ABGR, we need ARGB, so swap red and blue
-            uint32 size = width * height;
-            for ( uint32 i = 0; i < size; ++i )
-            {
-                uint32 red = ( data[i] & 0x00FF0000 ) >> 16;
-                uint32 blue = ( data[i] & 0x000000FF ) << 16;
-                data[i] = ( data[i] & 0xFF00FF00 ) + red + blue;
-            }
-        }
-
         if ( i != 0 )
             printer.newPage();
 
         QSize targetSize = printer.pageRect().size();
 
-        if ( (image.width() < targetSize.width()) && (image.height() < targetSize.height()) )
-        {
-            // draw small images at 100% (don't scale up)
-            p.drawImage( 0, 0, image );
-        } else {
-            // fit to page
-            p.drawImage( 0, 0, image.scaled( targetSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ) );
-        }
+        // draw small images at 100% (don't scale up), fit big ones to the page
+        if ( ( (int)width < targetSize.width() ) && ( (int)height < targetSize.height() ) )
+            targetSize = QSize( width, height );
+
+        p.drawImage( 0, 0, readPage( d->tiff, pageList[i] - 1, Okular::NormalizedRect( 0, 0, 1, 1 ), targetSize, false ) );
     }
 
     return true;
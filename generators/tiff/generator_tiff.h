@@ -14,6 +14,9 @@
 
 #include <QtCore/qloggingcategory.h>
 #include <qhash.h>
+#include <qrect.h>
+
+typedef struct tiff TIFF;
 
 class TIFFGenerator : public Okular::Generator
 {
@@ -41,6 +44,8 @@ class TIFFGenerator : public Okular::Generator
         bool loadTiff( QVector< Okular::Page * > & pagesVector, const char *name );
         void loadPages( QVector<Okular::Page*> & pagesVector );
         int mapPage( int page ) const;
+        QImage readPage( TIFF *tiff, int page, const Okular::NormalizedRect &rect, const QSize &size, bool keepOrientation ) const;
+        QImage readRegion( TIFF *tiff, int page, const QSize &pageSize, const QRect &region, const QSize &size ) const;
 
         QHash< int, int > m_pageMapping;
 };
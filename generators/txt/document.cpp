@@ -42,6 +42,18 @@ Document::~Document()
 }
 
 QString Document::toUnicode( const QByteArray &array )
+{
+    const QByteArray encoding = detectEncoding( array );
+
+    if ( encoding.isEmpty() )
+    {
+        return QString();
+    }
+
+    return QTextCodec::codecForName( encoding )->toUnicode( array );
+}
+
+QByteArray Document::detectEncoding( const QByteArray &array )
 {
     QByteArray encoding;
     KEncodingProber prober(KEncodingProber::Universal);
@@ -61,14 +73,12 @@ QString Document::toUnicode( const QByteArray &array )
         }
     }
 
-    if ( encoding.isEmpty() )
+    if ( !encoding.isEmpty() )
     {
-        return QString();
+        qCDebug(OkularTxtDebug) << "Detected" << encoding << "encoding"
+                 << "based on" << charsFeeded << "chars";
     }
-
-    qCDebug(OkularTxtDebug) << "Detected" << prober.encoding() << "encoding"
-             << "based on" << charsFeeded << "chars";
-    return QTextCodec::codecForName( encoding )->toUnicode( array );
+    return encoding;
 }
 
 Q_LOGGING_CATEGORY(OkularTxtDebug, "org.kde.okular.generators.txt", QtWarningMsg)
@@ -20,6 +20,12 @@ namespace Txt
             Document( const QString &fileName );
             ~Document();
 
+            /**
+             * Guesses the encoding of @p array, returns an empty array
+             * if the guess is not reliable enough.
+             */
+            static QByteArray detectEncoding( const QByteArray &array );
+
         private:
             QString toUnicode( const QByteArray &array );
     };
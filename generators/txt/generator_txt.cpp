@@ -10,16 +10,245 @@
 
 #include "generator_txt.h"
 #include "converter.h"
+#include "mappeddocument.h"
+
+#include <QtCore/QBitArray>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QTextCodec>
+#include <QtCore/QTextStream>
+#include <QtGui/QFontDatabase>
+#include <QtGui/QPainter>
+#include <QtPrintSupport/QPrinter>
 
 #include <KAboutData>
 #include <klocalizedstring.h>
 #include <KConfigDialog>
 
+#include <core/fileprinter.h>
+#include <core/page.h>
+
 OKULAR_EXPORT_PLUGIN(TxtGenerator, "libokularGenerator_txt.json")
 
+// files bigger than this are streamed from a memory mapping instead of
+// being converted to a QTextDocument
+static const qint64 StreamingThreshold = 16 * 1024 * 1024;
+
 TxtGenerator::TxtGenerator(QObject *parent, const QVariantList &args)
-    : Okular::TextDocumentGenerator(new Txt::Converter, QStringLiteral("okular_txt_generator_settings") , parent, args)
+    : Okular::TextDocumentGenerator(new Txt::Converter, QStringLiteral("okular_txt_generator_settings") , parent, args),
+      m_mappedDocument( nullptr ), m_convertedThreaded( false ), m_searchType( Okular::Document::AllDocument )
+{
+}
+
+TxtGenerator::~TxtGenerator()
+{
+    delete m_mappedDocument;
+}
+
+Okular::Document::OpenResult TxtGenerator::loadDocumentWithPassword( const QString & fileName, QVector<Okular::Page*> & pagesVector, const QString &password )
+{
+    if ( QFileInfo( fileName ).size() > StreamingThreshold )
+    {
+        QScopedPointer<Txt::MappedDocument> mapped( new Txt::MappedDocument );
+        if ( mapped->open( fileName ) )
+        {
+            m_mappedDocument = mapped.take();
+
+            const QSizeF size = m_mappedDocument->pageSize();
+            pagesVector.resize( m_mappedDocument->pageCount() );
+            for ( int i = 0; i < pagesVector.count(); ++i )
+                pagesVector[ i ] = new Okular::Page( i, size.width(), size.height(), Okular::Rotation0 );
+
+            // pages only read the mapping, so they can always be painted off the GUI thread
+            m_convertedThreaded = hasFeature( Threaded );
+            setFeature( Threaded, QFontDatabase::supportsThreadedFontRendering() );
+            setFeature( IndexedSearch );
+
+            return Okular::Document::OpenSuccess;
+        }
+    }
+
+    return Okular::TextDocumentGenerator::loadDocumentWithPassword( fileName, pagesVector, password );
+}
+
+bool TxtGenerator::doCloseDocument()
+{
+    if ( m_mappedDocument )
+    {
+        delete m_mappedDocument;
+        m_mappedDocument = nullptr;
+        setFeature( Threaded, m_convertedThreaded );
+        setFeature( IndexedSearch, false );
+        m_searchText.clear();
+        m_searchPages.clear();
+        return true;
+    }
+
+    return Okular::TextDocumentGenerator::doCloseDocument();
+}
+
+QImage TxtGenerator::image( Okular::PixmapRequest *request )
+{
+    if ( !m_mappedDocument )
+        return Okular::TextDocumentGenerator::image( request );
+
+    QImage image( request->width(), request->height(), QImage::Format_ARGB32 );
+    image.fill( Qt::white );
+
+    const QSizeF size = m_mappedDocument->pageSize();
+    QPainter p( &image );
+    p.scale( request->width() / size.width(), request->height() / size.height() );
+    m_mappedDocument->drawPage( &p, request->pageNumber() );
+    p.end();
+
+    return image;
+}
+
+Okular::TextPage* TxtGenerator::textPage( Okular::Page *page )
+{
+    if ( !m_mappedDocument )
+        return Okular::TextDocumentGenerator::textPage( page );
+
+    return m_mappedDocument->textPage( page->number() );
+}
+
+Okular::DocumentInfo TxtGenerator::generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const
+{
+    if ( !m_mappedDocument )
+        return Okular::TextDocumentGenerator::generateDocumentInfo( keys );
+
+    Okular::DocumentInfo info;
+    info.set( Okular::DocumentInfo::MimeType, QStringLiteral("text/plain") );
+    return info;
+}
+
+bool TxtGenerator::print( QPrinter& printer )
+{
+    if ( !m_mappedDocument )
+        return Okular::TextDocumentGenerator::print( printer );
+
+    const QList<int> pageList = Okular::FilePrinter::pageList( printer, document()->pages(),
+                                                               document()->currentPage() + 1,
+                                                               document()->bookmarkedPageList() );
+
+    const QSizeF size = m_mappedDocument->pageSize();
+    QPainter painter( &printer );
+    const QRect pageRect = printer.pageRect();
+    painter.scale( pageRect.width() / size.width(), pageRect.height() / size.height() );
+
+    for ( int i = 0; i < pageList.count(); ++i )
+    {
+        if ( i != 0 )
+            printer.newPage();
+
+        m_mappedDocument->drawPage( &painter, pageList.at( i ) - 1 );
+    }
+
+    return true;
+}
+
+Okular::ExportFormat::List TxtGenerator::exportFormats() const
+{
+    if ( !m_mappedDocument )
+        return Okular::TextDocumentGenerator::exportFormats();
+
+    return Okular::ExportFormat::List() << Okular::ExportFormat::standardFormat( Okular::ExportFormat::PlainText );
+}
+
+bool TxtGenerator::exportTo( const QString &fileName, const Okular::ExportFormat &format )
 {
+    if ( !m_mappedDocument )
+        return Okular::TextDocumentGenerator::exportTo( fileName, format );
+
+    if ( format.mimeType().name() != QLatin1String( "text/plain" ) )
+        return false;
+
+    QFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly ) )
+        return false;
+
+    // decode in chunks, the whole text is never held in memory
+    static const qint64 ChunkSize = 1024 * 1024;
+    QScopedPointer<QTextDecoder> decoder( m_mappedDocument->codec()->makeDecoder() );
+    QTextStream out( &file );
+    for ( qint64 pos = 0; pos < m_mappedDocument->size(); pos += ChunkSize )
+    {
+        const int length = qMin( ChunkSize, m_mappedDocument->size() - pos );
+        out << decoder->toUnicode( m_mappedDocument->data() + pos, length );
+    }
+
+    return true;
+}
+
+// the longest run of @p text that is matched by the same ASCII bytes in
+// the file, lowercase; 'k' and 's' end runs too, as they also match the
+// Kelvin sign and the long s case insensitively
+static QByteArray searchToken( const QString &text )
+{
+    QByteArray token;
+    QByteArray run;
+    // the text page normalizes the query the same way
+    const QString query = text.normalized( QString::NormalizationForm_KC ) + QLatin1Char(' ');
+    foreach ( const QChar &c, query )
+    {
+        const char latin = c.unicode() < 128 ? c.toLower().toLatin1() : 0;
+        if ( latin && !c.isSpace() && latin != 'k' && latin != 's' )
+        {
+            run += latin;
+        }
+        else
+        {
+            if ( run.size() > token.size() )
+                token = run;
+            run.clear();
+        }
+    }
+    return token;
+}
+
+bool TxtGenerator::searchCandidatePages( const QString &text, Okular::Document::SearchType type, QVector<int> *pages )
+{
+    if ( !m_mappedDocument )
+        return false;
+
+    if ( text == m_searchText && type == m_searchType )
+    {
+        *pages = m_searchPages;
+        return true;
+    }
+
+    // every word has to be found, but the longest one is enough to rule
+    // out pages; with any of them, the pages of each word are merged
+    QStringList words;
+    if ( type == Okular::Document::GoogleAny )
+        words = text.split( QLatin1Char(' '), QString::SkipEmptyParts );
+    else
+        words << text;
+
+    QBitArray matching( m_mappedDocument->pageCount() );
+    foreach ( const QString &word, words )
+    {
+        const QByteArray token = searchToken( word );
+        // the codec must encode the token as its ASCII bytes
+        if ( token.isEmpty() || m_mappedDocument->codec()->fromUnicode( QString::fromLatin1( token ) ) != token )
+            return false;
+
+        foreach ( int page, m_mappedDocument->pagesContaining( token ) )
+            matching.setBit( page );
+    }
+
+    pages->clear();
+    for ( int i = 0; i < matching.size(); ++i )
+    {
+        if ( matching.testBit( i ) )
+            pages->append( i );
+    }
+
+    m_searchText = text;
+    m_searchType = type;
+    m_searchPages = *pages;
+    return true;
 }
 
 void TxtGenerator::addPages( KConfigDialog* dlg )
@@ -14,6 +14,11 @@
 
 #include <core/textdocumentgenerator.h>
 
+namespace Txt
+{
+    class MappedDocument;
+}
+
 class TxtGenerator : public Okular::TextDocumentGenerator
 {
     Q_OBJECT
@@ -21,9 +26,35 @@ class TxtGenerator : public Okular::TextDocumentGenerator
 
 public:
     TxtGenerator(QObject *parent, const QVariantList &args);
-    ~TxtGenerator() {}
+    ~TxtGenerator();
+
+    Okular::Document::OpenResult loadDocumentWithPassword( const QString & fileName, QVector<Okular::Page*> & pagesVector, const QString &password ) override;
+
+    Okular::DocumentInfo generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const override;
+
+    bool print( QPrinter& printer ) override;
+
+    Okular::ExportFormat::List exportFormats() const override;
+    bool exportTo( const QString &fileName, const Okular::ExportFormat &format ) override;
 
     void addPages( KConfigDialog* dlg ) override;
+
+    bool searchCandidatePages( const QString &text, Okular::Document::SearchType type, QVector<int> *pages ) override;
+
+protected:
+    bool doCloseDocument() override;
+    QImage image( Okular::PixmapRequest *request ) override;
+    Okular::TextPage* textPage( Okular::Page *page ) override;
+
+private:
+    // set when the file is big enough to be streamed instead of converted
+    Txt::MappedDocument *m_mappedDocument;
+    bool m_convertedThreaded;
+
+    // the last scan of the mapping, "find next" searches again for the same text
+    QString m_searchText;
+    Okular::Document::SearchType m_searchType;
+    QVector<int> m_searchPages;
 };
 
 #endif
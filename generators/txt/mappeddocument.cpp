@@ -0,0 +1,290 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "mappeddocument.h"
+
+#include <QtCore/QScopedPointer>
+#include <QtCore/QTextCodec>
+#include <QtGui/QFontDatabase>
+#include <QtGui/QFontMetricsF>
+#include <QtGui/QPainter>
+
+#include <core/area.h>
+#include <core/textpage.h>
+
+#include <algorithm>
+#include <string.h>
+
+#include "document.h"
+#include "debug_txt.h"
+
+using namespace Txt;
+
+static const qreal PageWidth = 600;
+static const qreal PageHeight = 800;
+static const qreal Margin = 20;
+// how much of the file is given to the encoding prober
+static const qint64 EncodingPrefixSize = 1024 * 1024;
+
+MappedDocument::MappedDocument()
+    : m_data( nullptr ), m_size( 0 ), m_codec( nullptr ), m_utf8( false ),
+      m_charWidth( 0 ), m_lineHeight( 0 ), m_ascent( 0 ), m_columns( 1 ), m_rowsPerPage( 1 )
+{
+}
+
+MappedDocument::~MappedDocument()
+{
+    if ( m_data )
+        m_file.unmap( reinterpret_cast<uchar *>( const_cast<char *>( m_data ) ) );
+}
+
+bool MappedDocument::open( const QString &fileName )
+{
+    m_file.setFileName( fileName );
+    if ( !m_file.open( QIODevice::ReadOnly ) )
+    {
+        qCDebug(OkularTxtDebug) << "Can't open file" << m_file.fileName();
+        return false;
+    }
+
+    m_size = m_file.size();
+    uchar *mapped = m_size > 0 ? m_file.map( 0, m_size ) : nullptr;
+    if ( !mapped )
+    {
+        qCDebug(OkularTxtDebug) << "Can't map file" << m_file.fileName();
+        return false;
+    }
+    m_data = reinterpret_cast<const char *>( mapped );
+
+    const QByteArray prefix = QByteArray::fromRawData( m_data, qMin( m_size, EncodingPrefixSize ) );
+    const QByteArray encoding = Document::detectEncoding( prefix );
+    m_codec = encoding.isEmpty() ? nullptr : QTextCodec::codecForName( encoding );
+    // pagination splits lines on the '\n' byte, so it must mean the same in the encoding
+    if ( !m_codec || m_codec->fromUnicode( QStringLiteral("\n") ) != "\n" )
+    {
+        qCDebug(OkularTxtDebug) << "Encoding" << encoding << "can't be streamed";
+        return false;
+    }
+    m_utf8 = m_codec->mibEnum() == 106;
+
+    m_font = QFontDatabase::systemFont( QFontDatabase::FixedFont );
+    const QFontMetricsF metrics( m_font );
+    m_charWidth = metrics.width( QLatin1Char('M') );
+    m_lineHeight = metrics.lineSpacing();
+    m_ascent = metrics.ascent();
+    m_columns = qMax( 1, int( ( PageWidth - 2 * Margin ) / m_charWidth ) );
+    m_rowsPerPage = qMax( 1, int( ( PageHeight - 2 * Margin ) / m_lineHeight ) );
+
+    // a single pass over the bytes, nothing is decoded unless a line
+    // is long enough that it may need to be wrapped
+    m_pageOffsets.clear();
+    m_pageOffsets.append( 0 );
+    qint64 pos = 0;
+    int row = 0;
+    while ( pos < m_size )
+    {
+        const char *newLine = static_cast<const char *>( memchr( m_data + pos, '\n', m_size - pos ) );
+        qint64 lineEnd = newLine ? newLine - m_data : m_size;
+        const qint64 next = newLine ? lineEnd + 1 : m_size;
+        if ( lineEnd > pos && m_data[ lineEnd - 1 ] == '\r' )
+            --lineEnd;
+
+        qint64 rowStart = pos;
+        do
+        {
+            if ( row == m_rowsPerPage )
+            {
+                m_pageOffsets.append( rowStart );
+                row = 0;
+            }
+            rowStart = rowEnd( rowStart, lineEnd );
+            ++row;
+        } while ( rowStart < lineEnd );
+
+        pos = next;
+    }
+
+    qCDebug(OkularTxtDebug) << "Streaming" << m_size << "bytes in" << m_pageOffsets.count() << "pages";
+    return true;
+}
+
+int MappedDocument::pageCount() const
+{
+    return m_pageOffsets.count();
+}
+
+QSizeF MappedDocument::pageSize() const
+{
+    return QSizeF( PageWidth, PageHeight );
+}
+
+const char *MappedDocument::data() const
+{
+    return m_data;
+}
+
+qint64 MappedDocument::size() const
+{
+    return m_size;
+}
+
+QTextCodec *MappedDocument::codec() const
+{
+    return m_codec;
+}
+
+qint64 MappedDocument::rowEnd( qint64 start, qint64 end ) const
+{
+    // a row never holds more characters than bytes
+    if ( end - start <= m_columns )
+        return end;
+
+    if ( !m_utf8 )
+        return start + m_columns;
+
+    // count the lead bytes so a row never splits a character
+    int chars = 0;
+    qint64 i = start;
+    for ( ; i < end; ++i )
+    {
+        if ( ( m_data[ i ] & 0xC0 ) != 0x80 )
+        {
+            if ( chars == m_columns )
+                break;
+            ++chars;
+        }
+    }
+    return i;
+}
+
+qint64 MappedDocument::pageEnd( int pageNumber ) const
+{
+    return pageNumber + 1 < m_pageOffsets.count() ? m_pageOffsets.at( pageNumber + 1 ) : m_size;
+}
+
+static inline char foldAscii( char c )
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+bool MappedDocument::matchesAt( qint64 pos, const QByteArray &token ) const
+{
+    int j = 0;
+    for ( qint64 i = pos; i < m_size && j < token.size(); ++i )
+    {
+        if ( foldAscii( m_data[ i ] ) == token.at( j ) )
+            ++j;
+        else if ( j == 0 || m_data[ i ] != '-' )
+            return false;
+    }
+    return j == token.size();
+}
+
+QVector<int> MappedDocument::pagesContaining( const QByteArray &token ) const
+{
+    QVector<int> pages;
+    if ( token.isEmpty() )
+        return pages;
+
+    const char first = token.at( 0 );
+    qint64 pos = 0;
+    while ( pos < m_size )
+    {
+        if ( foldAscii( m_data[ pos ] ) != first || !matchesAt( pos, token ) )
+        {
+            ++pos;
+            continue;
+        }
+
+        // one match is enough, go on from the next page
+        const int page = std::upper_bound( m_pageOffsets.constBegin(), m_pageOffsets.constEnd(), pos ) - m_pageOffsets.constBegin() - 1;
+        pages.append( page );
+        pos = pageEnd( page );
+    }
+    return pages;
+}
+
+template <typename Visitor>
+void MappedDocument::visitRows( int pageNumber, Visitor visitor ) const
+{
+    if ( pageNumber < 0 || pageNumber >= m_pageOffsets.count() )
+        return;
+
+    // keep the decoder across rows, a wrap may fall inside a multibyte character
+    QScopedPointer<QTextDecoder> decoder( m_codec->makeDecoder() );
+    qint64 pos = m_pageOffsets.at( pageNumber );
+    const qint64 end = pageEnd( pageNumber );
+    qint64 lineEnd = -1;
+    qint64 next = -1;
+    for ( int row = 0; row < m_rowsPerPage && pos < end; ++row )
+    {
+        if ( lineEnd < pos )
+        {
+            const char *newLine = static_cast<const char *>( memchr( m_data + pos, '\n', m_size - pos ) );
+            lineEnd = newLine ? newLine - m_data : m_size;
+            next = newLine ? lineEnd + 1 : m_size;
+            if ( lineEnd > pos && m_data[ lineEnd - 1 ] == '\r' )
+                --lineEnd;
+        }
+
+        const qint64 rowStart = pos;
+        const qint64 rowStop = rowEnd( rowStart, lineEnd );
+        QString text = decoder->toUnicode( m_data + rowStart, rowStop - rowStart );
+        // one cell per character, also for tabs
+        text.replace( QLatin1Char('\t'), QLatin1Char(' ') );
+
+        const bool endsLine = rowStop == lineEnd;
+        visitor( row, text, endsLine );
+
+        if ( endsLine )
+        {
+            pos = next;
+            lineEnd = -1;
+        }
+        else
+        {
+            pos = rowStop;
+        }
+    }
+}
+
+void MappedDocument::drawPage( QPainter *painter, int pageNumber ) const
+{
+    painter->setFont( m_font );
+    painter->setPen( Qt::black );
+
+    visitRows( pageNumber, [this, painter]( int row, const QString &text, bool ) {
+        painter->drawText( QPointF( Margin, Margin + row * m_lineHeight + m_ascent ), text );
+    } );
+}
+
+Okular::TextPage *MappedDocument::textPage( int pageNumber ) const
+{
+    Okular::TextPage *textPage = new Okular::TextPage;
+
+    visitRows( pageNumber, [this, textPage]( int row, const QString &text, bool endsLine ) {
+        const double top = ( Margin + row * m_lineHeight ) / PageHeight;
+        const double bottom = ( Margin + ( row + 1 ) * m_lineHeight ) / PageHeight;
+        for ( int i = 0; i < text.length(); ++i )
+        {
+            const double left = ( Margin + i * m_charWidth ) / PageWidth;
+            const double right = ( Margin + ( i + 1 ) * m_charWidth ) / PageWidth;
+            textPage->append( QString( text.at( i ) ), new Okular::NormalizedRect( left, top, right, bottom ) );
+        }
+
+        if ( endsLine )
+        {
+            // pseudo character for the line break, as TextDocumentGenerator does
+            const double left = ( Margin + text.length() * m_charWidth ) / PageWidth;
+            textPage->append( QStringLiteral("\n"), new Okular::NormalizedRect( left, top, left + 3 / PageWidth, bottom ) );
+        }
+    } );
+
+    return textPage;
+}
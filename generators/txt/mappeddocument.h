@@ -0,0 +1,101 @@
+/***************************************************************************
+ *   Copyright (C) 2018 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef TXT_MAPPEDDOCUMENT_H
+#define TXT_MAPPEDDOCUMENT_H
+
+#include <QtCore/QFile>
+#include <QtCore/QVector>
+#include <QtGui/QFont>
+
+class QPainter;
+class QTextCodec;
+
+namespace Okular
+{
+    class TextPage;
+}
+
+namespace Txt
+{
+    /**
+     * A plain text document that is never converted as a whole.
+     *
+     * The file is memory mapped, paginated with a fixed pitch layout by
+     * looking only at its bytes, and every page is decoded when it is
+     * painted or its text is requested. This keeps opening multi-gigabyte
+     * logs bound by a single scan of the file instead of by QTextDocument.
+     */
+    class MappedDocument
+    {
+        public:
+            MappedDocument();
+            ~MappedDocument();
+
+            /**
+             * Maps and paginates @p fileName, returns false if the file can
+             * not be handled in streaming mode (unmappable, unknown or not
+             * ASCII compatible encoding).
+             */
+            bool open( const QString &fileName );
+
+            int pageCount() const;
+            QSizeF pageSize() const;
+
+            /**
+             * Paints the page @p pageNumber, in page coordinates.
+             */
+            void drawPage( QPainter *painter, int pageNumber ) const;
+
+            /**
+             * Returns the text of the page @p pageNumber with fixed pitch boxes.
+             */
+            Okular::TextPage *textPage( int pageNumber ) const;
+
+            /**
+             * Returns the pages whose bytes contain @p token, a lowercase
+             * ASCII string. The bytes are compared case insensitively and
+             * the '-' bytes within a match are skipped, as the text page
+             * drops a hyphen ending a wrapped row. Nothing is decoded.
+             */
+            QVector<int> pagesContaining( const QByteArray &token ) const;
+
+            const char *data() const;
+            qint64 size() const;
+            QTextCodec *codec() const;
+
+        private:
+            qint64 rowEnd( qint64 start, qint64 end ) const;
+            qint64 pageEnd( int pageNumber ) const;
+            bool matchesAt( qint64 pos, const QByteArray &token ) const;
+
+            template <typename Visitor>
+            void visitRows( int pageNumber, Visitor visitor ) const;
+
+            QFile m_file;
+            const char *m_data;
+            qint64 m_size;
+            QTextCodec *m_codec;
+            bool m_utf8;
+
+            QFont m_font;
+            qreal m_charWidth;
+            qreal m_lineHeight;
+            qreal m_ascent;
+            int m_columns;
+            int m_rowsPerPage;
+
+            // byte offset where each page starts
+            QVector<qint64> m_pageOffsets;
+
+            Q_DISABLE_COPY( MappedDocument )
+    };
+}
+
+#endif
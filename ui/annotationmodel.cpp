@@ -15,6 +15,7 @@
 #include <qlinkedlist.h>
 #include <qlist.h>
 #include <qpointer.h>
+#include <qset.h>
 
 #include <QIcon>
 #include <KLocalizedString>
@@ -25,6 +26,8 @@
 #include "core/page.h"
 #include "ui/guiutils.h"
 
+#include <algorithm>
+
 struct AnnItem
 {
     AnnItem();
@@ -65,11 +68,14 @@ public:
 
     QModelIndex indexForItem( AnnItem *item ) const;
     void rebuildTree( const QVector< Okular::Page * > &pages );
+    int pageItemPosition( int page ) const;
     AnnItem* findItem( int page, int *index ) const;
 
     AnnotationModel *q;
     AnnItem *root;
     QPointer< Okular::Document > document;
+    // the number of pages the tree was built for
+    int pageCount;
 };
 
 
@@ -99,7 +105,7 @@ AnnItem::~AnnItem()
 
 
 AnnotationModelPrivate::AnnotationModelPrivate( AnnotationModel *qq )
-    : q( qq ), root( new AnnItem )
+    : q( qq ), root( new AnnItem ), pageCount( 0 )
 {
 }
 
@@ -132,9 +138,13 @@ void AnnotationModelPrivate::notifySetup( const QVector< Okular::Page * > &pages
             // around so we can look for the new ones using unique ids, etc
             updateAnnotationPointer( root, pages );
         }
-        return;
+        // the generator may have added pages with annotations, or removed some
+        if ( !( setupFlags & Okular::DocumentObserver::NewLayoutForPages ) || pages.count() == pageCount )
+            return;
     }
 
+    pageCount = pages.count();
+
     q->beginResetModel();
     qDeleteAll( root->children );
     root->children.clear();
@@ -166,92 +176,86 @@ void AnnotationModelPrivate::notifyPageChanged( int page, int flags )
         return;
     }
     // case 2: no existing branch
-    //         => add a new branch, and add the annotations for the page
+    //         => add a new branch, together with the annotations for the page
     if ( !annItem )
     {
-        int i = 0;
-        while ( i < root->children.count() && root->children.at( i )->page < page ) ++i;
+        const int i = pageItemPosition( page );
 
         AnnItem *annItem = new AnnItem();
         annItem->page = page;
         annItem->parent = root;
-        q->beginInsertRows( indexForItem( root ), i, i );
-        annItem->parent->children.insert( i, annItem );
-        q->endInsertRows();
         QLinkedList< Okular::Annotation* >::ConstIterator it = annots.begin(), itEnd = annots.end();
-        int newid = 0;
-        for ( ; it != itEnd; ++it, ++newid )
-        {
-            q->beginInsertRows( indexForItem( annItem ), newid, newid );
+        for ( ; it != itEnd; ++it )
             new AnnItem( annItem, *it );
-            q->endInsertRows();
-        }
+
+        q->beginInsertRows( indexForItem( root ), i, i );
+        root->children.insert( i, annItem );
+        q->endInsertRows();
         return;
     }
-    // case 3: existing branch, less annotations than items
-    //         => lookup and remove the annotations
-    if ( annItem->children.count() > annots.count() )
+    // case 3: existing branch
+    //         => remove the items of the annotations that are gone, add the
+    //            new annotations, and tell that the others may have changed
+    QSet< Okular::Annotation* > pageAnnotations;
+    pageAnnotations.reserve( annots.count() );
+    QLinkedList< Okular::Annotation* >::ConstIterator it = annots.begin(), itEnd = annots.end();
+    for ( ; it != itEnd; ++it )
+        pageAnnotations.insert( *it );
+
+    const QModelIndex parentIndex = indexForItem( annItem );
+    // remove from the bottom, a range of consecutive rows at a time
+    int end = annItem->children.count();
+    while ( end > 0 )
     {
-        for ( int i = annItem->children.count(); i > 0; --i )
+        if ( pageAnnotations.contains( annItem->children.at( end - 1 )->annotation ) )
         {
-            Okular::Annotation *ref = annItem->children.at( i - 1 )->annotation;
-            bool found = false;
-            QLinkedList< Okular::Annotation* >::ConstIterator it = annots.begin(), itEnd = annots.end();
-            for ( ; !found && it != itEnd; ++it )
-            {
-                if ( ( *it ) == ref )
-                    found = true;
-            }
-            if ( !found )
-            {
-                q->beginRemoveRows( indexForItem( annItem ), i - 1, i - 1 );
-                delete annItem->children.at( i - 1 );
-                annItem->children.removeAt( i - 1 );
-                q->endRemoveRows();
-            }
+            --end;
+            continue;
         }
-        return;
+
+        int first = end - 1;
+        while ( first > 0 && !pageAnnotations.contains( annItem->children.at( first - 1 )->annotation ) )
+            --first;
+
+        q->beginRemoveRows( parentIndex, first, end - 1 );
+        for ( int i = end - 1; i >= first; --i )
+            delete annItem->children.takeAt( i );
+        q->endRemoveRows();
+        end = first;
     }
-    // case 4: existing branch, less items than annotations
-    //         => lookup and add annotations if not in the branch
-    if ( annots.count() > annItem->children.count() )
+
+    QSet< Okular::Annotation* > listedAnnotations;
+    listedAnnotations.reserve( annItem->children.count() );
+    foreach ( AnnItem *child, annItem->children )
+        listedAnnotations.insert( child->annotation );
+
+    QList< Okular::Annotation* > newAnnotations;
+    for ( it = annots.begin(); it != itEnd; ++it )
     {
-        QLinkedList< Okular::Annotation* >::ConstIterator it = annots.begin(), itEnd = annots.end();
-        for ( ; it != itEnd; ++it )
-        {
-            Okular::Annotation *ref = *it;
-            bool found = false;
-            int count = annItem->children.count();
-            for ( int i = 0; !found && i < count; ++i )
-            {
-                if ( ref == annItem->children.at( i )->annotation )
-                    found = true;
-            }
-            if ( !found )
-            {
-                q->beginInsertRows( indexForItem( annItem ), count, count );
-                new AnnItem( annItem, ref );
-                q->endInsertRows();
-            }
-        }
-        return;
+        if ( !listedAnnotations.contains( *it ) )
+            newAnnotations.append( *it );
     }
-    // case 5: the data of some annotation changed
-    // TODO: what do we do in this case?
-    // FIXME: for now, update ALL the annotations for that page
-    for ( int i = 0; i < annItem->children.count(); ++i )
+
+    const int keptCount = annItem->children.count();
+    if ( !newAnnotations.isEmpty() )
     {
-        QModelIndex index = indexForItem( annItem->children.at( i ) );
-        emit q->dataChanged( index, index );
+        q->beginInsertRows( parentIndex, keptCount, keptCount + newAnnotations.count() - 1 );
+        foreach ( Okular::Annotation *annotation, newAnnotations )
+            new AnnItem( annItem, annotation );
+        q->endInsertRows();
     }
+
+    if ( keptCount > 0 )
+        emit q->dataChanged( q->index( 0, 0, parentIndex ), q->index( keptCount - 1, 0, parentIndex ) );
 }
 
 QModelIndex AnnotationModelPrivate::indexForItem( AnnItem *item ) const
 {
     if ( item->parent )
     {
-        int id = item->parent->children.indexOf( item );
-        if ( id >= 0 && id < item->parent->children.count() )
+        // the page items are looked up by page, there can be many of them
+        int id = item->parent == root ? pageItemPosition( item->page ) : item->parent->children.indexOf( item );
+        if ( id >= 0 && id < item->parent->children.count() && item->parent->children.at( id ) == item )
            return q->createIndex( id, 0, item );
     }
     return QModelIndex();
@@ -259,10 +263,6 @@ QModelIndex AnnotationModelPrivate::indexForItem( AnnItem *item ) const
 
 void AnnotationModelPrivate::rebuildTree( const QVector< Okular::Page * > &pages )
 {
-    if ( pages.isEmpty() )
-        return;
-
-    emit q->layoutAboutToBeChanged();
     for ( int i = 0; i < pages.count(); ++i )
     {
         const QLinkedList< Okular::Annotation* > annots = filterOutWidgetAnnotations( pages.at( i )->annotations() );
@@ -276,20 +276,24 @@ void AnnotationModelPrivate::rebuildTree( const QVector< Okular::Page * > &pages
             new AnnItem( annItem, *it );
         }
     }
-    emit q->layoutChanged();
+}
+
+int AnnotationModelPrivate::pageItemPosition( int page ) const
+{
+    // the page items are sorted by page
+    const QList< AnnItem* >::const_iterator it = std::lower_bound( root->children.constBegin(), root->children.constEnd(), page,
+                                                                   []( const AnnItem *item, int page ) { return item->page < page; } );
+    return it - root->children.constBegin();
 }
 
 AnnItem* AnnotationModelPrivate::findItem( int page, int *index ) const
 {
-    for ( int i = 0; i < root->children.count(); ++i )
+    const int i = pageItemPosition( page );
+    if ( i < root->children.count() && root->children.at( i )->page == page )
     {
-        AnnItem *tmp = root->children.at( i );
-        if ( tmp->page == page )
-        {
-            if ( index )
-                *index = i;
-            return tmp;
-        }
+        if ( index )
+            *index = i;
+        return root->children.at( i );
     }
     if ( index )
         *index = -1;
@@ -9,6 +9,7 @@
 
 #include "annotationproxymodels.h"
 
+#include <QtCore/QHash>
 #include <QtCore/QList>
 #include <QtCore/QItemSelection>
 
@@ -17,10 +18,7 @@
 #include "annotationmodel.h"
 #include "debug_ui.h"
 
-static quint32 mixIndex( int row, int column )
-{
-    return ( row << 4 ) | column;
-}
+#include <algorithm>
 
 PageFilterProxyModel::PageFilterProxyModel( QObject *parent )
   : QSortFilterProxyModel( parent ),
@@ -72,6 +70,11 @@ PageGroupProxyModel::PageGroupProxyModel( QObject *parent )
 {
 }
 
+PageGroupProxyModel::~PageGroupProxyModel()
+{
+  qDeleteAll( mPages );
+}
+
 int PageGroupProxyModel::columnCount( const QModelIndex &parentIndex ) const
 {
   // For top-level and second level we have always only one column
@@ -96,19 +99,23 @@ int PageGroupProxyModel::columnCount( const QModelIndex &parentIndex ) const
 
 int PageGroupProxyModel::rowCount( const QModelIndex &parentIndex ) const
 {
+  if ( !sourceModel() )
+    return 0;
+
   if ( mGroupByPage ) {
+    // the tree of the source model is shown as it is
     if ( parentIndex.isValid() ) {
       if ( parentIndex.parent().isValid() )
         return 0;
       else {
-        return mTreeIndexes[ parentIndex.row() ].second.count(); // second-level
+        return sourceModel()->rowCount( sourceModel()->index( parentIndex.row(), 0 ) ); // second-level
       }
     } else {
-      return mTreeIndexes.count(); // top-level
+      return sourceModel()->rowCount(); // top-level
     }
   } else {
     if ( !parentIndex.isValid() ) // top-level
-      return mIndexes.count();
+      return mRowOffsets.isEmpty() ? 0 : mRowOffsets.last();
     else
       return 0;
   }
@@ -116,37 +123,23 @@ int PageGroupProxyModel::rowCount( const QModelIndex &parentIndex ) const
 
 QModelIndex PageGroupProxyModel::index( int row, int column, const QModelIndex &parentIndex ) const
 {
-  if ( row < 0 || column != 0 )
+  if ( row < 0 || column != 0 || row >= rowCount( parentIndex ) )
     return QModelIndex();
 
-  if ( mGroupByPage ) {
-    if ( parentIndex.isValid() ) {
-      if ( parentIndex.row() >= 0 && parentIndex.row() < mTreeIndexes.count()
-           && row < mTreeIndexes[ parentIndex.row() ].second.count() )
-        return createIndex( row, column, qint32( parentIndex.row() + 1 ) );
-      else
-        return QModelIndex();
-    } else {
-      if ( row < mTreeIndexes.count() )
-        return createIndex( row, column );
-      else
-        return QModelIndex();
-    }
-  } else {
-    if ( row < mIndexes.count() )
-      return createIndex( row, column, mixIndex( parentIndex.row(), parentIndex.column() ) );
-    else
-      return QModelIndex();
-  }
+  if ( mGroupByPage && parentIndex.isValid() )
+    return createIndex( row, column, mPages.at( parentIndex.row() ) );
+  else
+    return createIndex( row, column );
 }
 
 QModelIndex PageGroupProxyModel::parent( const QModelIndex &idx ) const
 {
   if ( mGroupByPage ) {
-    if ( idx.internalId() == 0 ) // top-level
+    const QPersistentModelIndex *page = static_cast<QPersistentModelIndex*>( idx.internalPointer() );
+    if ( !page || !page->isValid() ) // top-level
       return QModelIndex();
     else
-      return index( idx.internalId() - 1, idx.column() );
+      return index( page->row(), idx.column() );
   } else {
     // We have only top-level items
     return QModelIndex();
@@ -155,47 +148,53 @@ QModelIndex PageGroupProxyModel::parent( const QModelIndex &idx ) const
 
 QModelIndex PageGroupProxyModel::mapFromSource( const QModelIndex &sourceIndex ) const
 {
+  if ( !sourceIndex.isValid() )
+    return QModelIndex();
+
+  const QModelIndex sourceParent = sourceIndex.parent();
   if ( mGroupByPage ) {
-    if ( sourceIndex.parent().isValid() ) {
-      return index( sourceIndex.row(), sourceIndex.column(), sourceIndex.parent() );
+    if ( sourceParent.isValid() ) {
+      return index( sourceIndex.row(), sourceIndex.column(), index( sourceParent.row(), 0 ) );
     } else {
       return index( sourceIndex.row(), sourceIndex.column() );
     }
   } else {
-    for ( int i = 0; i < mIndexes.count(); ++i ) {
-      if ( mIndexes[ i ] == sourceIndex )
-        return index( i, 0 );
-    }
+    // the pages are not shown
+    if ( !sourceParent.isValid() || sourceParent.row() >= mRowOffsets.count() - 1 )
+      return QModelIndex();
 
-    return QModelIndex();
+    const int row = mRowOffsets[ sourceParent.row() ] + sourceIndex.row();
+    if ( row >= mRowOffsets[ sourceParent.row() + 1 ] )
+      return QModelIndex();
+
+    return index( row, 0 );
   }
 }
 
 QModelIndex PageGroupProxyModel::mapToSource( const QModelIndex &proxyIndex ) const
 {
-  if ( !proxyIndex.isValid() )
+  if ( !proxyIndex.isValid() || !sourceModel() )
     return QModelIndex();
 
   if ( mGroupByPage ) {
-    if ( proxyIndex.internalId() == 0 ) {
-
-      if ( proxyIndex.row() >= mTreeIndexes.count() || proxyIndex.row() < 0 )
-        return QModelIndex();
-
-      return mTreeIndexes[ proxyIndex.row() ].first;
+    const QPersistentModelIndex *page = static_cast<QPersistentModelIndex*>( proxyIndex.internalPointer() );
+    if ( !page ) {
+      return sourceModel()->index( proxyIndex.row(), 0 );
     } else {
-      if ( qint32(proxyIndex.internalId()) - 1 >= mTreeIndexes.count() ||
-           proxyIndex.row() >= mTreeIndexes[ proxyIndex.internalId() - 1 ].second.count() )
+      if ( !page->isValid() )
         return QModelIndex();
 
-      return mTreeIndexes[ proxyIndex.internalId() - 1 ].second[ proxyIndex.row() ];
+      return sourceModel()->index( proxyIndex.row(), 0, *page );
     }
   } else {
-    if ( proxyIndex.column() > 0 || proxyIndex.row() >= mIndexes.count() )
+    if ( proxyIndex.column() > 0 || proxyIndex.row() >= rowCount( QModelIndex() ) )
       return QModelIndex();
-    else {
-      return mIndexes[ proxyIndex.row() ];
-    }
+
+    // the page holding the row is the last one starting at or before it
+    const QVector<int>::const_iterator it = std::upper_bound( mRowOffsets.constBegin(), mRowOffsets.constEnd(), proxyIndex.row() ) - 1;
+    const int pageRow = it - mRowOffsets.constBegin();
+
+    return sourceModel()->index( proxyIndex.row() - *it, 0, sourceModel()->index( pageRow, 0 ) );
   }
 }
 
@@ -204,16 +203,22 @@ void PageGroupProxyModel::setSourceModel( QAbstractItemModel *model )
   if ( sourceModel() ) {
     disconnect( sourceModel(), &QAbstractItemModel::layoutChanged, this, &PageGroupProxyModel::rebuildIndexes );
     disconnect( sourceModel(), &QAbstractItemModel::modelReset, this, &PageGroupProxyModel::rebuildIndexes );
-    disconnect( sourceModel(), &QAbstractItemModel::rowsInserted, this, &PageGroupProxyModel::rebuildIndexes );
-    disconnect( sourceModel(), &QAbstractItemModel::rowsRemoved, this, &PageGroupProxyModel::rebuildIndexes );
+    disconnect( sourceModel(), &QAbstractItemModel::rowsAboutToBeInserted, this, &PageGroupProxyModel::sourceRowsAboutToBeInserted );
+    disconnect( sourceModel(), &QAbstractItemModel::rowsInserted, this, &PageGroupProxyModel::sourceRowsInserted );
+    disconnect( sourceModel(), &QAbstractItemModel::rowsAboutToBeRemoved, this, &PageGroupProxyModel::sourceRowsAboutToBeRemoved );
+    disconnect( sourceModel(), &QAbstractItemModel::rowsRemoved, this, &PageGroupProxyModel::sourceRowsRemoved );
+    disconnect( sourceModel(), &QAbstractItemModel::dataChanged, this, &PageGroupProxyModel::sourceDataChanged );
   }
 
   QAbstractProxyModel::setSourceModel( model );
 
   connect( sourceModel(), &QAbstractItemModel::layoutChanged, this, &PageGroupProxyModel::rebuildIndexes );
   connect( sourceModel(), &QAbstractItemModel::modelReset, this, &PageGroupProxyModel::rebuildIndexes );
-  connect( sourceModel(), &QAbstractItemModel::rowsInserted, this, &PageGroupProxyModel::rebuildIndexes );
-  connect( sourceModel(), &QAbstractItemModel::rowsRemoved, this, &PageGroupProxyModel::rebuildIndexes );
+  connect( sourceModel(), &QAbstractItemModel::rowsAboutToBeInserted, this, &PageGroupProxyModel::sourceRowsAboutToBeInserted );
+  connect( sourceModel(), &QAbstractItemModel::rowsInserted, this, &PageGroupProxyModel::sourceRowsInserted );
+  connect( sourceModel(), &QAbstractItemModel::rowsAboutToBeRemoved, this, &PageGroupProxyModel::sourceRowsAboutToBeRemoved );
+  connect( sourceModel(), &QAbstractItemModel::rowsRemoved, this, &PageGroupProxyModel::sourceRowsRemoved );
+  connect( sourceModel(), &QAbstractItemModel::dataChanged, this, &PageGroupProxyModel::sourceDataChanged );
 
   rebuildIndexes();
 }
@@ -222,31 +227,134 @@ void PageGroupProxyModel::rebuildIndexes()
 {
   beginResetModel();
 
+  const QList<QPersistentModelIndex*> oldPages = mPages;
+  mPages.clear();
+
+  // where the annotations of every page start in the list
+  mRowOffsets.clear();
   if ( mGroupByPage ) {
-    mTreeIndexes.clear();
+    const int pageCount = sourceModel()->rowCount();
+    mPages.reserve( pageCount );
+    for ( int row = 0; row < pageCount; ++row ) {
+      mPages.append( new QPersistentModelIndex( sourceModel()->index( row, 0 ) ) );
+    }
+  } else {
+    const int pageCount = sourceModel()->rowCount();
+    mRowOffsets.reserve( pageCount + 1 );
+    mRowOffsets.append( 0 );
+    for ( int row = 0; row < pageCount; ++row ) {
+      mRowOffsets.append( mRowOffsets.last() + sourceModel()->rowCount( sourceModel()->index( row, 0 ) ) );
+    }
+  }
 
-    for ( int row = 0; row < sourceModel()->rowCount(); ++row ) {
-      const QModelIndex pageIndex = sourceModel()->index( row, 0 );
+  endResetModel();
 
-      QList<QModelIndex> itemIndexes;
-      for ( int subRow = 0; subRow < sourceModel()->rowCount( pageIndex ); ++subRow ) {
-        itemIndexes.append( sourceModel()->index( subRow, 0, pageIndex ) );
-      }
+  // only now nothing refers to the old nodes any more
+  qDeleteAll( oldPages );
+}
 
-      mTreeIndexes.append( QPair<QModelIndex, QList<QModelIndex> >( pageIndex, itemIndexes ) );
+void PageGroupProxyModel::sourceRowsAboutToBeInserted( const QModelIndex &sourceParent, int first, int last )
+{
+  // the list follows the source model once it changed, see sourceRowsInserted()
+  if ( !mGroupByPage )
+    return;
+
+  beginInsertRows( mapFromSource( sourceParent ), first, last );
+}
+
+void PageGroupProxyModel::sourceRowsInserted( const QModelIndex &sourceParent, int first, int last )
+{
+  if ( mGroupByPage ) {
+    if ( !sourceParent.isValid() ) {
+      for ( int row = first; row <= last; ++row )
+        mPages.insert( row, new QPersistentModelIndex( sourceModel()->index( row, 0 ) ) );
     }
+    endInsertRows();
+    return;
+  }
+
+  if ( sourceParent.isValid() ) {
+    // annotations added to a page
+    const int pageRow = sourceParent.row();
+    const int count = last - first + 1;
+    beginInsertRows( QModelIndex(), mRowOffsets[ pageRow ] + first, mRowOffsets[ pageRow ] + last );
+    for ( int row = pageRow + 1; row < mRowOffsets.count(); ++row )
+      mRowOffsets[ row ] += count;
+    endInsertRows();
   } else {
-    mIndexes.clear();
+    // pages added, together with their annotations
+    QVector<int> counts;
+    int count = 0;
+    for ( int row = first; row <= last; ++row ) {
+      counts.append( sourceModel()->rowCount( sourceModel()->index( row, 0 ) ) );
+      count += counts.last();
+    }
 
-    for ( int row = 0; row < sourceModel()->rowCount(); ++row ) {
-      const QModelIndex pageIndex = sourceModel()->index( row, 0 );
-      for ( int subRow = 0; subRow < sourceModel()->rowCount( pageIndex ); ++subRow ) {
-        mIndexes.append( sourceModel()->index( subRow, 0, pageIndex ) );
-      }
+    const int start = mRowOffsets[ first ];
+    if ( count > 0 )
+      beginInsertRows( QModelIndex(), start, start + count - 1 );
+    for ( int row = first + 1; row < mRowOffsets.count(); ++row )
+      mRowOffsets[ row ] += count;
+    int offset = start;
+    for ( int i = 0; i < counts.count(); ++i ) {
+      offset += counts[ i ];
+      mRowOffsets.insert( first + 1 + i, offset );
     }
+    if ( count > 0 )
+      endInsertRows();
   }
+}
 
-  endResetModel();
+void PageGroupProxyModel::sourceRowsAboutToBeRemoved( const QModelIndex &sourceParent, int first, int last )
+{
+  // the list follows the source model once it changed, see sourceRowsRemoved()
+  if ( !mGroupByPage )
+    return;
+
+  beginRemoveRows( mapFromSource( sourceParent ), first, last );
+}
+
+void PageGroupProxyModel::sourceRowsRemoved( const QModelIndex &sourceParent, int first, int last )
+{
+  if ( mGroupByPage ) {
+    QList<QPersistentModelIndex*> removedPages;
+    if ( !sourceParent.isValid() ) {
+      for ( int row = first; row <= last; ++row )
+        removedPages.append( mPages.takeAt( first ) );
+    }
+    endRemoveRows();
+    qDeleteAll( removedPages );
+    return;
+  }
+
+  if ( sourceParent.isValid() ) {
+    // annotations removed from a page
+    const int pageRow = sourceParent.row();
+    const int count = last - first + 1;
+    beginRemoveRows( QModelIndex(), mRowOffsets[ pageRow ] + first, mRowOffsets[ pageRow ] + last );
+    for ( int row = pageRow + 1; row < mRowOffsets.count(); ++row )
+      mRowOffsets[ row ] -= count;
+    endRemoveRows();
+  } else {
+    // pages removed, together with their annotations
+    const int start = mRowOffsets[ first ];
+    const int count = mRowOffsets[ last + 1 ] - start;
+    if ( count > 0 )
+      beginRemoveRows( QModelIndex(), start, start + count - 1 );
+    mRowOffsets.remove( first + 1, last - first + 1 );
+    for ( int row = first + 1; row < mRowOffsets.count(); ++row )
+      mRowOffsets[ row ] -= count;
+    if ( count > 0 )
+      endRemoveRows();
+  }
+}
+
+void PageGroupProxyModel::sourceDataChanged( const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles )
+{
+  const QModelIndex first = mapFromSource( topLeft );
+  const QModelIndex last = mapFromSource( bottomRight );
+  if ( first.isValid() && last.isValid() )
+    emit dataChanged( first, last, roles );
 }
 
 void PageGroupProxyModel::groupByPage( bool value )
@@ -271,7 +379,7 @@ class AuthorGroupItem
         };
 
         AuthorGroupItem( AuthorGroupItem *parent, Type type = Page, const QModelIndex &index = QModelIndex() )
-            : mParent( parent ), mType( type ), mIndex( index )
+            : mParent( parent ), mType( type ), mIndex( index ), mRow( 0 )
         {
         }
 
@@ -280,7 +388,19 @@ class AuthorGroupItem
             qDeleteAll( mChilds );
         }
 
-        void appendChild( AuthorGroupItem *child ) { mChilds.append( child ); }
+        void appendChild( AuthorGroupItem *child ) { child->mRow = mChilds.count(); mChilds.append( child ); }
+        void insertChildren( int row, const QList<AuthorGroupItem*> &children )
+        {
+            for ( int i = 0; i < children.count(); ++i )
+                mChilds.insert( row + i, children[ i ] );
+            updateRows( row );
+        }
+        void removeChildren( int first, int last )
+        {
+            for ( int i = last; i >= first; --i )
+                delete mChilds.takeAt( i );
+            updateRows( first );
+        }
         AuthorGroupItem* parent() const { return mParent; }
         AuthorGroupItem* child( int row ) const { return mChilds.value( row ); }
         int childCount() const { return mChilds.count(); }
@@ -298,7 +418,7 @@ class AuthorGroupItem
 
         const AuthorGroupItem* findIndex( const QModelIndex &index ) const
         {
-            if ( index == mIndex )
+            if ( mIndex == index )
                 return this;
 
             for ( int i = 0; i < mChilds.count(); ++i ) {
@@ -310,10 +430,7 @@ class AuthorGroupItem
             return nullptr;
         }
 
-        int row() const
-        {
-            return ( mParent ? mParent->mChilds.indexOf( const_cast<AuthorGroupItem*>( this ) ) : 0 );
-        }   
+        int row() const { return mRow; }
 
         Type type() const { return mType; }
         QModelIndex index() const { return mIndex; }
@@ -322,9 +439,18 @@ class AuthorGroupItem
         QString author() const { return mAuthor; }
 
     private:
+        void updateRows( int from )
+        {
+            for ( int i = from; i < mChilds.count(); ++i )
+                mChilds[ i ]->mRow = i;
+        }
+
         AuthorGroupItem *mParent;
         Type mType;
-        QModelIndex mIndex;
+        // follows the rows inserted and removed in the source model, and
+        // becomes invalid once the source row is gone
+        QPersistentModelIndex mIndex;
+        int mRow;
         QList<AuthorGroupItem*> mChilds;
         QString mAuthor;
 };
@@ -334,7 +460,7 @@ class AuthorGroupProxyModel::Private
     public:
         Private( AuthorGroupProxyModel *parent )
             : mParent( parent ), mRoot( nullptr ),
-            mGroupByAuthor( false )
+            mGroupByAuthor( false ), mMirrorsSource( true )
         {
         }
         ~Private()
@@ -342,11 +468,71 @@ class AuthorGroupProxyModel::Private
             delete mRoot;
         }
 
+        AuthorGroupItem* createItem( AuthorGroupItem *parentItem, const QModelIndex &idx ) const;
+        QList<AuthorGroupItem*> createPageChildren( AuthorGroupItem *pageItem ) const;
+
         AuthorGroupProxyModel *mParent;
         AuthorGroupItem *mRoot;
         bool mGroupByAuthor;
+        // whether the top-level items are the ones of the source model, in
+        // the same order, which is not the case for annotations grouped by
+        // author without pages
+        bool mMirrorsSource;
 };
 
+AuthorGroupItem* AuthorGroupProxyModel::Private::createItem( AuthorGroupItem *parentItem, const QModelIndex &idx ) const
+{
+    const QString author = mParent->sourceModel()->data( idx, AnnotationModel::AuthorRole ).toString();
+    if ( !author.isEmpty() ) {
+        // We have the annotations as top-level items
+        return new AuthorGroupItem( parentItem, AuthorGroupItem::Annotation, idx );
+    }
+
+    // We have the pages as top-level items
+    AuthorGroupItem *pageItem = new AuthorGroupItem( parentItem, AuthorGroupItem::Page, idx );
+    pageItem->insertChildren( 0, createPageChildren( pageItem ) );
+    return pageItem;
+}
+
+QList<AuthorGroupItem*> AuthorGroupProxyModel::Private::createPageChildren( AuthorGroupItem *pageItem ) const
+{
+    QAbstractItemModel *model = mParent->sourceModel();
+    const QModelIndex idx = pageItem->index();
+    QList<AuthorGroupItem*> children;
+
+    if ( mGroupByAuthor ) {
+        // Append the authors for all annotations of the page, and then the annotations themself
+        QMap<QString, AuthorGroupItem*> pageAuthorMap;
+        for ( int subRow = 0; subRow < model->rowCount( idx ); ++subRow ) {
+            const QModelIndex annIdx = model->index( subRow, 0, idx );
+            const QString author = model->data( annIdx, AnnotationModel::AuthorRole ).toString();
+
+            AuthorGroupItem *authorItem = pageAuthorMap.value( author, 0 );
+            if ( !authorItem ) {
+                authorItem = new AuthorGroupItem( pageItem, AuthorGroupItem::Author );
+                authorItem->setAuthor( author );
+
+                // Add item to tree
+                children.append( authorItem );
+
+                // Insert to lookup list
+                pageAuthorMap.insert( author, authorItem );
+            }
+
+            AuthorGroupItem *item = new AuthorGroupItem( authorItem, AuthorGroupItem::Annotation, annIdx );
+            authorItem->appendChild( item );
+        }
+    } else {
+        // Append all annotations as second-level
+        for ( int subRow = 0; subRow < model->rowCount( idx ); ++subRow ) {
+            const QModelIndex subIdx = model->index( subRow, 0, idx );
+            children.append( new AuthorGroupItem( pageItem, AuthorGroupItem::Annotation, subIdx ) );
+        }
+    }
+
+    return children;
+}
+
 AuthorGroupProxyModel::AuthorGroupProxyModel( QObject *parent )
     : QAbstractProxyModel( parent ),
       d( new Private( this ) )
@@ -408,10 +594,20 @@ QModelIndex AuthorGroupProxyModel::parent( const QModelIndex &index ) const
 
 QModelIndex AuthorGroupProxyModel::mapFromSource( const QModelIndex &sourceIndex ) const
 {
-    if ( !sourceIndex.isValid() )
+    if ( !sourceIndex.isValid() || !d->mRoot )
         return QModelIndex();
 
-    const AuthorGroupItem *item = d->mRoot->findIndex( sourceIndex );
+    const AuthorGroupItem *item = nullptr;
+    if ( d->mMirrorsSource ) {
+        // only look into the branch of the top-level item
+        const QModelIndex sourceParent = sourceIndex.parent();
+        const AuthorGroupItem *topItem = d->mRoot->child( sourceParent.isValid() ? sourceParent.row() : sourceIndex.row() );
+        if ( topItem )
+            item = topItem->findIndex( sourceIndex );
+    } else {
+        item = d->mRoot->findIndex( sourceIndex );
+    }
+
     if ( !item )
         return QModelIndex();
 
@@ -433,16 +629,18 @@ void AuthorGroupProxyModel::setSourceModel( QAbstractItemModel *model )
     if ( sourceModel() ) {
         disconnect( sourceModel(), &QAbstractItemModel::layoutChanged, this, &AuthorGroupProxyModel::rebuildIndexes );
         disconnect( sourceModel(), &QAbstractItemModel::modelReset, this, &AuthorGroupProxyModel::rebuildIndexes );
-        disconnect( sourceModel(), &QAbstractItemModel::rowsInserted, this, &AuthorGroupProxyModel::rebuildIndexes );
-        disconnect( sourceModel(), &QAbstractItemModel::rowsRemoved, this, &AuthorGroupProxyModel::rebuildIndexes );
+        disconnect( sourceModel(), &QAbstractItemModel::rowsInserted, this, &AuthorGroupProxyModel::sourceRowsInserted );
+        disconnect( sourceModel(), &QAbstractItemModel::rowsRemoved, this, &AuthorGroupProxyModel::sourceRowsRemoved );
+        disconnect( sourceModel(), &QAbstractItemModel::dataChanged, this, &AuthorGroupProxyModel::sourceDataChanged );
     }
 
     QAbstractProxyModel::setSourceModel( model );
 
     connect( sourceModel(), &QAbstractItemModel::layoutChanged, this, &AuthorGroupProxyModel::rebuildIndexes );
     connect( sourceModel(), &QAbstractItemModel::modelReset, this, &AuthorGroupProxyModel::rebuildIndexes );
-    connect( sourceModel(), &QAbstractItemModel::rowsInserted, this, &AuthorGroupProxyModel::rebuildIndexes );
-    connect( sourceModel(), &QAbstractItemModel::rowsRemoved, this, &AuthorGroupProxyModel::rebuildIndexes );
+    connect( sourceModel(), &QAbstractItemModel::rowsInserted, this, &AuthorGroupProxyModel::sourceRowsInserted );
+    connect( sourceModel(), &QAbstractItemModel::rowsRemoved, this, &AuthorGroupProxyModel::sourceRowsRemoved );
+    connect( sourceModel(), &QAbstractItemModel::dataChanged, this, &AuthorGroupProxyModel::sourceDataChanged );
 
     rebuildIndexes();
 }
@@ -522,83 +720,239 @@ void AuthorGroupProxyModel::rebuildIndexes()
     beginResetModel();
     delete d->mRoot;
     d->mRoot = new AuthorGroupItem( nullptr );
+    d->mMirrorsSource = true;
 
-    if ( d->mGroupByAuthor ) {
-        QMap<QString, AuthorGroupItem*> authorMap;
-
-        for ( int row = 0; row < sourceModel()->rowCount(); ++row ) {
-            const QModelIndex idx = sourceModel()->index( row, 0 );
-            const QString author = sourceModel()->data( idx, AnnotationModel::AuthorRole ).toString();
-            if ( !author.isEmpty() ) {
-                // We have the annotations as top-level, so introduce authors as new
-                // top-levels and append the annotations
-                AuthorGroupItem *authorItem = authorMap.value( author, 0 );
-                if ( !authorItem ) {
-                    authorItem = new AuthorGroupItem( d->mRoot, AuthorGroupItem::Author );
-                    authorItem->setAuthor( author );
-
-                    // Add item to tree
-                    d->mRoot->appendChild( authorItem );
-
-                    // Insert to lookup list
-                    authorMap.insert( author, authorItem );
-                }
-
-                AuthorGroupItem *item = new AuthorGroupItem( authorItem, AuthorGroupItem::Annotation, idx );
-                authorItem->appendChild( item );
-            } else {
-                // We have the pages as top-level, so we use them as top-level, append the
-                // authors for all annotations of the page, and then the annotations themself
-                AuthorGroupItem *pageItem = new AuthorGroupItem( d->mRoot, AuthorGroupItem::Page, idx );
-                d->mRoot->appendChild( pageItem );
-
-                // First collect all authors...
-                QMap<QString, AuthorGroupItem*> pageAuthorMap;
-                for ( int subRow = 0; subRow < sourceModel()->rowCount( idx ); ++subRow ) {
-                    const QModelIndex annIdx = sourceModel()->index( subRow, 0, idx );
-                    const QString author = sourceModel()->data( annIdx, AnnotationModel::AuthorRole ).toString();
-
-                    AuthorGroupItem *authorItem = pageAuthorMap.value( author, 0 );
-                    if ( !authorItem ) {
-                        authorItem = new AuthorGroupItem( pageItem, AuthorGroupItem::Author );
-                        authorItem->setAuthor( author );
-
-                        // Add item to tree
-                        pageItem->appendChild( authorItem );
-
-                        // Insert to lookup list
-                        pageAuthorMap.insert( author, authorItem );
-                    }
-
-                    AuthorGroupItem *item = new AuthorGroupItem( authorItem, AuthorGroupItem::Annotation, annIdx );
-                    authorItem->appendChild( item );
-                }
+    QMap<QString, AuthorGroupItem*> authorMap;
+
+    for ( int row = 0; row < sourceModel()->rowCount(); ++row ) {
+        const QModelIndex idx = sourceModel()->index( row, 0 );
+        const QString author = sourceModel()->data( idx, AnnotationModel::AuthorRole ).toString();
+        if ( d->mGroupByAuthor && !author.isEmpty() ) {
+            // We have the annotations as top-level, so introduce authors as new
+            // top-levels and append the annotations
+            d->mMirrorsSource = false;
+
+            AuthorGroupItem *authorItem = authorMap.value( author, 0 );
+            if ( !authorItem ) {
+                authorItem = new AuthorGroupItem( d->mRoot, AuthorGroupItem::Author );
+                authorItem->setAuthor( author );
+
+                // Add item to tree
+                d->mRoot->appendChild( authorItem );
+
+                // Insert to lookup list
+                authorMap.insert( author, authorItem );
             }
+
+            AuthorGroupItem *item = new AuthorGroupItem( authorItem, AuthorGroupItem::Annotation, idx );
+            authorItem->appendChild( item );
+        } else {
+            d->mRoot->appendChild( d->createItem( d->mRoot, idx ) );
         }
-    } else {
-        for ( int row = 0; row < sourceModel()->rowCount(); ++row ) {
-            const QModelIndex idx = sourceModel()->index( row, 0 );
-            const QString author = sourceModel()->data( idx, AnnotationModel::AuthorRole ).toString();
-            if ( !author.isEmpty() ) {
-                // We have the annotations as top-level items
-                AuthorGroupItem *item = new AuthorGroupItem( d->mRoot, AuthorGroupItem::Annotation, idx );
-                d->mRoot->appendChild( item );
-            } else {
-                // We have the pages as top-level items
-                AuthorGroupItem *pageItem = new AuthorGroupItem( d->mRoot, AuthorGroupItem::Page, idx );
-                d->mRoot->appendChild( pageItem );
-
-                // Append all annotations as second-level
-                for ( int subRow = 0; subRow < sourceModel()->rowCount( idx ); ++subRow ) {
-                    const QModelIndex subIdx = sourceModel()->index( subRow, 0, idx );
-                    AuthorGroupItem *item = new AuthorGroupItem( pageItem, AuthorGroupItem::Annotation, subIdx );
-                    pageItem->appendChild( item );
-                }
+    }
+
+    endResetModel();
+}
+
+void AuthorGroupProxyModel::sourceRowsInserted( const QModelIndex &sourceParent, int first, int last )
+{
+    if ( !sourceParent.isValid() ) {
+        bool annotations = false;
+        for ( int row = first; row <= last && !annotations; ++row )
+            annotations = !sourceModel()->data( sourceModel()->index( row, 0 ), AnnotationModel::AuthorRole ).toString().isEmpty();
+
+        if ( d->mGroupByAuthor && annotations ) {
+            // top-level annotations, sorted into the top-level author groups
+            if ( d->mMirrorsSource && d->mRoot->childCount() > 0 ) {
+                rebuildIndexes();
+                return;
             }
+            d->mMirrorsSource = false;
+            insertIntoAuthorGroups( d->mRoot, sourceParent, first, last );
+            return;
+        }
+
+        if ( !d->mMirrorsSource ) {
+            rebuildIndexes();
+            return;
         }
+
+        QList<AuthorGroupItem*> items;
+        for ( int row = first; row <= last; ++row )
+            items.append( d->createItem( d->mRoot, sourceModel()->index( row, 0 ) ) );
+
+        beginInsertRows( QModelIndex(), first, last );
+        d->mRoot->insertChildren( first, items );
+        endInsertRows();
+        return;
     }
 
-    endResetModel();
+    AuthorGroupItem *pageItem = d->mMirrorsSource ? d->mRoot->child( sourceParent.row() ) : nullptr;
+    if ( !pageItem || pageItem->type() != AuthorGroupItem::Page ) {
+        rebuildIndexes();
+        return;
+    }
+
+    if ( d->mGroupByAuthor ) {
+        insertIntoAuthorGroups( pageItem, sourceParent, first, last );
+    } else {
+        QList<AuthorGroupItem*> items;
+        for ( int row = first; row <= last; ++row )
+            items.append( new AuthorGroupItem( pageItem, AuthorGroupItem::Annotation, sourceModel()->index( row, 0, sourceParent ) ) );
+
+        beginInsertRows( createIndex( pageItem->row(), 0, pageItem ), first, last );
+        pageItem->insertChildren( first, items );
+        endInsertRows();
+    }
+}
+
+void AuthorGroupProxyModel::sourceRowsRemoved( const QModelIndex &sourceParent, int first, int last )
+{
+    if ( !sourceParent.isValid() ) {
+        if ( d->mMirrorsSource ) {
+            beginRemoveRows( QModelIndex(), first, last );
+            d->mRoot->removeChildren( first, last );
+            endRemoveRows();
+        } else {
+            removeStaleItems( d->mRoot );
+        }
+        return;
+    }
+
+    AuthorGroupItem *pageItem = d->mMirrorsSource ? d->mRoot->child( sourceParent.row() ) : nullptr;
+    if ( !pageItem || pageItem->type() != AuthorGroupItem::Page ) {
+        rebuildIndexes();
+        return;
+    }
+
+    if ( d->mGroupByAuthor ) {
+        removeStaleItems( pageItem );
+    } else {
+        beginRemoveRows( createIndex( pageItem->row(), 0, pageItem ), first, last );
+        pageItem->removeChildren( first, last );
+        endRemoveRows();
+    }
+}
+
+void AuthorGroupProxyModel::sourceDataChanged( const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles )
+{
+    if ( !d->mRoot )
+        return;
+
+    const QModelIndex sourceParent = topLeft.parent();
+    AuthorGroupItem *branch = d->mRoot;
+    if ( sourceParent.isValid() )
+        branch = d->mMirrorsSource ? d->mRoot->child( sourceParent.row() ) : nullptr;
+    if ( !branch )
+        return;
+
+    if ( d->mMirrorsSource && !d->mGroupByAuthor ) {
+        // the rows are the ones of the source
+        AuthorGroupItem *first = branch->child( topLeft.row() );
+        AuthorGroupItem *last = branch->child( bottomRight.row() );
+        if ( first && last )
+            emit dataChanged( createIndex( first->row(), 0, first ), createIndex( last->row(), 0, last ), roles );
+        return;
+    }
+
+    // the items may be in different author groups, find them all in one go
+    // instead of looking for each of them, and an annotation whose author
+    // changed stays in its group until the next rebuild
+    QHash<int, AuthorGroupItem*> itemsByRow;
+    for ( int i = 0; i < branch->childCount(); ++i ) {
+        AuthorGroupItem *child = branch->child( i );
+        if ( child->type() != AuthorGroupItem::Author ) {
+            itemsByRow.insert( child->index().row(), child );
+            continue;
+        }
+        for ( int j = 0; j < child->childCount(); ++j ) {
+            AuthorGroupItem *item = child->child( j );
+            if ( item->index().isValid() )
+                itemsByRow.insert( item->index().row(), item );
+        }
+    }
+
+    for ( int row = topLeft.row(); row <= bottomRight.row(); ++row ) {
+        AuthorGroupItem *item = itemsByRow.value( row );
+        if ( !item )
+            continue;
+        const QModelIndex idx = createIndex( item->row(), 0, item );
+        emit dataChanged( idx, idx, roles );
+    }
+}
+
+void AuthorGroupProxyModel::insertIntoAuthorGroups( AuthorGroupItem *groupParent, const QModelIndex &sourceParent, int first, int last )
+{
+    const QModelIndex groupParentIndex = groupParent == d->mRoot ? QModelIndex() : createIndex( groupParent->row(), 0, groupParent );
+
+    for ( int row = first; row <= last; ++row ) {
+        const QModelIndex annIdx = sourceModel()->index( row, 0, sourceParent );
+        const QString author = sourceModel()->data( annIdx, AnnotationModel::AuthorRole ).toString();
+
+        AuthorGroupItem *authorItem = nullptr;
+        for ( int i = 0; i < groupParent->childCount() && !authorItem; ++i ) {
+            if ( groupParent->child( i )->author() == author )
+                authorItem = groupParent->child( i );
+        }
+
+        if ( authorItem ) {
+            const int childRow = authorItem->childCount();
+            beginInsertRows( createIndex( authorItem->row(), 0, authorItem ), childRow, childRow );
+            authorItem->appendChild( new AuthorGroupItem( authorItem, AuthorGroupItem::Annotation, annIdx ) );
+            endInsertRows();
+        } else {
+            authorItem = new AuthorGroupItem( groupParent, AuthorGroupItem::Author );
+            authorItem->setAuthor( author );
+            authorItem->appendChild( new AuthorGroupItem( authorItem, AuthorGroupItem::Annotation, annIdx ) );
+
+            const int authorRow = groupParent->childCount();
+            beginInsertRows( groupParentIndex, authorRow, authorRow );
+            groupParent->insertChildren( authorRow, QList<AuthorGroupItem*>() << authorItem );
+            endInsertRows();
+        }
+    }
+}
+
+void AuthorGroupProxyModel::removeStaleItems( AuthorGroupItem *groupParent )
+{
+    const QModelIndex groupParentIndex = groupParent == d->mRoot ? QModelIndex() : createIndex( groupParent->row(), 0, groupParent );
+
+    for ( int i = groupParent->childCount() - 1; i >= 0; --i ) {
+        AuthorGroupItem *authorItem = groupParent->child( i );
+        const QModelIndex authorIndex = createIndex( i, 0, authorItem );
+
+        // remove the annotations whose source rows are gone, a range of
+        // consecutive rows at a time
+        bool groupGone = authorItem->childCount() == 0;
+        int end = authorItem->childCount();
+        while ( end > 0 ) {
+            if ( authorItem->child( end - 1 )->index().isValid() ) {
+                --end;
+                continue;
+            }
+
+            int start = end - 1;
+            while ( start > 0 && !authorItem->child( start - 1 )->index().isValid() )
+                --start;
+
+            if ( start == 0 && end == authorItem->childCount() ) {
+                // the whole group goes, together with its annotations
+                groupGone = true;
+                break;
+            }
+
+            beginRemoveRows( authorIndex, start, end - 1 );
+            authorItem->removeChildren( start, end - 1 );
+            endRemoveRows();
+            end = start;
+        }
+
+        if ( groupGone ) {
+            beginRemoveRows( groupParentIndex, i, i );
+            groupParent->removeChildren( i, i );
+            endRemoveRows();
+        }
+    }
 }
 
 #include "moc_annotationproxymodels.cpp"
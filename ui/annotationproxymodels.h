@@ -10,8 +10,12 @@
 #ifndef ANNOTATIONPROXYMODEL_H
 #define ANNOTATIONPROXYMODEL_H
 
+#include <QtCore/QList>
+#include <QtCore/QPersistentModelIndex>
 #include <QtCore/QSortFilterProxyModel>
-#include <QtCore/QPair>
+#include <QtCore/QVector>
+
+class AuthorGroupItem;
 
 /**
  * A proxy model, which filters out all pages except the
@@ -66,6 +70,7 @@ class PageGroupProxyModel : public QAbstractProxyModel
      * @param parent The parent object.
      */
     explicit PageGroupProxyModel( QObject *parent = nullptr );
+    ~PageGroupProxyModel();
 
     int columnCount( const QModelIndex &parentIndex ) const override;
     int rowCount( const QModelIndex &parentIndex ) const override;
@@ -87,11 +92,21 @@ class PageGroupProxyModel : public QAbstractProxyModel
 
   private Q_SLOTS:
     void rebuildIndexes();
+    void sourceRowsAboutToBeInserted( const QModelIndex &sourceParent, int first, int last );
+    void sourceRowsInserted( const QModelIndex &sourceParent, int first, int last );
+    void sourceRowsAboutToBeRemoved( const QModelIndex &sourceParent, int first, int last );
+    void sourceRowsRemoved( const QModelIndex &sourceParent, int first, int last );
+    void sourceDataChanged( const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles );
 
   private:
     bool mGroupByPage;
-    QList<QModelIndex> mIndexes;
-    QList<QPair< QModelIndex, QList<QModelIndex> > > mTreeIndexes;
+    // when grouping by page, one node per page of the source model; the
+    // children of a page point to it, so they keep their parent when the
+    // rows of the pages shift
+    QList<QPersistentModelIndex*> mPages;
+    // when not grouping by page, the row of the list where the annotations
+    // of every page of the source model start, and the row count at the end
+    QVector<int> mRowOffsets;
 };
 
 /**
@@ -136,8 +151,14 @@ class AuthorGroupProxyModel : public QAbstractProxyModel
 
     private Q_SLOTS:
         void rebuildIndexes();
+        void sourceRowsInserted( const QModelIndex &sourceParent, int first, int last );
+        void sourceRowsRemoved( const QModelIndex &sourceParent, int first, int last );
+        void sourceDataChanged( const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles );
 
     private:
+        void insertIntoAuthorGroups( AuthorGroupItem *groupParent, const QModelIndex &sourceParent, int first, int last );
+        void removeStaleItems( AuthorGroupItem *groupParent );
+
         class Private;
         Private* const d;
 };
@@ -44,6 +44,14 @@ MagnifierView::~MagnifierView()
 void MagnifierView::notifySetup(const QVector< Okular::Page* >& pages, int setupFlags)
 {
   if (!(setupFlags & Okular::DocumentObserver::DocumentChanged)) {
+    // the generator may have added or removed pages
+    if ((setupFlags & Okular::DocumentObserver::NewLayoutForPages) && pages.count() != m_pages.count()) {
+      m_pages = pages;
+      if (m_current >= m_pages.count()) {
+        m_page = nullptr;
+        m_current = -1;
+      }
+    }
     return;
   }
 
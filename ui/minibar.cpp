@@ -72,8 +72,9 @@ int MiniBarLogic::currentPage() const
 
 void MiniBarLogic::notifySetup( const QVector< Okular::Page * > & pageVector, int setupFlags )
 {
-    // only process data when document changes
-    if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) )
+    // only process data when document changes, or its pages were laid out again
+    // as the generator may have added or removed some
+    if ( !( setupFlags & ( Okular::DocumentObserver::DocumentChanged | Okular::DocumentObserver::NewLayoutForPages ) ) )
         return;
 
     // if document is closed or has no pages, hide widget
@@ -120,6 +121,10 @@ void MiniBarLogic::notifySetup( const QVector< Okular::Page * > & pageVector, in
 
         miniBar->setEnabled( true );
     }
+
+    // the current page is not told again for a new layout
+    if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) )
+        notifyCurrentPageChanged( -1, m_document->currentPage() );
 }
 
 void MiniBarLogic::notifyCurrentPageChanged( int previousPage, int currentPage )
@@ -10,6 +10,7 @@
 #include "pagepainter.h"
 
 // qt / kde includes
+#include <qcache.h>
 #include <qrect.h>
 #include <qpainter.h>
 #include <qpalette.h>
@@ -23,6 +24,8 @@
 // system includes
 #include <math.h>
 
+#include <algorithm>
+
 // local includes
 #include "core/area.h"
 #include "core/page.h"
@@ -40,6 +43,110 @@ Q_GLOBAL_STATIC_WITH_ARGS( QPixmap, busyPixmap, ( KIconLoader::global()->loadIco
 
 #define TEXTANNOTATION_ICONSIZE 24
 
+// overlay layers are only rasterized when the highlights and annotations
+// cover up to this many device pixels, a quarter of the cache for both layers
+static const qint64 kMaxOverlayPixels = 2 * 1024 * 1024;
+// size of the overlays cache, in kilobytes
+static const int kOverlayCacheCost = 64 * 1024;
+
+struct PageOverlay
+{
+    // the highlights of the page sorted by their top, with the largest
+    // bottom up to each of them; empty when they are rasterized
+    QVector< QPair< QColor, Okular::NormalizedRect > > highlights;
+    QVector< double > highlightBottoms;
+    // whether the highlights and the composited annotations are rasterized
+    // in the layers, over the bounds on the whole (uncropped) page; the
+    // parts multiplying the page and the others
+    bool layers;
+    QImage multiplyLayer;
+    QImage normalLayer;
+    // the device pixels the layers change
+    QRect bounds;
+};
+
+struct OverlayKey
+{
+    const Okular::Page * page;
+    int width;
+    int height;
+    int croppedWidth;
+    int flags;
+    bool layers;
+};
+
+inline bool operator==( const OverlayKey & a, const OverlayKey & b )
+{
+    return a.page == b.page && a.width == b.width && a.height == b.height &&
+           a.croppedWidth == b.croppedWidth && a.flags == b.flags && a.layers == b.layers;
+}
+
+inline uint qHash( const OverlayKey & key, uint seed = 0 )
+{
+    return qHash( key.page, seed ) ^ ( uint( key.width ) << 16 ) ^ uint( key.height ) ^ ( uint( key.croppedWidth ) << 8 ) ^
+           ( uint( key.flags ) << 24 ) ^ uint( key.layers );
+}
+
+typedef QCache< OverlayKey, PageOverlay > OverlayCache;
+Q_GLOBAL_STATIC_WITH_ARGS( OverlayCache, overlayCache, ( kOverlayCacheCost ) )
+
+static bool hasAnnotationsInMotion( const Okular::Page * page )
+{
+    const QLinkedList< Okular::Annotation * > annotations = page->annotations();
+    for ( const Okular::Annotation * ann : annotations )
+    {
+        if ( ann->flags() & ( Okular::Annotation::BeingMoved | Okular::Annotation::BeingResized ) )
+            return true;
+    }
+    return false;
+}
+
+// the device pixels a composited annotation may change, pens and line
+// leaders go past its bounding rectangle
+static QRect overlayAnnotationRect( const Okular::Page * page, const Okular::Annotation * a, int dScaledWidth, int dScaledHeight, double pageScale )
+{
+    double margin = qMax( a->style().width(), 2.0 ) * pageScale;
+    if ( a->subType() == Okular::Annotation::ALine )
+    {
+        const Okular::LineAnnotation * la = static_cast< const Okular::LineAnnotation * >( a );
+        margin += ( fabs( la->lineLeadingForwardPoint() ) + fabs( la->lineLeadingBackwardPoint() ) ) * dScaledWidth / page->width();
+    }
+    const int m = int( ceil( margin ) ) + 1;
+    return a->transformedBoundingRectangle().geometry( dScaledWidth, dScaledHeight ).adjusted( -m, -m, m, m );
+}
+
+// whether drawCompositedAnnotation() multiplies shapes of the annotation
+// with the page, and whether it draws strokes over it
+static bool multipliesPage( const Okular::Annotation * a )
+{
+    if ( a->subType() == Okular::Annotation::ALine )
+        return true;
+    if ( a->subType() != Okular::Annotation::AHighlight )
+        return false;
+    const Okular::HighlightAnnotation::HighlightType type = static_cast< const Okular::HighlightAnnotation * >( a )->highlightType();
+    return type == Okular::HighlightAnnotation::Highlight || type == Okular::HighlightAnnotation::Squiggly;
+}
+
+static bool drawsStrokes( const Okular::Annotation * a )
+{
+    return a->subType() == Okular::Annotation::AInk || ( a->subType() == Okular::Annotation::AHighlight && !multipliesPage( a ) );
+}
+
+// composes the part of an overlay layer within the limits onto the back buffer
+static void drawOverlayLayer( QImage & backImage, const QImage & layer, const QRect & layerBounds, const QRect & dLimitsInPixmap,
+    qreal dpr, QPainter::CompositionMode mode )
+{
+    const QRect source = dLimitsInPixmap.intersected( layerBounds );
+    if ( source.isEmpty() )
+        return;
+
+    const QRectF target( ( source.left() - dLimitsInPixmap.left() ) / dpr, ( source.top() - dLimitsInPixmap.top() ) / dpr,
+                         source.width() / dpr, source.height() / dpr );
+    QPainter painter( &backImage );
+    painter.setCompositionMode( mode );
+    painter.drawImage( target, layer, source.translated( -layerBounds.topLeft() ) );
+}
+
 inline QPen buildPen( const Okular::Annotation *ann, double width, const QColor &color )
 {
     QPen p(
@@ -53,15 +160,16 @@ inline QPen buildPen( const Okular::Annotation *ann, double width, const QColor
 }
 
 void PagePainter::paintPageOnPainter( QPainter * destPainter, const Okular::Page * page,
-    Okular::DocumentObserver *observer, int flags, int scaledWidth, int scaledHeight, const QRect &limits )
+    Okular::DocumentObserver *observer, int flags, int scaledWidth, int scaledHeight, const QRect &limits,
+    const QPixmap * fallbackPixmap )
 {
         paintCroppedPageOnPainter( destPainter, page, observer, flags, scaledWidth, scaledHeight, limits,
-                                   Okular::NormalizedRect( 0, 0, 1, 1 ), nullptr );
+                                   Okular::NormalizedRect( 0, 0, 1, 1 ), nullptr, fallbackPixmap );
 }
 
 void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okular::Page * page,
     Okular::DocumentObserver *observer, int flags, int scaledWidth, int scaledHeight, const QRect &limits,
-    const Okular::NormalizedRect &crop, Okular::NormalizedPoint *viewPortPoint )
+    const Okular::NormalizedRect &crop, Okular::NormalizedPoint *viewPortPoint, const QPixmap * fallbackPixmap )
 {
     qreal dpr = destPainter->device()->devicePixelRatioF();
 
@@ -107,6 +215,10 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
     {
         /** 1 - RETRIEVE THE 'PAGE+ID' PIXMAP OR A SIMILAR 'PAGE' ONE **/
         const QPixmap *p = page->_o_nearestPixmap( observer, dScaledWidth, dScaledHeight );
+        // the replacement of the observer's own pixmap is closer than the
+        // pixmaps of the other observers
+        if ( fallbackPixmap && !fallbackPixmap->isNull() && !page->hasPixmap( observer ) )
+            p = fallbackPixmap;
 
         if (p != NULL) {
             pixmap = *p;
@@ -142,6 +254,18 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
     bool enhanceLinks = (flags & EnhanceLinks) && Okular::Settings::highlightLinks();
     bool enhanceImages = (flags & EnhanceImages) && Okular::Settings::highlightImages();
 
+    // the highlights and the composited annotations are rasterized once over
+    // the part of the page they cover and kept in an overlay, unless that is
+    // too large at this scale or annotations are being moved; then only the
+    // highlights get indexed in it
+    const int overlayFlags = ( canDrawHighlights ? Highlights : 0 ) | ( canDrawAnnotations ? Annotations : 0 );
+    bool overlayLayers = overlayFlags && !hasTilesManager && !( canDrawAnnotations && hasAnnotationsInMotion( page ) );
+    PageOverlay * overlay = nullptr;
+    if ( overlayLayers || canDrawHighlights )
+        overlay = pageOverlay( page, overlayFlags, dScaledWidth, dScaledHeight, croppedWidth, dpr, overlayLayers );
+    if ( overlayLayers && !overlay->layers )
+        overlayLayers = false;
+
     // vectors containing objects to draw
     // make this a qcolor, rect map, since we don't need
     // to know s_id here! we are only drawing this right?
@@ -158,7 +282,9 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
                nYMin = ( (double)limits.top() / scaledHeight ) + crop.top,
                nYMax = ( (double)limits.bottom() / scaledHeight ) + crop.top;
         // append all highlights inside limits to their list
-        if ( canDrawHighlights )
+        // the highlights rasterized in the overlay layers are not needed,
+        // else only the indexed ones around the limits are checked
+        if ( canDrawHighlights && !overlayLayers )
         {
             if ( !bufferedHighlights )
                  bufferedHighlights = new QList< QPair<QColor, Okular::NormalizedRect> >();
@@ -166,14 +292,12 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
             {*/
                 
                 Okular::NormalizedRect* limitRect = new Okular::NormalizedRect(nXMin, nYMin, nXMax, nYMax );
-                QLinkedList< Okular::HighlightAreaRect * >::const_iterator h2It = page->m_highlights.constBegin(), hEnd = page->m_highlights.constEnd();
-                Okular::HighlightAreaRect::const_iterator hIt;
-                for ( ; h2It != hEnd; ++h2It )
-                    for (hIt=(*h2It)->constBegin(); hIt!=(*h2It)->constEnd(); ++hIt)
-                    {
-                        if ((*hIt).intersects(limitRect))
-                            bufferedHighlights->append( qMakePair((*h2It)->color,*hIt) );
-                    }
+                const int hFirst = std::lower_bound( overlay->highlightBottoms.constBegin(), overlay->highlightBottoms.constEnd(), nYMin ) - overlay->highlightBottoms.constBegin();
+                for ( int h = hFirst; h < overlay->highlights.count() && overlay->highlights.at( h ).second.top <= nYMax; ++h )
+                {
+                    if ( overlay->highlights.at( h ).second.intersects( limitRect ) )
+                        bufferedHighlights->append( overlay->highlights.at( h ) );
+                }
                 delete limitRect;
             //}
         }
@@ -236,6 +360,9 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
                     if ( type == Okular::Annotation::ALine || type == Okular::Annotation::AHighlight ||
                          type == Okular::Annotation::AInk  /*|| (type == Annotation::AGeom && ann->style().opacity() < 0.99)*/ )
                     {
+                        // already rasterized in the overlay layers
+                        if ( overlayLayers )
+                            continue;
                         if ( !bufferedAnnotations )
                             bufferedAnnotations = new QList< Okular::Annotation * >();
                         bufferedAnnotations->append( ann );
@@ -254,11 +381,12 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
 
     /** 3 - ENABLE BACKBUFFERING IF DIRECT IMAGE MANIPULATION IS NEEDED **/
     bool bufferAccessibility = (flags & Accessibility) && Okular::SettingsCore::changeColors() && (Okular::SettingsCore::renderMode() != Okular::SettingsCore::EnumRenderMode::Paper);
-    bool useBackBuffer = bufferAccessibility || bufferedHighlights || bufferedAnnotations || viewPortPoint;
-    QPixmap * backPixmap = nullptr;
-    QPainter * mixedPainter = nullptr;
     QRect limitsInPixmap = limits.translated( scaledCrop.topLeft() );
     QRect dLimitsInPixmap = dLimits.translated( dScaledCrop.topLeft() );
+    const bool drawOverlay = overlayLayers && overlay->bounds.intersects( dLimitsInPixmap );
+    bool useBackBuffer = bufferAccessibility || bufferedHighlights || bufferedAnnotations || viewPortPoint || drawOverlay;
+    QPixmap * backPixmap = nullptr;
+    QPainter * mixedPainter = nullptr;
 
         // limits within full (scaled but uncropped) pixmap
 
@@ -395,7 +523,9 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
             }
         }
 
-        // 4B.3. highlight rects in page
+        // 4B.3. highlight rects in page, the overlay ones first
+        if ( drawOverlay )
+            drawOverlayLayer( backImage, overlay->multiplyLayer, overlay->bounds, dLimitsInPixmap, dpr, QPainter::CompositionMode_Multiply );
         if ( bufferedHighlights )
         {
             // draw highlights that are inside the 'limits' paint region
@@ -432,179 +562,11 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
             // paint all buffered annotations in the page
             QList< Okular::Annotation * >::const_iterator aIt = bufferedAnnotations->constBegin(), aEnd = bufferedAnnotations->constEnd();
             for ( ; aIt != aEnd; ++aIt )
-            {
-                Okular::Annotation * a = *aIt;
-                Okular::Annotation::SubType type = a->subType();
-                QColor acolor = a->style().color();
-                if ( !acolor.isValid() )
-                    acolor = Qt::yellow;
-                acolor.setAlphaF( a->style().opacity() );
-
-                // draw LineAnnotation MISSING: all
-                if ( type == Okular::Annotation::ALine )
-                {
-                    // get the annotation
-                    Okular::LineAnnotation * la = (Okular::LineAnnotation *) a;
-
-                    NormalizedPath path;
-                    // normalize page point to image
-                    const QLinkedList<Okular::NormalizedPoint> points = la->transformedLinePoints();
-                    QLinkedList<Okular::NormalizedPoint>::const_iterator it = points.constBegin();
-                    QLinkedList<Okular::NormalizedPoint>::const_iterator itEnd = points.constEnd();
-                    for ( ; it != itEnd; ++it )
-                    {
-                        Okular::NormalizedPoint point;
-                        point.x = ( (*it).x - xOffset) * xScale;
-                        point.y = ( (*it).y - yOffset) * yScale;
-                        path.append( point );
-                    }
-
-                    const QPen linePen = buildPen( a, a->style().width(), a->style().color() );
-                    QBrush fillBrush;
-
-                    if ( la->lineClosed() && la->lineInnerColor().isValid() )
-                        fillBrush = QBrush( la->lineInnerColor() );
-
-                    // draw the line as normalized path into image
-                    drawShapeOnImage( backImage, path, la->lineClosed(),
-                                      linePen,
-                                      fillBrush, pageScale ,Multiply);
-
-                    if ( path.count() == 2 && fabs( la->lineLeadingForwardPoint() ) > 0.1 )
-                    {
-                        Okular::NormalizedPoint delta( la->transformedLinePoints().last().x - la->transformedLinePoints().first().x, la->transformedLinePoints().first().y - la->transformedLinePoints().last().y );
-                        double angle = atan2( delta.y, delta.x );
-                        if ( delta.y < 0 )
-                            angle += 2 * M_PI;
-
-                        int sign = la->lineLeadingForwardPoint() > 0.0 ? 1 : -1;
-                        double LLx = fabs( la->lineLeadingForwardPoint() ) * cos( angle + sign * M_PI_2 + 2 * M_PI ) / page->width();
-                        double LLy = fabs( la->lineLeadingForwardPoint() ) * sin( angle + sign * M_PI_2 + 2 * M_PI ) / page->height();
-
-                        NormalizedPath path2;
-                        NormalizedPath path3;
-
-                        Okular::NormalizedPoint point;
-                        point.x = ( la->transformedLinePoints().first().x + LLx - xOffset ) * xScale;
-                        point.y = ( la->transformedLinePoints().first().y - LLy - yOffset ) * yScale;
-                        path2.append( point );
-                        point.x = ( la->transformedLinePoints().last().x + LLx - xOffset ) * xScale;
-                        point.y = ( la->transformedLinePoints().last().y - LLy - yOffset ) * yScale;
-                        path3.append( point );
-                        // do we have the extension on the "back"?
-                        if ( fabs( la->lineLeadingBackwardPoint() ) > 0.1 )
-                        {
-                            double LLEx = la->lineLeadingBackwardPoint() * cos( angle - sign * M_PI_2 + 2 * M_PI ) / page->width();
-                            double LLEy = la->lineLeadingBackwardPoint() * sin( angle - sign * M_PI_2 + 2 * M_PI ) / page->height();
-                            point.x = ( la->transformedLinePoints().first().x + LLEx - xOffset ) * xScale;
-                            point.y = ( la->transformedLinePoints().first().y - LLEy - yOffset ) * yScale;
-                            path2.append( point );
-                            point.x = ( la->transformedLinePoints().last().x + LLEx - xOffset ) * xScale;
-                            point.y = ( la->transformedLinePoints().last().y - LLEy - yOffset ) * yScale;
-                            path3.append( point );
-                        }
-                        else
-                        {
-                            path2.append( path[0] );
-                            path3.append( path[1] );
-                        }
-
-                        drawShapeOnImage( backImage, path2, false, linePen, QBrush(), pageScale, Multiply );
-                        drawShapeOnImage( backImage, path3, false, linePen, QBrush(), pageScale, Multiply );
-                    }
-                }
-                // draw HighlightAnnotation MISSING: under/strike width, feather, capping
-                else if ( type == Okular::Annotation::AHighlight )
-                {
-                    // get the annotation
-                    Okular::HighlightAnnotation * ha = (Okular::HighlightAnnotation *) a;
-                    Okular::HighlightAnnotation::HighlightType type = ha->highlightType();
-
-                    // draw each quad of the annotation
-                    int quads = ha->highlightQuads().size();
-                    for ( int q = 0; q < quads; q++ )
-                    {
-                        NormalizedPath path;
-                        const Okular::HighlightAnnotation::Quad & quad = ha->highlightQuads()[ q ];
-                        // normalize page point to image
-                        for ( int i = 0; i < 4; i++ )
-                        {
-                            Okular::NormalizedPoint point;
-                            point.x = (quad.transformedPoint( i ).x - xOffset) * xScale;
-                            point.y = (quad.transformedPoint( i ).y - yOffset) * yScale;
-                            path.append( point );
-                        }
-                        // draw the normalized path into image
-                        switch ( type )
-                        {
-                            // highlight the whole rect
-                            case Okular::HighlightAnnotation::Highlight:
-                                drawShapeOnImage( backImage, path, true, Qt::NoPen, acolor, pageScale, Multiply );
-                                break;
-                            // highlight the bottom part of the rect
-                            case Okular::HighlightAnnotation::Squiggly:
-                                path[ 3 ].x = ( path[ 0 ].x + path[ 3 ].x ) / 2.0;
-                                path[ 3 ].y = ( path[ 0 ].y + path[ 3 ].y ) / 2.0;
-                                path[ 2 ].x = ( path[ 1 ].x + path[ 2 ].x ) / 2.0;
-                                path[ 2 ].y = ( path[ 1 ].y + path[ 2 ].y ) / 2.0;
-                                drawShapeOnImage( backImage, path, true, Qt::NoPen, acolor, pageScale, Multiply );
-                                break;
-                            // make a line at 3/4 of the height
-                            case Okular::HighlightAnnotation::Underline:
-                                path[ 0 ].x = ( 3 * path[ 0 ].x + path[ 3 ].x ) / 4.0;
-                                path[ 0 ].y = ( 3 * path[ 0 ].y + path[ 3 ].y ) / 4.0;
-                                path[ 1 ].x = ( 3 * path[ 1 ].x + path[ 2 ].x ) / 4.0;
-                                path[ 1 ].y = ( 3 * path[ 1 ].y + path[ 2 ].y ) / 4.0;
-                                path.pop_back();
-                                path.pop_back();
-                                drawShapeOnImage( backImage, path, false, QPen( acolor, 2 ), QBrush(), pageScale );
-                                break;
-                            // make a line at 1/2 of the height
-                            case Okular::HighlightAnnotation::StrikeOut:
-                                path[ 0 ].x = ( path[ 0 ].x + path[ 3 ].x ) / 2.0;
-                                path[ 0 ].y = ( path[ 0 ].y + path[ 3 ].y ) / 2.0;
-                                path[ 1 ].x = ( path[ 1 ].x + path[ 2 ].x ) / 2.0;
-                                path[ 1 ].y = ( path[ 1 ].y + path[ 2 ].y ) / 2.0;
-                                path.pop_back();
-                                path.pop_back();
-                                drawShapeOnImage( backImage, path, false, QPen( acolor, 2 ), QBrush(), pageScale );
-                                break;
-                        }
-                    }
-                }
-                // draw InkAnnotation MISSING:invar width, PENTRACER
-                else if ( type == Okular::Annotation::AInk )
-                {
-                    // get the annotation
-                    Okular::InkAnnotation * ia = (Okular::InkAnnotation *) a;
-
-                    // draw each ink path
-                    const QList< QLinkedList<Okular::NormalizedPoint> > transformedInkPaths = ia->transformedInkPaths();
-
-                    const QPen inkPen = buildPen( a, a->style().width(), acolor );
-
-                    int paths = transformedInkPaths.size();
-                    for ( int p = 0; p < paths; p++ )
-                    {
-                        NormalizedPath path;
-                        const QLinkedList<Okular::NormalizedPoint> & inkPath = transformedInkPaths[ p ];
-
-                        // normalize page point to image
-                        QLinkedList<Okular::NormalizedPoint>::const_iterator pIt = inkPath.constBegin(), pEnd = inkPath.constEnd();
-                        for ( ; pIt != pEnd; ++pIt )
-                        {
-                            const Okular::NormalizedPoint & inkPoint = *pIt;
-                            Okular::NormalizedPoint point;
-                            point.x = (inkPoint.x - xOffset) * xScale;
-                            point.y = (inkPoint.y - yOffset) * yScale;
-                            path.append( point );
-                        }
-                        // draw the normalized path into image
-                        drawShapeOnImage( backImage, path, false, inkPen, QBrush(), pageScale );
-                    }
-                }
-            } // end current annotation drawing
+                drawCompositedAnnotation( backImage, backImage, page, *aIt, xOffset, xScale, yOffset, yScale, pageScale );
         }
+        // the parts of the overlay annotations that are not multiplied
+        if ( drawOverlay && !overlay->normalLayer.isNull() )
+            drawOverlayLayer( backImage, overlay->normalLayer, overlay->bounds, dLimitsInPixmap, dpr, QPainter::CompositionMode_SourceOver );
         if(viewPortPoint)
         {
             QPainter painter(&backImage);
@@ -852,6 +814,320 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
 }
 
 
+void PagePainter::drawCompositedAnnotation( QImage & multiplyImage, QImage & normalImage, const Okular::Page * page,
+    const Okular::Annotation * a, double xOffset, double xScale, double yOffset, double yScale, double pageScale )
+{
+    Okular::Annotation::SubType type = a->subType();
+    QColor acolor = a->style().color();
+    if ( !acolor.isValid() )
+        acolor = Qt::yellow;
+    acolor.setAlphaF( a->style().opacity() );
+
+    // draw LineAnnotation MISSING: all
+    if ( type == Okular::Annotation::ALine )
+    {
+        // get the annotation
+        Okular::LineAnnotation * la = (Okular::LineAnnotation *) a;
+
+        NormalizedPath path;
+        // normalize page point to image
+        const QLinkedList<Okular::NormalizedPoint> points = la->transformedLinePoints();
+        QLinkedList<Okular::NormalizedPoint>::const_iterator it = points.constBegin();
+        QLinkedList<Okular::NormalizedPoint>::const_iterator itEnd = points.constEnd();
+        for ( ; it != itEnd; ++it )
+        {
+            Okular::NormalizedPoint point;
+            point.x = ( (*it).x - xOffset) * xScale;
+            point.y = ( (*it).y - yOffset) * yScale;
+            path.append( point );
+        }
+
+        const QPen linePen = buildPen( a, a->style().width(), a->style().color() );
+        QBrush fillBrush;
+
+        if ( la->lineClosed() && la->lineInnerColor().isValid() )
+            fillBrush = QBrush( la->lineInnerColor() );
+
+        // draw the line as normalized path into image
+        drawShapeOnImage( multiplyImage, path, la->lineClosed(),
+                          linePen,
+                          fillBrush, pageScale ,Multiply);
+
+        if ( path.count() == 2 && fabs( la->lineLeadingForwardPoint() ) > 0.1 )
+        {
+            Okular::NormalizedPoint delta( la->transformedLinePoints().last().x - la->transformedLinePoints().first().x, la->transformedLinePoints().first().y - la->transformedLinePoints().last().y );
+            double angle = atan2( delta.y, delta.x );
+            if ( delta.y < 0 )
+                angle += 2 * M_PI;
+
+            int sign = la->lineLeadingForwardPoint() > 0.0 ? 1 : -1;
+            double LLx = fabs( la->lineLeadingForwardPoint() ) * cos( angle + sign * M_PI_2 + 2 * M_PI ) / page->width();
+            double LLy = fabs( la->lineLeadingForwardPoint() ) * sin( angle + sign * M_PI_2 + 2 * M_PI ) / page->height();
+
+            NormalizedPath path2;
+            NormalizedPath path3;
+
+            Okular::NormalizedPoint point;
+            point.x = ( la->transformedLinePoints().first().x + LLx - xOffset ) * xScale;
+            point.y = ( la->transformedLinePoints().first().y - LLy - yOffset ) * yScale;
+            path2.append( point );
+            point.x = ( la->transformedLinePoints().last().x + LLx - xOffset ) * xScale;
+            point.y = ( la->transformedLinePoints().last().y - LLy - yOffset ) * yScale;
+            path3.append( point );
+            // do we have the extension on the "back"?
+            if ( fabs( la->lineLeadingBackwardPoint() ) > 0.1 )
+            {
+                double LLEx = la->lineLeadingBackwardPoint() * cos( angle - sign * M_PI_2 + 2 * M_PI ) / page->width();
+                double LLEy = la->lineLeadingBackwardPoint() * sin( angle - sign * M_PI_2 + 2 * M_PI ) / page->height();
+                point.x = ( la->transformedLinePoints().first().x + LLEx - xOffset ) * xScale;
+                point.y = ( la->transformedLinePoints().first().y - LLEy - yOffset ) * yScale;
+                path2.append( point );
+                point.x = ( la->transformedLinePoints().last().x + LLEx - xOffset ) * xScale;
+                point.y = ( la->transformedLinePoints().last().y - LLEy - yOffset ) * yScale;
+                path3.append( point );
+            }
+            else
+            {
+                path2.append( path[0] );
+                path3.append( path[1] );
+            }
+
+            drawShapeOnImage( multiplyImage, path2, false, linePen, QBrush(), pageScale, Multiply );
+            drawShapeOnImage( multiplyImage, path3, false, linePen, QBrush(), pageScale, Multiply );
+        }
+    }
+    // draw HighlightAnnotation MISSING: under/strike width, feather, capping
+    else if ( type == Okular::Annotation::AHighlight )
+    {
+        // get the annotation
+        Okular::HighlightAnnotation * ha = (Okular::HighlightAnnotation *) a;
+        Okular::HighlightAnnotation::HighlightType type = ha->highlightType();
+
+        // draw each quad of the annotation
+        int quads = ha->highlightQuads().size();
+        for ( int q = 0; q < quads; q++ )
+        {
+            NormalizedPath path;
+            const Okular::HighlightAnnotation::Quad & quad = ha->highlightQuads()[ q ];
+            // normalize page point to image
+            for ( int i = 0; i < 4; i++ )
+            {
+                Okular::NormalizedPoint point;
+                point.x = (quad.transformedPoint( i ).x - xOffset) * xScale;
+                point.y = (quad.transformedPoint( i ).y - yOffset) * yScale;
+                path.append( point );
+            }
+            // draw the normalized path into image
+            switch ( type )
+            {
+                // highlight the whole rect
+                case Okular::HighlightAnnotation::Highlight:
+                    drawShapeOnImage( multiplyImage, path, true, Qt::NoPen, acolor, pageScale, Multiply );
+                    break;
+                // highlight the bottom part of the rect
+                case Okular::HighlightAnnotation::Squiggly:
+                    path[ 3 ].x = ( path[ 0 ].x + path[ 3 ].x ) / 2.0;
+                    path[ 3 ].y = ( path[ 0 ].y + path[ 3 ].y ) / 2.0;
+                    path[ 2 ].x = ( path[ 1 ].x + path[ 2 ].x ) / 2.0;
+                    path[ 2 ].y = ( path[ 1 ].y + path[ 2 ].y ) / 2.0;
+                    drawShapeOnImage( multiplyImage, path, true, Qt::NoPen, acolor, pageScale, Multiply );
+                    break;
+                // make a line at 3/4 of the height
+                case Okular::HighlightAnnotation::Underline:
+                    path[ 0 ].x = ( 3 * path[ 0 ].x + path[ 3 ].x ) / 4.0;
+                    path[ 0 ].y = ( 3 * path[ 0 ].y + path[ 3 ].y ) / 4.0;
+                    path[ 1 ].x = ( 3 * path[ 1 ].x + path[ 2 ].x ) / 4.0;
+                    path[ 1 ].y = ( 3 * path[ 1 ].y + path[ 2 ].y ) / 4.0;
+                    path.pop_back();
+                    path.pop_back();
+                    drawShapeOnImage( normalImage, path, false, QPen( acolor, 2 ), QBrush(), pageScale );
+                    break;
+                // make a line at 1/2 of the height
+                case Okular::HighlightAnnotation::StrikeOut:
+                    path[ 0 ].x = ( path[ 0 ].x + path[ 3 ].x ) / 2.0;
+                    path[ 0 ].y = ( path[ 0 ].y + path[ 3 ].y ) / 2.0;
+                    path[ 1 ].x = ( path[ 1 ].x + path[ 2 ].x ) / 2.0;
+                    path[ 1 ].y = ( path[ 1 ].y + path[ 2 ].y ) / 2.0;
+                    path.pop_back();
+                    path.pop_back();
+                    drawShapeOnImage( normalImage, path, false, QPen( acolor, 2 ), QBrush(), pageScale );
+                    break;
+            }
+        }
+    }
+    // draw InkAnnotation MISSING:invar width, PENTRACER
+    else if ( type == Okular::Annotation::AInk )
+    {
+        // get the annotation
+        Okular::InkAnnotation * ia = (Okular::InkAnnotation *) a;
+
+        // draw each ink path
+        const QList< QLinkedList<Okular::NormalizedPoint> > transformedInkPaths = ia->transformedInkPaths();
+
+        const QPen inkPen = buildPen( a, a->style().width(), acolor );
+
+        int paths = transformedInkPaths.size();
+        for ( int p = 0; p < paths; p++ )
+        {
+            NormalizedPath path;
+            const QLinkedList<Okular::NormalizedPoint> & inkPath = transformedInkPaths[ p ];
+
+            // normalize page point to image
+            QLinkedList<Okular::NormalizedPoint>::const_iterator pIt = inkPath.constBegin(), pEnd = inkPath.constEnd();
+            for ( ; pIt != pEnd; ++pIt )
+            {
+                const Okular::NormalizedPoint & inkPoint = *pIt;
+                Okular::NormalizedPoint point;
+                point.x = (inkPoint.x - xOffset) * xScale;
+                point.y = (inkPoint.y - yOffset) * yScale;
+                path.append( point );
+            }
+            // draw the normalized path into image
+            drawShapeOnImage( normalImage, path, false, inkPen, QBrush(), pageScale );
+        }
+    }
+}
+
+void PagePainter::invalidateOverlays( const Okular::Page * page )
+{
+    const QList< OverlayKey > keys = overlayCache()->keys();
+    for ( const OverlayKey & key : keys )
+    {
+        if ( key.page == page )
+            overlayCache()->remove( key );
+    }
+}
+
+void PagePainter::clearOverlays()
+{
+    overlayCache()->clear();
+}
+
+PageOverlay * PagePainter::pageOverlay( const Okular::Page * page, int overlayFlags, int dScaledWidth, int dScaledHeight,
+    int croppedWidth, qreal dpr, bool layers )
+{
+    const OverlayKey key = { page, dScaledWidth, dScaledHeight, croppedWidth, overlayFlags, layers };
+    PageOverlay * overlay = overlayCache()->object( key );
+    if ( overlay )
+        return overlay;
+
+    overlay = new PageOverlay;
+    overlay->layers = false;
+    if ( overlayFlags & Highlights )
+    {
+        QLinkedList< Okular::HighlightAreaRect * >::const_iterator h2It = page->m_highlights.constBegin(), hEnd = page->m_highlights.constEnd();
+        Okular::HighlightAreaRect::const_iterator hIt;
+        for ( ; h2It != hEnd; ++h2It )
+            for ( hIt = (*h2It)->constBegin(); hIt != (*h2It)->constEnd(); ++hIt )
+                overlay->highlights.append( qMakePair( (*h2It)->color, *hIt ) );
+    }
+
+    if ( layers )
+    {
+        QList< const Okular::Annotation * > annotations;
+        if ( overlayFlags & Annotations )
+        {
+            QLinkedList< Okular::Annotation * >::const_iterator aIt = page->m_annotations.constBegin(), aEnd = page->m_annotations.constEnd();
+            for ( ; aIt != aEnd; ++aIt )
+            {
+                const Okular::Annotation::SubType type = (*aIt)->subType();
+                if ( !( (*aIt)->flags() & ( Okular::Annotation::Hidden | Okular::Annotation::ExternallyDrawn ) ) &&
+                     ( type == Okular::Annotation::ALine || type == Okular::Annotation::AHighlight || type == Okular::Annotation::AInk ) )
+                    annotations.append( *aIt );
+            }
+        }
+
+        // the layers have no device pixel ratio, so it goes in the pen width
+        const double pageScale = croppedWidth * dpr / page->width();
+
+        // the layers only cover the device pixels they change
+        QRect bounds;
+        for ( const auto & highlight : qAsConst( overlay->highlights ) )
+            bounds |= highlight.second.geometry( dScaledWidth, dScaledHeight );
+
+        // all the multiplied shapes are composed before all the strokes, which
+        // is only the order of the annotations if no multiplied annotation
+        // covers a stroke of an annotation below it
+        bool reordered = false;
+        QRect strokesBounds;
+        QVector< QRect > strokeRects;
+        for ( const Okular::Annotation * a : qAsConst( annotations ) )
+        {
+            const QRect rect = overlayAnnotationRect( page, a, dScaledWidth, dScaledHeight, pageScale );
+            bounds |= rect;
+            if ( !reordered && multipliesPage( a ) && strokesBounds.intersects( rect ) )
+            {
+                for ( const QRect & strokeRect : qAsConst( strokeRects ) )
+                    reordered = reordered || strokeRect.intersects( rect );
+            }
+            if ( drawsStrokes( a ) )
+            {
+                strokesBounds |= rect;
+                strokeRects.append( rect );
+            }
+        }
+        bounds &= QRect( 0, 0, dScaledWidth, dScaledHeight );
+
+        // too large to keep or out of order, the annotations are drawn within
+        // the painted limits instead
+        overlay->layers = !reordered && (qint64)bounds.width() * bounds.height() <= kMaxOverlayPixels;
+        if ( overlay->layers && !bounds.isEmpty() )
+        {
+            overlay->bounds = bounds;
+
+            // multiplying by white leaves the page as it is
+            overlay->multiplyLayer = QImage( bounds.size(), QImage::Format_ARGB32_Premultiplied );
+            overlay->multiplyLayer.fill( Qt::white );
+            QPainter painter( &overlay->multiplyLayer );
+            painter.setCompositionMode( QPainter::CompositionMode_Multiply );
+            for ( const auto & highlight : qAsConst( overlay->highlights ) )
+                painter.fillRect( highlight.second.geometry( dScaledWidth, dScaledHeight ).translated( -bounds.topLeft() ), highlight.first );
+            painter.end();
+
+            // normalized page coordinates to normalized layer ones
+            const double xOffset = (double)bounds.left() / dScaledWidth,
+                         xScale = (double)dScaledWidth / bounds.width(),
+                         yOffset = (double)bounds.top() / dScaledHeight,
+                         yScale = (double)dScaledHeight / bounds.height();
+            for ( const Okular::Annotation * a : qAsConst( annotations ) )
+            {
+                // lines only multiply, highlights and inks may draw normally
+                if ( a->subType() != Okular::Annotation::ALine && overlay->normalLayer.isNull() )
+                {
+                    overlay->normalLayer = QImage( bounds.size(), QImage::Format_ARGB32_Premultiplied );
+                    overlay->normalLayer.fill( Qt::transparent );
+                }
+
+                drawCompositedAnnotation( overlay->multiplyLayer, overlay->normalLayer.isNull() ? overlay->multiplyLayer : overlay->normalLayer,
+                                          page, a, xOffset, xScale, yOffset, yScale, pageScale );
+            }
+        }
+        if ( overlay->layers )
+            overlay->highlights.clear();
+    }
+
+    if ( !overlay->layers )
+    {
+        std::stable_sort( overlay->highlights.begin(), overlay->highlights.end(),
+            []( const QPair< QColor, Okular::NormalizedRect > & a, const QPair< QColor, Okular::NormalizedRect > & b ) {
+                return a.second.top < b.second.top;
+            } );
+        overlay->highlightBottoms.reserve( overlay->highlights.count() );
+        double bottom = 0.0;
+        for ( const auto & highlight : qAsConst( overlay->highlights ) )
+        {
+            bottom = qMax( bottom, highlight.second.bottom );
+            overlay->highlightBottoms.append( bottom );
+        }
+    }
+
+    const qint64 bytes = overlay->multiplyLayer.byteCount() + overlay->normalLayer.byteCount() +
+                         overlay->highlights.count() * ( sizeof( QPair< QColor, Okular::NormalizedRect > ) + sizeof( double ) );
+    // an overlay larger than the whole cache just takes all of it
+    overlayCache()->insert( key, overlay, int( qMin( bytes / 1024 + 1, qint64( kOverlayCacheCost ) ) ) );
+    return overlay;
+}
+
 /** Private Helpers :: Pixmap conversion **/
 void PagePainter::cropPixmapOnImage( QImage & dest, const QPixmap * src, const QRect & r )
 {
@@ -17,8 +17,11 @@
 #include "core/area.h"  // for NormalizedPoint
 
 class QPainter;
+class QPixmap;
 class QRect;
+struct PageOverlay;
 namespace Okular {
+    class Annotation;
     class DocumentObserver;
     class Page;
 }
@@ -37,9 +40,12 @@ class Q_DECL_EXPORT PagePainter
 
         // draw (using painter 'p') the 'page' requested by 'observer' using features
         // in 'flags'. 'limits' is the bounding rect of the paint operation,
-        // 'scaledWidth' and 'scaledHeight' the expected size of page contents
+        // 'scaledWidth' and 'scaledHeight' the expected size of page contents.
+        // 'fallbackPixmap', if any, is painted when 'observer' has no pixmap
+        // of the page
         static void paintPageOnPainter( QPainter * p, const Okular::Page * page, Okular::DocumentObserver *observer,
-            int flags, int scaledWidth, int scaledHeight, const QRect & pageLimits );
+            int flags, int scaledWidth, int scaledHeight, const QRect & pageLimits,
+            const QPixmap * fallbackPixmap = nullptr );
 
         // draw (using painter 'p') the 'page' requested by 'observer' using features
         // in 'flags'.
@@ -50,15 +56,34 @@ class Q_DECL_EXPORT PagePainter
         // The painter's (0,0) is assumed to be top left of the painted ('pageLimits') rect.
         static void paintCroppedPageOnPainter( QPainter * p, const Okular::Page * page, Okular::DocumentObserver *observer,
             int flags, int scaledWidth, int scaledHeight, const QRect & pageLimits,
-            const Okular::NormalizedRect & crop, Okular::NormalizedPoint *viewPortPoint );
+            const Okular::NormalizedRect & crop, Okular::NormalizedPoint *viewPortPoint,
+            const QPixmap * fallbackPixmap = nullptr );
+
+        // forget the cached highlights and annotations overlays of 'page', to
+        // be called before painting it again once they changed
+        static void invalidateOverlays( const Okular::Page * page );
+        // forget all the cached overlays, to be called when pages go away
+        static void clearOverlays();
 
     private:
+        // return the cached overlay of 'page' at the given scale, building it
+        // if needed; with 'layers' the highlights and composited annotations
+        // are rasterized over the part of the page they cover, when it is
+        // small enough, otherwise only the highlights are indexed
+        static PageOverlay * pageOverlay( const Okular::Page * page, int overlayFlags, int dScaledWidth, int dScaledHeight,
+            int croppedWidth, qreal dpr, bool layers );
+
         static void cropPixmapOnImage( QImage & dest, const QPixmap * src, const QRect & r );
         static void recolor(QImage *image, const QColor &foreground, const QColor &background);
 
         // set the alpha component of the image to a given value
         static void changeImageAlpha( QImage & image, unsigned int alpha );
 
+        // draw a Line, Highlight or Ink annotation, the parts that multiply
+        // the page go on 'multiplyImage', the others on 'normalImage'
+        static void drawCompositedAnnotation( QImage & multiplyImage, QImage & normalImage, const Okular::Page * page,
+            const Okular::Annotation * a, double xOffset, double xScale, double yOffset, double yScale, double pageScale );
+
         // my pretty dear raster function
         typedef QList< Okular::NormalizedPoint > NormalizedPath;
         enum RasterOperation { Normal, Multiply };
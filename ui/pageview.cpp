@@ -60,6 +60,9 @@
 // system includes
 #include <math.h>
 #include <stdlib.h>
+#include <limits.h>
+
+#include <algorithm>
 
 // local includes
 #include "debug_ui.h"
@@ -131,12 +134,21 @@ public:
     OkularTTS* tts();
 #endif
     QString selectedText() const;
+    void rebuildLayoutIndex();
+    void layoutIndexRange( int top, int bottom, int *first, int *last ) const;
 
     // the document, pageviewItems and the 'visible cache'
     PageView *q;
     Okular::Document * document;
     QVector< PageViewItem * > items;
     QLinkedList< PageViewItem * > visibleItems;
+    // the laid out items sorted by their top, and the lowest bottom up to
+    // each of them, to find the items in a band of the contents in log time
+    QVector< PageViewItem * > layoutIndex;
+    QVector< int > layoutIndexBottoms;
+    // the items whose form and video widgets follow the viewport
+    QVector< PageViewItem * > itemsWithPlacedWidgets;
+    bool placeAllWidgets;
     MagnifierView *magnifierView;
 
     // view layout (columns and continuous in Settings), zoom and mouse
@@ -170,6 +182,11 @@ public:
     double lastSourceLocationViewportNormalizedY;
     QTimer * viewportMoveTimer;
     int controlWheelAccumulatedDelta;
+    // vertical scroll speed, in pixels per millisecond
+    QTime scrollTime;
+    int lastScrollY;
+    double scrollVelocity;
+    QTimer * scrollIdleTimer;
     // auto scroll
     int scrollIncrement;
     QTimer * autoScrollTimer;
@@ -180,6 +197,7 @@ public:
     // other stuff
     QTimer * delayResizeEventTimer;
     bool dirtyLayout;
+    bool relayoutQueued;
     bool blockViewport;                 // prevents changes to viewport
     bool blockPixmapsRequest;           // prevent pixmap requests
     PageViewMessage * messageWindow;    // in pageviewutils.h
@@ -267,6 +285,39 @@ FormWidgetsController* PageViewPrivate::formWidgetsController()
     return formsWidgetController;
 }
 
+void PageViewPrivate::rebuildLayoutIndex()
+{
+    layoutIndex.clear();
+    layoutIndexBottoms.clear();
+    for ( PageViewItem * item : qAsConst( items ) )
+    {
+        if ( item->isVisible() )
+            layoutIndex.append( item );
+    }
+
+    // rows come in page order already, but pages of a row may be centered differently
+    std::stable_sort( layoutIndex.begin(), layoutIndex.end(), []( const PageViewItem * a, const PageViewItem * b ) {
+        return a->croppedGeometry().top() < b->croppedGeometry().top();
+    } );
+
+    layoutIndexBottoms.reserve( layoutIndex.count() );
+    int bottom = INT_MIN;
+    for ( const PageViewItem * item : qAsConst( layoutIndex ) )
+    {
+        bottom = qMax( bottom, item->croppedGeometry().bottom() );
+        layoutIndexBottoms.append( bottom );
+    }
+}
+
+void PageViewPrivate::layoutIndexRange( int top, int bottom, int *first, int *last ) const
+{
+    // all the items before first end above top, all the items from last start below bottom
+    *first = std::lower_bound( layoutIndexBottoms.constBegin(), layoutIndexBottoms.constEnd(), top ) - layoutIndexBottoms.constBegin();
+    *last = std::upper_bound( layoutIndex.constBegin(), layoutIndex.constEnd(), bottom, []( int y, const PageViewItem * item ) {
+        return y < item->croppedGeometry().top();
+    } ) - layoutIndex.constBegin();
+}
+
 #ifdef HAVE_SPEECH
 OkularTTS* PageViewPrivate::tts()
 {
@@ -320,10 +371,16 @@ PageView::PageView( QWidget *parent, Okular::Document *document )
     d->lastSourceLocationViewportNormalizedY = 0.0;
     d->viewportMoveTimer = nullptr;
     d->controlWheelAccumulatedDelta = 0;
+    d->scrollTime.start();
+    d->lastScrollY = 0;
+    d->scrollVelocity = 0.0;
+    d->scrollIdleTimer = nullptr;
     d->scrollIncrement = 0;
     d->autoScrollTimer = nullptr;
     d->annotator = nullptr;
     d->dirtyLayout = false;
+    d->relayoutQueued = false;
+    d->placeAllWidgets = true;
     d->blockViewport = false;
     d->blockPixmapsRequest = false;
     d->messageWindow = new PageViewMessage(this);
@@ -976,11 +1033,18 @@ void PageView::createAnnotationsVideoWidgets(PageViewItem *item, const QLinkedLi
             }
         }
     }
+
+    // get the new widgets in place on the next viewport change
+    if ( !item->videoWidgets().isEmpty() && !d->itemsWithPlacedWidgets.contains( item ) )
+        d->itemsWithPlacedWidgets.append( item );
 }
 
 //BEGIN DocumentObserver inherited methods
 void PageView::notifySetup( const QVector< Okular::Page * > & pageSet, int setupFlags )
 {
+    // the pages the overlays were cached for may be gone
+    PagePainter::clearOverlays();
+
     bool documentChanged = setupFlags & Okular::DocumentObserver::DocumentChanged;
     const bool allownotes = d->document->isAllowed( Okular::AllowNotes );
     const bool allowfillforms = d->document->isAllowed( Okular::AllowFillForms );
@@ -1078,6 +1142,10 @@ void PageView::notifySetup( const QVector< Okular::Page * > & pageSet, int setup
         delete *dIt;
     d->items.clear();
     d->visibleItems.clear();
+    d->layoutIndex.clear();
+    d->layoutIndexBottoms.clear();
+    d->itemsWithPlacedWidgets.clear();
+    d->placeAllWidgets = true;
     d->pagesWithTextSelection.clear();
     toggleFormWidgets( false );
     if ( d->formsWidgetController )
@@ -1120,8 +1188,7 @@ void PageView::notifySetup( const QVector< Okular::Page * > & pageSet, int setup
         // We do a delayed call to slotRelayoutPages but also set the dirtyLayout
         // because we might end up in notifyViewportChanged while slotRelayoutPages
         // has not been done and we don't want that to happen
-        d->dirtyLayout = true;
-        QMetaObject::invokeMethod(this, "slotRelayoutPages", Qt::QueuedConnection);
+        scheduleRelayout();
     }
     else
     {
@@ -1299,14 +1366,7 @@ void PageView::slotRealNotifyViewportChanged( bool smoothMove )
 
     // find PageViewItem matching the viewport description
     const Okular::DocumentViewport & vp = d->document->viewport();
-    PageViewItem * item = nullptr;
-    QVector< PageViewItem * >::const_iterator iIt = d->items.constBegin(), iEnd = d->items.constEnd();
-    for ( ; iIt != iEnd; ++iIt )
-        if ( (*iIt)->pageNumber() == vp.pageNumber )
-        {
-            item = *iIt;
-            break;
-        }
+    PageViewItem * item = vp.pageNumber >= 0 && vp.pageNumber < d->items.count() ? d->items.at( vp.pageNumber ) : nullptr;
     if ( !item )
     {
         qCWarning(OkularUiDebug) << "viewport for page" << vp.pageNumber << "has no matching item!";
@@ -1383,6 +1443,9 @@ void PageView::slotRealNotifyViewportChanged( bool smoothMove )
 
 void PageView::notifyPageChanged( int pageNumber, int changedFlags )
 {
+    if ( changedFlags & ( DocumentObserver::Highlights | DocumentObserver::Annotations ) )
+        PagePainter::invalidateOverlays( d->document->page( pageNumber ) );
+
     // only handle pixmap / highlight changes notifies
     if ( changedFlags & DocumentObserver::Bookmark )
         return;
@@ -1418,15 +1481,14 @@ void PageView::notifyPageChanged( int pageNumber, int changedFlags )
         }
     }
 
-    if ( changedFlags & DocumentObserver::BoundingBox )
+    // the bounding boxes only change the layout when trimming margins; they
+    // come page by page as they are rendered, so relayout once for all of them
+    if ( ( changedFlags & DocumentObserver::BoundingBox ) && Okular::Settings::trimMargins() )
     {
 #ifdef PAGEVIEW_DEBUG
         qCDebug(OkularUiDebug) << "BoundingBox change on page" << pageNumber;
 #endif
-        slotRelayoutPages();
-        slotRequestVisiblePixmaps(); // TODO: slotRelayoutPages() may have done this already!
-        // Repaint the whole widget since layout may have changed
-        viewport()->update();
+        scheduleRelayout();
         return;
     }
 
@@ -3734,20 +3796,16 @@ void PageView::updateItemSize( PageViewItem * item, int colWidth, int rowHeight
 
 PageViewItem * PageView::pickItemOnPoint( int x, int y )
 {
-    PageViewItem * item = nullptr;
-    QLinkedList< PageViewItem * >::const_iterator iIt = d->visibleItems.constBegin(), iEnd = d->visibleItems.constEnd();
-    for ( ; iIt != iEnd; ++iIt )
+    int first, last;
+    d->layoutIndexRange( y, y, &first, &last );
+    for ( int index = first; index < last; ++index )
     {
-        PageViewItem * i = *iIt;
+        PageViewItem * i = d->layoutIndex.at( index );
         const QRect & r = i->croppedGeometry();
-        if ( x < r.right() && x > r.left() && y < r.bottom() )
-        {
-            if ( y > r.top() )
-                item = i;
-            break;
-        }
+        if ( x < r.right() && x > r.left() && y < r.bottom() && y > r.top() )
+            return i;
     }
-    return item;
+    return nullptr;
 }
 
 void PageView::textSelectionClear()
@@ -4609,7 +4667,9 @@ void PageView::slotRelayoutPages()
         delete [] colWidth;
         delete [] rowHeight;
 
-    // 3) reset dirty state
+    // 3) reset dirty state, the widgets of all the items moved
+    d->rebuildLayoutIndex();
+    d->placeAllWidgets = true;
     d->dirtyLayout = false;
 
     // 4) update scrollview's contents size and recenter view
@@ -4650,6 +4710,29 @@ void PageView::slotRelayoutPages()
         viewport()->update();
 }
 
+void PageView::scheduleRelayout()
+{
+    d->dirtyLayout = true;
+    if ( d->relayoutQueued )
+        return;
+
+    d->relayoutQueued = true;
+    QMetaObject::invokeMethod( this, "delayedRelayoutPages", Qt::QueuedConnection );
+}
+
+void PageView::delayedRelayoutPages()
+{
+    d->relayoutQueued = false;
+    // nothing to do if a relayout happened meanwhile
+    if ( !d->dirtyLayout )
+        return;
+
+    slotRelayoutPages();
+    slotRequestVisiblePixmaps();
+    // Repaint the whole widget since layout may have changed
+    viewport()->update();
+}
+
 void PageView::delayedResizeEvent()
 {
     // If we already got here we don't need to execute the timer slot again
@@ -4658,6 +4741,17 @@ void PageView::delayedResizeEvent()
     slotRequestVisiblePixmaps();
 }
 
+// how far ahead of the scroll pages are prefetched, in milliseconds of motion,
+// and at most in viewport heights
+static const int kPrefetchHorizon = 750;
+static const int kMaxPrefetchViewports = 4;
+// a pause in the scroll, in milliseconds, that ends the motion
+static const int kScrollIdleTime = 200;
+// the speed from which nothing is preloaded behind the scroll, in pixels per millisecond
+static const double kFastScrollVelocity = 2.0;
+// prefetched pages are first rendered this many times smaller
+static const int kPrefetchDownscale = 3;
+
 static void slotRequestPreloadPixmap( Okular::DocumentObserver * observer, const PageViewItem * i, const QRect &expandedViewportRect, QLinkedList< Okular::PixmapRequest * > *requestedPixmaps )
 {
     Okular::NormalizedRect preRenderRegion;
@@ -4688,12 +4782,65 @@ static void slotRequestPreloadPixmap( Okular::DocumentObserver * observer, const
     }
 }
 
+static void slotRequestPrefetchPixmap( Okular::DocumentObserver * observer, const PageViewItem * i, QLinkedList< Okular::PixmapRequest * > *requestedPixmaps )
+{
+    // tiled pages are only rendered around the viewport, and any pixmap
+    // of the page is good enough until it gets close to it
+    if ( i->uncroppedWidth() <= 0 || i->page()->hasTilesManager( observer ) || i->page()->hasPixmap( observer ) )
+        return;
+
+    Okular::PixmapRequest::PixmapRequestFeatures requestFeatures = Okular::PixmapRequest::Preload;
+    requestFeatures |= Okular::PixmapRequest::Asynchronous;
+    Okular::PixmapRequest * p = new Okular::PixmapRequest( observer, i->pageNumber(), qMax( 1, i->uncroppedWidth() / kPrefetchDownscale ),
+                                                           qMax( 1, i->uncroppedHeight() / kPrefetchDownscale ), PAGEVIEW_PRELOAD_PRIO, requestFeatures );
+    requestedPixmaps->push_back( p );
+}
+
 void PageView::slotRequestVisiblePixmaps( int newValue )
 {
     // if requests are blocked (because raised by an unwanted event), exit
     if ( d->blockPixmapsRequest || d->viewportMoveActive )
         return;
 
+    // follow the speed of the vertical scroll, to prefetch ahead of it
+    const int scrollY = verticalScrollBar()->value();
+    if ( scrollY != d->lastScrollY )
+    {
+        const int elapsed = d->scrollTime.restart();
+        const int distance = scrollY - d->lastScrollY;
+        d->lastScrollY = scrollY;
+        // a pause ends the motion, and a jump (going to a page, a search
+        // result...) starts none
+        if ( elapsed >= kScrollIdleTime || qAbs( distance ) > viewport()->height() )
+        {
+            d->scrollVelocity = 0.0;
+        }
+        else
+        {
+            // smoothed, as wheel and kinetic scrolling come in uneven steps
+            d->scrollVelocity = ( d->scrollVelocity + (double)distance / qMax( 1, elapsed ) ) / 2;
+        }
+
+        // once the motion stops, ask again for what is around the viewport only
+        if ( d->scrollVelocity != 0.0 )
+        {
+            if ( !d->scrollIdleTimer )
+            {
+                d->scrollIdleTimer = new QTimer( this );
+                d->scrollIdleTimer->setSingleShot( true );
+                connect( d->scrollIdleTimer, &QTimer::timeout, this, [this] {
+                    d->scrollVelocity = 0.0;
+                    slotRequestVisiblePixmaps();
+                } );
+            }
+            d->scrollIdleTimer->start( kScrollIdleTime );
+        }
+    }
+    else if ( d->scrollTime.elapsed() >= kScrollIdleTime )
+    {
+        d->scrollVelocity = 0.0;
+    }
+
     // precalc view limits for intersecting with page coords inside the loop
     const bool isEvent = newValue != -1 && !d->blockViewport;
     const QRect viewportRect( horizontalScrollBar()->value(),
@@ -4711,14 +4858,31 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
     // Margin (in pixels) around the viewport to preload
     const int pixelsToExpand = 512;
 
-    // iterate over all items
-    d->visibleItems.clear();
-    QLinkedList< Okular::PixmapRequest * > requestedPixmaps;
-    QVector< Okular::VisiblePageRect * > visibleRects;
-    QVector< PageViewItem * >::const_iterator iIt = d->items.constBegin(), iEnd = d->items.constEnd();
-    for ( ; iIt != iEnd; ++iIt )
+    // only the items in the band of the viewport can be visible
+    int firstIndexed, lastIndexed;
+    d->layoutIndexRange( viewportRect.top(), viewportRect.bottom(), &firstIndexed, &lastIndexed );
+    QVector< PageViewItem * > bandItems;
+    for ( int index = firstIndexed; index < lastIndexed; ++index )
+        bandItems.append( d->layoutIndex.at( index ) );
+    // in page order, as they are expected in the 'visible list'
+    std::sort( bandItems.begin(), bandItems.end(), []( const PageViewItem * a, const PageViewItem * b ) {
+        return a->pageNumber() < b->pageNumber();
+    } );
+
+    // move the widgets of the items in the band, and of the ones that were
+    // in it the last time so they leave the viewport too; the others are
+    // already out of sight
+    QVector< PageViewItem * > widgetItems;
+    for ( PageViewItem * i : qAsConst( bandItems ) )
+    {
+        if ( !i->formWidgets().isEmpty() || !i->videoWidgets().isEmpty() )
+            widgetItems.append( i );
+    }
+    const QVector< PageViewItem * > itemsToPlace = d->placeAllWidgets ? d->items : d->itemsWithPlacedWidgets + widgetItems;
+    d->itemsWithPlacedWidgets = widgetItems;
+    d->placeAllWidgets = false;
+    for ( PageViewItem * i : itemsToPlace )
     {
-        PageViewItem * i = *iIt;
         foreach( FormWidgetIface *fwi, i->formWidgets() )
         {
             Okular::NormalizedRect r = fwi->rect();
@@ -4738,9 +4902,14 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
                 vw->pageLeft();
             }
         }
+    }
 
-        if ( !i->isVisible() )
-            continue;
+    // iterate over the items in the band
+    d->visibleItems.clear();
+    QLinkedList< Okular::PixmapRequest * > requestedPixmaps;
+    QVector< Okular::VisiblePageRect * > visibleRects;
+    for ( PageViewItem * i : qAsConst( bandItems ) )
+    {
 #ifdef PAGEVIEW_DEBUG
         kWarning() << "checking page" << i->pageNumber();
         kWarning().nospace() << "viewportRect is " << viewportRect << ", page item is " << i->croppedGeometry() << " intersect : " << viewportRect.intersects( i->croppedGeometry() );
@@ -4817,25 +4986,37 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
         // request first the next page and then the previous
 
         int pagesToPreload = viewColumns();
+        const bool greedy = Okular::SettingsCore::memoryLevel() == Okular::SettingsCore::EnumMemoryLevel::Greedy;
 
         // if the greedy option is set, preload all pages
-        if (Okular::SettingsCore::memoryLevel() == Okular::SettingsCore::EnumMemoryLevel::Greedy)
+        if ( greedy )
             pagesToPreload = d->items.count();
 
-        const QRect expandedViewportRect = viewportRect.adjusted( 0, -pixelsToExpand, 0, pixelsToExpand );
+        // while scrolling fast nothing is preloaded behind the viewport; as
+        // these requests replace the pending ones, the preloads of pages
+        // left behind are cancelled
+        const bool preloadTail = greedy || d->scrollVelocity > -kFastScrollVelocity;
+        const bool preloadHead = greedy || d->scrollVelocity < kFastScrollVelocity;
 
+        // how far the scroll is going to get in the next moments
+        const int lookahead = qMin( qRound( qAbs( d->scrollVelocity ) * kPrefetchHorizon ), kMaxPrefetchViewports * viewportRect.height() );
+        const QRect expandedViewportRect = viewportRect.adjusted( 0, preloadHead ? -pixelsToExpand : 0, 0, preloadTail ? pixelsToExpand : 0 )
+                                                       .adjusted( 0, d->scrollVelocity < 0 ? -lookahead : 0, 0, d->scrollVelocity > 0 ? lookahead : 0 );
+
+        const int firstPreloaded = d->visibleItems.first()->pageNumber() - pagesToPreload;
+        const int lastPreloaded = d->visibleItems.last()->pageNumber() + pagesToPreload;
         for( int j = 1; j <= pagesToPreload; j++ )
         {
             // add the page after the 'visible series' in preload
             const int tailRequest = d->visibleItems.last()->pageNumber() + j;
-            if ( tailRequest < (int)d->items.count() )
+            if ( preloadTail && tailRequest < (int)d->items.count() )
             {
                 slotRequestPreloadPixmap( this, d->items[ tailRequest ], expandedViewportRect, &requestedPixmaps );
             }
 
             // add the page before the 'visible series' in preload
             const int headRequest = d->visibleItems.first()->pageNumber() - j;
-            if ( headRequest >= 0 )
+            if ( preloadHead && headRequest >= 0 )
             {
                 slotRequestPreloadPixmap( this, d->items[ headRequest ], expandedViewportRect, &requestedPixmaps );
             }
@@ -4844,6 +5025,24 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
             if ( headRequest < 0 && tailRequest >= (int)d->items.count() )
                 break;
         }
+
+        // prefetch the pages the scroll is heading to, the nearest first, at
+        // a lower resolution; they are refined as they get close
+        if ( lookahead > pixelsToExpand )
+        {
+            const bool down = d->scrollVelocity > 0;
+            int first, last;
+            if ( down )
+                d->layoutIndexRange( viewportRect.bottom() + 1, viewportRect.bottom() + lookahead, &first, &last );
+            else
+                d->layoutIndexRange( viewportRect.top() - lookahead, viewportRect.top() - 1, &first, &last );
+            for ( int j = 0; j < last - first; ++j )
+            {
+                const PageViewItem * item = d->layoutIndex.at( down ? first + j : last - 1 - j );
+                if ( item->pageNumber() < firstPreloaded || item->pageNumber() > lastPreloaded )
+                    slotRequestPrefetchPixmap( this, item, &requestedPixmaps );
+            }
+        }
     }
 
     // send requests to the document
@@ -159,6 +159,8 @@ Q_OBJECT
         void drawDocumentOnPainter( const QRect & pageViewRect, QPainter * p );
         // update item width and height using current zoom parameters
         void updateItemSize( PageViewItem * item, int columnWidth, int rowHeight );
+        // relayout once back in the event loop, however many times it is asked
+        void scheduleRelayout();
         // return the widget placed on a certain point or 0 if clicking on empty space
         PageViewItem * pickItemOnPoint( int x, int y );
         // start / modify / clear selection rectangle
@@ -210,10 +212,12 @@ Q_OBJECT
     private Q_SLOTS:
         // used to decouple the notifyViewportChanged calle
         void slotRealNotifyViewportChanged(bool smoothMove);
-        // activated either directly or via queued connection on notifySetup
+        // activated directly or through scheduleRelayout
         void slotRelayoutPages();
         // activated by the resize event delay timer
         void delayedResizeEvent();
+        // activated via queued connection by scheduleRelayout
+        void delayedRelayoutPages();
         // activated either directly or via the contentsMoving(int,int) signal
         void slotRequestVisiblePixmaps( int newValue = -1 );
         // activated by the viewport move timer
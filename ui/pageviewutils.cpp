@@ -48,7 +48,7 @@
 
 PageViewItem::PageViewItem( const Okular::Page * page )
     : m_page( page ), m_zoomFactor( 1.0 ), m_visible( true ),
-    m_formsVisible( false ), m_crop( 0., 0., 1., 1. )
+    m_formsVisible( false ), m_geometryDirty( true ), m_crop( 0., 0., 1., 1. )
 {
 }
 
@@ -135,6 +135,11 @@ QHash< Okular::Movie *, VideoWidget* >& PageViewItem::videoWidgets()
 
 void PageViewItem::setWHZC( int w, int h, double z, const Okular:: NormalizedRect & c )
 {
+    // relayouts mostly give most of the items their same size again
+    if ( !m_geometryDirty && w == m_croppedGeometry.width() && h == m_croppedGeometry.height() && z == m_zoomFactor && c == m_crop )
+        return;
+    m_geometryDirty = true;
+
     m_croppedGeometry.setWidth( w );
     m_croppedGeometry.setHeight( h );
     m_zoomFactor = z;
@@ -160,6 +165,10 @@ void PageViewItem::setWHZC( int w, int h, double z, const Okular:: NormalizedRec
 void PageViewItem::moveTo( int x, int y )
 // Assumes setWHZC() has already been called
 {
+    if ( !m_geometryDirty && x == m_croppedGeometry.left() && y == m_croppedGeometry.top() )
+        return;
+    m_geometryDirty = false;
+
     m_croppedGeometry.moveLeft( x );
     m_croppedGeometry.moveTop( y );
     m_uncroppedGeometry.moveLeft( qRound( x - m_crop.left * m_uncroppedGeometry.width() ) );
@@ -191,6 +200,7 @@ void PageViewItem::invalidate()
 {
     m_croppedGeometry.setRect( 0, 0, 0, 0 );
     m_uncroppedGeometry.setRect( 0, 0, 0, 0 );
+    m_geometryDirty = true;
 }
 
 bool PageViewItem::setFormWidgetsVisible( bool visible )
@@ -87,6 +87,8 @@ class PageViewItem
         double m_zoomFactor;
         bool m_visible;
         bool m_formsVisible;
+        // the size changed since the last moveTo()
+        bool m_geometryDirty;
         QRect m_croppedGeometry;
         QRect m_uncroppedGeometry;
         Okular::NormalizedRect m_crop;
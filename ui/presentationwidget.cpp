@@ -144,7 +144,7 @@ PresentationWidget::PresentationWidget( QWidget * parent, Okular::Document * doc
     m_pressedLink( nullptr ), m_handCursor( false ), m_drawingEngine( nullptr ),
     m_screenInhibitCookie(0), m_sleepInhibitCookie(0),
     m_parentWidget( parent ),
-    m_document( doc ), m_frameIndex( -1 ), m_topBar( nullptr ), m_pagesEdit( nullptr ), m_searchBar( nullptr ),
+    m_document( doc ), m_frameIndex( -1 ), m_navigationDirection( 1 ), m_navigationRun( 0 ), m_topBar( nullptr ), m_pagesEdit( nullptr ), m_searchBar( nullptr ),
     m_ac( collection ), m_screenSelect( nullptr ), m_isSetup( false ), m_blockNotifications( false ), m_inBlackScreenMode( false ),
     m_showSummaryView( Okular::Settings::slidesShowSummary() ),
     m_advanceSlides( Okular::SettingsCore::slidesAdvance() ),
@@ -312,9 +312,13 @@ PresentationWidget::~PresentationWidget()
 
 void PresentationWidget::notifySetup( const QVector< Okular::Page * > & pageSet, int setupFlags )
 {
+    // the pages the overlays were cached for may be gone
+    PagePainter::clearOverlays();
+
     // same document, nothing to change - here we assume the document sets up
-    // us with the whole document set as first notifySetup()
-    if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) )
+    // us with the whole document set as first notifySetup(), unless the
+    // generator added or removed pages since
+    if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) && pageSet.count() == m_frames.count() )
         return;
 
     // delete previous frames (if any (shouldn't be))
@@ -394,6 +398,10 @@ void PresentationWidget::notifyViewportChanged( bool /*smoothMove*/ )
 
 void PresentationWidget::notifyPageChanged( int pageNumber, int changedFlags )
 {
+    // the page may be painted right away, before other observers hear of it
+    if ( changedFlags & ( DocumentObserver::Highlights | DocumentObserver::Annotations ) )
+        PagePainter::invalidateOverlays( m_document->page( pageNumber ) );
+
     // if we are blocking the notifications, do nothing
     if ( m_blockNotifications )
         return;
@@ -405,7 +413,7 @@ void PresentationWidget::notifyPageChanged( int pageNumber, int changedFlags )
 
 void PresentationWidget::notifyCurrentPageChanged( int previousPage, int currentPage )
 {
-    if ( previousPage != -1 )
+    if ( previousPage != -1 && previousPage < m_frames.count() )
     {
         // stop video playback
         Q_FOREACH ( VideoWidget *vw, m_frames[ previousPage ]->videoWidgets )
@@ -438,6 +446,18 @@ void PresentationWidget::notifyCurrentPageChanged( int previousPage, int current
 
     if ( currentPage != -1 )
     {
+        // follow how the slides are walked, to preload ahead of it
+        const int step = previousPage != -1 ? currentPage - previousPage : 0;
+        if ( ( step == 1 || step == -1 ) && step == m_navigationDirection )
+        {
+            ++m_navigationRun;
+        }
+        else
+        {
+            m_navigationDirection = step < 0 ? -1 : 1;
+            m_navigationRun = 0;
+        }
+
         m_frameIndex = currentPage;
 
         // check if pixmap exists or else request it
@@ -460,6 +480,8 @@ void PresentationWidget::notifyCurrentPageChanged( int previousPage, int current
         {
             // make the background pixmap
             generatePage();
+            // and keep preloading the next slides
+            requestPixmaps();
         }
 
         // perform the page opening action, if any
@@ -1408,29 +1430,41 @@ void PresentationWidget::requestPixmaps()
     int pixW = frame->geometry.width();
     int pixH = frame->geometry.height();
 
-    // operation will take long: set busy cursor
-    QApplication::setOverrideCursor( QCursor( Qt::BusyCursor ) );
-    // request the pixmap
     QLinkedList< Okular::PixmapRequest * > requests;
-    requests.push_back( new Okular::PixmapRequest( this, m_frameIndex, pixW, pixH, PRESENTATION_PRIO, Okular::PixmapRequest::NoFeature ) );
-    // restore cursor
-    QApplication::restoreOverrideCursor();
+    // request the pixmap, unless only the preloading is needed
+    if ( !frame->page->hasPixmap( this, ceil(pixW * qApp->devicePixelRatio()), ceil(pixH * qApp->devicePixelRatio()) ) )
+    {
+        // operation will take long: set busy cursor
+        QApplication::setOverrideCursor( QCursor( Qt::BusyCursor ) );
+        requests.push_back( new Okular::PixmapRequest( this, m_frameIndex, pixW, pixH, PRESENTATION_PRIO, Okular::PixmapRequest::NoFeature ) );
+        // restore cursor
+        QApplication::restoreOverrideCursor();
+    }
     // ask for next and previous page if not in low memory usage setting
     if ( Okular::SettingsCore::memoryLevel() != Okular::SettingsCore::EnumMemoryLevel::Low )
     {
-        int pagesToPreload = 1;
+        // preload further in the direction the slides are being walked, and
+        // stop preloading behind once that goes on; the requests replace
+        // the pending ones, so the preloads that are not wanted any more
+        // are cancelled
+        const bool backwards = m_navigationDirection < 0;
+        int pagesAhead = 1 + qMin( m_navigationRun, 2 );
+        int pagesBehind = m_navigationRun >= 2 ? 0 : 1;
 
         // If greedy, preload everything
         if (Okular::SettingsCore::memoryLevel() == Okular::SettingsCore::EnumMemoryLevel::Greedy)
-            pagesToPreload = (int)m_document->pages();
+            pagesAhead = pagesBehind = (int)m_document->pages();
+
+        const int tailPages = backwards ? pagesBehind : pagesAhead;
+        const int headPages = backwards ? pagesAhead : pagesBehind;
 
         Okular::PixmapRequest::PixmapRequestFeatures requestFeatures = Okular::PixmapRequest::Preload;
         requestFeatures |= Okular::PixmapRequest::Asynchronous;
 
-        for( int j = 1; j <= pagesToPreload; j++ )
+        for( int j = 1; j <= qMax( tailPages, headPages ); j++ )
         {
             int tailRequest = m_frameIndex + j;
-            if ( tailRequest < (int)m_document->pages() )
+            if ( j <= tailPages && tailRequest < (int)m_document->pages() )
             {
                 PresentationFrame *nextFrame = m_frames[ tailRequest ];
                 pixW = nextFrame->geometry.width();
@@ -1440,7 +1474,7 @@ void PresentationWidget::requestPixmaps()
             }
 
             int headRequest = m_frameIndex - j;
-            if ( headRequest >= 0 )
+            if ( j <= headPages && headRequest >= 0 )
             {
                 PresentationFrame *prevFrame = m_frames[ headRequest ];
                 pixW = prevFrame->geometry.width();
@@ -1454,7 +1488,8 @@ void PresentationWidget::requestPixmaps()
                 break;
         }
     }
-    m_document->requestPixmaps( requests );
+    if ( !requests.isEmpty() )
+        m_document->requestPixmaps( requests );
 }
 
 
@@ -134,6 +134,10 @@ class PresentationWidget : public QWidget, public Okular::DocumentObserver
         Okular::Document * m_document;
         QVector< PresentationFrame * > m_frames;
         int m_frameIndex;
+        // direction of the last page change, and how many single steps
+        // were made in it in a row
+        int m_navigationDirection;
+        int m_navigationRun;
         QStringList m_metaStrings;
         QToolBar * m_topBar;
         QLineEdit *m_pagesEdit;
@@ -12,13 +12,20 @@
 // qt/kde includes
 #include <QAction>
 #include <QApplication>
+#include <QBuffer>
+#include <QCache>
 #include <QDesktopWidget>
+#include <QHash>
 #include <QIcon>
+#include <QImage>
+#include <QMutex>
 #include <QPainter>
 #include <QResizeEvent>
 #include <QScrollBar>
+#include <QSet>
 #include <QSizePolicy>
 #include <QStyle>
+#include <QThreadPool>
 #include <QTimer>
 
 #include <KLocalizedString>
@@ -33,10 +40,93 @@
 #include "core/generator.h"
 #include "core/page.h"
 #include "settings.h"
+#include "settings_core.h"
 #include "priorities.h"
 
 class ThumbnailWidget;
 
+// The thumbnails of the pages, kept compressed so that they are still there
+// once the memory of their pixmaps was taken back for the other views.
+class ThumbnailCache
+{
+    public:
+        explicit ThumbnailCache( QObject *receiver );
+
+        // the thumbnail is compressed in a worker thread, it is kept as it is
+        // until then
+        void insert( int page, const QPixmap &pixmap );
+        // keeps the thumbnails compressed since the last call, called back
+        // through slotThumbnailsEncoded() of the receiver
+        void takeEncoded();
+        void remove( int page );
+        void clear();
+        // whether there is a thumbnail of the page with the given size
+        bool contains( int page, const QSize &size ) const;
+        // the thumbnail of the page, or a null pixmap
+        QPixmap pixmap( int page ) const;
+        // whether adding more thumbnails would push others out
+        bool isFull() const;
+
+    private:
+        friend class ThumbnailEncodeJob;
+
+        struct Entry
+        {
+            QByteArray data;
+            QSize size;
+        };
+
+        struct Encoded
+        {
+            int page;
+            quint64 serial;
+            Entry entry;
+        };
+
+        QObject *m_receiver;
+        // costs in kB
+        QCache< int, Entry > m_entries;
+        mutable QCache< int, QPixmap > m_decoded;
+        // the thumbnails being compressed, by page, and the serial of their job
+        QHash< int, QPair< quint64, QPixmap > > m_encoding;
+        quint64 m_serial;
+        // the results of the jobs, filled by the worker thread
+        QMutex m_encodedMutex;
+        QVector< Encoded > m_encoded;
+        // last, so that it waits for the jobs before the rest goes away
+        QThreadPool m_encoder;
+};
+
+class ThumbnailEncodeJob : public QRunnable
+{
+    public:
+        ThumbnailEncodeJob( ThumbnailCache *cache, int page, quint64 serial, const QImage &image )
+            : m_cache( cache ), m_page( page ), m_serial( serial ), m_image( image )
+        {
+        }
+
+        void run() override
+        {
+            ThumbnailCache::Encoded encoded{ m_page, m_serial, { QByteArray(), m_image.size() } };
+            QBuffer buffer( &encoded.entry.data );
+            buffer.open( QIODevice::WriteOnly );
+            if ( !m_image.save( &buffer, "JPG", 85 ) && !m_image.save( &buffer, "PNG" ) )
+                encoded.entry.data.clear();
+
+            QMutexLocker locker( &m_cache->m_encodedMutex );
+            m_cache->m_encoded.append( encoded );
+            // only one call back for the results piling up in the meantime
+            if ( m_cache->m_encoded.count() == 1 )
+                QMetaObject::invokeMethod( m_cache->m_receiver, "slotThumbnailsEncoded", Qt::QueuedConnection );
+        }
+
+    private:
+        ThumbnailCache *m_cache;
+        const int m_page;
+        const quint64 m_serial;
+        const QImage m_image;
+};
+
 class ThumbnailListPrivate : public QWidget
 {
     public:
@@ -56,7 +146,20 @@ class ThumbnailListPrivate : public QWidget
         Okular::Document *m_document;
         ThumbnailWidget *m_selected;
         QTimer *m_delayTimer;
+        QTimer *m_refilterTimer;
         QPixmap *m_bookmarkOverlay;
+        // the pages of the last setup, and whether only the ones with search
+        // results are shown
+        QVector<Okular::Page *> m_pages;
+        bool m_showsSearchResults;
+        ThumbnailCache m_cache;
+        QTimer *m_fillTimer;
+        // the pages requested to fill the cache, and the ones whose requests
+        // were dropped and are not asked again until the next setup
+        QSet<int> m_fillPending;
+        QSet<int> m_fillSkipped;
+        // the filled pages whose pixmaps are not needed once in the cache
+        QSet<int> m_fillDone;
         QVector<ThumbnailWidget *> m_thumbnails;
         QList<ThumbnailWidget *> m_visibleThumbnails;
         int m_vectorIndex;
@@ -74,12 +177,22 @@ class ThumbnailListPrivate : public QWidget
 
         ThumbnailWidget* itemFor( const QPoint & p ) const;
         void delayedRequestVisiblePixmaps( int delayMs = 0 );
+        // the pages with search results changed, show them when possible
+        void delayedRefilter();
+        // fill the thumbnail cache for the other pages in the background
+        void delayedFill( int delayMs );
 
         // SLOTS:
         // make requests for generating pixmaps for visible thumbnails
         void slotRequestVisiblePixmaps( int newContentsY = -1 );
         // delay timeout: resize overlays and requests pixmaps
         void slotDelayTimeout();
+        // set up the thumbnails again for the pages with search results
+        void slotRefilter();
+        // request the next thumbnails that are not in the cache
+        void slotFill();
+        // keep the thumbnails compressed by the cache's worker thread
+        void slotThumbnailsEncoded();
         ThumbnailWidget* getPageByNumber( int page ) const;
         int getNewPageOffset( int n, ThumbnailListPrivate::ChangePageDirection dir ) const;
         ThumbnailWidget *getThumbnailbyOffset( int current, int offset ) const;
@@ -142,9 +255,111 @@ class ThumbnailWidget
 };
 
 
+static int thumbnailCacheCost()
+{
+    switch ( Okular::SettingsCore::memoryLevel() )
+    {
+        case Okular::SettingsCore::EnumMemoryLevel::Low:
+            return 4 * 1024;
+        case Okular::SettingsCore::EnumMemoryLevel::Normal:
+            return 16 * 1024;
+        default:
+            return 64 * 1024;
+    }
+}
+
+ThumbnailCache::ThumbnailCache( QObject *receiver )
+    : m_receiver( receiver ), m_entries( thumbnailCacheCost() ), m_decoded( 4 * 1024 ), m_serial( 0 )
+{
+    // one at a time, the visible thumbnails are not waiting for these
+    m_encoder.setMaxThreadCount( 1 );
+}
+
+void ThumbnailCache::insert( int page, const QPixmap &pixmap )
+{
+    m_entries.remove( page );
+    m_decoded.remove( page );
+
+    const quint64 serial = ++m_serial;
+    m_encoding.insert( page, qMakePair( serial, pixmap ) );
+    // QPixmap is not to be used outside of the GUI thread
+    m_encoder.start( new ThumbnailEncodeJob( this, page, serial, pixmap.toImage() ) );
+}
+
+void ThumbnailCache::takeEncoded()
+{
+    QVector< Encoded > encoded;
+    {
+        QMutexLocker locker( &m_encodedMutex );
+        encoded.swap( m_encoded );
+    }
+
+    m_entries.setMaxCost( thumbnailCacheCost() );
+    for ( const Encoded &e : qAsConst( encoded ) )
+    {
+        // a newer thumbnail of the page replaced it, or it was removed
+        QHash< int, QPair< quint64, QPixmap > >::iterator it = m_encoding.find( e.page );
+        if ( it == m_encoding.end() || it->first != e.serial )
+            continue;
+
+        m_encoding.erase( it );
+        if ( !e.entry.data.isEmpty() )
+            m_entries.insert( e.page, new Entry( e.entry ), e.entry.data.size() / 1024 + 1 );
+    }
+}
+
+void ThumbnailCache::remove( int page )
+{
+    m_entries.remove( page );
+    m_decoded.remove( page );
+    m_encoding.remove( page );
+}
+
+void ThumbnailCache::clear()
+{
+    m_entries.clear();
+    m_decoded.clear();
+    m_encoding.clear();
+}
+
+bool ThumbnailCache::contains( int page, const QSize &size ) const
+{
+    QHash< int, QPair< quint64, QPixmap > >::const_iterator it = m_encoding.constFind( page );
+    if ( it != m_encoding.constEnd() )
+        return it->second.size() == size;
+
+    const Entry *entry = m_entries.object( page );
+    return entry && entry->size == size;
+}
+
+QPixmap ThumbnailCache::pixmap( int page ) const
+{
+    QHash< int, QPair< quint64, QPixmap > >::const_iterator it = m_encoding.constFind( page );
+    if ( it != m_encoding.constEnd() )
+        return it->second;
+
+    if ( const QPixmap *decoded = m_decoded.object( page ) )
+        return *decoded;
+
+    const Entry *entry = m_entries.object( page );
+    QPixmap pixmap;
+    if ( !entry || !pixmap.loadFromData( entry->data ) )
+        return QPixmap();
+
+    m_decoded.insert( page, new QPixmap( pixmap ), pixmap.width() * pixmap.height() * 4 / 1024 + 1 );
+    return pixmap;
+}
+
+bool ThumbnailCache::isFull() const
+{
+    return m_entries.totalCost() >= m_entries.maxCost() * 9 / 10;
+}
+
+
 ThumbnailListPrivate::ThumbnailListPrivate( ThumbnailList *qq, Okular::Document *document )
     : QWidget(), q( qq ), m_document( document ), m_selected( nullptr ),
-    m_delayTimer( nullptr ), m_bookmarkOverlay( nullptr ), m_vectorIndex( 0 )
+    m_delayTimer( nullptr ), m_refilterTimer( nullptr ), m_bookmarkOverlay( nullptr ),
+    m_showsSearchResults( false ), m_cache( qq ), m_fillTimer( nullptr ), m_vectorIndex( 0 )
 {
     setMouseTracking( true );
     m_mouseGrabItem = nullptr;
@@ -246,6 +461,15 @@ void ThumbnailList::notifySetup( const QVector< Okular::Page * > & pages, int se
     d->m_visibleThumbnails.clear();
     d->m_selected = nullptr;
     d->m_mouseGrabItem = nullptr;
+    d->m_pages = pages;
+    d->m_showsSearchResults = false;
+    if ( d->m_refilterTimer )
+        d->m_refilterTimer->stop();
+    if ( setupFlags & Okular::DocumentObserver::DocumentChanged )
+        d->m_cache.clear();
+    d->m_fillPending.clear();
+    d->m_fillSkipped.clear();
+    d->m_fillDone.clear();
 
     if ( pages.count() < 1 )
     {
@@ -263,6 +487,7 @@ void ThumbnailList::notifySetup( const QVector< Okular::Page * > & pages, int se
         //if ( (*pIt)->attributes() & flags )
         if ( (*pIt)->hasHighlights( SW_SEARCH_ID ) )
             skipCheck = false;
+    d->m_showsSearchResults = !skipCheck;
 
     // generate Thumbnails for the given set of pages
     const int width = viewport()->width();
@@ -344,6 +569,39 @@ void ThumbnailList::notifyPageChanged( int pageNumber, int changedFlags )
     if ( !( changedFlags & interestingFlags ) )
         return;
 
+    if ( changedFlags & ( DocumentObserver::Highlights | DocumentObserver::Annotations ) )
+        PagePainter::invalidateOverlays( d->m_document->page( pageNumber ) );
+
+    // keep the new thumbnail, or forget the one whose contents may be outdated
+    if ( changedFlags & DocumentObserver::Pixmap )
+    {
+        const ThumbnailWidget *t = d->getPageByNumber( pageNumber );
+        const Okular::Page *page = d->m_document->page( pageNumber );
+        if ( t && page->hasPixmap( this, t->pixmapWidth(), t->pixmapHeight() ) )
+            d->m_cache.insert( pageNumber, *page->_o_nearestPixmap( this, t->pixmapWidth(), t->pixmapHeight() ) );
+
+        if ( d->m_fillPending.remove( pageNumber ) )
+        {
+            d->m_fillDone.insert( pageNumber );
+            if ( d->m_fillPending.isEmpty() )
+                d->delayedFill( 20 );
+        }
+    }
+    else if ( changedFlags & DocumentObserver::Annotations )
+    {
+        d->m_cache.remove( pageNumber );
+    }
+
+    // search results come page by page, the thumbnails of the pages with
+    // results replace the others once there are some
+    if ( changedFlags & DocumentObserver::Highlights )
+    {
+        const bool hasResults = d->m_document->page( pageNumber )->hasHighlights( SW_SEARCH_ID );
+        const bool shown = !d->m_showsSearchResults || d->getPageByNumber( pageNumber );
+        if ( d->m_showsSearchResults ? hasResults != shown : hasResults )
+            d->delayedRefilter();
+    }
+
     // iterate over visible items: if page(pageNumber) is one of them, repaint it
     QList<ThumbnailWidget *>::const_iterator vIt = d->m_visibleThumbnails.constBegin(), vEnd = d->m_visibleThumbnails.constEnd();
     for ( ; vIt != vEnd; ++vIt )
@@ -358,7 +616,10 @@ void ThumbnailList::notifyContentsCleared( int changedFlags )
 {
     // if pixmaps were cleared, re-ask them
     if ( changedFlags & DocumentObserver::Pixmap )
+    {
+        d->m_cache.clear();
         d->slotRequestVisiblePixmaps();
+    }
 }
 
 void ThumbnailList::notifyVisibleRectsChanged()
@@ -621,17 +882,28 @@ void ThumbnailListPrivate::slotRequestVisiblePixmaps( int /*newContentsY*/ )
           continue;
         // add ThumbnailWidget to visible list
         m_visibleThumbnails.push_back( t );
-        // if pixmap not present add it to requests
-        if ( !t->page()->hasPixmap( q, t->pixmapWidth(), t->pixmapHeight() ) )
+        // if pixmap not present add it to requests, unless the cached thumbnail
+        // has the same size already
+        if ( !t->page()->hasPixmap( q, t->pixmapWidth(), t->pixmapHeight() ) &&
+             !m_cache.contains( t->pageNumber(), QSize( t->pixmapWidth(), t->pixmapHeight() ) ) )
         {
-            Okular::PixmapRequest * p = new Okular::PixmapRequest( q, t->pageNumber(), t->pixmapWidth(), t->pixmapHeight(), THUMBNAILS_PRIO, Okular::PixmapRequest::Asynchronous );
+            Okular::PixmapRequest * p = new Okular::PixmapRequest( q, t->pageNumber(), t->pixmapWidth(), t->pixmapHeight(), THUMBNAILS_PRIO,
+                                                                   Okular::PixmapRequest::Asynchronous | Okular::PixmapRequest::Thumbnail );
             requestedPixmaps.push_back( p );
         }
     }
 
     // actually request pixmaps
     if ( !requestedPixmaps.isEmpty() )
+    {
+        // this drops the requests made to fill the cache
+        m_fillPending.clear();
         m_document->requestPixmaps( requestedPixmaps );
+    }
+
+    // then the other thumbnails, once the visible ones are there
+    if ( m_fillPending.isEmpty() )
+        delayedFill( requestedPixmaps.isEmpty() ? 100 : 1000 );
 }
 
 void ThumbnailListPrivate::slotDelayTimeout()
@@ -647,6 +919,80 @@ void ThumbnailListPrivate::slotDelayTimeout()
     // request pixmaps
     slotRequestVisiblePixmaps();
 }
+
+void ThumbnailListPrivate::slotRefilter()
+{
+    q->notifySetup( m_pages, 0 );
+}
+
+void ThumbnailListPrivate::slotFill()
+{
+    // pages still pending once the timer fires had their requests dropped
+    m_fillSkipped += m_fillPending;
+    m_fillPending.clear();
+
+    // the filled thumbnails are painted from the cache while they are not
+    // visible, their pixmaps would only take room in the document's pool
+    for ( int pageNumber : qAsConst( m_fillDone ) )
+    {
+        const ThumbnailWidget * t = getPageByNumber( pageNumber );
+        if ( t && q->canUnloadPixmap( pageNumber ) && m_cache.contains( pageNumber, QSize( t->pixmapWidth(), t->pixmapHeight() ) ) )
+            m_document->deletePixmap( q, pageNumber );
+    }
+    m_fillDone.clear();
+
+    // the generator would drop the preload requests
+    if ( q->isHidden() || m_cache.isFull() || !m_document->supportsPreloading() )
+        return;
+
+    // a few at a time, at the lowest priority, the ones closest to the
+    // visible thumbnails first
+    static const int FillBatchSize = 4;
+    QLinkedList< Okular::PixmapRequest * > requestedPixmaps;
+    const int count = m_thumbnails.count();
+    int firstVisible = 0, lastVisible = -1;
+    if ( !m_visibleThumbnails.isEmpty() )
+    {
+        firstVisible = m_thumbnails.indexOf( m_visibleThumbnails.first() );
+        lastVisible = m_thumbnails.indexOf( m_visibleThumbnails.last() );
+    }
+    for ( int distance = 1; requestedPixmaps.count() < FillBatchSize && ( lastVisible + distance < count || firstVisible - distance >= 0 ); ++distance )
+    {
+        const int candidates[] = { lastVisible + distance, firstVisible - distance };
+        for ( int i : candidates )
+        {
+            if ( i < 0 || i >= count || requestedPixmaps.count() >= FillBatchSize )
+                continue;
+
+            ThumbnailWidget * t = m_thumbnails.at( i );
+            const QSize size( t->pixmapWidth(), t->pixmapHeight() );
+            if ( m_cache.contains( t->pageNumber(), size ) || m_fillSkipped.contains( t->pageNumber() ) )
+                continue;
+
+            if ( t->page()->hasPixmap( q, size.width(), size.height() ) )
+            {
+                m_cache.insert( t->pageNumber(), *t->page()->_o_nearestPixmap( q, size.width(), size.height() ) );
+                continue;
+            }
+
+            requestedPixmaps.push_back( new Okular::PixmapRequest( q, t->pageNumber(), size.width(), size.height(), THUMBNAILS_PRELOAD_PRIO,
+                                                                   Okular::PixmapRequest::Asynchronous | Okular::PixmapRequest::Preload |
+                                                                   Okular::PixmapRequest::Thumbnail ) );
+            m_fillPending.insert( t->pageNumber() );
+        }
+    }
+
+    if ( requestedPixmaps.isEmpty() )
+        return;
+
+    m_document->requestPixmaps( requestedPixmaps, Okular::Document::NoOption );
+    // give up on the requests that do not come back
+    delayedFill( 5000 );
+}
+void ThumbnailListPrivate::slotThumbnailsEncoded()
+{
+    m_cache.takeEncoded();
+}
 //END internal SLOTS
 
 void ThumbnailListPrivate::delayedRequestVisiblePixmaps( int delayMs )
@@ -660,6 +1006,30 @@ void ThumbnailListPrivate::delayedRequestVisiblePixmaps( int delayMs )
     m_delayTimer->start( delayMs );
 }
 
+void ThumbnailListPrivate::delayedRefilter()
+{
+    if ( !m_refilterTimer )
+    {
+        m_refilterTimer = new QTimer( q );
+        m_refilterTimer->setSingleShot( true );
+        connect( m_refilterTimer, SIGNAL(timeout()), q, SLOT(slotRefilter()) );
+    }
+    // not restarted, so that the results of a long search show up on the way
+    if ( !m_refilterTimer->isActive() )
+        m_refilterTimer->start( 300 );
+}
+
+void ThumbnailListPrivate::delayedFill( int delayMs )
+{
+    if ( !m_fillTimer )
+    {
+        m_fillTimer = new QTimer( q );
+        m_fillTimer->setSingleShot( true );
+        connect( m_fillTimer, SIGNAL(timeout()), q, SLOT(slotFill()) );
+    }
+    m_fillTimer->start( delayMs );
+}
+
 
 /** ThumbnailWidget implementation **/
 
@@ -952,7 +1322,9 @@ void ThumbnailWidget::paint( QPainter &p, const QRect &_clipRect )
         {
             int flags = PagePainter::Accessibility | PagePainter::Highlights |
                         PagePainter::Annotations;
-            PagePainter::paintPageOnPainter( &p, m_page, m_parent->q, flags, m_pixmapWidth, m_pixmapHeight, clipRect );
+            // the cached thumbnail stands in for an evicted pixmap
+            const QPixmap cached = m_page->hasPixmap( m_parent->q ) ? QPixmap() : m_parent->m_cache.pixmap( pageNumber() );
+            PagePainter::paintPageOnPainter( &p, m_page, m_parent->q, flags, m_pixmapWidth, m_pixmapHeight, clipRect, &cached );
         }
 
         if ( !m_visibleRect.isNull() )
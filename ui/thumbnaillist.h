@@ -70,6 +70,9 @@ Q_OBJECT
 
         Q_PRIVATE_SLOT( d, void slotRequestVisiblePixmaps( int newContentsY = -1 ) )
         Q_PRIVATE_SLOT( d, void slotDelayTimeout() )
+        Q_PRIVATE_SLOT( d, void slotRefilter() )
+        Q_PRIVATE_SLOT( d, void slotFill() )
+        Q_PRIVATE_SLOT( d, void slotThumbnailsEncoded() )
 };
 
 /**
@@ -61,7 +61,12 @@ TOC::~TOC()
 void TOC::notifySetup( const QVector< Okular::Page * > & /*pages*/, int setupFlags )
 {
     if ( !( setupFlags & Okular::DocumentObserver::DocumentChanged ) )
-        return;
+    {
+        // a generator laying out the document while it is shown may only
+        // have the synopsis once it is done, with a new layout of the pages
+        if ( !( setupFlags & Okular::DocumentObserver::NewLayoutForPages ) || !m_model->isEmpty() || !m_document->documentSynopsis() )
+            return;
+    }
 
     // clear contents
     m_model->clear();